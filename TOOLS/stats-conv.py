@@ -3,6 +3,7 @@ from pyqtgraph.Qt import QtGui, QtCore
 import pyqtgraph as pg
 import sys
 import re
+import struct
 
 filename = sys.argv[1]
 
@@ -23,6 +24,9 @@ e.g.:
 
 <text> is what MP_STATS(log, "...") writes. The rest is added by msg.c.
 
+mpv writes a binary file (see common/stats_file.h), which is converted to the
+line form above by read_lines(). Text files in the old format are still read.
+
 Currently, the following event types are supported:
 
     'signal' <name>             singular event
@@ -72,7 +76,45 @@ def mkColor(t):
 
 SCALE = 1e6 # microseconds to seconds
 
-for line in [line.split("#")[0].strip() for line in open(filename, "r")]:
+def read_lines(filename):
+    with open(filename, "rb") as f:
+        data = f.read()
+    if not data.startswith(b"mpvstats"):
+        return data.decode("utf-8", "replace").splitlines()
+    header = struct.Struct("=8sII")
+    record = struct.Struct("=qIId")
+    record_size = header.unpack_from(data, 0)[2]
+    pos = header.size
+    names = {}
+    records = []
+    while pos + record_size <= len(data):
+        ts, id, tid, value = record.unpack_from(data, pos)
+        pos += record_size
+        rtype, index = id >> 28, id & ((1 << 28) - 1)
+        if rtype in (5, 6): # name, text
+            size = int(value)
+            text = data[pos:pos + size].decode("utf-8", "replace")
+            pos += (size + 7) & ~7
+            if rtype == 5:
+                names[index] = text
+                continue
+            records.append((ts, text))
+        else:
+            records.append((ts, (rtype, index, value)))
+    lines = []
+    for ts, ev in sorted(records, key=lambda r: r[0]):
+        if not isinstance(ev, str):
+            rtype, index, value = ev
+            name = names.get(index, "unknown")
+            ev = {1: name, 2: "start " + name, 3: "end " + name,
+                  4: "value %f %s" % (value, name),
+                  7: "signal stats-dropped"}.get(rtype)
+            if ev is None:
+                continue
+        lines.append("%d %s" % (ts, ev))
+    return lines
+
+for line in [line.split("#")[0].strip() for line in read_lines(filename)]:
     line = line.strip()
     if not line:
         continue
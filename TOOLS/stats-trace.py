@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""
+Convert a file written by mpv --dump-stats=filename to the Chrome trace event
+JSON format, which can be loaded into chrome://tracing or Perfetto.
+
+    stats-trace.py <stats-file> [<output.json>]
+
+Without output file, the JSON is written to stdout.
+
+The binary format is described in common/stats_file.h. MP_STATS() events are
+mapped as follows:
+
+    start/end <name>                begin/end of a duration event
+    <name>, signal <name>           instant event
+    value <float> <name>            counter
+    event-timed <ts> <name>         instant event at the given timestamp
+    value-timed <ts> <float> <name> counter at the given timestamp
+    range-timed <ts1> <ts2> <name>  complete event with explicit times
+
+Each mpv thread becomes a separate track.
+"""
+
+import json
+import struct
+import sys
+
+HEADER = struct.Struct("=8sII")
+RECORD = struct.Struct("=qIId")
+
+SIGNAL, START, END, VALUE, NAME, TEXT, DROPPED = range(1, 8)
+
+def read_stats_file(filename):
+    """Return a list of (ts, tid, type, name_or_text, value) tuples."""
+    with open(filename, "rb") as f:
+        data = f.read()
+    magic, version, record_size = HEADER.unpack_from(data, 0)
+    if magic != b"mpvstats" or version != 1:
+        sys.exit("%s: not a binary mpv stats file" % filename)
+    pos = HEADER.size
+    names = {}
+    records = []
+    while pos + record_size <= len(data):
+        ts, id, tid, value = RECORD.unpack_from(data, pos)
+        pos += record_size
+        rtype, index = id >> 28, id & ((1 << 28) - 1)
+        if rtype in (NAME, TEXT):
+            size = int(value)
+            text = data[pos:pos + size].decode("utf-8", "replace")
+            pos += (size + 7) & ~7
+            if rtype == NAME:
+                names[index] = text
+            else:
+                records.append((ts, tid, rtype, text, 0))
+        else:
+            records.append((ts, tid, rtype, index, value))
+    # Names can be defined after their first use, so resolve them at the end.
+    res = []
+    for ts, tid, rtype, name, value in records:
+        if rtype in (SIGNAL, START, END, VALUE):
+            name = names.get(name, "unknown-%d" % name)
+        res.append((ts, tid, rtype, name, value))
+    res.sort(key=lambda r: r[0])
+    return res
+
+def convert_text(ts, tid, text):
+    ev = {"pid": 0, "tid": tid, "ts": ts}
+    words = text.split(" ")
+    try:
+        if words[0] == "event-timed" and len(words) >= 3:
+            ev.update(ph="i", s="t", ts=int(words[1]), name=" ".join(words[2:]))
+        elif words[0] == "value-timed" and len(words) >= 4:
+            name = " ".join(words[3:])
+            ev.update(ph="C", ts=int(words[1]), name=name,
+                      args={name: float(words[2])})
+        elif words[0] == "range-timed" and len(words) >= 4:
+            ts1, ts2 = int(words[1]), int(words[2])
+            ev.update(ph="X", ts=ts1, dur=ts2 - ts1, name=" ".join(words[3:]))
+        else:
+            ev.update(ph="i", s="t", name=text)
+    except ValueError:
+        ev.update(ph="i", s="t", name=text)
+    return ev
+
+def convert(records):
+    events = []
+    for ts, tid, rtype, name, value in records:
+        ev = {"pid": 0, "tid": tid, "ts": ts, "name": name}
+        if rtype == START:
+            ev["ph"] = "B"
+        elif rtype == END:
+            ev["ph"] = "E"
+        elif rtype == SIGNAL:
+            ev.update(ph="i", s="t")
+        elif rtype == VALUE:
+            ev.update(ph="C", args={name: value})
+        elif rtype == TEXT:
+            ev = convert_text(ts, tid, name)
+        elif rtype == DROPPED:
+            ev.update(ph="i", s="t", name="stats-dropped",
+                      args={"count": int(value)})
+        else:
+            continue
+        events.append(ev)
+    return {"traceEvents": events, "displayTimeUnit": "ms"}
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        sys.exit(__doc__)
+    trace = convert(read_stats_file(sys.argv[1]))
+    if len(sys.argv) > 2:
+        with open(sys.argv[2], "w") as f:
+            json.dump(trace, f)
+    else:
+        json.dump(trace, sys.stdout)
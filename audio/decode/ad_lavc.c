@@ -20,6 +20,7 @@
 #include <unistd.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <math.h>
 
 #include <libavcodec/avcodec.h>
 #include <libavutil/opt.h>
@@ -50,6 +51,18 @@ struct priv {
     AVRational codec_timebase;
     struct lavc_state state;
 
+    // Decoded frames not returned yet, merged into one frame once they reach
+    // batch_duration (--ad-lavc-batch-duration).
+    double batch_duration;
+    struct mp_aframe **batch;
+    int num_batch;
+    int batch_samples;
+    bool batch_eof;             // return EOF after the final batch
+    struct mp_aframe_pool *batch_pool;
+    // Frames returned one by one, because merging them failed.
+    struct mp_aframe **unbatched;
+    int num_unbatched;
+
     struct mp_decoder public;
 };
 
@@ -58,6 +71,7 @@ struct ad_lavc_params {
     float ac3drc;
     int downmix;
     int threads;
+    double batch_duration;
     char **avopts;
 };
 
@@ -66,6 +80,7 @@ const struct m_sub_options ad_lavc_conf = {
         {"ac3drc", OPT_FLOAT(ac3drc), M_RANGE(0, 6)},
         {"downmix", OPT_FLAG(downmix)},
         {"threads", OPT_INT(threads), M_RANGE(0, 16)},
+        {"batch-duration", OPT_DOUBLE(batch_duration), M_RANGE(0, 10)},
         {"o", OPT_KEYVALUELIST(avopts)},
         {0}
     },
@@ -133,14 +148,30 @@ static bool init(struct mp_filter *da, struct mp_codec_params *codec,
     }
 
     ctx->next_pts = MP_NOPTS_VALUE;
+    ctx->batch_duration = opts->batch_duration;
+    ctx->batch_pool = mp_aframe_pool_create(ctx);
 
     return true;
 }
 
+static void clear_batch(struct priv *ctx)
+{
+    for (int n = 0; n < ctx->num_batch; n++)
+        talloc_free(ctx->batch[n]);
+    ctx->num_batch = 0;
+    ctx->batch_samples = 0;
+    ctx->batch_eof = false;
+    for (int n = 0; n < ctx->num_unbatched; n++)
+        talloc_free(ctx->unbatched[n]);
+    ctx->num_unbatched = 0;
+}
+
 static void destroy(struct mp_filter *da)
 {
     struct priv *ctx = da->priv;
 
+    clear_batch(ctx);
+
     avcodec_free_context(&ctx->avctx);
     av_frame_free(&ctx->avframe);
 }
@@ -155,6 +186,7 @@ static void reset(struct mp_filter *da)
     ctx->preroll_done = false;
     ctx->next_pts = MP_NOPTS_VALUE;
     ctx->state = (struct lavc_state){0};
+    clear_batch(ctx);
 }
 
 static int send_packet(struct mp_filter *da, struct demux_packet *mpkt)
@@ -177,7 +209,7 @@ static int send_packet(struct mp_filter *da, struct demux_packet *mpkt)
     return ret;
 }
 
-static int receive_frame(struct mp_filter *da, struct mp_frame *out)
+static int decode_frame(struct mp_filter *da, struct mp_frame *out)
 {
     struct priv *priv = da->priv;
     AVCodecContext *avctx = priv->avctx;
@@ -254,6 +286,129 @@ static int receive_frame(struct mp_filter *da, struct mp_frame *out)
     return ret;
 }
 
+// Whether f can be appended to the current batch without losing information.
+static bool batch_continues(struct priv *priv, struct mp_aframe *f)
+{
+    struct mp_aframe *first = priv->batch[0];
+    struct mp_aframe *last = priv->batch[priv->num_batch - 1];
+    if (!mp_aframe_config_equals(first, f) ||
+        mp_aframe_get_speed(first) != mp_aframe_get_speed(f))
+        return false;
+    double end = mp_aframe_end_pts(last);
+    double pts = mp_aframe_get_pts(f);
+    if (end == MP_NOPTS_VALUE || pts == MP_NOPTS_VALUE)
+        return end == pts;
+    return fabs(pts - end) < 0.001;
+}
+
+// Return the next frame that could not be merged into a batch.
+static struct mp_frame pop_unbatched(struct priv *priv)
+{
+    assert(priv->num_unbatched);
+    struct mp_aframe *res = priv->unbatched[0];
+    MP_TARRAY_REMOVE_AT(priv->unbatched, priv->num_unbatched, 0);
+    return MAKE_FRAME(MP_FRAME_AUDIO, res);
+}
+
+// Merge all frames of the current batch into a single frame.
+static struct mp_frame flush_batch(struct mp_filter *da)
+{
+    struct priv *priv = da->priv;
+
+    assert(priv->num_batch);
+    struct mp_aframe *first = priv->batch[0];
+    struct mp_aframe *res = NULL;
+
+    if (priv->num_batch == 1) {
+        res = first;
+        priv->num_batch = 0;
+    } else {
+        res = mp_aframe_create();
+        mp_aframe_config_copy(res, first);
+        if (mp_aframe_pool_allocate(priv->batch_pool, res,
+                                    priv->batch_samples) < 0)
+        {
+            // Return the frames unmerged instead of dropping them.
+            MP_WARN(da, "Could not allocate audio batch.\n");
+            TA_FREEP(&res);
+            for (int n = 0; n < priv->num_batch; n++) {
+                MP_TARRAY_APPEND(priv, priv->unbatched, priv->num_unbatched,
+                                 priv->batch[n]);
+            }
+            priv->num_batch = 0;
+        } else {
+            mp_aframe_copy_attributes(res, first);
+            int pos = 0;
+            for (int n = 0; n < priv->num_batch; n++) {
+                struct mp_aframe *f = priv->batch[n];
+                int size = mp_aframe_get_size(f);
+                mp_aframe_copy_samples(res, pos, f, 0, size);
+                pos += size;
+            }
+        }
+    }
+
+    for (int n = 0; n < priv->num_batch; n++)
+        talloc_free(priv->batch[n]);
+    priv->num_batch = 0;
+    priv->batch_samples = 0;
+
+    return res ? MAKE_FRAME(MP_FRAME_AUDIO, res) : pop_unbatched(priv);
+}
+
+// Like decode_frame(), but collect decoded frames until they reach
+// batch_duration. Returning AVERROR(EAGAIN) makes lavc_process() feed the next
+// packet, without waking up anything downstream.
+static int receive_frame(struct mp_filter *da, struct mp_frame *out)
+{
+    struct priv *priv = da->priv;
+
+    if (priv->batch_duration <= 0)
+        return decode_frame(da, out);
+
+    if (priv->num_unbatched) {
+        *out = pop_unbatched(priv);
+        return 0;
+    }
+
+    if (priv->batch_eof) {
+        priv->batch_eof = false;
+        return AVERROR_EOF;
+    }
+
+    while (1) {
+        struct mp_frame frame = {0};
+        int ret = decode_frame(da, &frame);
+
+        if (!frame.type) {
+            if (priv->num_batch) {
+                if (ret == AVERROR_EOF) {
+                    priv->batch_eof = true;
+                } else if (ret != AVERROR(EAGAIN) ||
+                           priv->batch_samples < priv->batch_duration *
+                                mp_aframe_get_rate(priv->batch[0]))
+                {
+                    return ret;
+                }
+                *out = flush_batch(da);
+                return 0;
+            }
+            return ret;
+        }
+
+        struct mp_aframe *af = frame.data;
+        if (priv->num_batch && !batch_continues(priv, af)) {
+            *out = flush_batch(da);
+            MP_TARRAY_APPEND(priv, priv->batch, priv->num_batch, af);
+            priv->batch_samples = mp_aframe_get_size(af);
+            return 0;
+        }
+
+        MP_TARRAY_APPEND(priv, priv->batch, priv->num_batch, af);
+        priv->batch_samples += mp_aframe_get_size(af);
+    }
+}
+
 static void process(struct mp_filter *ad)
 {
     struct priv *priv = ad->priv;
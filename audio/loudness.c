@@ -0,0 +1,242 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "common/common.h"
+#include "mpv_talloc.h"
+
+#include "aframe.h"
+#include "chmap.h"
+#include "format.h"
+#include "loudness.h"
+
+struct biquad {
+    double b0, b1, b2, a1, a2;
+};
+
+struct mp_loudness {
+    int rate;
+    int num_ch;
+    double weight[MP_NUM_CHANNELS];
+
+    // K-weighting: shelving pre-filter followed by the RLB high-pass.
+    struct biquad pre, rlb;
+    double state[MP_NUM_CHANNELS][4];
+
+    // Measurement is done on 400ms blocks with 75% overlap, i.e. each block is
+    // made of the last 4 sub-blocks of 100ms.
+    int sub_len;
+    int sub_pos;
+    double sub_acc;
+    double subs[4];
+    int num_subs;
+
+    double *blocks;             // mean square energy of each block
+    int num_blocks;
+
+    double peak;
+};
+
+// Filter design from the BS.1770 reference coefficients, re-derived for
+// sample rates other than 48 kHz.
+static void init_filters(struct mp_loudness *l)
+{
+    double f0 = 1681.974450955533;
+    double G = 3.999843853973347;
+    double Q = 0.7071752369554196;
+
+    double K = tan(M_PI * f0 / l->rate);
+    double Vh = pow(10.0, G / 20.0);
+    double Vb = pow(Vh, 0.4996667741545416);
+    double a0 = 1.0 + K / Q + K * K;
+
+    l->pre = (struct biquad){
+        .b0 = (Vh + Vb * K / Q + K * K) / a0,
+        .b1 = 2.0 * (K * K - Vh) / a0,
+        .b2 = (Vh - Vb * K / Q + K * K) / a0,
+        .a1 = 2.0 * (K * K - 1.0) / a0,
+        .a2 = (1.0 - K / Q + K * K) / a0,
+    };
+
+    f0 = 38.13547087602444;
+    Q = 0.5003270373238773;
+    K = tan(M_PI * f0 / l->rate);
+    a0 = 1.0 + K / Q + K * K;
+
+    l->rlb = (struct biquad){
+        .b0 = 1.0,
+        .b1 = -2.0,
+        .b2 = 1.0,
+        .a1 = 2.0 * (K * K - 1.0) / a0,
+        .a2 = (1.0 - K / Q + K * K) / a0,
+    };
+}
+
+static double channel_weight(int speaker)
+{
+    switch (speaker) {
+    case MP_SPEAKER_ID_LFE:
+    case MP_SPEAKER_ID_LFE2:
+        return 0.0;
+    case MP_SPEAKER_ID_BL:
+    case MP_SPEAKER_ID_BR:
+    case MP_SPEAKER_ID_SL:
+    case MP_SPEAKER_ID_SR:
+    case MP_SPEAKER_ID_SDL:
+    case MP_SPEAKER_ID_SDR:
+        return 1.41; // +1.5 dB for surround channels
+    }
+    return 1.0;
+}
+
+struct mp_loudness *mp_loudness_create(void *ta_parent, int rate,
+                                       struct mp_chmap *chmap)
+{
+    if (rate < 8000 || !mp_chmap_is_valid(chmap))
+        return NULL;
+
+    struct mp_loudness *l = talloc_zero(ta_parent, struct mp_loudness);
+    l->rate = rate;
+    l->num_ch = chmap->num;
+    for (int n = 0; n < l->num_ch; n++)
+        l->weight[n] = channel_weight(chmap->speaker[n]);
+    l->sub_len = rate / 10;
+    init_filters(l);
+    return l;
+}
+
+// Run both filter stages over samples of a single channel and return the sum
+// of squares of the output.
+static double filter_channel(struct mp_loudness *l, double st[4],
+                             const float *src, int step, int samples)
+{
+    const struct biquad *p = &l->pre, *r = &l->rlb;
+    double z0 = st[0], z1 = st[1], z2 = st[2], z3 = st[3];
+    double sum = 0;
+    for (int n = 0; n < samples; n++) {
+        double x = src[n * (ptrdiff_t)step];
+        double y = p->b0 * x + z0;
+        z0 = p->b1 * x - p->a1 * y + z1;
+        z1 = p->b2 * x - p->a2 * y;
+        double w = r->b0 * y + z2;
+        z2 = r->b1 * y - r->a1 * w + z3;
+        z3 = r->b2 * y - r->a2 * w;
+        sum += w * w;
+    }
+    st[0] = z0; st[1] = z1; st[2] = z2; st[3] = z3;
+    return sum;
+}
+
+static void finish_sub_block(struct mp_loudness *l)
+{
+    memmove(&l->subs[0], &l->subs[1], sizeof(l->subs) - sizeof(l->subs[0]));
+    l->subs[3] = l->sub_acc / l->sub_len;
+    l->num_subs = MPMIN(l->num_subs + 1, 4);
+    l->sub_acc = 0;
+    l->sub_pos = 0;
+
+    if (l->num_subs == 4) {
+        double e = (l->subs[0] + l->subs[1] + l->subs[2] + l->subs[3]) / 4;
+        MP_TARRAY_APPEND(l, l->blocks, l->num_blocks, e);
+    }
+}
+
+bool mp_loudness_add(struct mp_loudness *l, struct mp_aframe *frame)
+{
+    int format = mp_aframe_get_format(frame);
+    if (af_fmt_from_planar(format) != AF_FORMAT_FLOAT ||
+        mp_aframe_get_rate(frame) != l->rate ||
+        mp_aframe_get_channels(frame) != l->num_ch)
+        return false;
+
+    bool planar = af_fmt_is_planar(format);
+    uint8_t **planes = mp_aframe_get_data_ro(frame);
+    int samples = mp_aframe_get_size(frame);
+    if (!planes)
+        return false;
+
+    for (int c = 0; c < l->num_ch; c++) {
+        const float *src = planar ? (float *)planes[c] : (float *)planes[0] + c;
+        int step = planar ? 1 : l->num_ch;
+        for (int n = 0; n < samples; n++)
+            l->peak = MPMAX(l->peak, fabs(src[n * (ptrdiff_t)step]));
+    }
+
+    int pos = 0;
+    while (pos < samples) {
+        int len = MPMIN(samples - pos, l->sub_len - l->sub_pos);
+        for (int c = 0; c < l->num_ch; c++) {
+            const float *src = planar ? (float *)planes[c] + pos
+                                      : (float *)planes[0] + pos * l->num_ch + c;
+            double sum = filter_channel(l, l->state[c], src,
+                                        planar ? 1 : l->num_ch, len);
+            l->sub_acc += l->weight[c] * sum;
+        }
+        pos += len;
+        l->sub_pos += len;
+        if (l->sub_pos == l->sub_len)
+            finish_sub_block(l);
+    }
+
+    return true;
+}
+
+static double energy_to_lufs(double e)
+{
+    return -0.691 + 10.0 * log10(e);
+}
+
+double mp_loudness_integrated(struct mp_loudness *l)
+{
+    // Absolute gate at -70 LUFS.
+    double abs_gate = pow(10.0, (-70.0 + 0.691) / 10.0);
+
+    double sum = 0;
+    int count = 0;
+    for (int n = 0; n < l->num_blocks; n++) {
+        if (l->blocks[n] > abs_gate) {
+            sum += l->blocks[n];
+            count++;
+        }
+    }
+    if (!count)
+        return -HUGE_VAL;
+
+    // Relative gate 10 LU below the absolute-gated loudness.
+    double gate = MPMAX(abs_gate, sum / count * 0.1);
+
+    sum = 0;
+    count = 0;
+    for (int n = 0; n < l->num_blocks; n++) {
+        if (l->blocks[n] > gate) {
+            sum += l->blocks[n];
+            count++;
+        }
+    }
+    if (!count)
+        return -HUGE_VAL;
+
+    return energy_to_lufs(sum / count);
+}
+
+double mp_loudness_peak(struct mp_loudness *l)
+{
+    return l->peak;
+}
@@ -0,0 +1,49 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_LOUDNESS_H
+#define MP_LOUDNESS_H
+
+#include <stdbool.h>
+
+struct mp_aframe;
+struct mp_chmap;
+
+// Integrated loudness and sample peak measurement as specified by EBU R128
+// (ITU-R BS.1770-4 K-weighting and gating).
+struct mp_loudness;
+
+// Free with talloc_free(). Returns NULL for unsupported rates.
+struct mp_loudness *mp_loudness_create(void *ta_parent, int rate,
+                                       struct mp_chmap *chmap);
+
+// Feed audio in AF_FORMAT_FLOAT or AF_FORMAT_FLOATP. The frame must match the
+// rate and channel map passed to mp_loudness_create(). Returns false on
+// mismatch.
+bool mp_loudness_add(struct mp_loudness *l, struct mp_aframe *frame);
+
+// Integrated loudness in LUFS of all audio fed so far. Returns -HUGE_VAL if
+// everything was silence (or too short to form a single measurement block).
+double mp_loudness_integrated(struct mp_loudness *l);
+
+// Highest absolute sample value seen so far (1.0 is full scale).
+double mp_loudness_peak(struct mp_loudness *l);
+
+// ReplayGain 2.0 reference level, which the track gain is relative to.
+#define MP_LOUDNESS_RG_REFERENCE (-18.0)
+
+#endif
@@ -251,6 +251,12 @@ static struct ao *ao_init(bool probing, struct mpv_global *global,
         MP_VERBOSE(ao, "device buffer: %d samples.\n", ao->device_buffer);
     ao->buffer = MPMAX(ao->device_buffer, ao->def_buffer * ao->samplerate);
     ao->buffer = MPMAX(ao->buffer, 1);
+    if (ao->batch) {
+        assert(ao->untimed);
+        // Fewer, larger transfers between decoder, filters and AO.
+        ao->buffer = MPMAX(ao->buffer, AO_BATCH_BUFFER_SECS * ao->samplerate);
+        MP_VERBOSE(ao, "batch rendering enabled.\n");
+    }
 
     int align = af_format_sample_alignment(ao->format);
     ao->buffer = (ao->buffer + align - 1) / align * align;
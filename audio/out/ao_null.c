@@ -45,6 +45,7 @@ struct priv {
     bool playing;
 
     int untimed;
+    int batch;
     float bufferlen;    // seconds
     float speed;        // multiplier
     float latency_sec;  // seconds
@@ -89,7 +90,8 @@ static int init(struct ao *ao)
     if (priv->format)
         ao->format = priv->format;
 
-    ao->untimed = priv->untimed;
+    ao->untimed = priv->untimed || priv->batch;
+    ao->batch = priv->batch;
 
     struct mp_chmap_sel sel = {.tmp = ao};
     if (priv->channel_layouts.num_chmaps) {
@@ -104,7 +106,10 @@ static int init(struct ao *ao)
     priv->latency = priv->latency_sec * ao->samplerate;
 
     // A "buffer" for this many seconds of audio
-    int bursts = (int)(ao->samplerate * priv->bufferlen + 1) / priv->outburst;
+    float bufferlen = priv->bufferlen;
+    if (ao->batch)
+        bufferlen = MPMAX(bufferlen, AO_BATCH_BUFFER_SECS);
+    int bursts = (int)(ao->samplerate * bufferlen + 1) / priv->outburst;
     ao->device_buffer = priv->outburst * bursts + priv->latency;
 
     priv->last_time = mp_time_sec();
@@ -217,6 +222,7 @@ const struct ao_driver audio_out_null = {
     },
     .options = (const struct m_option[]) {
         {"untimed", OPT_FLAG(untimed)},
+        {"batch", OPT_FLAG(batch)},
         {"buffer", OPT_FLOAT(bufferlen), M_RANGE(0, 100)},
         {"outburst", OPT_INT(outburst), M_RANGE(1, 100000)},
         {"speed", OPT_FLOAT(speed), M_RANGE(0, 10000)},
@@ -33,6 +33,7 @@
 #include "audio/format.h"
 #include "ao.h"
 #include "internal.h"
+#include "common/common.h"
 #include "common/msg.h"
 #include "osdep/endian.h"
 
@@ -46,6 +47,7 @@ struct priv {
     char *outputfilename;
     int waveheader;
     int append;
+    int batch;
     uint64_t data_length;
     FILE *fp;
 };
@@ -159,10 +161,18 @@ static int init(struct ao *ao)
         MP_ERR(ao, "Failed to open %s for writing!\n", outputfilename);
         return -1;
     }
+    if (priv->batch) {
+        // Write in large chunks; the data is written in AO-sized blocks anyway.
+        setvbuf(priv->fp, NULL, _IOFBF, 1 << 20);
+    }
     if (priv->waveheader)  // Reserve space for wave header
         write_wave_header(ao, priv->fp, 0x7ffff000);
     ao->untimed = true;
+    ao->batch = priv->batch;
     ao->device_buffer = 1 << 16;
+    if (ao->batch)
+        ao->device_buffer = MPMAX(ao->device_buffer,
+                                  AO_BATCH_BUFFER_SECS * ao->samplerate);
 
     return 0;
 }
@@ -244,6 +254,7 @@ const struct ao_driver audio_out_pcm = {
         {"file", OPT_STRING(outputfilename), .flags = M_OPT_FILE},
         {"waveheader", OPT_FLAG(waveheader)},
         {"append", OPT_FLAG(append)},
+        {"batch", OPT_FLAG(batch)},
         {0}
     },
     .options_prefix = "ao-pcm",
@@ -74,6 +74,10 @@ struct buffer_state {
     bool thread_valid;          // thread is running
     struct mp_aframe *temp_buf;
 
+    // Batch mode statistics.
+    int64_t batch_samples;      // total samples written to the driver
+    int64_t batch_start_us;     // time of first write
+
     // --- protected by pt_lock
     bool need_wakeup;
     bool terminate;             // exit thread
@@ -468,6 +472,13 @@ void ao_uninit(struct ao *ao)
         p->thread_valid = false;
     }
 
+    if (ao->batch && p->batch_start_us) {
+        double played = p->batch_samples / (double)ao->samplerate;
+        double elapsed = (mp_time_us() - p->batch_start_us) / 1e6;
+        MP_INFO(ao, "Rendered %.3f s of audio in %.3f s (%.1fx realtime).\n",
+                played, elapsed, played / MPMAX(elapsed, 1e-6));
+    }
+
     if (ao->driver_initialized)
         ao->driver->uninit(ao);
 
@@ -613,6 +624,10 @@ static bool ao_play_data(struct ao *ao)
     }
 
     if (samples) {
+        if (ao->batch && !p->batch_start_us)
+            p->batch_start_us = mp_time_us();
+        p->batch_samples += samples;
+
         MP_STATS(ao, "start ao fill");
         if (!ao->driver->write(ao, planes, samples))
             MP_ERR(ao, "Error writing audio to device.\n");
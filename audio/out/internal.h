@@ -35,6 +35,8 @@ struct ao {
     int num_planes;
     bool probing;               // if true, don't fail loudly on init
     bool untimed;               // don't assume realtime playback
+    bool batch;                 // untimed, and render as fast as possible in
+                                // large blocks (offline processing)
     int device_buffer;          // device buffer in samples (guessed by
                                 // common init code if not set by driver)
     const struct ao_driver *driver;
@@ -70,6 +72,9 @@ struct ao {
     struct buffer_state *buffer_state;
 };
 
+// Minimum buffer size in seconds used by AOs in batch mode.
+#define AO_BATCH_BUFFER_SECS 2.0
+
 void init_buffer_pre(struct ao *ao);
 bool init_buffer_post(struct ao *ao);
 
@@ -46,6 +46,8 @@ struct encode_opts {
     int copy_metadata;
     char **set_metadata;
     char **remove_metadata;
+    int queue_size;
+    int parallel_segments;
 };
 
 // interface for player core
@@ -32,6 +32,7 @@
 #include "options/m_config.h"
 #include "options/m_option.h"
 #include "options/options.h"
+#include "osdep/threads.h"
 #include "osdep/timer.h"
 #include "video/out/vo.h"
 #include "mpv_talloc.h"
@@ -53,14 +54,41 @@ struct encode_priv {
     struct mux_stream **streams;
     int num_streams;
 
+    // Muxer thread, used if --oqueue-size > 0. The encoders append packets
+    // to the queue, and the thread writes them. Once the header is written,
+    // only the thread accesses the muxer.
+    pthread_t mux_thread;
+    bool mux_thread_active;
+    bool mux_terminate;
+    pthread_cond_t mux_wakeup;  // signaled on any queue change
+    AVPacket **packets;
+    int num_packets;
+
     // Statistics
     double t0;
 
     long long abytes;
     long long vbytes;
+    int64_t file_size;          // avio_tell() after the last write
 
     unsigned int frames;
     double audioseconds;
+
+    // Per-stage throughput (time spent on each frame/packet)
+    struct {
+        unsigned int count;
+        double time;
+    } stages[ENCODE_STAGE_COUNT];
+};
+
+// Frame queue between encoder_encode_async() and the encoder thread.
+struct encoder_queue {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;      // signaled on any queue change
+    AVFrame **frames;           // a NULL entry flushes the encoder
+    int num_frames;
+    bool terminate;             // exit without processing the queue
 };
 
 struct mux_stream {
@@ -96,6 +124,8 @@ const struct m_sub_options encode_config = {
         {"ocopy-metadata", OPT_FLAG(copy_metadata)},
         {"oset-metadata", OPT_KEYVALUELIST(set_metadata)},
         {"oremove-metadata", OPT_STRINGLIST(remove_metadata)},
+        {"oqueue-size", OPT_INT(queue_size), M_RANGE(0, 1000)},
+        {"oparallel-segments", OPT_INT(parallel_segments), M_RANGE(0, 64)},
 
         {"ocopyts", OPT_REMOVED("ocopyts is now the default")},
         {"oneverdrop", OPT_REMOVED("no replacement")},
@@ -108,6 +138,7 @@ const struct m_sub_options encode_config = {
     .size = sizeof(struct encode_opts),
     .defaults = &(const struct encode_opts){
         .copy_metadata = 1,
+        .queue_size = 8,
     },
 };
 
@@ -124,6 +155,7 @@ struct encode_lavc_context *encode_lavc_init(struct mpv_global *global)
 
     struct encode_priv *p = ctx->priv;
     p->log = ctx->log;
+    pthread_cond_init(&p->mux_wakeup, NULL);
 
     const char *filename = ctx->options->file;
 
@@ -211,6 +243,14 @@ bool encode_lavc_free(struct encode_lavc_context *ctx)
 
     struct encode_priv *p = ctx->priv;
 
+    if (p->mux_thread_active) {
+        pthread_mutex_lock(&ctx->lock);
+        p->mux_terminate = true;
+        pthread_cond_broadcast(&p->mux_wakeup);
+        pthread_mutex_unlock(&ctx->lock);
+        pthread_join(p->mux_thread, NULL);
+    }
+
     if (!p->failed && !p->header_written) {
         MP_FATAL(p, "no data written to target file\n");
         p->failed = true;
@@ -236,12 +276,76 @@ bool encode_lavc_free(struct encode_lavc_context *ctx)
 
     res = !p->failed;
 
+    pthread_cond_destroy(&p->mux_wakeup);
     pthread_mutex_destroy(&ctx->lock);
     talloc_free(ctx);
 
     return res;
 }
 
+// called locked
+static void add_stage_time(struct encode_priv *p, enum encode_stage stage,
+                           double t0)
+{
+    p->stages[stage].count += 1;
+    p->stages[stage].time += mp_time_sec() - t0;
+}
+
+// Takes over the packet reference. Besides the muxer, this doesn't touch
+// any fields protected by the lock; the file size is returned in *file_size.
+static bool write_packet(struct encode_priv *p, AVPacket *pkt,
+                         int64_t *file_size)
+{
+    bool ok = av_interleaved_write_frame(p->muxer, pkt) >= 0;
+    if (p->muxer->pb)
+        *file_size = avio_tell(p->muxer->pb);
+    return ok;
+}
+
+static void *mux_thread(void *arg)
+{
+    struct encode_lavc_context *ctx = arg;
+    struct encode_priv *p = ctx->priv;
+
+    mpthread_set_name("encode mux");
+
+    pthread_mutex_lock(&ctx->lock);
+    while (1) {
+        if (!p->num_packets) {
+            if (p->mux_terminate)
+                break;
+            pthread_cond_wait(&p->mux_wakeup, &ctx->lock);
+            continue;
+        }
+
+        AVPacket *pkt = p->packets[0];
+        MP_TARRAY_REMOVE_AT(p->packets, p->num_packets, 0);
+        pthread_cond_broadcast(&p->mux_wakeup);
+
+        if (p->failed) {
+            av_packet_free(&pkt);
+            continue;
+        }
+
+        int64_t file_size = p->file_size;
+        pthread_mutex_unlock(&ctx->lock);
+
+        double t0 = mp_time_sec();
+        bool ok = write_packet(p, pkt, &file_size);
+        av_packet_free(&pkt);
+
+        pthread_mutex_lock(&ctx->lock);
+        if (!ok) {
+            MP_ERR(p, "Writing packet failed.\n");
+            p->failed = true;
+        }
+        p->file_size = file_size;
+        add_stage_time(p, ENCODE_STAGE_MUX, t0);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    return NULL;
+}
+
 // called locked
 static void maybe_init_muxer(struct encode_lavc_context *ctx)
 {
@@ -296,6 +400,17 @@ static void maybe_init_muxer(struct encode_lavc_context *ctx)
 
     p->header_written = true;
 
+    if (p->muxer->pb)
+        p->file_size = avio_tell(p->muxer->pb);
+
+    if (ctx->options->queue_size > 0) {
+        if (pthread_create(&p->mux_thread, NULL, mux_thread, ctx)) {
+            MP_WARN(p, "Could not create muxer thread.\n");
+        } else {
+            p->mux_thread_active = true;
+        }
+    }
+
     for (int n = 0; n < p->num_streams; n++) {
         struct mux_stream *s = p->streams[n];
 
@@ -359,11 +474,10 @@ done:
 // Signal that you are ready to encode (you provide the codec params etc. too).
 // This returns a muxing handle which you can use to add encodec packets.
 // Can be called only once per stream. info is copied by callee as needed.
-static void encode_lavc_add_stream(struct encoder_context *enc,
-                                   struct encode_lavc_context *ctx,
-                                   struct encoder_stream_info *info,
-                                   void (*on_ready)(void *ctx),
-                                   void *on_ready_ctx)
+static struct mux_stream *add_stream(struct encode_lavc_context *ctx,
+                                     struct encoder_stream_info *info,
+                                     void (*on_ready)(void *ctx),
+                                     void *on_ready_ctx)
 {
     struct encode_priv *p = ctx->priv;
 
@@ -398,12 +512,23 @@ static void encode_lavc_add_stream(struct encoder_context *enc,
 
     dst->on_ready = on_ready;
     dst->on_ready_ctx = on_ready_ctx;
-    enc->mux_stream = dst;
 
     maybe_init_muxer(ctx);
 
 done:
     pthread_mutex_unlock(&ctx->lock);
+    return dst;
+}
+
+struct mux_stream *encode_lavc_add_packet_stream(struct encode_lavc_context *ctx,
+                                                 AVCodecParameters *codecpar,
+                                                 AVRational timebase)
+{
+    struct encoder_stream_info info = {
+        .timebase = timebase,
+        .codecpar = codecpar,
+    };
+    return add_stream(ctx, &info, NULL, NULL);
 }
 
 // Write a packet. This will take over ownership of `pkt`
@@ -443,9 +568,23 @@ static void encode_lavc_add_packet(struct mux_stream *dst, AVPacket *pkt)
         break;
     }
 
-    if (av_interleaved_write_frame(p->muxer, pkt) < 0) {
-        MP_ERR(p, "Writing packet failed.\n");
-        p->failed = true;
+    if (p->mux_thread_active) {
+        while (p->num_packets >= ctx->options->queue_size && !p->failed)
+            pthread_cond_wait(&p->mux_wakeup, &ctx->lock);
+        if (p->failed)
+            goto done;
+        AVPacket *copy = av_packet_alloc();
+        MP_HANDLE_OOM(copy);
+        av_packet_move_ref(copy, pkt);
+        MP_TARRAY_APPEND(p, p->packets, p->num_packets, copy);
+        pthread_cond_broadcast(&p->mux_wakeup);
+    } else {
+        double t0 = mp_time_sec();
+        if (!write_packet(p, pkt, &p->file_size)) {
+            MP_ERR(p, "Writing packet failed.\n");
+            p->failed = true;
+        }
+        add_stage_time(p, ENCODE_STAGE_MUX, t0);
     }
 
     pkt = NULL;
@@ -456,6 +595,11 @@ done:
         av_packet_unref(pkt);
 }
 
+void encode_lavc_write_packet(struct mux_stream *dst, AVPacket *pkt)
+{
+    encode_lavc_add_packet(dst, pkt);
+}
+
 AVRational encoder_get_mux_timebase_unlocked(struct encoder_context *p)
 {
     return p->mux_stream->st->time_base;
@@ -697,12 +841,20 @@ int encode_lavc_getstatus(struct encode_lavc_context *ctx,
     }
 
     minutes = (now - p->t0) / 60.0 * (1 - f) / f;
-    megabytes = p->muxer->pb ? (avio_size(p->muxer->pb) / 1048576.0 / f) : 0;
+    megabytes = p->file_size / 1048576.0 / f;
     fps = p->frames / (now - p->t0);
     x = p->audioseconds / (now - p->t0);
     if (p->frames) {
-        snprintf(buf, bufsize, "{%.1fmin %.1ffps %.1fMB}",
-                 minutes, fps, megabytes);
+        // Frames (or packets) per second each stage could process on its own.
+        double rates[ENCODE_STAGE_COUNT];
+        for (int n = 0; n < ENCODE_STAGE_COUNT; n++) {
+            rates[n] = p->stages[n].time > 0
+                     ? p->stages[n].count / p->stages[n].time : 0;
+        }
+        snprintf(buf, bufsize, "{%.1fmin %.1ffps %.1fMB conv:%.0f enc:%.0f "
+                 "mux:%.0f}", minutes, fps, megabytes,
+                 rates[ENCODE_STAGE_CONVERT], rates[ENCODE_STAGE_ENCODE],
+                 rates[ENCODE_STAGE_MUX]);
     } else if (p->audioseconds) {
         snprintf(buf, bufsize, "{%.1fmin %.2fx %.1fMB}",
                  minutes, x, megabytes);
@@ -727,10 +879,30 @@ bool encode_lavc_didfail(struct encode_lavc_context *ctx)
     return fail;
 }
 
+static void encoder_stop_thread(struct encoder_context *p, bool terminate)
+{
+    struct encoder_queue *q = p->queue;
+
+    pthread_mutex_lock(&q->lock);
+    q->terminate |= terminate;
+    pthread_cond_broadcast(&q->wakeup);
+    pthread_mutex_unlock(&q->lock);
+    pthread_join(q->thread, NULL);
+
+    for (int n = 0; n < q->num_frames; n++)
+        av_frame_free(&q->frames[n]);
+    pthread_cond_destroy(&q->wakeup);
+    pthread_mutex_destroy(&q->lock);
+    TA_FREEP(&p->queue);
+}
+
 static void encoder_destroy(void *ptr)
 {
     struct encoder_context *p = ptr;
 
+    if (p->queue)
+        encoder_stop_thread(p, true);
+
     avcodec_free_context(&p->encoder);
     free_stream(p->twopass_bytebuffer);
 }
@@ -865,6 +1037,10 @@ bool encoder_init_codec_and_muxer(struct encoder_context *p,
         ? p->options->vopts
         : p->options->aopts;
 
+    // Let libavcodec pick the number of frame/slice threads (like ffmpeg.c).
+    // The user can override it with "threads" in the codec options.
+    p->encoder->thread_count = 0;
+
     // Set these now, so the code below can read back parsed settings from it.
     mp_set_avopts(p->log, p->encoder, copts);
 
@@ -910,7 +1086,7 @@ bool encoder_init_codec_and_muxer(struct encoder_context *p,
     if (avcodec_parameters_from_context(p->info.codecpar, p->encoder) < 0)
         goto fail;
 
-    encode_lavc_add_stream(p, p->encode_lavc_ctx, &p->info, on_ready, ctx);
+    p->mux_stream = add_stream(p->encode_lavc_ctx, &p->info, on_ready, ctx);
     if (!p->mux_stream)
         goto fail;
 
@@ -923,6 +1099,9 @@ fail:
 
 bool encoder_encode(struct encoder_context *p, AVFrame *frame)
 {
+    double t0 = mp_time_sec();
+    double mux_time = 0; // time blocked in the muxer, not part of encoding
+
     int status = avcodec_send_frame(p->encoder, frame);
     if (status < 0) {
         if (frame && status == AVERROR_EOF)
@@ -948,9 +1127,14 @@ bool encoder_encode(struct encoder_context *p, AVFrame *frame)
         if (status == AVERROR_EOF)
             break;
 
+        double t = mp_time_sec();
         encode_lavc_add_packet(p->mux_stream, &packet);
+        mux_time += mp_time_sec() - t;
     }
 
+    if (frame && p->type == STREAM_VIDEO)
+        encoder_account_stage(p, ENCODE_STAGE_ENCODE, t0 + mux_time);
+
     return true;
 
 fail:
@@ -959,6 +1143,84 @@ fail:
     return false;
 }
 
+static void *encoder_thread(void *arg)
+{
+    struct encoder_context *p = arg;
+    struct encoder_queue *q = p->queue;
+
+    mpthread_set_name(p->type == STREAM_VIDEO ? "encode video"
+                                              : "encode audio");
+
+    pthread_mutex_lock(&q->lock);
+    while (!q->terminate) {
+        if (!q->num_frames) {
+            pthread_cond_wait(&q->wakeup, &q->lock);
+            continue;
+        }
+
+        AVFrame *frame = q->frames[0];
+        MP_TARRAY_REMOVE_AT(q->frames, q->num_frames, 0);
+        pthread_cond_broadcast(&q->wakeup);
+        pthread_mutex_unlock(&q->lock);
+
+        encoder_encode(p, frame);
+
+        pthread_mutex_lock(&q->lock);
+        if (!frame)
+            break;
+        av_frame_free(&frame);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return NULL;
+}
+
+bool encoder_encode_async(struct encoder_context *p, AVFrame *frame)
+{
+    int queue_size = p->options->queue_size;
+
+    if (!p->queue && queue_size > 0 && frame) {
+        struct encoder_queue *q = talloc_zero(p, struct encoder_queue);
+        pthread_mutex_init(&q->lock, NULL);
+        pthread_cond_init(&q->wakeup, NULL);
+        p->queue = q;
+        if (pthread_create(&q->thread, NULL, encoder_thread, p)) {
+            MP_WARN(p, "Could not create encoder thread.\n");
+            pthread_cond_destroy(&q->wakeup);
+            pthread_mutex_destroy(&q->lock);
+            TA_FREEP(&p->queue);
+        }
+    }
+
+    struct encoder_queue *q = p->queue;
+    if (!q) {
+        bool ok = encoder_encode(p, frame);
+        av_frame_free(&frame);
+        return ok;
+    }
+
+    pthread_mutex_lock(&q->lock);
+    while (q->num_frames >= queue_size)
+        pthread_cond_wait(&q->wakeup, &q->lock);
+    MP_TARRAY_APPEND(q, q->frames, q->num_frames, frame);
+    pthread_cond_broadcast(&q->wakeup);
+    pthread_mutex_unlock(&q->lock);
+
+    if (!frame)
+        encoder_stop_thread(p, false);
+
+    return true;
+}
+
+void encoder_account_stage(struct encoder_context *p, enum encode_stage stage,
+                           double t0)
+{
+    struct encode_lavc_context *ctx = p->encode_lavc_ctx;
+
+    pthread_mutex_lock(&ctx->lock);
+    add_stage_time(ctx->priv, stage, t0);
+    pthread_mutex_unlock(&ctx->lock);
+}
+
 double encoder_get_offset(struct encoder_context *p)
 {
     switch (p->encoder->codec_type) {
@@ -56,6 +56,14 @@ struct encode_lavc_context {
 
 // --- interface for vo/ao drivers
 
+// Stages of the encoding pipeline, for the statistics in the status line.
+enum encode_stage {
+    ENCODE_STAGE_CONVERT,   // preparing a video frame (vo_lavc.c)
+    ENCODE_STAGE_ENCODE,    // encoding a video frame
+    ENCODE_STAGE_MUX,       // writing a packet
+    ENCODE_STAGE_COUNT,
+};
+
 // Static information after encoder init. This never changes (even if there are
 // dynamic runtime changes, they have to work over AVPacket side data).
 // For use in encoder_context, most fields are copied from encoder_context.encoder
@@ -84,6 +92,9 @@ struct encoder_context {
     struct mux_stream *mux_stream;
 
     struct stream *twopass_bytebuffer;
+
+    // Encoder thread (used by encoder_encode_async())
+    struct encoder_queue *queue;
 };
 
 // Free with talloc_free(). (Keep in mind actual deinitialization requires
@@ -105,10 +116,33 @@ bool encoder_init_codec_and_muxer(struct encoder_context *p,
 // Encode the frame and write the packet. frame is ref'ed as need.
 bool encoder_encode(struct encoder_context *p, AVFrame *frame);
 
+// Like encoder_encode(), but queue the frame for encoding on a separate thread
+// if --oqueue-size > 0. Blocks while the queue is full. Takes ownership of
+// frame. Sending the flush frame (NULL) waits until everything was encoded.
+// Errors are only logged.
+bool encoder_encode_async(struct encoder_context *p, AVFrame *frame);
+
+// Add the time since t0 (mp_time_sec()) to the statistics of the given stage.
+void encoder_account_stage(struct encoder_context *p, enum encode_stage stage,
+                           double t0);
+
 // Return muxer timebase (only available after on_ready() has been called).
 // Caller needs to acquire encode_lavc_context.lock (or call it from on_ready).
 AVRational encoder_get_mux_timebase_unlocked(struct encoder_context *p);
 
 double encoder_get_offset(struct encoder_context *p);
 
+// --- interface for muxing already encoded packets (player/encode_segments.c)
+
+// Add a stream for packets with the given codec parameters and timebase (like
+// encoder_init_codec_and_muxer(), codecpar is copied). The stream type must
+// have been announced with encode_lavc_expect_stream(). Returns NULL on
+// failure.
+struct mux_stream *encode_lavc_add_packet_stream(struct encode_lavc_context *ctx,
+                                                 AVCodecParameters *codecpar,
+                                                 AVRational timebase);
+
+// Write a packet to the stream. Takes over ownership of pkt's reference.
+void encode_lavc_write_packet(struct mux_stream *dst, AVPacket *pkt);
+
 #endif
@@ -42,14 +42,39 @@
 
 #include "msg.h"
 #include "msg_control.h"
+#include "stats_file.h"
 
 #define TERM_BUF 100
 
+// Number of messages that can be queued for the logger thread. Must be a
+// power of 2.
+#define LOG_QUEUE_SIZE 512
+// Messages (including prefixes) up to this size are stored in the queue
+// itself; longer ones are allocated.
+#define LOG_ENTRY_BUF 256
+
+struct log_entry {
+    int64_t time;
+    int level;
+    int terminal_level;         // mp_log.terminal_level of the source
+    char *prefix;               // mp_log.prefix (can be NULL)
+    char *verbose_prefix;       // mp_log.verbose_prefix
+    char *text;                 // one or more lines
+    char *alloc;                // if not NULL, the strings point into this
+    char buf[LOG_ENTRY_BUF];
+};
+
+struct log_slot {
+    // Equal to the queue position if the slot is free, and position + 1 if
+    // the entry was written and can be read.
+    atomic_ulong seq;
+    struct log_entry entry;
+};
+
 struct mp_log_root {
     struct mpv_global *global;
     pthread_mutex_t lock;
-    pthread_mutex_t log_file_lock;
-    pthread_cond_t log_file_wakeup;
+    pthread_mutex_t partial_lock; // protects mp_log.partial
     // --- protected by lock
     char **msg_levels;
     bool use_terminal;  // make accesses to stderr/stdout
@@ -63,23 +88,37 @@ struct mp_log_root {
     bool force_stderr;
     struct mp_log_buffer **buffers;
     int num_buffers;
+    bool buffers_need_wakeup;   // some mp_log_buffer.need_wakeup is set
     struct mp_log_buffer *early_buffer;
-    FILE *stats_file;
-    bstr buffer;
+    bool stats_enabled;
+    FILE *log_file;     // also only written by the owner thread
     // --- must be accessed atomically
     /* This is incremented every time the msglevels must be reloaded.
      * (This is perhaps better than maintaining a globally accessible and
      * synchronized mp_log tree.) */
     atomic_ulong reload_counter;
+    // --- message queue (MPSC ringbuffer), see queue_push()
+    struct log_slot *queue;     // LOG_QUEUE_SIZE entries, immutable pointer
+    atomic_ulong queue_write;   // next position a producer will claim
+    atomic_ulong queue_read;    // next position the logger thread will read
+    atomic_ulong queue_dropped; // messages not queued because it was full
+    atomic_bool logger_waiting; // logger thread is (about to) wait on queue_cond
+    atomic_int queue_waiters;   // threads waiting on queue_done_cond
+    pthread_mutex_t queue_lock;
+    pthread_cond_t queue_cond;      // signaled when an entry was written
+    pthread_cond_t queue_done_cond; // signaled when an entry was processed
+    bool logger_terminate;      // protected by queue_lock
+    // --- log buffer wakeup callbacks, see unlock_and_wakeup()
+    pthread_mutex_t wakeup_lock;
+    struct buffer_wakeup *wakeups;  // protected by wakeup_lock
+    int num_wakeups;
+    // --- thread-safe
+    struct mp_stats_file *stats_file;
     // --- owner thread only (caller of mp_msg_init() etc.)
     char *log_path;
     char *stats_path;
-    pthread_t log_file_thread;
-    // --- owner thread only, but frozen while log_file_thread is running
-    FILE *log_file;
-    struct mp_log_buffer *log_file_buffer;
-    // --- protected by log_file_lock
-    bool log_file_thread_active; // also termination signal for the thread
+    pthread_t logger_thread;
+    bool logger_active;         // frozen while other threads can log
 };
 
 struct mp_log {
@@ -90,7 +129,8 @@ struct mp_log {
     int level;                  // minimum log level for any outputs
     int terminal_level;         // minimum log level for terminal output
     atomic_ulong reload_counter;
-    char *partial;
+    atomic_bool has_partial;
+    char *partial;              // protected by mp_log_root.partial_lock
 };
 
 struct mp_log_buffer {
@@ -103,12 +143,19 @@ struct mp_log_buffer {
     int num_entries;                        // number of valid entries after entry0
     uint64_t dropped;                       // number of skipped entries
     bool silent;
+    // --- protected by mp_log_root.lock
+    bool need_wakeup;                       // call wakeup_cb after unlocking
     // --- immutable
     void (*wakeup_cb)(void *ctx);
     void *wakeup_cb_ctx;
     int level;
 };
 
+struct buffer_wakeup {
+    void (*cb)(void *ctx);
+    void *ctx;
+};
+
 static const struct mp_log null_log = {0};
 struct mp_log *const mp_null_log = (struct mp_log *)&null_log;
 
@@ -135,14 +182,12 @@ static void update_loglevel(struct mp_log *log)
     log->terminal_level = log->level;
     for (int n = 0; n < log->root->num_buffers; n++) {
         int buffer_level = log->root->buffers[n]->level;
-        if (buffer_level == MP_LOG_BUFFER_MSGL_LOGFILE)
-            buffer_level = MSGL_DEBUG;
         if (buffer_level != MP_LOG_BUFFER_MSGL_TERM)
             log->level = MPMAX(log->level, buffer_level);
     }
     if (log->root->log_file)
         log->level = MPMAX(log->level, MSGL_DEBUG);
-    if (log->root->stats_file)
+    if (log->root->stats_enabled)
         log->level = MPMAX(log->level, MSGL_STATS);
     log->level = MPMIN(log->level, log->max_level);
     atomic_store(&log->reload_counter, atomic_load(&log->root->reload_counter));
@@ -176,6 +221,25 @@ int mp_msg_level(struct mp_log *log)
     return log->level;
 }
 
+// Wait until the logger thread has output all messages queued so far. Must not
+// be called with root->lock held.
+static void flush_queue(struct mp_log_root *root)
+{
+    if (!root->logger_active)
+        return;
+
+    unsigned long pos = atomic_load(&root->queue_write);
+    if (atomic_load(&root->queue_read) == pos)
+        return;
+
+    pthread_mutex_lock(&root->queue_lock);
+    atomic_fetch_add(&root->queue_waiters, 1);
+    while ((long)(pos - atomic_load(&root->queue_read)) > 0)
+        pthread_cond_wait(&root->queue_done_cond, &root->queue_lock);
+    atomic_fetch_add(&root->queue_waiters, -1);
+    pthread_mutex_unlock(&root->queue_lock);
+}
+
 // Reposition cursor and clear lines for outputting the status line. In certain
 // cases, like term OSD and subtitle display, the status can consist of
 // multiple lines.
@@ -224,6 +288,7 @@ static void flush_status_line(struct mp_log_root *root)
 void mp_msg_flush_status_line(struct mp_log *log)
 {
     if (log->root) {
+        flush_queue(log->root);
         pthread_mutex_lock(&log->root->lock);
         flush_status_line(log->root);
         pthread_mutex_unlock(&log->root->lock);
@@ -233,6 +298,7 @@ void mp_msg_flush_status_line(struct mp_log *log)
 void mp_msg_set_term_title(struct mp_log *log, const char *title)
 {
     if (log->root && title) {
+        flush_queue(log->root);
         // Lock because printf to terminal is not necessarily atomic.
         pthread_mutex_lock(&log->root->lock);
         fprintf(stderr, "\e]0;%s\007", title);
@@ -284,19 +350,19 @@ static void pretty_print_module(FILE* stream, const char *prefix, bool use_color
         set_msg_color(stream, lev);
 }
 
-static bool test_terminal_level(struct mp_log *log, int lev)
+static bool test_terminal_level(struct mp_log_root *root, struct log_entry *e)
 {
-    return lev <= log->terminal_level && log->root->use_terminal &&
-           !(lev == MSGL_STATUS && terminal_in_background());
+    return e->level <= e->terminal_level && root->use_terminal &&
+           !(e->level == MSGL_STATUS && terminal_in_background());
 }
 
-static void print_terminal_line(struct mp_log *log, int lev,
-                                char *text,  char *trail)
+static void print_terminal_line(struct mp_log_root *root, struct log_entry *e,
+                                char *text, char *trail)
 {
-    if (!test_terminal_level(log, lev))
+    if (!test_terminal_level(root, e))
         return;
 
-    struct mp_log_root *root = log->root;
+    int lev = e->level;
     FILE *stream = (root->force_stderr || lev == MSGL_STATUS) ? stderr : stdout;
 
     if (lev != MSGL_STATUS)
@@ -306,11 +372,11 @@ static void print_terminal_line(struct mp_log *log, int lev,
         set_msg_color(stream, lev);
 
     if (root->show_time)
-        fprintf(stream, "[%10.6f] ", (mp_time_us() - MP_START_TIME) / 1e6);
+        fprintf(stream, "[%10.6f] ", (e->time - MP_START_TIME) / 1e6);
 
-    const char *prefix = log->prefix;
+    const char *prefix = e->prefix;
     if ((lev >= MSGL_V) || root->verbose || root->module)
-        prefix = log->verbose_prefix;
+        prefix = e->verbose_prefix;
 
     if (prefix) {
         if (root->module) {
@@ -336,37 +402,17 @@ static struct mp_log_buffer_entry *log_buffer_read(struct mp_log_buffer *buffer)
     return res;
 }
 
-static void write_msg_to_buffers(struct mp_log *log, int lev, char *text)
+static void write_msg_to_buffers(struct mp_log_root *root, struct log_entry *e,
+                                 char *text)
 {
-    struct mp_log_root *root = log->root;
+    int lev = e->level;
     for (int n = 0; n < root->num_buffers; n++) {
         struct mp_log_buffer *buffer = root->buffers[n];
-        bool wakeup = false;
         pthread_mutex_lock(&buffer->lock);
         int buffer_level = buffer->level;
         if (buffer_level == MP_LOG_BUFFER_MSGL_TERM)
-            buffer_level = log->terminal_level;
-        if (buffer_level == MP_LOG_BUFFER_MSGL_LOGFILE)
-            buffer_level = MPMAX(log->terminal_level, MSGL_DEBUG);
+            buffer_level = e->terminal_level;
         if (lev <= buffer_level && lev != MSGL_STATUS) {
-            if (buffer->level == MP_LOG_BUFFER_MSGL_LOGFILE) {
-                // If the buffer is full, block until we can write again.
-                bool dead = false;
-                while (buffer->num_entries == buffer->capacity && !dead) {
-                    // Temporary unlock is OK; buffer->level is immutable, and
-                    // buffer can't go away because the global log lock is held.
-                    pthread_mutex_unlock(&buffer->lock);
-                    pthread_mutex_lock(&root->log_file_lock);
-                    if (root->log_file_thread_active) {
-                        pthread_cond_wait(&root->log_file_wakeup,
-                                          &root->log_file_lock);
-                    } else {
-                        dead = true;
-                    }
-                    pthread_mutex_unlock(&root->log_file_lock);
-                    pthread_mutex_lock(&buffer->lock);
-                }
-            }
             if (buffer->num_entries == buffer->capacity) {
                 struct mp_log_buffer_entry *skip = log_buffer_read(buffer);
                 talloc_free(skip);
@@ -374,83 +420,306 @@ static void write_msg_to_buffers(struct mp_log *log, int lev, char *text)
             }
             struct mp_log_buffer_entry *entry = talloc_ptrtype(NULL, entry);
             *entry = (struct mp_log_buffer_entry) {
-                .prefix = talloc_strdup(entry, log->verbose_prefix),
+                .prefix = talloc_strdup(entry, e->verbose_prefix),
                 .level = lev,
                 .text = talloc_strdup(entry, text),
             };
             int pos = (buffer->entry0 + buffer->num_entries) % buffer->capacity;
             buffer->entries[pos] = entry;
             buffer->num_entries += 1;
-            if (buffer->wakeup_cb && !buffer->silent)
-                wakeup = true;
+            if (buffer->wakeup_cb && !buffer->silent) {
+                buffer->need_wakeup = true;
+                root->buffers_need_wakeup = true;
+            }
         }
         pthread_mutex_unlock(&buffer->lock);
-        if (wakeup)
-            buffer->wakeup_cb(buffer->wakeup_cb_ctx);
     }
 }
 
-static void dump_stats(struct mp_log *log, int lev, char *text)
+// Unlock root->lock, and call the wakeup callbacks of the log buffers that
+// received messages. The callbacks are run without root->lock, so they can't
+// block logging. wakeup_lock makes mp_msg_log_buffer_destroy() wait until
+// callbacks for the destroyed buffer have returned.
+static void unlock_and_wakeup(struct mp_log_root *root)
 {
-    struct mp_log_root *root = log->root;
-    if (lev == MSGL_STATS && root->stats_file)
-        fprintf(root->stats_file, "%"PRId64" %s\n", mp_time_us(), text);
+    if (!root->buffers_need_wakeup) {
+        pthread_mutex_unlock(&root->lock);
+        return;
+    }
+
+    pthread_mutex_lock(&root->wakeup_lock);
+    root->num_wakeups = 0;
+    for (int n = 0; n < root->num_buffers; n++) {
+        struct mp_log_buffer *buffer = root->buffers[n];
+        if (buffer->need_wakeup) {
+            struct buffer_wakeup w = {buffer->wakeup_cb, buffer->wakeup_cb_ctx};
+            MP_TARRAY_APPEND(root, root->wakeups, root->num_wakeups, w);
+            buffer->need_wakeup = false;
+        }
+    }
+    root->buffers_need_wakeup = false;
+    pthread_mutex_unlock(&root->lock);
+
+    for (int n = 0; n < root->num_wakeups; n++)
+        root->wakeups[n].cb(root->wakeups[n].ctx);
+    pthread_mutex_unlock(&root->wakeup_lock);
 }
 
-void mp_msg_va(struct mp_log *log, int lev, const char *format, va_list va)
+static void write_msg_to_log_file(struct mp_log_root *root, struct log_entry *e,
+                                  char *text)
 {
-    if (!mp_msg_test(log, lev))
-        return; // do not display
+    // --log-file uses --msg-level, but at least MSGL_DEBUG.
+    int lev = e->level;
+    if (!root->log_file || lev == MSGL_STATUS ||
+        lev > MPMAX(e->terminal_level, MSGL_DEBUG))
+        return;
 
-    struct mp_log_root *root = log->root;
+    fprintf(root->log_file, "[%8.3f][%c][%s] %s",
+            (e->time - MP_START_TIME) / 1e6,
+            mp_log_levels[lev][0], e->verbose_prefix, text);
+}
 
-    pthread_mutex_lock(&root->lock);
+// Output a message to the terminal, log buffers and log file. Called with
+// root->lock held, usually on the logger thread.
+static void write_entry(struct mp_log_root *root, struct log_entry *e)
+{
+    char *text = e->text;
 
-    root->buffer.len = 0;
+    if (e->level == MSGL_STATUS) {
+        if (!test_terminal_level(root, e))
+            return;
+        prepare_status_line(root, text);
+    }
 
-    if (log->partial[0])
-        bstr_xappend_asprintf(root, &root->buffer, "%s", log->partial);
-    log->partial[0] = '\0';
+    // Split away each line.
+    while (1) {
+        char *end = strchr(text, '\n');
+        if (!end)
+            break;
+        char *next = &end[1];
+        char saved = next[0];
+        next[0] = '\0';
+        print_terminal_line(root, e, text, "");
+        write_msg_to_buffers(root, e, text);
+        write_msg_to_log_file(root, e, text);
+        next[0] = saved;
+        text = next;
+    }
 
-    bstr_xappend_vasprintf(root, &root->buffer, format, va);
+    if (e->level == MSGL_STATUS && text[0])
+        print_terminal_line(root, e, text, "\r");
 
-    char *text = root->buffer.start;
+    if (root->log_file)
+        fflush(root->log_file);
+}
 
-    if (lev == MSGL_STATS) {
-        dump_stats(log, lev, text);
-    } else if (lev == MSGL_STATUS && !test_terminal_level(log, lev)) {
-        /* discard */
-    } else {
-        if (lev == MSGL_STATUS)
-            prepare_status_line(root, text);
-
-        // Split away each line. Normally we require full lines; buffer partial
-        // lines if they happen.
-        while (1) {
-            char *end = strchr(text, '\n');
-            if (!end)
+// Copy the message and everything needed from log into e, so that the message
+// can be output after log was destroyed.
+static void init_entry(struct log_entry *e, struct mp_log *log, int lev,
+                       const char *text, size_t len)
+{
+    const char *prefix = log->prefix ? log->prefix : "";
+    size_t prefix_size = strlen(prefix) + 1;
+    size_t verbose_prefix_size = strlen(log->verbose_prefix) + 1;
+    size_t size = prefix_size + verbose_prefix_size + len + 1;
+
+    char *buf = e->buf;
+    e->alloc = NULL;
+    if (size > sizeof(e->buf))
+        buf = e->alloc = talloc_size(NULL, size);
+
+    e->time = mp_time_us();
+    e->level = lev;
+    e->terminal_level = log->terminal_level;
+    e->prefix = log->prefix ? buf : NULL;
+    memcpy(buf, prefix, prefix_size);
+    e->verbose_prefix = buf + prefix_size;
+    memcpy(e->verbose_prefix, log->verbose_prefix, verbose_prefix_size);
+    e->text = e->verbose_prefix + verbose_prefix_size;
+    memcpy(e->text, text, len);
+    e->text[len] = '\0';
+}
+
+// Add a message to the queue. This takes no locks, unless the logger thread
+// needs to be woken up. Returns false if the queue is full; the logging thread
+// is never blocked by the logger thread, like with the log buffers.
+static bool queue_push(struct mp_log_root *root, struct mp_log *log, int lev,
+                       const char *text, size_t len)
+{
+    unsigned long pos = atomic_load(&root->queue_write);
+    struct log_slot *slot;
+    while (1) {
+        slot = &root->queue[pos % LOG_QUEUE_SIZE];
+        unsigned long seq = atomic_load_explicit(&slot->seq,
+                                                 memory_order_acquire);
+        long diff = (long)(seq - pos);
+        if (diff == 0) {
+            // Free; claim it, unless another producer was faster.
+            if (atomic_compare_exchange_strong(&root->queue_write, &pos,
+                                               pos + 1))
+                break;
+        } else if (diff < 0) {
+            // Still contains the entry from LOG_QUEUE_SIZE positions before.
+            return false;
+        } else {
+            // Claimed by another producer in the meantime.
+            pos = atomic_load(&root->queue_write);
+        }
+    }
+
+    init_entry(&slot->entry, log, lev, text, len);
+    atomic_store(&slot->seq, pos + 1);
+
+    if (atomic_load(&root->logger_waiting)) {
+        pthread_mutex_lock(&root->queue_lock);
+        pthread_cond_signal(&root->queue_cond);
+        pthread_mutex_unlock(&root->queue_lock);
+    }
+    return true;
+}
+
+// Output a notice for messages that were dropped because the queue was full.
+// Called with root->lock held.
+static void write_dropped(struct mp_log_root *root)
+{
+    unsigned long dropped = atomic_exchange(&root->queue_dropped, 0);
+    if (!dropped)
+        return;
+    char text[80];
+    int len = snprintf(text, sizeof(text), "Log message queue overflow: "
+                       "%lu messages skipped.\n", dropped);
+    struct log_entry e;
+    init_entry(&e, root->global->log, MSGL_WARN, text, len);
+    write_entry(root, &e);
+    talloc_free(e.alloc);
+}
+
+static void *logger_thread(void *p)
+{
+    struct mp_log_root *root = p;
+
+    mpthread_set_name("logger");
+
+    unsigned long pos = atomic_load(&root->queue_read);
+
+    while (1) {
+        struct log_slot *slot = &root->queue[pos % LOG_QUEUE_SIZE];
+
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != pos + 1) {
+            pthread_mutex_lock(&root->queue_lock);
+            atomic_store(&root->logger_waiting, true);
+            while (atomic_load(&slot->seq) != pos + 1 && !root->logger_terminate)
+                pthread_cond_wait(&root->queue_cond, &root->queue_lock);
+            atomic_store(&root->logger_waiting, false);
+            // Exit only once the queue is empty.
+            bool terminate = atomic_load(&slot->seq) != pos + 1;
+            pthread_mutex_unlock(&root->queue_lock);
+            if (terminate)
                 break;
-            char *next = &end[1];
-            char saved = next[0];
-            next[0] = '\0';
-            print_terminal_line(log, lev, text, "");
-            write_msg_to_buffers(log, lev, text);
-            next[0] = saved;
-            text = next;
         }
 
-        if (lev == MSGL_STATUS) {
-            if (text[0])
-                print_terminal_line(log, lev, text, "\r");
-        } else if (text[0]) {
-            int size = strlen(text) + 1;
-            if (talloc_get_size(log->partial) < size)
-                log->partial = talloc_realloc(NULL, log->partial, char, size);
-            memcpy(log->partial, text, size);
+        // Output all entries that are ready at once (but not too many, so
+        // that callers of flush_queue() are woken up in time).
+        pthread_mutex_lock(&root->lock);
+        for (int n = 0; n < LOG_QUEUE_SIZE / 4; n++) {
+            slot = &root->queue[pos % LOG_QUEUE_SIZE];
+            if (n && atomic_load_explicit(&slot->seq, memory_order_acquire) !=
+                     pos + 1)
+                break;
+            write_entry(root, &slot->entry);
+            talloc_free(slot->entry.alloc);
+            atomic_store(&slot->seq, pos + LOG_QUEUE_SIZE);
+            pos += 1;
+        }
+        write_dropped(root);
+        unlock_and_wakeup(root);
+        atomic_store(&root->queue_read, pos);
+
+        if (atomic_load(&root->queue_waiters)) {
+            pthread_mutex_lock(&root->queue_lock);
+            pthread_cond_broadcast(&root->queue_done_cond);
+            pthread_mutex_unlock(&root->queue_lock);
         }
     }
 
-    pthread_mutex_unlock(&root->lock);
+    return NULL;
+}
+
+static void write_msg(struct mp_log_root *root, struct mp_log *log, int lev,
+                      const char *text, size_t len)
+{
+    if (root->logger_active) {
+        bool queued = queue_push(root, log, lev, text, len);
+        // Make sure it's visible if the caller is going to abort().
+        if (lev == MSGL_FATAL)
+            flush_queue(root);
+        if (queued)
+            return;
+        if (lev != MSGL_FATAL) {
+            atomic_fetch_add(&root->queue_dropped, 1);
+            return;
+        }
+        // Never drop fatal messages; output them directly instead.
+    }
+
+    struct log_entry e;
+    init_entry(&e, log, lev, text, len);
+    pthread_mutex_lock(&root->lock);
+    write_entry(root, &e);
+    unlock_and_wakeup(root);
+    talloc_free(e.alloc);
+}
+
+void mp_msg_va(struct mp_log *log, int lev, const char *format, va_list va)
+{
+    if (!mp_msg_test(log, lev))
+        return; // do not display
+
+    struct mp_log_root *root = log->root;
+
+    // Doesn't need the lock, and avoids formatting in most cases.
+    if (lev == MSGL_STATS) {
+        if (root->stats_file)
+            mp_stats_file_record(root->stats_file, format, va);
+        return;
+    }
+
+    // Format on the stack; the text is copied into the queue anyway.
+    char buf[LOG_ENTRY_BUF];
+    char *text = buf;
+    va_list copy;
+    va_copy(copy, va);
+    int len = vsnprintf(buf, sizeof(buf), format, copy);
+    va_end(copy);
+    if (len < 0)
+        return;
+    if (len >= sizeof(buf))
+        text = talloc_vasprintf(NULL, format, va);
+
+    // Normally we require full lines; buffer partial lines if they happen.
+    if (lev != MSGL_STATUS && (!len || text[len - 1] != '\n' ||
+        atomic_load_explicit(&log->has_partial, memory_order_relaxed)))
+    {
+        pthread_mutex_lock(&root->partial_lock);
+        char *full = talloc_asprintf(NULL, "%s%s", log->partial, text);
+        char *end = strrchr(full, '\n');
+        size_t full_len = end ? end - full + 1 : 0;
+        char *rest = full + full_len;
+        size_t size = strlen(rest) + 1;
+        if (talloc_get_size(log->partial) < size)
+            log->partial = talloc_realloc(NULL, log->partial, char, size);
+        memcpy(log->partial, rest, size);
+        atomic_store(&log->has_partial, !!rest[0]);
+        if (full_len)
+            write_msg(root, log, lev, full, full_len);
+        pthread_mutex_unlock(&root->partial_lock);
+        talloc_free(full);
+    } else {
+        write_msg(root, log, lev, text, len);
+    }
+
+    if (text != buf)
+        talloc_free(text);
 }
 
 static void destroy_log(void *ptr)
@@ -517,77 +786,26 @@ void mp_msg_init(struct mpv_global *global)
     };
 
     pthread_mutex_init(&root->lock, NULL);
-    pthread_mutex_init(&root->log_file_lock, NULL);
-    pthread_cond_init(&root->log_file_wakeup, NULL);
+    pthread_mutex_init(&root->partial_lock, NULL);
+    pthread_mutex_init(&root->queue_lock, NULL);
+    pthread_mutex_init(&root->wakeup_lock, NULL);
+    pthread_cond_init(&root->queue_cond, NULL);
+    pthread_cond_init(&root->queue_done_cond, NULL);
+
+    root->queue = talloc_zero_array(root, struct log_slot, LOG_QUEUE_SIZE);
+    for (int n = 0; n < LOG_QUEUE_SIZE; n++)
+        atomic_store(&root->queue[n].seq, n);
+
+    root->stats_file = mp_stats_file_create();
 
     struct mp_log dummy = { .root = root };
     struct mp_log *log = mp_log_new(root, &dummy, "");
 
     global->log = log;
-}
-
-static void *log_file_thread(void *p)
-{
-    struct mp_log_root *root = p;
-
-    mpthread_set_name("log-file");
-
-    pthread_mutex_lock(&root->log_file_lock);
-
-    while (root->log_file_thread_active) {
-        struct mp_log_buffer_entry *e =
-            mp_msg_log_buffer_read(root->log_file_buffer);
-        if (e) {
-            pthread_mutex_unlock(&root->log_file_lock);
-            fprintf(root->log_file, "[%8.3f][%c][%s] %s",
-                    (mp_time_us() - MP_START_TIME) / 1e6,
-                    mp_log_levels[e->level][0], e->prefix, e->text);
-            fflush(root->log_file);
-            pthread_mutex_lock(&root->log_file_lock);
-            talloc_free(e);
-            // Multiple threads might be blocked if the log buffer was full.
-            pthread_cond_broadcast(&root->log_file_wakeup);
-        } else {
-            pthread_cond_wait(&root->log_file_wakeup, &root->log_file_lock);
-        }
-    }
-
-    pthread_mutex_unlock(&root->log_file_lock);
 
-    return NULL;
-}
-
-static void wakeup_log_file(void *p)
-{
-    struct mp_log_root *root = p;
-
-    pthread_mutex_lock(&root->log_file_lock);
-    pthread_cond_broadcast(&root->log_file_wakeup);
-    pthread_mutex_unlock(&root->log_file_lock);
-}
-
-// Only to be called from the main thread.
-static void terminate_log_file_thread(struct mp_log_root *root)
-{
-    bool wait_terminate = false;
-
-    pthread_mutex_lock(&root->log_file_lock);
-    if (root->log_file_thread_active) {
-        root->log_file_thread_active = false;
-        pthread_cond_broadcast(&root->log_file_wakeup);
-        wait_terminate = true;
-    }
-    pthread_mutex_unlock(&root->log_file_lock);
-
-    if (wait_terminate)
-        pthread_join(root->log_file_thread, NULL);
-
-    mp_msg_log_buffer_destroy(root->log_file_buffer);
-    root->log_file_buffer = NULL;
-
-    if (root->log_file)
-        fclose(root->log_file);
-    root->log_file = NULL;
+    // If this fails, messages are output directly by the logging thread.
+    root->logger_active =
+        !pthread_create(&root->logger_thread, NULL, logger_thread, root);
 }
 
 // If opt is different from *current_path, update *current_path and return true.
@@ -620,6 +838,9 @@ void mp_msg_update_msglevels(struct mpv_global *global, struct MPOpts *opts)
 {
     struct mp_log_root *root = global->log->root;
 
+    // Messages logged before this call are output with the old settings.
+    flush_queue(root);
+
     pthread_mutex_lock(&root->lock);
 
     root->verbose = opts->verbose;
@@ -637,41 +858,38 @@ void mp_msg_update_msglevels(struct mpv_global *global, struct MPOpts *opts)
     pthread_mutex_unlock(&root->lock);
 
     if (check_new_path(global, opts->log_file, &root->log_path)) {
-        terminate_log_file_thread(root);
+        FILE *log_file = NULL;
         if (root->log_path) {
-            root->log_file = fopen(root->log_path, "wb");
-            if (root->log_file) {
-                root->log_file_buffer =
-                    mp_msg_log_buffer_new(global, 100, MP_LOG_BUFFER_MSGL_LOGFILE,
-                                          wakeup_log_file, root);
-                root->log_file_thread_active = true;
-                if (pthread_create(&root->log_file_thread, NULL, log_file_thread,
-                                   root))
-                {
-                    root->log_file_thread_active = false;
-                    terminate_log_file_thread(root);
-                }
-            } else {
+            log_file = fopen(root->log_path, "wb");
+            if (!log_file) {
                 mp_err(global->log, "Failed to open log file '%s'\n",
                        root->log_path);
             }
         }
+
+        // The logger thread writes to the log file with the lock held.
+        flush_queue(root);
+        pthread_mutex_lock(&root->lock);
+        FILE *old_log_file = root->log_file;
+        root->log_file = log_file;
+        atomic_fetch_add(&root->reload_counter, 1);
+        pthread_mutex_unlock(&root->lock);
+
+        if (old_log_file)
+            fclose(old_log_file);
     }
 
-    if (check_new_path(global, opts->dump_stats, &root->stats_path)) {
-        bool open_error = false;
+    if (check_new_path(global, opts->dump_stats, &root->stats_path) &&
+        root->stats_file)
+    {
+        bool ok = mp_stats_file_set_path(root->stats_file, root->stats_path);
 
         pthread_mutex_lock(&root->lock);
-        if (root->stats_file)
-            fclose(root->stats_file);
-        root->stats_file = NULL;
-        if (root->stats_path) {
-            root->stats_file = fopen(root->stats_path, "wb");
-            open_error = !root->stats_file;
-        }
+        root->stats_enabled = ok && root->stats_path;
+        atomic_fetch_add(&root->reload_counter, 1);
         pthread_mutex_unlock(&root->lock);
 
-        if (open_error) {
+        if (!ok) {
             mp_err(global->log, "Failed to open stats file '%s'\n",
                    root->stats_path);
         }
@@ -682,6 +900,7 @@ void mp_msg_force_stderr(struct mpv_global *global, bool force_stderr)
 {
     struct mp_log_root *root = global->log->root;
 
+    flush_queue(root);
     pthread_mutex_lock(&root->lock);
     root->force_stderr = force_stderr;
     pthread_mutex_unlock(&root->lock);
@@ -695,20 +914,37 @@ bool mp_msg_has_log_file(struct mpv_global *global)
     return !!root->log_file;
 }
 
+// Wait until all messages logged before this call have been output.
+void mp_msg_flush(struct mpv_global *global)
+{
+    flush_queue(global->log->root);
+}
+
 void mp_msg_uninit(struct mpv_global *global)
 {
     struct mp_log_root *root = global->log->root;
-    terminate_log_file_thread(root);
+    if (root->logger_active) {
+        pthread_mutex_lock(&root->queue_lock);
+        root->logger_terminate = true;
+        pthread_cond_signal(&root->queue_cond);
+        pthread_mutex_unlock(&root->queue_lock);
+        pthread_join(root->logger_thread, NULL);
+        root->logger_active = false;
+    }
+    if (root->log_file)
+        fclose(root->log_file);
     mp_msg_log_buffer_destroy(root->early_buffer);
     assert(root->num_buffers == 0);
-    if (root->stats_file)
-        fclose(root->stats_file);
+    mp_stats_file_destroy(root->stats_file);
     talloc_free(root->stats_path);
     talloc_free(root->log_path);
     m_option_type_msglevels.free(&root->msg_levels);
     pthread_mutex_destroy(&root->lock);
-    pthread_mutex_destroy(&root->log_file_lock);
-    pthread_cond_destroy(&root->log_file_wakeup);
+    pthread_mutex_destroy(&root->partial_lock);
+    pthread_mutex_destroy(&root->queue_lock);
+    pthread_mutex_destroy(&root->wakeup_lock);
+    pthread_cond_destroy(&root->queue_cond);
+    pthread_cond_destroy(&root->queue_done_cond);
     talloc_free(root);
     global->log = NULL;
 }
@@ -814,14 +1050,18 @@ void mp_msg_log_buffer_destroy(struct mp_log_buffer *buffer)
 
 found:
 
+    atomic_fetch_add(&root->reload_counter, 1);
+    pthread_mutex_unlock(&root->lock);
+
+    // Wait until a concurrent unlock_and_wakeup() is done with the callback.
+    pthread_mutex_lock(&root->wakeup_lock);
+    pthread_mutex_unlock(&root->wakeup_lock);
+
     while (buffer->num_entries)
         talloc_free(log_buffer_read(buffer));
 
     pthread_mutex_destroy(&buffer->lock);
     talloc_free(buffer);
-
-    atomic_fetch_add(&root->reload_counter, 1);
-    pthread_mutex_unlock(&root->lock);
 }
 
 // Return a queued message, or if the buffer is empty, NULL.
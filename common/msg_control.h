@@ -12,6 +12,7 @@ void mp_msg_force_stderr(struct mpv_global *global, bool force_stderr);
 bool mp_msg_has_status_line(struct mpv_global *global);
 bool mp_msg_has_log_file(struct mpv_global *global);
 void mp_msg_set_early_logging(struct mpv_global *global, bool enable);
+void mp_msg_flush(struct mpv_global *global);
 
 void mp_msg_flush_status_line(struct mp_log *log);
 void mp_msg_set_term_title(struct mp_log *log, const char *title);
@@ -24,8 +25,6 @@ struct mp_log_buffer_entry {
 
 // Use --msg-level option for log level of this log buffer
 #define MP_LOG_BUFFER_MSGL_TERM (MSGL_MAX + 1)
-// For --log-file; --msg-level, but at least MSGL_DEBUG
-#define MP_LOG_BUFFER_MSGL_LOGFILE (MSGL_MAX + 2)
 
 struct mp_log_buffer;
 struct mp_log_buffer *mp_msg_log_buffer_new(struct mpv_global *global,
@@ -16,6 +16,8 @@
  */
 
 #include <assert.h>
+#include <string.h>
+
 #include "config.h"
 #include "playlist.h"
 #include "common/common.h"
@@ -27,11 +29,25 @@
 #include "demux/demux.h"
 #include "stream/stream.h"
 
+// The filename is normally stored in the same allocation as the entry, which
+// halves the number of allocations when reading big playlists.
+static bool filename_is_inline(struct playlist_entry *e)
+{
+    return e->filename == (char *)(e + 1);
+}
+
 struct playlist_entry *playlist_entry_new(const char *filename)
 {
-    struct playlist_entry *e = talloc_zero(NULL, struct playlist_entry);
+    size_t len = strlen(filename);
+    struct playlist_entry *e =
+        talloc_zero_size(NULL, sizeof(struct playlist_entry) + len + 1);
     char *local_filename = mp_file_url_to_filename(e, bstr0(filename));
-    e->filename = local_filename ? local_filename : talloc_strdup(e, filename);
+    if (local_filename) {
+        e->filename = local_filename;
+    } else {
+        e->filename = (char *)(e + 1);
+        memcpy(e->filename, filename, len + 1);
+    }
     e->stream_flags = STREAM_ORIGIN_DIRECT;
     e->original_index = -1;
     return e;
@@ -51,22 +67,175 @@ void playlist_entry_add_params(struct playlist_entry *e,
         playlist_entry_add_param(e, params[n].name, params[n].value);
 }
 
-static void playlist_update_indexes(struct playlist *pl, int start, int end)
+// The entries are stored in a treap with implicit keys: the position of an
+// entry is the number of entries preceding it in an in-order traversal, and
+// each node caches the size of its subtree. Random priorities keep the tree
+// balanced with high probability, so all operations by index are O(log n).
+
+static int t_size(struct playlist_entry *e)
+{
+    return e ? e->t_size : 0;
+}
+
+static void t_set_child(struct playlist_entry *e, int dir,
+                        struct playlist_entry *child)
+{
+    e->t_child[dir] = child;
+    if (child)
+        child->t_parent = e;
+}
+
+static struct playlist_entry *t_update(struct playlist_entry *e)
+{
+    e->t_size = 1 + t_size(e->t_child[0]) + t_size(e->t_child[1]);
+    return e;
+}
+
+static struct playlist_entry *t_root(struct playlist_entry *e)
+{
+    if (e)
+        e->t_parent = NULL;
+    return e;
+}
+
+static void t_reset(struct playlist_entry *e)
+{
+    e->t_parent = e->t_child[0] = e->t_child[1] = NULL;
+    e->t_size = 1;
+}
+
+// Derive the priority from the (unique) ID (splitmix64 finalizer).
+static void t_set_prio(struct playlist_entry *e)
+{
+    uint64_t x = e->id;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    e->t_prio = (x ^ (x >> 31)) >> 32;
+}
+
+// Concatenate the trees a and b. Returns the new root (with a stale parent).
+static struct playlist_entry *t_merge(struct playlist_entry *a,
+                                      struct playlist_entry *b)
+{
+    if (!a || !b)
+        return a ? a : b;
+    if (a->t_prio > b->t_prio) {
+        t_set_child(a, 1, t_merge(a->t_child[1], b));
+        return t_update(a);
+    } else {
+        t_set_child(b, 0, t_merge(a, b->t_child[0]));
+        return t_update(b);
+    }
+}
+
+// Split t into the first n entries (*a) and the remaining ones (*b).
+static void t_split(struct playlist_entry *t, int n,
+                    struct playlist_entry **a, struct playlist_entry **b)
+{
+    if (!t) {
+        *a = *b = NULL;
+        return;
+    }
+    struct playlist_entry *sub;
+    int left = t_size(t->t_child[0]);
+    if (n <= left) {
+        t_split(t->t_child[0], n, a, &sub);
+        t_set_child(t, 0, sub);
+        *b = t_update(t);
+    } else {
+        t_split(t->t_child[1], n - left - 1, &sub, b);
+        t_set_child(t, 1, sub);
+        *a = t_update(t);
+    }
+}
+
+static void t_fix_sizes(struct playlist_entry *e)
+{
+    if (!e)
+        return;
+    t_fix_sizes(e->t_child[0]);
+    t_fix_sizes(e->t_child[1]);
+    t_update(e);
+}
+
+// Build a tree from entries[0..num-1] (in this order) in linear time. This
+// keeps the rightmost path of the tree on a stack (Cartesian tree algorithm).
+static struct playlist_entry *t_build(struct playlist_entry **entries, int num)
+{
+    struct playlist_entry **stack = talloc_array(NULL, struct playlist_entry *,
+                                                 num);
+    int depth = 0;
+    for (int n = 0; n < num; n++) {
+        struct playlist_entry *e = entries[n];
+        struct playlist_entry *last = NULL;
+        t_reset(e);
+        while (depth && stack[depth - 1]->t_prio < e->t_prio)
+            last = stack[--depth];
+        t_set_child(e, 0, last);
+        if (depth)
+            t_set_child(stack[depth - 1], 1, e);
+        stack[depth++] = e;
+    }
+    struct playlist_entry *root = t_root(depth ? stack[0] : NULL);
+    talloc_free(stack);
+    t_fix_sizes(root);
+    return root;
+}
+
+static int t_index(struct playlist_entry *e)
+{
+    int index = t_size(e->t_child[0]);
+    for (; e->t_parent; e = e->t_parent) {
+        if (e->t_parent->t_child[1] == e)
+            index += t_size(e->t_parent->t_child[0]) + 1;
+    }
+    return index;
+}
+
+// Insert the tree sub so that its first entry ends up at the given index.
+static void t_insert(struct playlist *pl, int index, struct playlist_entry *sub)
+{
+    struct playlist_entry *a, *b;
+    t_split(pl->root, index, &a, &b);
+    pl->root = t_root(t_merge(t_merge(a, sub), b));
+}
+
+static void t_remove(struct playlist *pl, struct playlist_entry *e)
 {
-    start = MPMAX(start, 0);
-    end = end < 0 ? pl->num_entries : MPMIN(end, pl->num_entries);
+    struct playlist_entry *sub = t_merge(e->t_child[0], e->t_child[1]);
+    struct playlist_entry *parent = e->t_parent;
+    if (parent) {
+        t_set_child(parent, parent->t_child[1] == e, sub);
+        for (struct playlist_entry *p = parent; p; p = p->t_parent)
+            p->t_size -= 1;
+    } else {
+        pl->root = t_root(sub);
+    }
+    t_reset(e);
+}
 
-    for (int n = start; n < end; n++)
-        pl->entries[n]->pl_index = n;
+// Return all entries in playlist order. Free the result with talloc_free().
+static struct playlist_entry **get_entries(struct playlist *pl)
+{
+    struct playlist_entry **entries =
+        talloc_array(NULL, struct playlist_entry *, pl->num_entries);
+    int num = 0;
+    for (struct playlist_entry *e = playlist_get_first(pl); e;
+         e = playlist_entry_get_rel(e, 1))
+        entries[num++] = e;
+    assert(num == pl->num_entries);
+    return entries;
 }
 
 void playlist_add(struct playlist *pl, struct playlist_entry *add)
 {
     assert(add->filename);
-    MP_TARRAY_APPEND(pl, pl->entries, pl->num_entries, add);
     add->pl = pl;
-    add->pl_index = pl->num_entries - 1;
     add->id = ++pl->id_alloc;
+    t_set_prio(add);
+    t_reset(add);
+    t_insert(pl, pl->num_entries, add);
+    pl->num_entries += 1;
     talloc_steal(pl, add);
 }
 
@@ -88,11 +257,10 @@ void playlist_remove(struct playlist *pl, struct playlist_entry *entry)
         pl->current_was_replaced = true;
     }
 
-    MP_TARRAY_REMOVE_AT(pl->entries, pl->num_entries, entry->pl_index);
-    playlist_update_indexes(pl, entry->pl_index, -1);
+    t_remove(pl, entry);
+    pl->num_entries -= 1;
 
     entry->pl = NULL;
-    entry->pl_index = -1;
     ta_set_parent(entry, NULL);
 
     entry->removed = true;
@@ -101,17 +269,21 @@ void playlist_remove(struct playlist *pl, struct playlist_entry *entry)
 
 void playlist_clear(struct playlist *pl)
 {
-    for (int n = pl->num_entries - 1; n >= 0; n--)
-        playlist_remove(pl, pl->entries[n]);
+    struct playlist_entry *e;
+    while ((e = playlist_get_last(pl)))
+        playlist_remove(pl, e);
     assert(!pl->current);
     pl->current_was_replaced = false;
 }
 
 void playlist_clear_except_current(struct playlist *pl)
 {
-    for (int n = pl->num_entries - 1; n >= 0; n--) {
-        if (pl->entries[n] != pl->current)
-            playlist_remove(pl, pl->entries[n]);
+    struct playlist_entry *e = playlist_get_last(pl);
+    while (e) {
+        struct playlist_entry *prev = playlist_entry_get_rel(e, -1);
+        if (e != pl->current)
+            playlist_remove(pl, e);
+        e = prev;
     }
 }
 
@@ -125,16 +297,8 @@ void playlist_move(struct playlist *pl, struct playlist_entry *entry,
     assert(entry && entry->pl == pl);
     assert(!at || at->pl == pl);
 
-    int index = at ? at->pl_index : pl->num_entries;
-    MP_TARRAY_INSERT_AT(pl, pl->entries, pl->num_entries, index, entry);
-
-    int old_index = entry->pl_index;
-    if (old_index >= index)
-        old_index += 1;
-    MP_TARRAY_REMOVE_AT(pl->entries, pl->num_entries, old_index);
-
-    playlist_update_indexes(pl, MPMIN(index - 1, old_index - 1),
-                                MPMAX(index + 1, old_index + 1));
+    t_remove(pl, entry);
+    t_insert(pl, at ? t_index(at) : pl->num_entries - 1, entry);
 }
 
 void playlist_add_file(struct playlist *pl, const char *filename)
@@ -144,44 +308,68 @@ void playlist_add_file(struct playlist *pl, const char *filename)
 
 void playlist_shuffle(struct playlist *pl)
 {
+    struct playlist_entry **entries = get_entries(pl);
     for (int n = 0; n < pl->num_entries; n++)
-        pl->entries[n]->original_index = n;
+        entries[n]->original_index = n;
     for (int n = 0; n < pl->num_entries - 1; n++) {
         int j = (int)((double)(pl->num_entries - n) * rand() / (RAND_MAX + 1.0));
-        MPSWAP(struct playlist_entry *, pl->entries[n], pl->entries[n + j]);
+        MPSWAP(struct playlist_entry *, entries[n], entries[n + j]);
     }
-    playlist_update_indexes(pl, 0, -1);
+    pl->root = t_build(entries, pl->num_entries);
+    talloc_free(entries);
 }
 
 #define CMP_INT(a, b) ((a) == (b) ? 0 : ((a) > (b) ? 1 : -1))
 
+struct unshuffle_item {
+    struct playlist_entry *e;
+    int index;
+};
+
 static int cmp_unshuffle(const void *a, const void *b)
 {
-    struct playlist_entry *ea = *(struct playlist_entry **)a;
-    struct playlist_entry *eb = *(struct playlist_entry **)b;
+    const struct unshuffle_item *ia = a;
+    const struct unshuffle_item *ib = b;
+    int oa = ia->e->original_index, ob = ib->e->original_index;
 
-    if (ea->original_index >= 0 && ea->original_index != eb->original_index)
-        return CMP_INT(ea->original_index, eb->original_index);
-    return CMP_INT(ea->pl_index, eb->pl_index);
+    if (oa >= 0 && oa != ob)
+        return CMP_INT(oa, ob);
+    return CMP_INT(ia->index, ib->index);
 }
 
 void playlist_unshuffle(struct playlist *pl)
 {
+    struct playlist_entry **entries = get_entries(pl);
+    struct unshuffle_item *items =
+        talloc_array(NULL, struct unshuffle_item, pl->num_entries);
+    for (int n = 0; n < pl->num_entries; n++)
+        items[n] = (struct unshuffle_item){entries[n], n};
     if (pl->num_entries)
-        qsort(pl->entries, pl->num_entries, sizeof(pl->entries[0]), cmp_unshuffle);
-    playlist_update_indexes(pl, 0, -1);
+        qsort(items, pl->num_entries, sizeof(items[0]), cmp_unshuffle);
+    for (int n = 0; n < pl->num_entries; n++)
+        entries[n] = items[n].e;
+    pl->root = t_build(entries, pl->num_entries);
+    talloc_free(items);
+    talloc_free(entries);
+}
+
+static struct playlist_entry *t_outermost(struct playlist_entry *e, int dir)
+{
+    while (e && e->t_child[dir])
+        e = e->t_child[dir];
+    return e;
 }
 
 // (Explicitly ignores current_was_replaced.)
 struct playlist_entry *playlist_get_first(struct playlist *pl)
 {
-    return pl->num_entries ? pl->entries[0] : NULL;
+    return t_outermost(pl->root, 0);
 }
 
 // (Explicitly ignores current_was_replaced.)
 struct playlist_entry *playlist_get_last(struct playlist *pl)
 {
-    return pl->num_entries ? pl->entries[pl->num_entries - 1] : NULL;
+    return t_outermost(pl->root, 1);
 }
 
 struct playlist_entry *playlist_get_next(struct playlist *pl, int direction)
@@ -203,18 +391,25 @@ struct playlist_entry *playlist_entry_get_rel(struct playlist_entry *e,
     assert(direction == -1 || direction == +1);
     if (!e->pl)
         return NULL;
-    return playlist_entry_from_index(e->pl, e->pl_index + direction);
+    int dir = direction > 0;
+    if (e->t_child[dir])
+        return t_outermost(e->t_child[dir], !dir);
+    while (e->t_parent && e->t_parent->t_child[dir] == e)
+        e = e->t_parent;
+    return e->t_parent;
 }
 
 void playlist_add_base_path(struct playlist *pl, bstr base_path)
 {
     if (base_path.len == 0 || bstrcmp0(base_path, ".") == 0)
         return;
-    for (int n = 0; n < pl->num_entries; n++) {
-        struct playlist_entry *e = pl->entries[n];
+    for (struct playlist_entry *e = playlist_get_first(pl); e;
+         e = playlist_entry_get_rel(e, 1))
+    {
         if (!mp_is_url(bstr0(e->filename))) {
             char *new_file = mp_path_join_bstr(e, base_path, bstr0(e->filename));
-            talloc_free(e->filename);
+            if (!filename_is_inline(e))
+                talloc_free(e->filename);
             e->filename = new_file;
         }
     }
@@ -223,8 +418,9 @@ void playlist_add_base_path(struct playlist *pl, bstr base_path)
 // Add redirected_from as new redirect entry to each item in pl.
 void playlist_add_redirect(struct playlist *pl, const char *redirected_from)
 {
-    for (int n = 0; n < pl->num_entries; n++) {
-        struct playlist_entry *e = pl->entries[n];
+    for (struct playlist_entry *e = playlist_get_first(pl); e;
+         e = playlist_entry_get_rel(e, 1))
+    {
         if (e->num_redirects >= 10) // arbitrary limit for sanity
             continue;
         char *s = talloc_strdup(e, redirected_from);
@@ -235,29 +431,35 @@ void playlist_add_redirect(struct playlist *pl, const char *redirected_from)
 
 void playlist_set_stream_flags(struct playlist *pl, int flags)
 {
-    for (int n = 0; n < pl->num_entries; n++)
-        pl->entries[n]->stream_flags = flags;
+    for (struct playlist_entry *e = playlist_get_first(pl); e;
+         e = playlist_entry_get_rel(e, 1))
+        e->stream_flags = flags;
 }
 
-static int64_t playlist_transfer_entries_to(struct playlist *pl, int dst_index,
-                                            struct playlist *source_pl)
+// Move all entries from source_pl to pl, inserting them so that the first entry
+// ends up at dst_index. See playlist_transfer_entries() for the return value.
+int64_t playlist_transfer_entries_to(struct playlist *pl, int dst_index,
+                                     struct playlist *source_pl)
 {
     assert(pl != source_pl);
     struct playlist_entry *first = playlist_get_first(source_pl);
 
     int count = source_pl->num_entries;
-    MP_TARRAY_INSERT_N_AT(pl, pl->entries, pl->num_entries, dst_index, count);
+    struct playlist_entry **entries = get_entries(source_pl);
 
     for (int n = 0; n < count; n++) {
-        struct playlist_entry *e = source_pl->entries[n];
+        struct playlist_entry *e = entries[n];
         e->pl = pl;
-        e->pl_index = dst_index + n;
         e->id = ++pl->id_alloc;
-        pl->entries[e->pl_index] = e;
+        t_set_prio(e);
         talloc_steal(pl, e);
     }
 
-    playlist_update_indexes(pl, dst_index + count, -1);
+    t_insert(pl, dst_index, t_build(entries, count));
+    pl->num_entries += count;
+    talloc_free(entries);
+
+    source_pl->root = NULL;
     source_pl->num_entries = 0;
 
     return first ? first->id : 0;
@@ -273,7 +475,7 @@ int64_t playlist_transfer_entries(struct playlist *pl, struct playlist *source_p
 
     int add_at = pl->num_entries;
     if (pl->current) {
-        add_at = pl->current->pl_index + 1;
+        add_at = t_index(pl->current) + 1;
         if (pl->current_was_replaced)
             add_at += 1;
     }
@@ -294,7 +496,7 @@ int playlist_entry_to_index(struct playlist *pl, struct playlist_entry *e)
 {
     if (!e || e->pl != pl)
         return -1;
-    return e->pl_index;
+    return t_index(e);
 }
 
 int playlist_entry_count(struct playlist *pl)
@@ -306,7 +508,20 @@ int playlist_entry_count(struct playlist *pl)
 // Return NULL if not found.
 struct playlist_entry *playlist_entry_from_index(struct playlist *pl, int index)
 {
-    return index >= 0 && index < pl->num_entries ? pl->entries[index] : NULL;
+    if (index < 0 || index >= pl->num_entries)
+        return NULL;
+    struct playlist_entry *e = pl->root;
+    while (1) {
+        int left = t_size(e->t_child[0]);
+        if (index == left)
+            return e;
+        if (index < left) {
+            e = e->t_child[0];
+        } else {
+            index -= left + 1;
+            e = e->t_child[1];
+        }
+    }
 }
 
 struct playlist *playlist_parse_file(const char *file, struct mp_cancel *cancel,
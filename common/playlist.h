@@ -26,9 +26,15 @@ struct playlist_param {
 };
 
 struct playlist_entry {
-    // Invariant: (pl && pl->entries[pl_index] == this) || (!pl && pl_index < 0)
+    // Playlist this entry is part of, or NULL.
     struct playlist *pl;
-    int pl_index;
+
+    // Order statistics tree node (private to playlist.c). Entries are stored
+    // in a treap keyed by position, with t_size the number of entries in the
+    // subtree. This makes lookups and updates by index O(log n).
+    struct playlist_entry *t_parent, *t_child[2];
+    int t_size;
+    uint32_t t_prio;
 
     uint64_t id;
 
@@ -44,7 +50,7 @@ struct playlist_entry {
     char **redirects;
     int num_redirects;
 
-    // Used for unshuffling: the pl_index before it was shuffled. -1 => unknown.
+    // Used for unshuffling: the index before it was shuffled. -1 => unknown.
     int original_index;
 
     // Set to true if playback didn't seem to work, or if the file could be
@@ -65,7 +71,9 @@ struct playlist_entry {
 };
 
 struct playlist {
-    struct playlist_entry **entries;
+    // Root of the entry tree. Use playlist_get_first()/playlist_entry_get_rel()
+    // or playlist_entry_from_index() to access entries.
+    struct playlist_entry *root;
     int num_entries;
 
     // This provides some sort of stable iterator. If this entry is removed from
@@ -104,6 +112,8 @@ void playlist_add_base_path(struct playlist *pl, bstr base_path);
 void playlist_add_redirect(struct playlist *pl, const char *redirected_from);
 void playlist_set_stream_flags(struct playlist *pl, int flags);
 int64_t playlist_transfer_entries(struct playlist *pl, struct playlist *source_pl);
+int64_t playlist_transfer_entries_to(struct playlist *pl, int dst_index,
+                                     struct playlist *source_pl);
 int64_t playlist_append_entries(struct playlist *pl, struct playlist *source_pl);
 
 int playlist_entry_to_index(struct playlist *pl, struct playlist_entry *e);
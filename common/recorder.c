@@ -16,6 +16,7 @@
  */
 
 #include <math.h>
+#include <pthread.h>
 
 #include <libavformat/avformat.h>
 
@@ -26,6 +27,8 @@
 #include "demux/demux.h"
 #include "demux/packet.h"
 #include "demux/stheader.h"
+#include "osdep/atomic.h"
+#include "osdep/threads.h"
 
 #include "recorder.h"
 
@@ -37,6 +40,11 @@
 // codec delay and frame reordering, and potentially lack of DTS).
 // Keyframe flags can trigger this earlier.
 #define QUEUE_MIN_PACKETS 16
+// Maximum number of packets and bytes queued for the writer thread. If writing
+// is slower than this can absorb, feeding packets blocks. (Must be a power of
+// 2.)
+#define WRITE_QUEUE_PACKETS 4096
+#define WRITE_QUEUE_BYTES (64 * 1024 * 1024)
 
 struct mp_recorder {
     struct mpv_global *global;
@@ -58,6 +66,23 @@ struct mp_recorder {
     double rebase_ts;
 
     AVFormatContext *mux;
+
+    // Writer thread. Packets are queued by the thread feeding the recorder
+    // (there is only one at a time), and the writer thread is the only reader,
+    // so the queue needs no lock. The lock is only used for sleeping.
+    pthread_t writer;
+    bool writer_active;
+    AVPacket **write_queue;             // WRITE_QUEUE_PACKETS entries
+    mp_atomic_uint64 write_head;        // next entry written by the feeder
+    mp_atomic_uint64 write_tail;        // next entry read by the writer
+    mp_atomic_int64 write_bytes;        // payload bytes in the queue
+    atomic_bool writer_waiting;
+    atomic_bool feeder_waiting;
+    atomic_bool write_failed;
+    bool overflow_warning;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool terminate;                     // protected by lock
 };
 
 struct mp_recorder_sink {
@@ -117,6 +142,91 @@ static int add_stream(struct mp_recorder *priv, struct sh_stream *sh)
     return 0;
 }
 
+static bool write_queue_empty(struct mp_recorder *priv)
+{
+    return atomic_load(&priv->write_head) == atomic_load(&priv->write_tail);
+}
+
+static bool write_queue_full(struct mp_recorder *priv, int size)
+{
+    uint64_t used = atomic_load(&priv->write_head) -
+                    atomic_load(&priv->write_tail);
+    int64_t bytes = atomic_load(&priv->write_bytes);
+    return used >= WRITE_QUEUE_PACKETS ||
+           (used && bytes + size > WRITE_QUEUE_BYTES);
+}
+
+static void wakeup_locked(struct mp_recorder *priv)
+{
+    pthread_mutex_lock(&priv->lock);
+    pthread_cond_broadcast(&priv->wakeup);
+    pthread_mutex_unlock(&priv->lock);
+}
+
+static void *writer_thread(void *p)
+{
+    struct mp_recorder *priv = p;
+
+    mpthread_set_name("recorder");
+
+    while (1) {
+        if (write_queue_empty(priv)) {
+            pthread_mutex_lock(&priv->lock);
+            atomic_store(&priv->writer_waiting, true);
+            // Recheck after announcing it, so a wakeup can't be missed.
+            while (write_queue_empty(priv) && !priv->terminate)
+                pthread_cond_wait(&priv->wakeup, &priv->lock);
+            atomic_store(&priv->writer_waiting, false);
+            bool terminate = priv->terminate && write_queue_empty(priv);
+            pthread_mutex_unlock(&priv->lock);
+            if (terminate)
+                break;
+            continue;
+        }
+
+        uint64_t tail = atomic_load(&priv->write_tail);
+        AVPacket *pkt = priv->write_queue[tail & (WRITE_QUEUE_PACKETS - 1)];
+        int size = pkt->size;
+
+        // This takes over the packet reference.
+        if (av_interleaved_write_frame(priv->mux, pkt) < 0 &&
+            !atomic_exchange(&priv->write_failed, true))
+            MP_ERR(priv, "Failed writing packet.\n");
+        av_packet_free(&pkt);
+
+        atomic_fetch_add(&priv->write_bytes, -size);
+        atomic_store(&priv->write_tail, tail + 1);
+        if (atomic_load(&priv->feeder_waiting))
+            wakeup_locked(priv);
+    }
+
+    return NULL;
+}
+
+// Queue the packet for the writer thread. Takes over ownership of pkt.
+static void queue_packet(struct mp_recorder *priv, AVPacket *pkt)
+{
+    if (write_queue_full(priv, pkt->size)) {
+        if (!priv->overflow_warning) {
+            MP_WARN(priv, "Writing the output file is too slow, waiting.\n");
+            priv->overflow_warning = true;
+        }
+        pthread_mutex_lock(&priv->lock);
+        atomic_store(&priv->feeder_waiting, true);
+        while (write_queue_full(priv, pkt->size))
+            pthread_cond_wait(&priv->wakeup, &priv->lock);
+        atomic_store(&priv->feeder_waiting, false);
+        pthread_mutex_unlock(&priv->lock);
+    }
+
+    uint64_t head = atomic_load(&priv->write_head);
+    priv->write_queue[head & (WRITE_QUEUE_PACKETS - 1)] = pkt;
+    atomic_fetch_add(&priv->write_bytes, pkt->size);
+    atomic_store(&priv->write_head, head + 1);
+    if (atomic_load(&priv->writer_waiting))
+        wakeup_locked(priv);
+}
+
 struct mp_recorder *mp_recorder_create(struct mpv_global *global,
                                        const char *target_file,
                                        struct sh_stream **streams,
@@ -128,6 +238,8 @@ struct mp_recorder *mp_recorder_create(struct mpv_global *global,
 
     priv->global = global;
     priv->log = mp_log_new(priv, global->log, "recorder");
+    pthread_mutex_init(&priv->lock, NULL);
+    pthread_cond_init(&priv->wakeup, NULL);
 
     if (!num_streams) {
         MP_ERR(priv, "No streams.\n");
@@ -201,6 +313,13 @@ struct mp_recorder *mp_recorder_create(struct mpv_global *global,
     priv->opened = true;
     priv->muxing_from_start = true;
 
+    priv->write_queue = talloc_zero_array(priv, AVPacket *, WRITE_QUEUE_PACKETS);
+    if (pthread_create(&priv->writer, NULL, writer_thread, priv)) {
+        MP_ERR(priv, "Could not create writer thread.\n");
+        goto error;
+    }
+    priv->writer_active = true;
+
     priv->base_ts = MP_NOPTS_VALUE;
     priv->rebase_ts = 0;
 
@@ -245,14 +364,15 @@ static void mux_packet(struct mp_recorder_sink *rst,
     if (avpkt.duration < 0 && rst->sh->type != STREAM_SUB)
         avpkt.duration = 0;
 
+    // New reference to the packet data (only copied if the demux packet has
+    // no refcounted buffer).
     AVPacket *new_packet = av_packet_clone(&avpkt);
     if (!new_packet) {
         MP_ERR(priv, "Failed to allocate packet.\n");
         return;
     }
 
-    if (av_interleaved_write_frame(priv->mux, new_packet) < 0)
-        MP_ERR(priv, "Failed writing packet.\n");
+    queue_packet(priv, new_packet);
 }
 
 // Write all packets available in the stream queue
@@ -320,7 +440,17 @@ void mp_recorder_destroy(struct mp_recorder *priv)
             struct mp_recorder_sink *rst = priv->streams[n];
             mux_packets(rst);
         }
+    }
+
+    if (priv->writer_active) {
+        pthread_mutex_lock(&priv->lock);
+        priv->terminate = true;
+        pthread_cond_broadcast(&priv->wakeup);
+        pthread_mutex_unlock(&priv->lock);
+        pthread_join(priv->writer, NULL);
+    }
 
+    if (priv->opened) {
         if (av_write_trailer(priv->mux) < 0)
             MP_ERR(priv, "Writing trailer failed.\n");
     }
@@ -333,6 +463,8 @@ void mp_recorder_destroy(struct mp_recorder *priv)
     }
 
     flush_packets(priv);
+    pthread_cond_destroy(&priv->wakeup);
+    pthread_mutex_destroy(&priv->lock);
     talloc_free(priv);
 }
 
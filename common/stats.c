@@ -27,6 +27,25 @@ struct stats_base {
     int num_entries;
 
     int64_t last_time;
+
+    // Trace recording (stats_trace_start()).
+    atomic_bool tracing;
+    int64_t trace_start;
+    struct trace_event *trace;
+    int num_trace;
+    pthread_t *trace_threads;
+    int num_trace_threads;
+};
+
+// Limits memory use if tracing is left enabled.
+#define MAX_TRACE_EVENTS 50000
+
+struct trace_event {
+    char cat[32];       // stats_ctx.prefix
+    char name[32];      // stat_entry.name
+    char ph;            // Chrome trace event type ('B', 'E', 'i')
+    int tid;            // index into stats_base.trace_threads
+    int64_t ts;
 };
 
 struct stats_ctx {
@@ -48,6 +67,41 @@ enum val_type {
     VAL_INC,
     VAL_TIME,
     VAL_THREAD_CPU_TIME,
+    VAL_HIST,
+};
+
+// Latency histogram: 4 buckets per power of 2 (values 0-3 get one bucket each),
+// so percentiles are accurate to about 25%. Covers up to ~70 minutes in us.
+#define HIST_BUCKETS 128
+
+struct stats_handle {
+    struct stats_ctx *ctx;
+    struct stat_entry *e;
+
+    // Written by the owner thread only, read in stats_global_query().
+    atomic_int type;                // enum val_type, set on first use
+    mp_atomic_uint64 count;
+    mp_atomic_uint64 sum_rt;        // VAL_TIME: real time in us
+    mp_atomic_uint64 sum_th;        // VAL_TIME: thread CPU time in ns
+    mp_atomic_uint64 max;           // VAL_HIST: largest sample
+    mp_atomic_uint64 hist[HIST_BUCKETS];
+
+    // Owner thread only.
+    int64_t time_start_us;
+    int64_t cpu_start_ns;
+
+    // Values at the previous query (protected by stats_base.lock).
+    uint64_t last_count, last_rt, last_th;
+    uint64_t last_hist[HIST_BUCKETS];
+};
+
+// A thread inside stats_span_begin()/stats_span_end() of an entry. Spans with
+// the same name can be entered by several threads at once.
+struct span_state {
+    pthread_t thread;
+    int depth;
+    int64_t time_start_us;
+    int64_t cpu_start_ns;
 };
 
 struct stat_entry {
@@ -60,12 +114,23 @@ struct stat_entry {
     int64_t val_th;
     int64_t time_start_us;
     int64_t cpu_start_ns;
+    struct span_state *spans;
+    int num_spans;
     pthread_t thread;
+
+    // Per-thread handles aggregated into this entry (stats_handle_create()).
+    struct stats_handle **handles;
+    int num_handles;
+    uint64_t hist[HIST_BUCKETS];    // VAL_HIST: summed delta since last query
+    uint64_t hist_max;
 };
 
 #define IS_ACTIVE(ctx) \
     (atomic_load_explicit(&(ctx)->base->active, memory_order_relaxed))
 
+#define IS_TRACING(ctx) \
+    (atomic_load_explicit(&(ctx)->base->tracing, memory_order_relaxed))
+
 // Overflows only after I'm dead.
 static int64_t get_thread_cpu_time_ns(pthread_t thread)
 {
@@ -122,6 +187,81 @@ static int cmp_entry(const void *p1, const void *p2)
     return strcmp((*e1)->full_name, (*e2)->full_name);
 }
 
+static int hist_bucket(uint64_t v)
+{
+    if (v < 4)
+        return v;
+    int exp = v > UINT32_MAX ? 32 : mp_log2(v);
+    int idx = 4 * (exp - 1) + ((v >> (exp - 2)) & 3);
+    return MPMIN(idx, HIST_BUCKETS - 1);
+}
+
+// Smallest value which falls into bucket idx.
+static uint64_t hist_bucket_start(int idx)
+{
+    if (idx < 4)
+        return idx;
+    return (uint64_t)(4 + idx % 4) << (idx / 4 - 1);
+}
+
+// Upper bound of the given percentile (0-100) of the samples.
+static double hist_percentile(struct stat_entry *e, uint64_t total, double p)
+{
+    uint64_t want = MPMAX((uint64_t)(total * p / 100 + 0.5), 1);
+    uint64_t cur = 0;
+    for (int n = 0; n < HIST_BUCKETS; n++) {
+        cur += e->hist[n];
+        if (cur >= want)
+            return MPMIN(hist_bucket_start(n + 1), e->hist_max);
+    }
+    return e->hist_max;
+}
+
+// Add the changes since the last query from all handles to the entry.
+static void collect_handles(struct stat_entry *e)
+{
+    for (int n = 0; n < e->num_handles; n++) {
+        struct stats_handle *h = e->handles[n];
+
+        int type = atomic_load(&h->type);
+        if (type == VAL_UNSET)
+            continue;
+
+        uint64_t count = atomic_load(&h->count);
+        uint64_t d_count = count - h->last_count;
+        h->last_count = count;
+        if (!d_count)
+            continue;
+
+        e->type = type;
+        switch (type) {
+        case VAL_INC:
+            e->val_d += d_count;
+            break;
+        case VAL_TIME: {
+            uint64_t rt = atomic_load(&h->sum_rt);
+            uint64_t th = atomic_load(&h->sum_th);
+            e->val_rt += rt - h->last_rt;
+            e->val_th += th - h->last_th;
+            h->last_rt = rt;
+            h->last_th = th;
+            break;
+        }
+        case VAL_HIST:
+            for (int i = 0; i < HIST_BUCKETS; i++) {
+                uint64_t v = atomic_load(&h->hist[i]);
+                e->hist[i] += v - h->last_hist[i];
+                h->last_hist[i] = v;
+            }
+            uint64_t max = atomic_exchange(&h->max, 0);
+            e->hist_max = MPMAX(e->hist_max, max);
+            e->val_d += d_count;
+            break;
+        default: ;
+        }
+    }
+}
+
 void stats_global_query(struct mpv_global *global, struct mpv_node *out)
 {
     struct stats_base *stats = global->stats;
@@ -173,6 +313,8 @@ void stats_global_query(struct mpv_global *global, struct mpv_node *out)
     for (int n = 0; n < stats->num_entries; n++) {
         struct stat_entry *e = stats->entries[n];
 
+        collect_handles(e);
+
         switch (e->type) {
         case VAL_STATIC:
             add_stat(out, e, NULL, e->val_d, NULL);
@@ -204,6 +346,22 @@ void stats_global_query(struct mpv_global *global, struct mpv_node *out)
             e->cpu_start_ns = t;
             break;
         }
+        case VAL_HIST: {
+            uint64_t total = e->val_d;
+            static const double pcts[] = {50, 95, 99};
+            for (int i = 0; i < MP_ARRAY_SIZE(pcts); i++) {
+                double t = hist_percentile(e, total, pcts[i]) / 1e3;
+                add_stat(out, e, mp_tprintf(8, "p%d", (int)pcts[i]), t,
+                         mp_tprintf(80, "%.2f ms", t));
+            }
+            double t_max = e->hist_max / 1e3;
+            add_stat(out, e, "max", t_max, mp_tprintf(80, "%.2f ms", t_max));
+            add_stat(out, e, "count", total, NULL);
+            e->val_d = 0;
+            e->hist_max = 0;
+            memset(e->hist, 0, sizeof(e->hist));
+            break;
+        }
         default: ;
         }
     }
@@ -240,6 +398,28 @@ struct stats_ctx *stats_ctx_create(void *ta_parent, struct mpv_global *global,
     return ctx;
 }
 
+// Must be called with base->lock held.
+static void trace_add(struct stats_ctx *ctx, struct stat_entry *e, char ph)
+{
+    struct stats_base *base = ctx->base;
+    if (!atomic_load_explicit(&base->tracing, memory_order_relaxed) ||
+        base->num_trace >= MAX_TRACE_EVENTS)
+        return;
+
+    pthread_t self = pthread_self();
+    int tid = 0;
+    while (tid < base->num_trace_threads &&
+           !pthread_equal(base->trace_threads[tid], self))
+        tid++;
+    if (tid == base->num_trace_threads)
+        MP_TARRAY_APPEND(base, base->trace_threads, base->num_trace_threads, self);
+
+    struct trace_event ev = {.ph = ph, .tid = tid, .ts = mp_time_us()};
+    snprintf(ev.cat, sizeof(ev.cat), "%s", ctx->prefix);
+    snprintf(ev.name, sizeof(ev.name), "%s", e->name);
+    MP_TARRAY_APPEND(base, base->trace, base->num_trace, ev);
+}
+
 static struct stat_entry *find_entry(struct stats_ctx *ctx, const char *name)
 {
     for (int n = 0; n < ctx->num_entries; n++) {
@@ -284,19 +464,20 @@ void stats_size_value(struct stats_ctx *ctx, const char *name, double val)
 void stats_time_start(struct stats_ctx *ctx, const char *name)
 {
     MP_STATS(ctx->base->global, "start %s", name);
-    if (!IS_ACTIVE(ctx))
+    if (!IS_ACTIVE(ctx) && !IS_TRACING(ctx))
         return;
     pthread_mutex_lock(&ctx->base->lock);
     struct stat_entry *e = find_entry(ctx, name);
     e->cpu_start_ns = get_thread_cpu_time_ns(pthread_self());
     e->time_start_us = mp_time_us();
+    trace_add(ctx, e, 'B');
     pthread_mutex_unlock(&ctx->base->lock);
 }
 
 void stats_time_end(struct stats_ctx *ctx, const char *name)
 {
     MP_STATS(ctx->base->global, "end %s", name);
-    if (!IS_ACTIVE(ctx))
+    if (!IS_ACTIVE(ctx) && !IS_TRACING(ctx))
         return;
     pthread_mutex_lock(&ctx->base->lock);
     struct stat_entry *e = find_entry(ctx, name);
@@ -305,10 +486,119 @@ void stats_time_end(struct stats_ctx *ctx, const char *name)
         e->val_rt += mp_time_us() - e->time_start_us;
         e->val_th += get_thread_cpu_time_ns(pthread_self()) - e->cpu_start_ns;
         e->time_start_us = 0;
+        trace_add(ctx, e, 'E');
+    }
+    pthread_mutex_unlock(&ctx->base->lock);
+}
+
+// Return the index of the calling thread's span state, or -1.
+static int find_span(struct stat_entry *e)
+{
+    for (int n = 0; n < e->num_spans; n++) {
+        if (pthread_equal(e->spans[n].thread, pthread_self()))
+            return n;
+    }
+    return -1;
+}
+
+void stats_span_begin(struct stats_ctx *ctx, const char *name)
+{
+    MP_STATS(ctx->base->global, "start %s", name);
+    pthread_mutex_lock(&ctx->base->lock);
+    struct stat_entry *e = find_entry(ctx, name);
+    int i = find_span(e);
+    if (i < 0) {
+        // Only the outermost span of a recursion is accounted.
+        struct span_state st = {
+            .thread = pthread_self(),
+            .time_start_us = mp_time_us(),
+            .cpu_start_ns = get_thread_cpu_time_ns(pthread_self()),
+        };
+        i = e->num_spans;
+        MP_TARRAY_APPEND(e, e->spans, e->num_spans, st);
     }
+    e->spans[i].depth += 1;
+    trace_add(ctx, e, 'B');
     pthread_mutex_unlock(&ctx->base->lock);
 }
 
+void stats_span_end(struct stats_ctx *ctx, const char *name)
+{
+    MP_STATS(ctx->base->global, "end %s", name);
+    pthread_mutex_lock(&ctx->base->lock);
+    struct stat_entry *e = find_entry(ctx, name);
+    int i = find_span(e);
+    if (i >= 0 && --e->spans[i].depth == 0) {
+        struct span_state *st = &e->spans[i];
+        e->type = VAL_TIME;
+        e->val_rt += mp_time_us() - st->time_start_us;
+        e->val_th += get_thread_cpu_time_ns(pthread_self()) - st->cpu_start_ns;
+        MP_TARRAY_REMOVE_AT(e->spans, e->num_spans, i);
+    }
+    trace_add(ctx, e, 'E');
+    pthread_mutex_unlock(&ctx->base->lock);
+}
+
+void stats_trace_mark(struct stats_ctx *ctx, const char *name)
+{
+    if (!IS_TRACING(ctx))
+        return;
+    pthread_mutex_lock(&ctx->base->lock);
+    trace_add(ctx, find_entry(ctx, name), 'i');
+    pthread_mutex_unlock(&ctx->base->lock);
+}
+
+void stats_trace_start(struct mpv_global *global)
+{
+    struct stats_base *stats = global->stats;
+    pthread_mutex_lock(&stats->lock);
+    if (!atomic_load(&stats->tracing)) {
+        stats->trace_start = mp_time_us();
+        atomic_store(&stats->tracing, true);
+    }
+    pthread_mutex_unlock(&stats->lock);
+}
+
+bool stats_trace_stop(struct mpv_global *global, void *ta_parent,
+                      struct mpv_node *out)
+{
+    struct stats_base *stats = global->stats;
+    pthread_mutex_lock(&stats->lock);
+
+    bool was_tracing = atomic_load(&stats->tracing);
+    atomic_store(&stats->tracing, false);
+
+    if (was_tracing && out) {
+        node_init(out, MPV_FORMAT_NODE_MAP, NULL);
+        struct mpv_node *list =
+            node_map_add(out, "traceEvents", MPV_FORMAT_NODE_ARRAY);
+        for (int n = 0; n < stats->num_trace; n++) {
+            struct trace_event *ev = &stats->trace[n];
+            struct mpv_node *ne = node_array_add(list, MPV_FORMAT_NODE_MAP);
+            node_map_add_string(ne, "name", ev->name);
+            node_map_add_string(ne, "cat", ev->cat);
+            node_map_add_string(ne, "ph", (char[2]){ev->ph});
+            node_map_add_int64(ne, "ts", ev->ts - stats->trace_start);
+            node_map_add_int64(ne, "pid", 0);
+            node_map_add_int64(ne, "tid", ev->tid);
+            if (ev->ph == 'i')
+                node_map_add_string(ne, "s", "p");
+        }
+        node_map_add_string(out, "displayTimeUnit", "ms");
+        if (stats->num_trace >= MAX_TRACE_EVENTS)
+            node_map_add_flag(out, "truncated", true);
+        talloc_steal(ta_parent, out->u.list);
+    }
+
+    TA_FREEP(&stats->trace);
+    stats->num_trace = 0;
+    TA_FREEP(&stats->trace_threads);
+    stats->num_trace_threads = 0;
+
+    pthread_mutex_unlock(&stats->lock);
+    return was_tracing;
+}
+
 void stats_event(struct stats_ctx *ctx, const char *name)
 {
     if (!IS_ACTIVE(ctx))
@@ -339,3 +629,69 @@ void stats_unregister_thread(struct stats_ctx *ctx, const char *name)
 {
     register_thread(ctx, name, 0);
 }
+
+struct stats_handle *stats_handle_create(struct stats_ctx *ctx, const char *name)
+{
+    pthread_mutex_lock(&ctx->base->lock);
+    struct stat_entry *e = find_entry(ctx, name);
+    struct stats_handle *h = talloc_zero(ctx, struct stats_handle);
+    h->ctx = ctx;
+    h->e = e;
+    MP_TARRAY_APPEND(e, e->handles, e->num_handles, h);
+    pthread_mutex_unlock(&ctx->base->lock);
+    return h;
+}
+
+static void handle_set_type(struct stats_handle *h, enum val_type type)
+{
+    if (atomic_load_explicit(&h->type, memory_order_relaxed) != type)
+        atomic_store(&h->type, type);
+}
+
+// Single writer, so no atomic read-modify-write is needed. The reader only
+// needs to see each value eventually, so no ordering is needed either.
+static void handle_add(mp_atomic_uint64 *v, uint64_t add)
+{
+    uint64_t cur = atomic_load_explicit(v, memory_order_relaxed);
+    atomic_store_explicit(v, cur + add, memory_order_relaxed);
+}
+
+void stats_handle_event(struct stats_handle *h)
+{
+    if (!IS_ACTIVE(h->ctx))
+        return;
+    handle_set_type(h, VAL_INC);
+    handle_add(&h->count, 1);
+}
+
+void stats_handle_time_start(struct stats_handle *h)
+{
+    if (!IS_ACTIVE(h->ctx))
+        return;
+    h->cpu_start_ns = get_thread_cpu_time_ns(pthread_self());
+    h->time_start_us = mp_time_us();
+}
+
+void stats_handle_time_end(struct stats_handle *h)
+{
+    if (!h->time_start_us)
+        return;
+    handle_set_type(h, VAL_TIME);
+    handle_add(&h->sum_rt, mp_time_us() - h->time_start_us);
+    handle_add(&h->sum_th,
+               get_thread_cpu_time_ns(pthread_self()) - h->cpu_start_ns);
+    handle_add(&h->count, 1);
+    h->time_start_us = 0;
+}
+
+void stats_handle_latency(struct stats_handle *h, int64_t us)
+{
+    if (!IS_ACTIVE(h->ctx))
+        return;
+    uint64_t v = MPMAX(us, 0);
+    handle_set_type(h, VAL_HIST);
+    handle_add(&h->hist[hist_bucket(v)], 1);
+    if (v > atomic_load_explicit(&h->max, memory_order_relaxed))
+        atomic_store_explicit(&h->max, v, memory_order_relaxed);
+    handle_add(&h->count, 1);
+}
@@ -1,8 +1,12 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
+
 struct mpv_global;
 struct mpv_node;
 struct stats_ctx;
+struct stats_handle;
 
 void stats_global_init(struct mpv_global *global);
 void stats_global_query(struct mpv_global *global, struct mpv_node *out);
@@ -22,9 +26,48 @@ void stats_size_value(struct stats_ctx *ctx, const char *name, double val);
 void stats_time_start(struct stats_ctx *ctx, const char *name);
 void stats_time_end(struct stats_ctx *ctx, const char *name);
 
+// Like stats_time_start()/stats_time_end(), but spans can be nested (including
+// recursively with the same name), and are always recorded if tracing is
+// enabled. Each _begin call must be matched by an _end call on the same thread.
+// Several threads can be in a span with the same name at the same time; each
+// span is accounted separately.
+// Meant for coarse, infrequent operations, such as initialization phases.
+void stats_span_begin(struct stats_ctx *ctx, const char *name);
+void stats_span_end(struct stats_ctx *ctx, const char *name);
+
+// Record a point in time if tracing is enabled.
+void stats_trace_mark(struct stats_ctx *ctx, const char *name);
+
+// Start recording spans, stats_time_*() calls and marks as trace events.
+void stats_trace_start(struct mpv_global *global);
+
+// Stop recording and drop the recorded events. If out is not NULL, return
+// them in the Chrome trace event format ({"traceEvents": [...]}), allocated
+// under ta_parent. Returns false (and leaves out untouched) if tracing was
+// not enabled.
+bool stats_trace_stop(struct mpv_global *global, void *ta_parent,
+                      struct mpv_node *out);
+
 // Display number of events per poll period.
 void stats_event(struct stats_ctx *ctx, const char *name);
 
+// For hot paths: a handle refers to an entry looked up once, and the
+// stats_handle_*() functions only update memory owned by the handle, without
+// locking or name lookups. The values are collected in stats_global_query().
+// A handle must not be used by several threads at once. If several threads
+// update the same entry, each uses its own handle, and the values are summed.
+// Handles are freed with the stats_ctx.
+struct stats_handle *stats_handle_create(struct stats_ctx *ctx, const char *name);
+
+// Like stats_event(), stats_time_start() and stats_time_end().
+void stats_handle_event(struct stats_handle *h);
+void stats_handle_time_start(struct stats_handle *h);
+void stats_handle_time_end(struct stats_handle *h);
+
+// Add a sample (in microseconds) to a histogram. The 50th, 95th and 99th
+// percentile, maximum and number of the samples per poll period are reported.
+void stats_handle_latency(struct stats_handle *h, int64_t us);
+
 // Report the thread's CPU time. This needs to be called only once per thread.
 // The current thread is assumed to stay valid until the stats_ctx is destroyed
 // or stats_unregister_thread() is called, otherwise UB will occur.
@@ -0,0 +1,402 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "common.h"
+#include "misc/bstr.h"
+#include "mpv_talloc.h"
+#include "osdep/atomic.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
+#include "stats_file.h"
+
+#define RING_SIZE 8192          // records per thread (power of 2)
+#define NAME_CACHE_SIZE 64      // per thread (power of 2)
+#define FLUSH_INTERVAL 0.05     // seconds
+
+struct name_cache_entry {
+    const char *ptr;            // name as passed by the caller
+    const char *name;           // interned copy
+    uint32_t index;
+};
+
+struct ring {
+    atomic_bool dead;           // owner thread has exited
+    atomic_bool busy;           // owner thread is recording a message
+    uint32_t tid;
+    // Written by the owner thread only.
+    mp_atomic_uint64 head;
+    mp_atomic_uint64 dropped;
+    uint64_t cached_tail;       // owner thread only, avoids reading tail
+    struct name_cache_entry names[NAME_CACHE_SIZE]; // owner thread only
+    char pad0[64];              // keep tail on a different cache line
+    // Written by the writer only.
+    mp_atomic_uint64 tail;
+    uint64_t dropped_written;
+    char pad1[64];
+    struct mp_stats_record recs[RING_SIZE];
+};
+
+struct mp_stats_file {
+    pthread_key_t key;          // struct ring of the current thread
+    atomic_bool enabled;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    // --- protected by lock
+    struct ring **rings;
+    int num_rings;
+    uint32_t next_tid;
+    char **names;               // interned names, array index is name index
+    int num_names;
+    bstr pending;               // NAME and TEXT records not written yet
+    bool terminate;
+    // --- mp_stats_file_set_path() caller only
+    bool thread_valid;
+    pthread_t thread;
+    FILE *file;                 // used by the writer while it is running
+};
+
+static void ring_thread_exit(void *p)
+{
+    struct ring *r = p;
+    atomic_store(&r->dead, true);
+}
+
+struct mp_stats_file *mp_stats_file_create(void)
+{
+    struct mp_stats_file *sf = talloc_zero(NULL, struct mp_stats_file);
+    if (pthread_key_create(&sf->key, ring_thread_exit)) {
+        talloc_free(sf);
+        return NULL;
+    }
+    pthread_mutex_init(&sf->lock, NULL);
+    pthread_cond_init(&sf->wakeup, NULL);
+    return sf;
+}
+
+void mp_stats_file_destroy(struct mp_stats_file *sf)
+{
+    if (!sf)
+        return;
+    mp_stats_file_set_path(sf, NULL);
+    // Other threads must have stopped recording, because they could still be
+    // writing into their ring (or use sf) otherwise.
+    for (int n = 0; n < sf->num_rings; n++) {
+        assert(!atomic_load(&sf->rings[n]->busy));
+        talloc_free(sf->rings[n]);
+    }
+    pthread_key_delete(sf->key);
+    pthread_mutex_destroy(&sf->lock);
+    pthread_cond_destroy(&sf->wakeup);
+    talloc_free(sf);
+}
+
+// Must be called with sf->lock held.
+static void add_pending(struct mp_stats_file *sf, int type, uint32_t index,
+                        uint32_t tid, bstr payload)
+{
+    static const char zeros[8];
+    struct mp_stats_record rec = {
+        .ts = mp_time_us(),
+        .id = ((uint32_t)type << 28) | index,
+        .tid = tid,
+        .value = payload.len,
+    };
+    bstr_xappend(sf, &sf->pending, (bstr){(unsigned char *)&rec, sizeof(rec)});
+    bstr_xappend(sf, &sf->pending, payload);
+    bstr_xappend(sf, &sf->pending,
+                 (bstr){(unsigned char *)zeros, -payload.len & 7});
+}
+
+static struct ring *get_ring(struct mp_stats_file *sf)
+{
+    struct ring *r = pthread_getspecific(sf->key);
+    if (r)
+        return r;
+
+    r = talloc_zero(NULL, struct ring);
+    if (pthread_setspecific(sf->key, r)) {
+        talloc_free(r);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&sf->lock);
+    r->tid = sf->next_tid++;
+    MP_TARRAY_APPEND(sf, sf->rings, sf->num_rings, r);
+    pthread_mutex_unlock(&sf->lock);
+    return r;
+}
+
+static uint32_t get_name(struct mp_stats_file *sf, struct ring *r,
+                         const char *name)
+{
+    // The pointer is a cheap hash, but the same buffer can be reused for
+    // different names, so the contents are checked too.
+    uintptr_t hash = (uintptr_t)name;
+    struct name_cache_entry *c =
+        &r->names[(hash ^ (hash >> 7)) & (NAME_CACHE_SIZE - 1)];
+    if (c->ptr == name && strcmp(c->name, name) == 0)
+        return c->index;
+
+    pthread_mutex_lock(&sf->lock);
+    int index = 0;
+    while (index < sf->num_names && strcmp(sf->names[index], name) != 0)
+        index++;
+    if (index == sf->num_names) {
+        MP_TARRAY_APPEND(sf, sf->names, sf->num_names, talloc_strdup(sf, name));
+        add_pending(sf, MP_STATS_NAME, index, r->tid, bstr0(name));
+    }
+    c->ptr = name;
+    c->name = sf->names[index];
+    c->index = index;
+    pthread_mutex_unlock(&sf->lock);
+    return index;
+}
+
+static void push(struct mp_stats_file *sf, struct ring *r, int type,
+                 uint32_t index, double value)
+{
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    uint64_t used = head - r->cached_tail;
+    if (used >= RING_SIZE / 2) {
+        r->cached_tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+        used = head - r->cached_tail;
+        // Flush early if the ring fills up fast. This doesn't need the lock;
+        // if the wakeup is missed, the writer wakes up on its timer anyway.
+        if (used == RING_SIZE / 2)
+            pthread_cond_signal(&sf->wakeup);
+    }
+    if (used >= RING_SIZE) {
+        uint64_t d = atomic_load_explicit(&r->dropped, memory_order_relaxed);
+        atomic_store_explicit(&r->dropped, d + 1, memory_order_relaxed);
+        return;
+    }
+    r->recs[head & (RING_SIZE - 1)] = (struct mp_stats_record){
+        .ts = mp_time_us(),
+        .id = ((uint32_t)type << 28) | index,
+        .tid = r->tid,
+        .value = value,
+    };
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
+
+// Literal names ("start name", "end name", "signal name", or "name" without
+// spaces). Other texts use the forms with explicit timestamps.
+static bool parse_literal(const char *format, int *type, const char **name)
+{
+    static const struct { const char *prefix; int type; } prefixes[] = {
+        {"start ", MP_STATS_START},
+        {"end ", MP_STATS_END},
+        {"signal ", MP_STATS_SIGNAL},
+    };
+    for (int n = 0; n < MP_ARRAY_SIZE(prefixes); n++) {
+        size_t len = strlen(prefixes[n].prefix);
+        if (strncmp(format, prefixes[n].prefix, len) == 0) {
+            *type = prefixes[n].type;
+            *name = format + len;
+            return true;
+        }
+    }
+    *type = MP_STATS_SIGNAL;
+    *name = format;
+    return !strchr(format, ' ');
+}
+
+static void record(struct mp_stats_file *sf, struct ring *r,
+                   const char *format, va_list va)
+{
+    int type = 0;
+    const char *name = NULL;
+    double value = 0;
+    if (strcmp(format, "start %s") == 0) {
+        type = MP_STATS_START;
+        name = va_arg(va, const char *);
+    } else if (strcmp(format, "end %s") == 0) {
+        type = MP_STATS_END;
+        name = va_arg(va, const char *);
+    } else if (strncmp(format, "value %f ", 9) == 0 && !strchr(format + 9, '%')) {
+        type = MP_STATS_VALUE;
+        value = va_arg(va, double);
+        name = format + 9;
+    } else if (!strchr(format, '%') && parse_literal(format, &type, &name)) {
+        // done
+    } else {
+        char text[256];
+        vsnprintf(text, sizeof(text), format, va);
+        pthread_mutex_lock(&sf->lock);
+        add_pending(sf, MP_STATS_TEXT, 0, r->tid, bstr0(text));
+        pthread_mutex_unlock(&sf->lock);
+        return;
+    }
+
+    push(sf, r, type, get_name(sf, r, name), value);
+}
+
+void mp_stats_file_record(struct mp_stats_file *sf, const char *format,
+                          va_list va)
+{
+    if (!atomic_load_explicit(&sf->enabled, memory_order_relaxed))
+        return;
+
+    struct ring *r = get_ring(sf);
+    if (!r)
+        return;
+
+    atomic_store_explicit(&r->busy, true, memory_order_relaxed);
+    record(sf, r, format, va);
+    atomic_store_explicit(&r->busy, false, memory_order_release);
+}
+
+static void drain_ring(struct ring *r, FILE *f)
+{
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    while (tail != head) {
+        uint64_t pos = tail & (RING_SIZE - 1);
+        uint64_t num = MPMIN(head - tail, RING_SIZE - pos);
+        fwrite(&r->recs[pos], sizeof(r->recs[0]), num, f);
+        tail += num;
+    }
+    atomic_store_explicit(&r->tail, tail, memory_order_release);
+
+    uint64_t dropped = atomic_load(&r->dropped);
+    if (dropped != r->dropped_written) {
+        struct mp_stats_record rec = {
+            .ts = mp_time_us(),
+            .id = (uint32_t)MP_STATS_DROPPED << 28,
+            .tid = r->tid,
+            .value = dropped - r->dropped_written,
+        };
+        fwrite(&rec, sizeof(rec), 1, f);
+        r->dropped_written = dropped;
+    }
+}
+
+static void *writer_thread(void *p)
+{
+    struct mp_stats_file *sf = p;
+    mpthread_set_name("stats-file");
+
+    struct ring **rings = NULL;
+    int num_rings = 0;
+
+    pthread_mutex_lock(&sf->lock);
+    while (1) {
+        bool terminate = sf->terminate;
+        bstr pending = sf->pending;
+        sf->pending = (bstr){0};
+        num_rings = 0;
+        for (int n = 0; n < sf->num_rings; n++)
+            MP_TARRAY_APPEND(NULL, rings, num_rings, sf->rings[n]);
+        pthread_mutex_unlock(&sf->lock);
+
+        if (pending.len)
+            fwrite(pending.start, pending.len, 1, sf->file);
+        talloc_free(pending.start);
+
+        bool have_dead = false;
+        for (int n = 0; n < num_rings; n++) {
+            // Read dead first, so that all records pushed before the thread
+            // exited are written.
+            bool dead = atomic_load(&rings[n]->dead);
+            drain_ring(rings[n], sf->file);
+            have_dead |= dead;
+            if (!dead)
+                rings[n] = NULL;
+        }
+        fflush(sf->file);
+
+        pthread_mutex_lock(&sf->lock);
+        for (int n = 0; have_dead && n < num_rings; n++) {
+            if (!rings[n])
+                continue;
+            for (int i = 0; i < sf->num_rings; i++) {
+                if (sf->rings[i] == rings[n]) {
+                    MP_TARRAY_REMOVE_AT(sf->rings, sf->num_rings, i);
+                    break;
+                }
+            }
+            talloc_free(rings[n]);
+        }
+
+        if (terminate)
+            break;
+        if (!sf->terminate) {
+            struct timespec ts =
+                mp_time_us_to_timespec(mp_add_timeout(mp_time_us(), FLUSH_INTERVAL));
+            pthread_cond_timedwait(&sf->wakeup, &sf->lock, &ts);
+        }
+    }
+    pthread_mutex_unlock(&sf->lock);
+
+    talloc_free(rings);
+    return NULL;
+}
+
+bool mp_stats_file_set_path(struct mp_stats_file *sf, const char *path)
+{
+    atomic_store(&sf->enabled, false);
+
+    if (sf->thread_valid) {
+        pthread_mutex_lock(&sf->lock);
+        sf->terminate = true;
+        pthread_cond_signal(&sf->wakeup);
+        pthread_mutex_unlock(&sf->lock);
+        pthread_join(sf->thread, NULL);
+        sf->thread_valid = false;
+        fclose(sf->file);
+        sf->file = NULL;
+    }
+
+    if (!path)
+        return true;
+
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+
+    struct mp_stats_file_header header = {
+        .magic = MP_STATS_FILE_MAGIC,
+        .version = MP_STATS_FILE_VERSION,
+        .record_size = sizeof(struct mp_stats_record),
+    };
+    fwrite(&header, sizeof(header), 1, f);
+
+    pthread_mutex_lock(&sf->lock);
+    sf->terminate = false;
+    // A new file needs all names again.
+    talloc_free(sf->pending.start);
+    sf->pending = (bstr){0};
+    for (int n = 0; n < sf->num_names; n++)
+        add_pending(sf, MP_STATS_NAME, n, 0, bstr0(sf->names[n]));
+    pthread_mutex_unlock(&sf->lock);
+
+    sf->file = f;
+    if (pthread_create(&sf->thread, NULL, writer_thread, sf)) {
+        fclose(f);
+        sf->file = NULL;
+        return false;
+    }
+    sf->thread_valid = true;
+
+    atomic_store(&sf->enabled, true);
+    return true;
+}
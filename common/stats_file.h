@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Binary format written by --dump-stats. All fields use native byte order.
+// TOOLS/stats-conv.py and TOOLS/stats-trace.py read it.
+//
+// The file starts with struct mp_stats_file_header, followed by records. Each
+// record is a struct mp_stats_record, possibly followed by payload bytes. The
+// payload is padded with 0 bytes to a multiple of 8 bytes. Records are
+// grouped by thread, so they are not necessarily sorted by time. A name can be
+// defined after the first record using it.
+
+#define MP_STATS_FILE_MAGIC "mpvstats"
+#define MP_STATS_FILE_VERSION 1
+
+struct mp_stats_file_header {
+    char magic[8];              // MP_STATS_FILE_MAGIC (not 0-terminated)
+    uint32_t version;           // MP_STATS_FILE_VERSION
+    uint32_t record_size;       // sizeof(struct mp_stats_record)
+};
+
+enum mp_stats_record_type {
+    // Event records. "id" is the event name index.
+    MP_STATS_SIGNAL = 1,        // MP_STATS(log, "name")
+    MP_STATS_START,             // MP_STATS(log, "start name")
+    MP_STATS_END,               // MP_STATS(log, "end name")
+    MP_STATS_VALUE,             // MP_STATS(log, "value %f name", value)
+    // Defines the name for index "id". "value" is the string length; the
+    // string is the payload.
+    MP_STATS_NAME,
+    // Any other MP_STATS() call. "value" is the length of the formatted text,
+    // which is the payload. "id" is unused.
+    MP_STATS_TEXT,
+    // "value" records of the thread were lost because the file was not
+    // written fast enough. "id" is unused.
+    MP_STATS_DROPPED,
+};
+
+struct mp_stats_record {
+    int64_t ts;                 // mp_time_us()
+    uint32_t id;                // bits 0-27: name index; 28-31: record type
+    uint32_t tid;               // index of the thread that created the record
+    double value;
+};
+
+#define MP_STATS_RECORD_TYPE(id) ((id) >> 28)
+#define MP_STATS_RECORD_INDEX(id) ((id) & ((1 << 28) - 1))
+
+struct mp_stats_file;
+
+// Recorder for MP_STATS() messages. Each thread appends to its own lock-free
+// ring buffer, which is written to the file by a separate thread.
+struct mp_stats_file *mp_stats_file_create(void);
+// Other threads must not record messages during or after this call (e.g. they
+// have been joined, like for logging with mp_msg_uninit()).
+void mp_stats_file_destroy(struct mp_stats_file *sf);
+
+// Start writing to the given file (truncated), or stop writing if path is
+// NULL. Returns false if the file could not be opened.
+bool mp_stats_file_set_path(struct mp_stats_file *sf, const char *path);
+
+// Record a MP_STATS() message. Messages which use the forms documented in
+// enum mp_stats_record_type are recorded without formatting or locking.
+void mp_stats_file_record(struct mp_stats_file *sf, const char *format,
+                          va_list va);
@@ -17,6 +17,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -58,6 +59,10 @@ struct demux_cache {
 
     char *filename;
     bool need_unlink;
+
+    // Protects the file position, so that packets can be read by a thread
+    // other than the one writing them.
+    pthread_mutex_t lock;
     int fd;
     int64_t file_pos;
     uint64_t file_size;
@@ -85,6 +90,8 @@ static void cache_destroy(void *p)
         if (unlink(cache->filename))
             MP_ERR(cache, "Failed to delete cache temporary file.\n");
     }
+
+    pthread_mutex_destroy(&cache->lock);
 }
 
 // Create a cache. This also initializes the cache file from the options. The
@@ -94,6 +101,7 @@ struct demux_cache *demux_cache_create(struct mpv_global *global,
                                        struct mp_log *log)
 {
     struct demux_cache *cache = talloc_zero(NULL, struct demux_cache);
+    pthread_mutex_init(&cache->lock, NULL);
     talloc_set_destructor(cache, cache_destroy);
     cache->opts = mp_get_config_group(cache, global, &demux_cache_conf);
     cache->log = log;
@@ -128,7 +136,10 @@ fail:
 
 uint64_t demux_cache_get_size(struct demux_cache *cache)
 {
-    return cache->file_size;
+    pthread_mutex_lock(&cache->lock);
+    uint64_t size = cache->file_size;
+    pthread_mutex_unlock(&cache->lock);
+    return size;
 }
 
 static bool do_seek(struct demux_cache *cache, uint64_t pos)
@@ -191,10 +202,7 @@ static bool read_raw(struct demux_cache *cache, void *ptr, size_t len)
     return true;
 }
 
-// Serialize a packet to the cache file. Returns the packet position, which can
-// be passed to demux_cache_read() to read the packet again.
-// Returns a negative value on errors, i.e. writing the file failed.
-int64_t demux_cache_write(struct demux_cache *cache, struct demux_packet *dp)
+static int64_t cache_write(struct demux_cache *cache, struct demux_packet *dp)
 {
     assert(dp->avpacket);
 
@@ -276,7 +284,18 @@ fail:
     return -1;
 }
 
-struct demux_packet *demux_cache_read(struct demux_cache *cache, uint64_t pos)
+// Serialize a packet to the cache file. Returns the packet position, which can
+// be passed to demux_cache_read() to read the packet again.
+// Returns a negative value on errors, i.e. writing the file failed.
+int64_t demux_cache_write(struct demux_cache *cache, struct demux_packet *dp)
+{
+    pthread_mutex_lock(&cache->lock);
+    int64_t pos = cache_write(cache, dp);
+    pthread_mutex_unlock(&cache->lock);
+    return pos;
+}
+
+static struct demux_packet *cache_read(struct demux_cache *cache, uint64_t pos)
 {
     if (!do_seek(cache, pos))
         return NULL;
@@ -322,3 +341,13 @@ fail:
     talloc_free(dp);
     return NULL;
 }
+
+// Read a packet previously written with demux_cache_write(). Written packets
+// are never overwritten, so this can be called from any thread.
+struct demux_packet *demux_cache_read(struct demux_cache *cache, uint64_t pos)
+{
+    pthread_mutex_lock(&cache->lock);
+    struct demux_packet *dp = cache_read(cache, pos);
+    pthread_mutex_unlock(&cache->lock);
+    return dp;
+}
@@ -282,8 +282,8 @@ struct demux_internal {
     bool force_metadata_update;
     int cached_metadata_index;  // speed up repeated lookups
 
-    struct mp_recorder *dumper;
-    int dumper_status;
+    struct demux_dumper *dumper;
+    int dumper_status;      // only if dumper==NULL
 
     bool owns_stream;
 
@@ -406,12 +406,15 @@ struct demux_stream {
     double bitrate;
     struct demux_packet *reader_head;   // points at current decoder position
     bool skip_to_keyframe;
+    bool keyframes_only;    // return only keyframes (trick play)
+    bool keyframe_resync;   // keyframes_only was unset; skip to next keyframe
+    bool keyframe_seen;     // the stream has keyframe flags at all
     bool attached_picture_added;
     bool need_wakeup;       // call wakeup_cb on next reader_head state change
     double force_read_until;// eager=false streams (subs): force read-ahead
 
     // For demux_internal.dumper. Currently, this is used only temporarily
-    // during blocking dumping.
+    // while queuing the cached packets to the dump thread.
     struct demux_packet *dump_pos;
 
     // for refresh seeks: pos/dts of last packet returned to reader
@@ -465,6 +468,8 @@ static struct demux_packet *find_seek_target(struct demux_queue *queue,
                                              double pts, int flags);
 static void prune_old_packets(struct demux_internal *in);
 static void dumper_close(struct demux_internal *in);
+static void dumper_queue_limited(struct demux_dumper *d, struct sh_stream *sh,
+                                 struct demux_packet *dp, bool limit);
 static void demux_convert_tags_charset(struct demuxer *demuxer);
 
 static uint64_t get_foward_buffered_bytes(struct demux_stream *ds)
@@ -832,6 +837,7 @@ static void ds_clear_reader_state(struct demux_stream *ds,
     ds->last_br_bytes = 0;
     ds->bitrate = -1;
     ds->skip_to_keyframe = false;
+    ds->keyframe_resync = false;
     ds->attached_picture_added = false;
     ds->last_ret_pos = -1;
     ds->last_ret_dts = MP_NOPTS_VALUE;
@@ -1962,16 +1968,10 @@ static struct mp_recorder *recorder_create(struct demux_internal *in,
 static void write_dump_packet(struct demux_internal *in, struct demux_packet *dp)
 {
     assert(in->dumper);
-    assert(in->dumper_status == CONTROL_TRUE);
 
-    struct mp_recorder_sink *sink =
-        mp_recorder_get_sink(in->dumper, in->streams[dp->stream]);
-    if (sink) {
-        mp_recorder_feed_packet(sink, dp);
-    } else {
-        MP_ERR(in, "New stream appeared; stopping recording.\n");
-        in->dumper_status = CONTROL_ERROR;
-    }
+    struct demux_packet *new = demux_copy_packet(dp);
+    if (new)
+        dumper_queue_limited(in->dumper, in->streams[dp->stream], new, true);
 }
 
 static void record_packet(struct demux_internal *in, struct demux_packet *dp)
@@ -2001,7 +2001,7 @@ static void record_packet(struct demux_internal *in, struct demux_packet *dp)
         }
     }
 
-    if (in->dumper_status == CONTROL_OK)
+    if (in->dumper)
         write_dump_packet(in, dp);
 }
 
@@ -2063,6 +2063,8 @@ static void add_packet_locked(struct sh_stream *stream, demux_packet_t *dp)
 
     record_packet(in, dp);
 
+    ds->keyframe_seen |= dp->keyframe;
+
     if (in->cache && in->opts->disk_cache) {
         int64_t pos = demux_cache_write(in->cache, dp);
         if (pos >= 0) {
@@ -2666,6 +2668,17 @@ static int dequeue_packet(struct demux_stream *ds, double min_pts,
         return 0;
     }
 
+    // Skip non-keyframes without returning them (or reading them from the
+    // disk cache). If the demuxer does not set keyframe flags, do nothing.
+    if ((ds->keyframes_only || ds->keyframe_resync) && ds->keyframe_seen &&
+        !in->back_demuxing)
+    {
+        while (ds->reader_head && !ds->reader_head->keyframe)
+            advance_reader_head(ds);
+        if (ds->reader_head)
+            ds->keyframe_resync = false;
+    }
+
     bool eof = !ds->reader_head && ds->eof;
 
     if (in->back_demuxing) {
@@ -2975,6 +2988,7 @@ static void demux_copy(struct demuxer *dst, struct demuxer *src)
     dst->num_attachments = src->num_attachments;
     dst->matroska_data = src->matroska_data;
     dst->playlist = src->playlist;
+    dst->playlist_incomplete = src->playlist_incomplete;
     dst->seekable = src->seekable;
     dst->partially_seekable = src->partially_seekable;
     dst->filetype = src->filetype;
@@ -3307,7 +3321,10 @@ static struct demuxer *open_given_type(struct mpv_global *global,
         stream_seek(stream, 0);
 
     in->d_thread->params = params; // temporary during open()
+    char *span = mp_tprintf(32, "probe-%s", desc->name);
+    stats_span_begin(in->stats, span);
     int ret = demuxer->desc->open(in->d_thread, check);
+    stats_span_end(in->stats, span);
     if (ret >= 0) {
         in->d_thread->params = NULL;
         if (in->d_thread->filetype)
@@ -4026,6 +4043,19 @@ void demux_set_stream_wakeup_cb(struct sh_stream *sh,
     pthread_mutex_unlock(&sh->ds->in->lock);
 }
 
+// Make the reader return only keyframes for this stream (for trick play).
+// Packets are skipped as they are dequeued, so they still are read and cached.
+// After disabling it, packets are skipped until the next keyframe.
+void demux_set_stream_keyframes_only(struct sh_stream *sh, bool enable)
+{
+    struct demux_stream *ds = sh->ds;
+    pthread_mutex_lock(&ds->in->lock);
+    if (ds->keyframes_only && !enable)
+        ds->keyframe_resync = true;
+    ds->keyframes_only = enable;
+    pthread_mutex_unlock(&ds->in->lock);
+}
+
 int demuxer_add_attachment(demuxer_t *demuxer, char *name, char *type,
                            void *data, size_t data_size)
 {
@@ -4164,10 +4194,202 @@ static void update_cache(struct demux_internal *in)
         in->next_cache_update = now + MP_SECOND_US + 1;
 }
 
+struct demux_dump_packet {
+    struct sh_stream *sh;       // NULL: discontinuity
+    struct demux_packet *dp;    // if dp->is_cached, read from the disk cache
+    size_t bytes;               // size accounted in demux_dumper.queued_bytes
+};
+
+// Cache dumping (demux_cache_dump_set()). The demuxer queues references to the
+// cached packets (and then possibly newly read packets) with in->lock held,
+// and the dump thread feeds them to the recorder, which does the file I/O.
+// Packets in the disk cache are read by the dump thread one by one.
+struct demux_dumper {
+    struct mp_log *log;
+    struct mp_recorder *recorder;
+    struct demux_cache *cache;  // for packets queued with is_cached set
+    void (*wakeup_cb)(void *ctx);
+    void *wakeup_cb_ctx;
+
+    pthread_t thread;
+    atomic_bool terminate;      // abort as soon as possible
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    // -- protected by lock
+    struct demux_dump_packet *packets;
+    int num_packets;
+    bool finish;                // no more packets are queued
+    int status;                 // CONTROL_*; CONTROL_TRUE while running
+    int64_t num_total;          // packets of the cache snapshot (0 if unknown)
+    int64_t num_written;
+    // Size of the queued packets newly read by the demuxer. These are the only
+    // ones which would not be freed by pruning the cache anyway.
+    uint64_t queued_bytes;
+    uint64_t max_bytes;
+};
+
+// Takes over ownership of dp. If limit is set, the packet counts against the
+// queue size limit, and dumping fails if the dump thread can't keep up.
+static void dumper_queue_limited(struct demux_dumper *d, struct sh_stream *sh,
+                                 struct demux_packet *dp, bool limit)
+{
+    pthread_mutex_lock(&d->lock);
+    if (d->status == CONTROL_TRUE && !d->finish) {
+        struct demux_dump_packet pkt = {sh, dp};
+        if (limit && dp)
+            pkt.bytes = demux_packet_estimate_total_size(dp);
+        if (pkt.bytes && d->queued_bytes + pkt.bytes > d->max_bytes) {
+            MP_ERR(d, "Dump queue overflow, the file can't be written fast "
+                   "enough. Stopping.\n");
+            d->status = CONTROL_ERROR;
+            talloc_free(dp);
+        } else {
+            d->queued_bytes += pkt.bytes;
+            MP_TARRAY_APPEND(d, d->packets, d->num_packets, pkt);
+        }
+        pthread_cond_signal(&d->wakeup);
+    } else {
+        talloc_free(dp);
+    }
+    pthread_mutex_unlock(&d->lock);
+}
+
+static void dumper_queue(struct demux_dumper *d, struct sh_stream *sh,
+                         struct demux_packet *dp)
+{
+    dumper_queue_limited(d, sh, dp, false);
+}
+
+static void *dumper_thread(void *p)
+{
+    struct demux_dumper *d = p;
+
+    mpthread_set_name("demux dump");
+
+    pthread_mutex_lock(&d->lock);
+    while (d->status == CONTROL_TRUE && !atomic_load(&d->terminate)) {
+        if (!d->num_packets) {
+            if (d->finish)
+                break;
+            pthread_cond_wait(&d->wakeup, &d->lock);
+            continue;
+        }
+
+        struct demux_dump_packet *packets = d->packets;
+        int num_packets = d->num_packets;
+        d->packets = NULL;
+        d->num_packets = 0;
+        pthread_mutex_unlock(&d->lock);
+
+        int status = CONTROL_TRUE;
+        int written = 0;
+        uint64_t bytes = 0;
+        for (int n = 0; n < num_packets; n++) {
+            struct demux_dump_packet *pkt = &packets[n];
+            bytes += pkt->bytes;
+            if (pkt->dp && pkt->dp->is_cached && status == CONTROL_TRUE &&
+                !atomic_load(&d->terminate))
+            {
+                struct demux_packet *meta = pkt->dp;
+                pkt->dp = demux_cache_read(d->cache, meta->cached_data.pos);
+                if (pkt->dp) {
+                    demux_packet_copy_attribs(pkt->dp, meta);
+                } else {
+                    MP_ERR(d, "Failed to retrieve packet from cache.\n");
+                    status = CONTROL_ERROR;
+                }
+                talloc_free(meta);
+            }
+            if (status == CONTROL_TRUE && !atomic_load(&d->terminate)) {
+                if (!pkt->sh) {
+                    mp_recorder_mark_discontinuity(d->recorder);
+                } else {
+                    struct mp_recorder_sink *sink =
+                        mp_recorder_get_sink(d->recorder, pkt->sh);
+                    if (sink) {
+                        mp_recorder_feed_packet(sink, pkt->dp);
+                        written++;
+                    } else {
+                        MP_ERR(d, "New stream appeared; stopping recording.\n");
+                        status = CONTROL_ERROR;
+                    }
+                }
+            }
+            talloc_free(pkt->dp);
+            pkt->dp = NULL;
+        }
+        talloc_free(packets);
+
+        pthread_mutex_lock(&d->lock);
+        d->num_written += written;
+        d->queued_bytes -= bytes;
+        if (status != CONTROL_TRUE)
+            d->status = status;
+    }
+    pthread_mutex_unlock(&d->lock);
+
+    // Completion must not be reported before the file was closed.
+    mp_recorder_destroy(d->recorder);
+    d->recorder = NULL;
+
+    pthread_mutex_lock(&d->lock);
+    if (d->status == CONTROL_TRUE)
+        d->status = CONTROL_FALSE;
+    pthread_mutex_unlock(&d->lock);
+
+    if (!atomic_load(&d->terminate) && d->wakeup_cb)
+        d->wakeup_cb(d->wakeup_cb_ctx);
+
+    return NULL;
+}
+
+static struct demux_dumper *dumper_create(struct demux_internal *in,
+                                          const char *file)
+{
+    struct mp_recorder *recorder = recorder_create(in, file);
+    if (!recorder)
+        return NULL;
+
+    struct demux_dumper *d = talloc_zero(NULL, struct demux_dumper);
+    d->log = in->log;
+    d->recorder = recorder;
+    d->wakeup_cb = in->wakeup_cb;
+    d->wakeup_cb_ctx = in->wakeup_cb_ctx;
+    d->status = CONTROL_TRUE;
+    d->max_bytes = in->max_bytes;
+    pthread_mutex_init(&d->lock, NULL);
+    pthread_cond_init(&d->wakeup, NULL);
+
+    if (pthread_create(&d->thread, NULL, dumper_thread, d)) {
+        MP_ERR(in, "Could not create dump thread.\n");
+        mp_recorder_destroy(recorder);
+        pthread_cond_destroy(&d->wakeup);
+        pthread_mutex_destroy(&d->lock);
+        talloc_free(d);
+        return NULL;
+    }
+
+    return d;
+}
+
 static void dumper_close(struct demux_internal *in)
 {
-    if (in->dumper)
-        mp_recorder_destroy(in->dumper);
+    struct demux_dumper *d = in->dumper;
+    if (d) {
+        atomic_store(&d->terminate, true);
+        pthread_mutex_lock(&d->lock);
+        pthread_cond_signal(&d->wakeup);
+        pthread_mutex_unlock(&d->lock);
+        pthread_join(d->thread, NULL);
+
+        in->dumper_status = d->status;
+        for (int n = 0; n < d->num_packets; n++)
+            talloc_free(d->packets[n].dp);
+        pthread_cond_destroy(&d->wakeup);
+        pthread_mutex_destroy(&d->lock);
+        talloc_free(d);
+    }
     in->dumper = NULL;
     if (in->dumper_status == CONTROL_TRUE)
         in->dumper_status = CONTROL_FALSE; // make abort equal to success
@@ -4185,10 +4407,18 @@ static int range_time_compare(const void *p1, const void *p2)
 
 static void dump_cache(struct demux_internal *in, double start, double end)
 {
-    in->dumper_status = in->dumper ? CONTROL_TRUE : CONTROL_ERROR;
-    if (!in->dumper)
+    struct demux_dumper *d = in->dumper;
+    in->dumper_status = d ? CONTROL_TRUE : CONTROL_ERROR;
+    if (!d)
         return;
 
+    bool error = false;
+    int64_t num_total = 0;
+
+    pthread_mutex_lock(&d->lock);
+    d->cache = in->cache;
+    pthread_mutex_unlock(&d->lock);
+
     // (only in pathological cases there might be more ranges than allowed)
     struct demux_cached_range *ranges[MAX_SEEK_RANGES];
     int num_ranges = 0;
@@ -4205,7 +4435,7 @@ static void dump_cache(struct demux_internal *in, double start, double end)
         if (end != MP_NOPTS_VALUE && r->seek_start >= end)
             continue;
 
-        mp_recorder_mark_discontinuity(in->dumper);
+        dumper_queue(d, NULL, NULL);
 
         double pts = start;
         int flags = 0;
@@ -4259,18 +4489,26 @@ static void dump_cache(struct demux_internal *in, double start, double end)
             struct demux_stream *ds = in->streams[next->stream]->ds;
             ds->dump_pos = next->next;
 
-            struct demux_packet *dp = read_packet_from_cache(in, next);
-            if (!dp) {
-                in->dumper_status = CONTROL_ERROR;
-                break;
+            // Packets in the disk cache are read by the dump thread.
+            struct demux_packet *dp = NULL;
+            if (next->is_cached) {
+                dp = talloc_zero(NULL, struct demux_packet);
+                demux_packet_copy_attribs(dp, next);
+                dp->is_cached = true;
+                dp->cached_data.pos = next->cached_data.pos;
+            } else {
+                dp = demux_copy_packet(next);
+                if (!dp) {
+                    error = true;
+                    break;
+                }
             }
 
-            write_dump_packet(in, dp);
-
-            talloc_free(dp);
+            dumper_queue(d, in->streams[next->stream], dp);
+            num_total++;
         }
 
-        if (in->dumper_status != CONTROL_OK)
+        if (error)
             break;
     }
 
@@ -4281,20 +4519,27 @@ static void dump_cache(struct demux_internal *in, double start, double end)
     // If dumping (in end==NOPTS mode) doesn't continue at the range that
     // was written last, we have a discontinuity.
     if (num_ranges && ranges[num_ranges - 1] != in->current_range)
-        mp_recorder_mark_discontinuity(in->dumper);
+        dumper_queue(d, NULL, NULL);
 
     // end=NOPTS means the demuxer output continues to be written to the
-    // dump file.
-    if (end != MP_NOPTS_VALUE || in->dumper_status != CONTROL_OK)
-        dumper_close(in);
+    // dump file. Otherwise the dump thread exits once it's done.
+    pthread_mutex_lock(&d->lock);
+    d->num_total = num_total;
+    if (error)
+        d->status = CONTROL_ERROR;
+    if (end != MP_NOPTS_VALUE || error)
+        d->finish = true;
+    pthread_cond_signal(&d->wakeup);
+    pthread_mutex_unlock(&d->lock);
 }
 
 // Set the current cache dumping mode. There is only at most 1 dump process
 // active, so calling this aborts the previous dumping. Passing file==NULL
 // stops dumping.
 // This is synchronous with demux_cache_dump_get_status() (i.e. starting or
-// aborting is not asynchronous). On status change, the demuxer wakeup callback
-// is invoked (except for this call).
+// aborting is not asynchronous, and aborting closes the file). The actual
+// writing happens on a separate thread. On status change, the demuxer wakeup
+// callback is invoked (except for this call).
 // Returns whether dumping was logically started.
 bool demux_cache_dump_set(struct demuxer *demuxer, double start, double end,
                           char *file)
@@ -4314,14 +4559,13 @@ bool demux_cache_dump_set(struct demuxer *demuxer, double start, double end,
     if (file && file[0] && start != MP_NOPTS_VALUE) {
         res = true;
 
-        in->dumper = recorder_create(in, file);
+        in->dumper = dumper_create(in, file);
 
-        // This is not asynchronous and will freeze the shit for a while if the
-        // user is unlucky. It could be moved to a thread with some effort.
-        // General idea: iterate over all cache ranges, dump what intersects.
+        // General idea: iterate over all cache ranges, queue what intersects.
         // After that, and if the user requested it, make it dump all newly
         // received packets, even if it's awkward (consider the case if the
-        // current range is not the last range).
+        // current range is not the last range). This only takes references
+        // to the packets, so the lock is held only briefly.
         dump_cache(in, start, end);
     }
 
@@ -4331,12 +4575,25 @@ bool demux_cache_dump_set(struct demuxer *demuxer, double start, double end,
 }
 
 // Returns one of CONTROL_*. CONTROL_TRUE means dumping is in progress.
-int demux_cache_dump_get_status(struct demuxer *demuxer)
+// If progress is not NULL, it's set to the fraction of the cached data that
+// has been written (newly read data is not included).
+int demux_cache_dump_get_status(struct demuxer *demuxer, double *progress)
 {
     struct demux_internal *in = demuxer->in;
     pthread_mutex_lock(&in->lock);
     int status = in->dumper_status;
+    double pos = status == CONTROL_TRUE ? 0 : 1;
+    struct demux_dumper *d = in->dumper;
+    if (d) {
+        pthread_mutex_lock(&d->lock);
+        status = d->status;
+        pos = d->num_total ? d->num_written / (double)d->num_total : 1;
+        pos = status == CONTROL_TRUE ? MPMIN(pos, 1) : 1;
+        pthread_mutex_unlock(&d->lock);
+    }
     pthread_mutex_unlock(&in->lock);
+    if (progress)
+        *progress = pos;
     return status;
 }
 
@@ -179,6 +179,7 @@ struct demuxer_params {
     bool stream_record; // if true, enable stream recording if option is set
     int stream_flags;
     struct stream *external_stream; // if set, use this, don't open or close streams
+    bool incremental_playlist; // allow returning a partial playlist (see below)
     // result
     bool demuxer_failed;
 };
@@ -222,6 +223,10 @@ typedef struct demuxer {
 
     // If the file is a playlist file
     struct playlist *playlist;
+    // The playlist file is still being read in the background, and playlist
+    // contains only the first entries. Use demux_playlist_read_more() to get
+    // the rest. Only with demuxer_params.incremental_playlist set.
+    bool playlist_incomplete;
 
     struct mp_tags *metadata;
 
@@ -258,6 +263,7 @@ int demux_read_packet_async_until(struct sh_stream *sh, double min_pts,
 bool demux_stream_is_selected(struct sh_stream *stream);
 void demux_set_stream_wakeup_cb(struct sh_stream *sh,
                                 void (*cb)(void *ctx), void *ctx);
+void demux_set_stream_keyframes_only(struct sh_stream *sh, bool enable);
 struct demux_packet *demux_read_any_packet(struct demuxer *demuxer);
 
 struct sh_stream *demux_get_stream(struct demuxer *demuxer, int index);
@@ -308,7 +314,7 @@ void demux_update(demuxer_t *demuxer, double playback_pts);
 
 bool demux_cache_dump_set(struct demuxer *demuxer, double start, double end,
                           char *file);
-int demux_cache_dump_get_status(struct demuxer *demuxer);
+int demux_cache_dump_get_status(struct demuxer *demuxer, double *progress);
 
 double demux_probe_cache_dump_target(struct demuxer *demuxer, double pts,
                                      bool for_end);
@@ -328,4 +334,9 @@ bool demux_matroska_uid_cmp(struct matroska_segment_uid *a,
 
 const char *stream_type_name(enum stream_type type);
 
+// demux_playlist.c
+bool demux_playlist_read_more(struct demuxer *demuxer, struct playlist *dst);
+void demux_playlist_set_wakeup_cb(struct demuxer *demuxer,
+                                  void (*cb)(void *ctx), void *ctx);
+
 #endif /* MPLAYER_DEMUXER_H */
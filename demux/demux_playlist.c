@@ -19,6 +19,7 @@
 #include <string.h>
 #include <strings.h>
 #include <dirent.h>
+#include <pthread.h>
 
 #include <libavutil/common.h>
 
@@ -30,12 +31,18 @@
 #include "misc/thread_tools.h"
 #include "options/path.h"
 #include "stream/stream.h"
+#include "osdep/atomic.h"
 #include "osdep/io.h"
+#include "osdep/threads.h"
 #include "misc/natural_sort.h"
 #include "demux.h"
 
 #define PROBE_SIZE (8 * 1024)
 
+// With demuxer_params.incremental_playlist, parsed entries are handed out in
+// batches of this size while the rest of the file is read.
+#define INCREMENTAL_BATCH 1000
+
 static bool check_mimetype(struct stream *s, const char *const *list)
 {
     if (s->mime_type) {
@@ -60,6 +67,25 @@ struct pl_parser {
     enum demux_check check_level;
     struct stream *real_stream;
     char *format;
+
+    const struct pl_format *fmt;
+    bstr base_path;
+    int stream_origin;
+
+    // Incremental reading on a separate thread.
+    bool incremental;
+    bool thread_valid;
+    pthread_t thread;
+    atomic_bool terminate;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    // --- protected by lock
+    struct playlist *pending;   // parsed entries not returned to the user yet
+    bool done;                  // parsing has finished
+    bool ok;                    // parsing was successful (valid if done)
+    void (*wakeup_cb)(void *ctx);
+    void *wakeup_cb_ctx;
 };
 
 
@@ -149,16 +175,44 @@ static bstr pl_get_line(struct pl_parser *p)
     return bstr0(pl_get_line0(p));
 }
 
+// Move the entries parsed so far to p->pending, where the user can get them.
+static void pl_flush(struct pl_parser *p)
+{
+    if (p->add_base)
+        playlist_add_base_path(p->pl, p->base_path);
+    playlist_set_stream_flags(p->pl, p->stream_origin);
+
+    pthread_mutex_lock(&p->lock);
+    playlist_append_entries(p->pending, p->pl);
+    pthread_cond_broadcast(&p->wakeup);
+    void (*cb)(void *ctx) = p->wakeup_cb;
+    void *cb_ctx = p->wakeup_cb_ctx;
+    pthread_mutex_unlock(&p->lock);
+
+    if (cb)
+        cb(cb_ctx);
+}
+
+static void pl_add_entry(struct pl_parser *p, struct playlist_entry *e)
+{
+    playlist_add(p->pl, e);
+    if (p->incremental && p->pl->num_entries >= INCREMENTAL_BATCH)
+        pl_flush(p);
+}
+
+// entry must point into p->buffer (which is the case for all lines returned
+// by pl_get_line()), so it can be terminated in place instead of copying it.
 static void pl_add(struct pl_parser *p, bstr entry)
 {
-    char *s = bstrto0(NULL, entry);
-    playlist_add_file(p->pl, s);
-    talloc_free(s);
+    assert((char *)entry.start >= p->buffer &&
+           (char *)entry.start + entry.len < p->buffer + sizeof(p->buffer));
+    entry.start[entry.len] = '\0';
+    pl_add_entry(p, playlist_entry_new(entry.start));
 }
 
 static bool pl_eof(struct pl_parser *p)
 {
-    return p->error || p->s->eof;
+    return p->error || p->s->eof || atomic_load(&p->terminate);
 }
 
 static bool maybe_text(bstr d)
@@ -205,14 +259,15 @@ ok:
                 title = bstrto0(NULL, btitle);
             }
         } else if (bstr_startswith0(line, "#EXT-X-")) {
+            pthread_mutex_lock(&p->lock);
             p->format = "hls";
+            pthread_mutex_unlock(&p->lock);
         } else if (line.len > 0 && !bstr_startswith0(line, "#")) {
-            char *fn = bstrto0(NULL, line);
-            struct playlist_entry *e = playlist_entry_new(fn);
-            talloc_free(fn);
+            line.start[line.len] = '\0'; // see pl_add()
+            struct playlist_entry *e = playlist_entry_new(line.start);
             e->title = talloc_steal(e, title);
             title = NULL;
-            playlist_add(p->pl, e);
+            pl_add_entry(p, e);
         }
         line = bstr_strip(pl_get_line(p));
     }
@@ -426,6 +481,39 @@ static const struct pl_format *probe_pl(struct pl_parser *p)
     return NULL;
 }
 
+static void *parse_thread(void *arg)
+{
+    struct pl_parser *p = arg;
+    mpthread_set_name("playlist");
+
+    bool ok = p->fmt->parse(p) >= 0 && !p->error;
+    pl_flush(p);
+
+    pthread_mutex_lock(&p->lock);
+    p->done = true;
+    p->ok = ok;
+    pthread_cond_broadcast(&p->wakeup);
+    void (*cb)(void *ctx) = p->wakeup_cb;
+    void *cb_ctx = p->wakeup_cb_ctx;
+    pthread_mutex_unlock(&p->lock);
+
+    if (cb)
+        cb(cb_ctx);
+    return NULL;
+}
+
+static void destroy_parser(struct pl_parser *p)
+{
+    if (p->thread_valid) {
+        // The stream is normally cancelled already (demux_cancel_and_free()).
+        atomic_store(&p->terminate, true);
+        pthread_join(p->thread, NULL);
+    }
+    pthread_cond_destroy(&p->wakeup);
+    pthread_mutex_destroy(&p->lock);
+    talloc_free(p);
+}
+
 static int open_file(struct demuxer *demuxer, enum demux_check check)
 {
     if (!demuxer->access_references)
@@ -436,8 +524,11 @@ static int open_file(struct demuxer *demuxer, enum demux_check check)
     struct pl_parser *p = talloc_zero(NULL, struct pl_parser);
     p->log = demuxer->log;
     p->pl = talloc_zero(p, struct playlist);
+    p->pending = talloc_zero(p, struct playlist);
     p->real_stream = demuxer->stream;
     p->add_base = true;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wakeup, NULL);
 
     char probe[PROBE_SIZE];
     int probe_len = stream_read_peek(p->real_stream, probe, sizeof(probe));
@@ -451,7 +542,7 @@ static int open_file(struct demuxer *demuxer, enum demux_check check)
     free_stream(p->s);
     playlist_clear(p->pl);
     if (!fmt) {
-        talloc_free(p);
+        destroy_parser(p);
         return -1;
     }
 
@@ -459,21 +550,92 @@ static int open_file(struct demuxer *demuxer, enum demux_check check)
     p->error = false;
     p->s = demuxer->stream;
     p->utf16 = stream_skip_bom(p->s);
-    bool ok = fmt->parse(p) >= 0 && !p->error;
-    if (p->add_base)
-        playlist_add_base_path(p->pl, mp_dirname(demuxer->filename));
-    playlist_set_stream_flags(p->pl, demuxer->stream_origin);
-    demuxer->playlist = talloc_steal(demuxer, p->pl);
-    demuxer->filetype = p->format ? p->format : fmt->name;
+    p->fmt = fmt;
+    p->base_path = mp_dirname(demuxer->filename);
+    p->stream_origin = demuxer->stream_origin;
+    p->incremental = demuxer->params && demuxer->params->incremental_playlist;
+
+    if (p->incremental) {
+        // Return as soon as the first batch of entries is available, and let
+        // the thread read the rest of the file.
+        if (pthread_create(&p->thread, NULL, parse_thread, p)) {
+            destroy_parser(p);
+            return -1;
+        }
+        p->thread_valid = true;
+        pthread_mutex_lock(&p->lock);
+        while (!p->done && !p->pending->num_entries)
+            pthread_cond_wait(&p->wakeup, &p->lock);
+        demuxer->filetype = p->format ? p->format : fmt->name;
+        pthread_mutex_unlock(&p->lock);
+    } else {
+        p->ok = fmt->parse(p) >= 0 && !p->error;
+        pl_flush(p);
+        p->done = true;
+        demuxer->filetype = p->format ? p->format : fmt->name;
+    }
+
+    demuxer->playlist = talloc_zero(demuxer, struct playlist);
     demuxer->fully_read = true;
-    talloc_free(p);
-    if (ok)
-        demux_close_stream(demuxer);
+    demuxer->priv = p;
+    bool ok = true;
+    if (demux_playlist_read_more(demuxer, demuxer->playlist)) {
+        ok = p->ok;
+        demuxer->priv = NULL;
+        destroy_parser(p);
+        if (ok)
+            demux_close_stream(demuxer);
+    } else {
+        demuxer->playlist_incomplete = true;
+        // The stream is still owned by the demuxer (and closed with it), but
+        // only the parser thread may access it now.
+        demuxer->stream = NULL;
+        MP_VERBOSE(demuxer, "Reading rest of the playlist in the background.\n");
+    }
     return ok ? 0 : -1;
 }
 
+static void close_file(struct demuxer *demuxer)
+{
+    struct pl_parser *p = demuxer->priv;
+    if (p)
+        destroy_parser(p);
+}
+
 const struct demuxer_desc demuxer_desc_playlist = {
     .name = "playlist",
     .desc = "Playlist file",
     .open = open_file,
+    .close = close_file,
 };
+
+// Move all entries parsed since the last call to the end of dst. Return true
+// if the playlist was read completely (no new entries will be added anymore).
+// This can be called from any thread.
+bool demux_playlist_read_more(struct demuxer *demuxer, struct playlist *dst)
+{
+    struct pl_parser *p = demuxer->priv;
+    if (demuxer->desc != &demuxer_desc_playlist || !p)
+        return true;
+
+    pthread_mutex_lock(&p->lock);
+    playlist_append_entries(dst, p->pending);
+    bool done = p->done;
+    pthread_mutex_unlock(&p->lock);
+    return done;
+}
+
+// cb is called (from the parser thread) when new entries are available, or
+// reading the playlist file has finished.
+void demux_playlist_set_wakeup_cb(struct demuxer *demuxer,
+                                  void (*cb)(void *ctx), void *ctx)
+{
+    struct pl_parser *p = demuxer->priv;
+    if (demuxer->desc != &demuxer_desc_playlist || !p)
+        return;
+
+    pthread_mutex_lock(&p->lock);
+    p->wakeup_cb = cb;
+    p->wakeup_cb_ctx = ctx;
+    pthread_mutex_unlock(&p->lock);
+}
@@ -0,0 +1,234 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "audio/aframe.h"
+#include "audio/format.h"
+#include "common/common.h"
+#include "common/msg.h"
+
+#include "f_aconvert.h"
+#include "filter_internal.h"
+
+struct priv {
+    struct mp_aframe_pool *pool;
+    struct mp_aconvert public;
+};
+
+// Convert samples from src to dst. Each step is the distance between two
+// consecutive samples of the same channel, in units of the sample type. The
+// step==1 path is kept separate so the compiler can vectorize it.
+typedef void (*conv_fn)(void *dst, int dst_step, const void *src, int src_step,
+                        int samples);
+
+#define CONV_FN(name, src_t, dst_t, expr)                                   \
+static void name(void *dst_p, int dst_step, const void *src_p, int src_step,\
+                 int samples)                                               \
+{                                                                           \
+    dst_t *restrict dst = dst_p;                                            \
+    const src_t *restrict src = src_p;                                      \
+    if (dst_step == 1 && src_step == 1) {                                   \
+        for (int n = 0; n < samples; n++) {                                 \
+            src_t v = src[n];                                               \
+            dst[n] = (expr);                                                \
+        }                                                                   \
+    } else {                                                                \
+        for (int n = 0; n < samples; n++) {                                 \
+            src_t v = src[n * (ptrdiff_t)src_step];                         \
+            dst[n * (ptrdiff_t)dst_step] = (expr);                          \
+        }                                                                   \
+    }                                                                       \
+}
+
+// Round to nearest; written without lrint() to keep the loops vectorizable.
+#define ROUND_F(x) ((x) + ((x) >= 0 ? 0.5f : -0.5f))
+#define ROUND_D(x) ((x) + ((x) >= 0 ? 0.5 : -0.5))
+
+#define F_TO_S16(v) \
+    (int16_t)ROUND_F(MPCLAMP((v) * 32768.0f, -32768.0f, 32767.0f))
+#define F_TO_S32(v) \
+    (int32_t)ROUND_D(MPCLAMP((v) * 2147483648.0, -2147483648.0, 2147483647.0))
+
+CONV_FN(conv_s16_s16,     int16_t, int16_t, v)
+CONV_FN(conv_s16_s32,     int16_t, int32_t, (int32_t)((uint32_t)v << 16))
+CONV_FN(conv_s16_float,   int16_t, float,   v * (1.0f / 32768.0f))
+CONV_FN(conv_s32_s16,     int32_t, int16_t, (int16_t)(v >> 16))
+CONV_FN(conv_s32_s32,     int32_t, int32_t, v)
+CONV_FN(conv_s32_float,   int32_t, float,   v * (1.0f / 2147483648.0f))
+CONV_FN(conv_float_s16,   float,   int16_t, F_TO_S16(v))
+CONV_FN(conv_float_s32,   float,   int32_t, F_TO_S32(v))
+CONV_FN(conv_float_float, float,   float,   v)
+
+// Index into conv_fns[][].
+static int sample_type(int format)
+{
+    switch (af_fmt_from_planar(format)) {
+    case AF_FORMAT_S16:     return 0;
+    case AF_FORMAT_S32:     return 1;
+    case AF_FORMAT_FLOAT:   return 2;
+    }
+    return -1;
+}
+
+// conv_fns[src][dst]
+static const conv_fn conv_fns[3][3] = {
+    {conv_s16_s16,   conv_s16_s32,   conv_s16_float},
+    {conv_s32_s16,   conv_s32_s32,   conv_s32_float},
+    {conv_float_s16, conv_float_s32, conv_float_float},
+};
+
+bool mp_aconvert_supports(int in_format, const struct mp_chmap *in_channels,
+                          int out_format, const struct mp_chmap *out_channels)
+{
+    if (sample_type(in_format) < 0 || sample_type(out_format) < 0)
+        return false;
+
+    if (in_channels->num != out_channels->num)
+        return false;
+
+    // Pure reordering only; anything that adds or drops speakers needs a
+    // remix matrix.
+    int reorder[MP_NUM_CHANNELS];
+    mp_chmap_get_reorder(reorder, in_channels, out_channels);
+    bool used[MP_NUM_CHANNELS] = {0};
+    for (int n = 0; n < out_channels->num; n++) {
+        int c = reorder[n];
+        if (c < 0 || used[c])
+            return false;
+        used[c] = true;
+    }
+    return true;
+}
+
+bool mp_aconvert_frame(struct mp_aframe *dst, struct mp_aframe *src)
+{
+    int in_format = mp_aframe_get_format(src);
+    int out_format = mp_aframe_get_format(dst);
+    struct mp_chmap in_chmap, out_chmap;
+    if (!mp_aframe_get_chmap(src, &in_chmap) ||
+        !mp_aframe_get_chmap(dst, &out_chmap))
+        return false;
+
+    if (!mp_aconvert_supports(in_format, &in_chmap, out_format, &out_chmap))
+        return false;
+
+    int samples = mp_aframe_get_size(src);
+    if (mp_aframe_get_size(dst) != samples)
+        return false;
+
+    conv_fn conv = conv_fns[sample_type(in_format)][sample_type(out_format)];
+
+    int reorder[MP_NUM_CHANNELS];
+    mp_chmap_get_reorder(reorder, &in_chmap, &out_chmap);
+
+    uint8_t **in_planes = mp_aframe_get_data_ro(src);
+    uint8_t **out_planes = mp_aframe_get_data_rw(dst);
+    if (!in_planes || !out_planes)
+        return false;
+
+    bool in_planar = af_fmt_is_planar(in_format);
+    bool out_planar = af_fmt_is_planar(out_format);
+    int in_bps = af_fmt_to_bytes(in_format);
+    int out_bps = af_fmt_to_bytes(out_format);
+    int num_ch = out_chmap.num;
+
+    for (int n = 0; n < num_ch; n++) {
+        int c = reorder[n];
+        assert(c >= 0 && c < num_ch);
+
+        const uint8_t *s = in_planar ? in_planes[c] : in_planes[0] + c * in_bps;
+        uint8_t *d = out_planar ? out_planes[n] : out_planes[0] + n * out_bps;
+
+        conv(d, out_planar ? 1 : num_ch, s, in_planar ? 1 : num_ch, samples);
+    }
+
+    return true;
+}
+
+static void process(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+
+    if (!mp_pin_can_transfer_data(f->ppins[1], f->ppins[0]))
+        return;
+
+    struct mp_frame frame = mp_pin_out_read(f->ppins[0]);
+
+    if (frame.type == MP_FRAME_EOF) {
+        mp_pin_in_write(f->ppins[1], frame);
+        return;
+    }
+
+    if (frame.type != MP_FRAME_AUDIO) {
+        MP_ERR(f, "audio frame expected\n");
+        goto error;
+    }
+
+    struct mp_aframe *in = frame.data;
+    struct mp_aconvert *c = &p->public;
+
+    int out_format = c->out_format ? c->out_format : mp_aframe_get_format(in);
+    struct mp_chmap out_chmap = c->out_channels;
+    if (!out_chmap.num)
+        mp_aframe_get_chmap(in, &out_chmap);
+
+    struct mp_aframe *out = mp_aframe_create();
+    mp_aframe_config_copy(out, in);
+    if (!mp_aframe_set_format(out, out_format) ||
+        !mp_aframe_set_chmap(out, &out_chmap) ||
+        mp_aframe_pool_allocate(p->pool, out, mp_aframe_get_size(in)) < 0 ||
+        !mp_aconvert_frame(out, in))
+    {
+        MP_ERR(f, "unsupported conversion\n");
+        talloc_free(out);
+        goto error;
+    }
+    mp_aframe_copy_attributes(out, in);
+
+    talloc_free(in);
+    mp_pin_in_write(f->ppins[1], MAKE_FRAME(MP_FRAME_AUDIO, out));
+    return;
+
+error:
+    mp_frame_unref(&frame);
+    mp_filter_internal_mark_failed(f);
+}
+
+static const struct mp_filter_info aconvert_filter = {
+    .name = "aconvert",
+    .priv_size = sizeof(struct priv),
+    .process = process,
+};
+
+struct mp_aconvert *mp_aconvert_create(struct mp_filter *parent)
+{
+    struct mp_filter *f = mp_filter_create(parent, &aconvert_filter);
+    if (!f)
+        return NULL;
+
+    mp_filter_add_pin(f, MP_PIN_IN, "in");
+    mp_filter_add_pin(f, MP_PIN_OUT, "out");
+
+    struct priv *p = f->priv;
+    p->public.f = f;
+    p->pool = mp_aframe_pool_create(p);
+
+    return &p->public;
+}
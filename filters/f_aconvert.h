@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "audio/chmap.h"
+#include "filter.h"
+
+// Lightweight audio conversion filter. Unlike f_swresample, this can only
+// change the sample format (including planar <-> packed) and the channel
+// order, and never resamples or remixes.
+struct mp_aconvert {
+    struct mp_filter *f;
+    // Desired output parameters. For unset parameters, passes through the
+    // format.
+    int out_format;
+    struct mp_chmap out_channels;
+};
+
+// Return whether the conversion in->out can be done by this filter. The
+// sample rate is assumed to be the same.
+bool mp_aconvert_supports(int in_format, const struct mp_chmap *in_channels,
+                          int out_format, const struct mp_chmap *out_channels);
+
+// Create the filter. Free with talloc_free(mp_aconvert.f).
+struct mp_aconvert *mp_aconvert_create(struct mp_filter *parent);
+
+// Convert src to dst, which must have been allocated with the same number of
+// samples. Returns false if the conversion is not supported.
+bool mp_aconvert_frame(struct mp_aframe *dst, struct mp_aframe *src);
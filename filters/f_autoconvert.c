@@ -9,6 +9,7 @@
 #include "video/mp_image.h"
 #include "video/mp_image_pool.h"
 
+#include "f_aconvert.h"
 #include "f_autoconvert.h"
 #include "f_hwtransfer.h"
 #include "f_swresample.h"
@@ -47,6 +48,8 @@ struct priv {
 
     double audio_speed;
     bool resampling_forced;
+    // Whether sub.filter is a f_swresample instance (and not f_aconvert).
+    bool sub_is_resampler;
 
     bool format_change_blocked;
     bool format_change_cont;
@@ -343,11 +346,13 @@ static void handle_audio_frame(struct mp_filter *f)
                          !mp_chmap_equals(&chmap, &p->in_chmap) ||
                          p->force_update;
 
-    if (!format_change && (!p->resampling_forced || p->sub.filter))
+    if (!format_change && (!p->resampling_forced ||
+                          (p->sub.filter && p->sub_is_resampler)))
         goto cont;
 
     if (!mp_subfilter_drain_destroy(&p->sub))
         return;
+    p->sub_is_resampler = false;
 
     if (format_change && p->public.on_audio_format_change) {
         if (p->format_change_blocked)
@@ -396,6 +401,23 @@ static void handle_audio_frame(struct mp_filter *f)
         goto cont;
     }
 
+    // Use the cheap converter if libswresample would only repack samples.
+    if (out_srate == p->in_srate && !p->resampling_forced &&
+        mp_aconvert_supports(p->in_afmt, &p->in_chmap, out_afmt, &out_chmap))
+    {
+        MP_VERBOSE(p, "inserting format converter\n");
+
+        struct mp_aconvert *ac = mp_aconvert_create(f);
+        if (!ac)
+            abort();
+
+        ac->out_format = out_afmt;
+        ac->out_channels = out_chmap;
+
+        p->sub.filter = ac->f;
+        goto cont;
+    }
+
     MP_VERBOSE(p, "inserting resampler\n");
 
     struct mp_swresample *s = mp_swresample_create(f, NULL);
@@ -407,6 +429,7 @@ static void handle_audio_frame(struct mp_filter *f)
     s->out_channels = out_chmap;
 
     p->sub.filter = s->f;
+    p->sub_is_resampler = true;
 
 cont:
 
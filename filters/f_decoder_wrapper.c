@@ -40,6 +40,7 @@
 #include "common/codecs.h"
 #include "common/global.h"
 #include "common/recorder.h"
+#include "common/stats.h"
 #include "misc/dispatch.h"
 
 #include "audio/aframe.h"
@@ -151,6 +152,8 @@ const struct m_sub_options dec_wrapper_conf = {
 struct priv {
     struct mp_log *log;
     struct sh_stream *header;
+    struct stats_ctx *stats;
+    struct stats_handle *stats_process;
 
     // --- The following fields are to be accessed by dec_dispatch (or if that
     //     field is NULL, by the mp_decoder_wrapper user thread).
@@ -233,6 +236,7 @@ struct priv {
     bool pts_reset;
     int attempt_framedrops; // try dropping this many frames
     int dropped_frames; // total frames _probably_ dropped
+    bool keyframes_only;
 };
 
 static int decoder_list_help(struct mp_log *log, const m_option_t *opt,
@@ -452,7 +456,9 @@ static bool reinit_decoder(struct priv *p)
         struct mp_decoder_entry *sel = &list->entries[n];
         MP_VERBOSE(p, "Opening decoder %s\n", sel->decoder);
 
+        stats_span_begin(p->stats, "init");
         p->decoder = driver->create(p->decf, p->codec, sel->decoder);
+        stats_span_end(p->stats, "init");
         if (p->decoder) {
             pthread_mutex_lock(&p->cache_lock);
             p->decoder_desc =
@@ -502,6 +508,21 @@ void mp_decoder_wrapper_set_frame_drops(struct mp_decoder_wrapper *d, int num)
     pthread_mutex_unlock(&p->cache_lock);
 }
 
+void mp_decoder_wrapper_set_keyframes_only(struct mp_decoder_wrapper *d,
+                                           bool enable)
+{
+    struct priv *p = d->f->priv;
+    pthread_mutex_lock(&p->cache_lock);
+    bool changed = p->keyframes_only != enable;
+    p->keyframes_only = enable;
+    pthread_mutex_unlock(&p->cache_lock);
+
+    if (changed) {
+        MP_VERBOSE(p, "Keyframe-only decoding %s.\n", enable ? "on" : "off");
+        demux_set_stream_keyframes_only(p->header, enable);
+    }
+}
+
 int mp_decoder_wrapper_get_frames_dropped(struct mp_decoder_wrapper *d)
 {
     struct priv *p = d->f->priv;
@@ -890,12 +911,16 @@ static void feed_packet(struct priv *p)
         pthread_mutex_lock(&p->cache_lock);
         if (p->attempt_framedrops)
             framedrop_type = 1;
+        bool keyframes_only = p->keyframes_only;
         pthread_mutex_unlock(&p->cache_lock);
 
         if (start_pts != MP_NOPTS_VALUE && packet && p->play_dir > 0 &&
             packet->pts < start_pts - .005 && !p->has_broken_packet_pts)
             framedrop_type = 2;
 
+        if (keyframes_only)
+            framedrop_type = 3;
+
         p->decoder->control(p->decoder->f, VDCTRL_SET_FRAMEDROP, &framedrop_type);
     }
 
@@ -1076,6 +1101,8 @@ static void decf_process(struct mp_filter *f)
     struct priv *p = f->priv;
     assert(p->decf == f);
 
+    stats_handle_event(p->stats_process);
+
     if (m_config_cache_update(p->opt_cache))
         update_queue_config(p);
 
@@ -1136,6 +1163,10 @@ static void public_f_destroy(struct mp_filter *f)
 
     mp_filter_free_children(f);
 
+    // The stream may be decoded again by a new decoder wrapper.
+    if (p->keyframes_only)
+        demux_set_stream_keyframes_only(p->header, false);
+
     talloc_free(p->dec_root_filter);
     talloc_free(p->queue);
     pthread_mutex_destroy(&p->cache_lock);
@@ -1159,6 +1190,7 @@ static void wakeup_dec_thread(void *ptr)
 {
     struct priv *p = ptr;
 
+    stats_event(p->stats, "wakeups");
     mp_dispatch_interrupt(p->dec_dispatch);
 }
 
@@ -1189,6 +1221,7 @@ struct mp_decoder_wrapper *mp_decoder_wrapper_create(struct mp_filter *parent,
 
     if (p->header->type == STREAM_VIDEO) {
         p->log = mp_log_new(p, parent->global->log, "!vd");
+        p->stats = stats_ctx_create(p, public_f->global, "vdec");
 
         p->fps = src->codec->fps;
 
@@ -1203,11 +1236,14 @@ struct mp_decoder_wrapper *mp_decoder_wrapper_create(struct mp_filter *parent,
         p->queue_opts = p->opts->vdec_queue_opts;
     } else if (p->header->type == STREAM_AUDIO) {
         p->log = mp_log_new(p, parent->global->log, "!ad");
+        p->stats = stats_ctx_create(p, public_f->global, "adec");
         p->queue_opts = p->opts->adec_queue_opts;
     } else {
         goto error;
     }
 
+    p->stats_process = stats_handle_create(p->stats, "process");
+
     if (p->queue_opts && p->queue_opts->use_queue) {
         p->queue = mp_async_queue_create();
         p->dec_dispatch = mp_dispatch_create(p);
@@ -63,6 +63,11 @@ bool mp_decoder_wrapper_get_pts_reset(struct mp_decoder_wrapper *d);
 
 void mp_decoder_wrapper_set_play_dir(struct mp_decoder_wrapper *d, int dir);
 
+// Decode only keyframes (trick play). The demuxer stops returning other
+// packets, and the decoder is told to skip non-keyframes.
+void mp_decoder_wrapper_set_keyframes_only(struct mp_decoder_wrapper *d,
+                                           bool enable);
+
 struct mp_decoder_list *video_decoder_list(void);
 struct mp_decoder_list *audio_decoder_list(void);
 
@@ -75,8 +80,10 @@ enum dec_ctrl {
     VDCTRL_GET_HWDEC,
     VDCTRL_REINIT,
     VDCTRL_GET_BFRAMES,
-    // framedrop mode: 0=none, 1=standard, 2=hrseek
+    // framedrop mode: 0=none, 1=standard, 2=hrseek, 3=keyframes only
     VDCTRL_SET_FRAMEDROP,
+    // bool*: decode with 1 thread, instead of --vd-lavc-threads
+    VDCTRL_SET_SINGLE_THREAD,
 };
 
 int mp_decoder_wrapper_control(struct mp_decoder_wrapper *d,
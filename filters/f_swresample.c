@@ -30,12 +30,28 @@
 #include "common/common.h"
 #include "common/av_common.h"
 #include "common/msg.h"
+#include "misc/thread_pool.h"
+#include "misc/thread_tools.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
 
 #include "f_swresample.h"
 #include "filter_internal.h"
 
+// A subset of the channels, resampled independently (possibly on a different
+// thread) from the others.
+struct resample_group {
+    struct SwrContext *ctx;
+    int first_ch, num_ch;
+    // Per resample_groups() call.
+    uint8_t *out[MP_NUM_CHANNELS];
+    const uint8_t *in[MP_NUM_CHANNELS];
+    int out_samples, in_samples;
+    bool have_in;
+    int result;
+    struct mp_waiter waiter;
+};
+
 struct priv {
     struct mp_log *log;
     bool is_resampling;
@@ -51,6 +67,13 @@ struct priv {
     struct mp_aframe_pool *reorder_buffer;
     struct mp_aframe_pool *out_pool;
 
+    // If num_groups > 1, avrctx resamples groups[0], and the other groups
+    // have their own contexts, which are run on the thread pool.
+    struct resample_group *groups;
+    int num_groups;
+    struct mp_thread_pool *tp;
+    int current_thread_count;
+
     int in_rate_user; // user input sample rate
     int in_rate;      // actual rate (used by lavr), adjusted for playback speed
     int in_format;
@@ -78,6 +101,7 @@ const struct m_sub_options resample_conf = {
         {"audio-normalize-downmix", OPT_FLAG(normalize)},
         {"audio-resample-max-output-size", OPT_DOUBLE(max_output_frame_size)},
         {"audio-swresample-o", OPT_KEYVALUELIST(avopts)},
+        {"audio-resample-threads", OPT_INT(threads), M_RANGE(1, 64)},
         {0}
     },
     .size = sizeof(struct mp_resample_opts),
@@ -100,6 +124,11 @@ static void close_lavrr(struct priv *p)
     swr_free(&p->avrctx);
     swr_free(&p->avrctx_out);
 
+    for (int n = 1; n < p->num_groups; n++)
+        swr_free(&p->groups[n].ctx);
+    TA_FREEP(&p->groups);
+    p->num_groups = 0;
+
     TA_FREEP(&p->pre_out_fmt);
     TA_FREEP(&p->avrctx_fmt);
     TA_FREEP(&p->pool_fmt);
@@ -157,6 +186,95 @@ static void transpose_order(int *map, int num)
     memcpy(map, nmap, sizeof(nmap));
 }
 
+// Set the user resampler options, which must be the same for all contexts.
+static bool set_resampler_opts(struct priv *p, struct SwrContext *ctx)
+{
+    av_opt_set_int(ctx, "filter_size",        p->opts->filter_size, 0);
+    av_opt_set_int(ctx, "phase_shift",        p->opts->phase_shift, 0);
+    av_opt_set_int(ctx, "linear_interp",      p->opts->linear, 0);
+
+    double cutoff = p->opts->cutoff;
+    if (cutoff <= 0.0)
+        cutoff = MPMAX(1.0 - 6.5 / (p->opts->filter_size + 8), 0.80);
+    av_opt_set_double(ctx, "cutoff",          cutoff, 0);
+
+    int normalize = p->opts->normalize;
+    av_opt_set_double(ctx, "rematrix_maxval", normalize ? 1 : 1000, 0);
+
+    return mp_set_avopts(p->log, ctx, p->opts->avopts) >= 0;
+}
+
+static uint64_t fake_layout(int num_channels)
+{
+    struct mp_chmap chmap;
+    mp_chmap_set_unknown(&chmap, num_channels);
+    return mp_chmap_to_lavc_unchecked(&chmap);
+}
+
+// Split the channels into groups that can be resampled concurrently. This is
+// only possible if there is no remixing or reordering, and the input is
+// planar, so that each group can access its own planes directly.
+static void setup_groups(struct priv *p)
+{
+    p->num_groups = 0;
+
+    int num_ch = p->in_channels.num;
+    int threads = MPMIN(p->opts->threads, num_ch / 2);
+    if (threads < 2 || !af_fmt_is_planar(p->in_format) ||
+        !mp_chmap_equals(&p->in_channels, &p->out_channels))
+        return;
+
+    p->groups = talloc_array(p, struct resample_group, threads);
+    for (int n = 0; n < threads; n++) {
+        struct resample_group *g = &p->groups[n];
+        *g = (struct resample_group){
+            .first_ch = num_ch * n / threads,
+            .num_ch = num_ch * (n + 1) / threads - num_ch * n / threads,
+        };
+    }
+    p->num_groups = threads;
+}
+
+static bool init_groups(struct priv *p, enum AVSampleFormat in_samplefmt,
+                        enum AVSampleFormat out_samplefmt)
+{
+    if (p->num_groups < 2)
+        return true;
+
+    p->groups[0].ctx = p->avrctx;
+
+    for (int n = 1; n < p->num_groups; n++) {
+        struct resample_group *g = &p->groups[n];
+        g->ctx = swr_alloc();
+        if (!g->ctx || !set_resampler_opts(p, g->ctx))
+            return false;
+
+        uint64_t layout = fake_layout(g->num_ch);
+        av_opt_set_int(g->ctx, "in_channel_layout",  layout, 0);
+        av_opt_set_int(g->ctx, "out_channel_layout", layout, 0);
+        av_opt_set_int(g->ctx, "in_sample_rate",     p->in_rate, 0);
+        av_opt_set_int(g->ctx, "out_sample_rate",    p->out_rate, 0);
+        av_opt_set_int(g->ctx, "in_sample_fmt",      in_samplefmt, 0);
+        av_opt_set_int(g->ctx, "out_sample_fmt",     out_samplefmt, 0);
+
+        if (swr_init(g->ctx) < 0)
+            return false;
+    }
+
+    int threads = p->num_groups - 1;
+    if (threads != p->current_thread_count) {
+        TA_FREEP(&p->tp);
+        p->current_thread_count = 0;
+        MP_VERBOSE(p, "using %d threads for resampling\n", threads);
+        p->tp = mp_thread_pool_create(NULL, threads, threads, threads);
+        if (!p->tp)
+            return false;
+        p->current_thread_count = threads;
+    }
+
+    return true;
+}
+
 static bool configure_lavrr(struct priv *p, bool verbose)
 {
     close_lavrr(p);
@@ -187,19 +305,7 @@ static bool configure_lavrr(struct priv *p, bool verbose)
         goto error;
     }
 
-    av_opt_set_int(p->avrctx, "filter_size",        p->opts->filter_size, 0);
-    av_opt_set_int(p->avrctx, "phase_shift",        p->opts->phase_shift, 0);
-    av_opt_set_int(p->avrctx, "linear_interp",      p->opts->linear, 0);
-
-    double cutoff = p->opts->cutoff;
-    if (cutoff <= 0.0)
-        cutoff = MPMAX(1.0 - 6.5 / (p->opts->filter_size + 8), 0.80);
-    av_opt_set_double(p->avrctx, "cutoff",          cutoff, 0);
-
-    int normalize = p->opts->normalize;
-    av_opt_set_double(p->avrctx, "rematrix_maxval", normalize ? 1 : 1000, 0);
-
-    if (mp_set_avopts(p->log, p->avrctx, p->opts->avopts) < 0)
+    if (!set_resampler_opts(p, p->avrctx))
         goto error;
 
     struct mp_chmap map_in = p->in_channels;
@@ -250,6 +356,11 @@ static bool configure_lavrr(struct priv *p, bool verbose)
     }
     mp_chmap_get_reorder(p->reorder_out, &out_lavc, &map_out);
 
+    setup_groups(p);
+    // Each group writes to its own planes; avrctx_out packs them if needed.
+    if (p->num_groups > 1)
+        out_samplefmtp = av_get_planar_sample_fmt(out_samplefmt);
+
     p->pre_out_fmt = mp_aframe_create();
     mp_aframe_set_rate(p->pre_out_fmt, p->out_rate);
     mp_aframe_set_chmap(p->pre_out_fmt, &p->out_channels);
@@ -271,6 +382,12 @@ static bool configure_lavrr(struct priv *p, bool verbose)
 
     out_ch_layout = fudge_layout_conversion(p, in_ch_layout, out_ch_layout);
 
+    if (p->num_groups > 1) {
+        // No remixing is done, so a layout with the right count is enough.
+        in_ch_layout = fake_layout(p->groups[0].num_ch);
+        out_ch_layout = in_ch_layout;
+    }
+
     // Real conversion; output is input to avrctx_out.
     av_opt_set_int(p->avrctx, "in_channel_layout",  in_ch_layout, 0);
     av_opt_set_int(p->avrctx, "out_channel_layout", out_ch_layout, 0);
@@ -280,9 +397,7 @@ static bool configure_lavrr(struct priv *p, bool verbose)
     av_opt_set_int(p->avrctx, "out_sample_fmt",     out_samplefmtp, 0);
 
     // Just needs the correct number of channels for deplanarization.
-    struct mp_chmap fake_chmap;
-    mp_chmap_set_unknown(&fake_chmap, map_out.num);
-    uint64_t fake_out_ch_layout = mp_chmap_to_lavc_unchecked(&fake_chmap);
+    uint64_t fake_out_ch_layout = fake_layout(map_out.num);
     if (!fake_out_ch_layout)
         goto error;
     av_opt_set_int(p->avrctx_out, "in_channel_layout",  fake_out_ch_layout, 0);
@@ -304,6 +419,11 @@ static bool configure_lavrr(struct priv *p, bool verbose)
         MP_ERR(p, "Cannot open Libavresample context.\n");
         goto error;
     }
+
+    if (!init_groups(p, in_samplefmt, out_samplefmtp)) {
+        MP_ERR(p, "Cannot set up parallel resampling.\n");
+        goto error;
+    }
     return true;
 
 error:
@@ -323,8 +443,17 @@ static void reset(struct mp_filter *f)
     if (!p->avrctx)
         return;
     swr_close(p->avrctx);
-    if (swr_init(p->avrctx) < 0)
+    if (swr_init(p->avrctx) < 0) {
         close_lavrr(p);
+        return;
+    }
+    for (int n = 1; n < p->num_groups; n++) {
+        swr_close(p->groups[n].ctx);
+        if (swr_init(p->groups[n].ctx) < 0) {
+            close_lavrr(p);
+            return;
+        }
+    }
 }
 
 static void extra_output_conversion(struct mp_aframe *mpa)
@@ -399,6 +528,66 @@ static int resample_frame(struct SwrContext *r,
         av_i ? MPMIN(av_i->nb_samples, consume_in) : 0);
 }
 
+static void resample_group(struct resample_group *g)
+{
+    g->result = swr_convert(g->ctx, g->out, g->out_samples,
+                            g->have_in ? g->in : NULL, g->in_samples);
+}
+
+static void resample_group_thread(void *ptr)
+{
+    struct resample_group *g = ptr;
+
+    resample_group(g);
+    mp_waiter_wakeup(&g->waiter, 0);
+}
+
+// Like resample_frame(), but run each channel group on its own thread.
+static int resample_groups(struct priv *p,
+                           struct mp_aframe *out, struct mp_aframe *in,
+                           int consume_in)
+{
+    uint8_t **out_planes = mp_aframe_get_data_rw(out);
+    uint8_t **in_planes = in ? mp_aframe_get_data_ro(in) : NULL;
+    if (!out_planes || (in && !in_planes))
+        return -1;
+
+    for (int n = 0; n < p->num_groups; n++) {
+        struct resample_group *g = &p->groups[n];
+        for (int c = 0; c < g->num_ch; c++) {
+            g->out[c] = out_planes[g->first_ch + c];
+            g->in[c] = in_planes ? in_planes[g->first_ch + c] : NULL;
+        }
+        g->out_samples = mp_aframe_get_size(out);
+        g->in_samples = in ? MPMIN(mp_aframe_get_size(in), consume_in) : 0;
+        g->have_in = !!in;
+    }
+
+    for (int n = 1; n < p->num_groups; n++) {
+        struct resample_group *g = &p->groups[n];
+
+        g->waiter = (struct mp_waiter)MP_WAITER_INITIALIZER;
+
+        bool r = mp_thread_pool_run(p->tp, resample_group_thread, g);
+        // This is guaranteed by the API; and unrolling would be inconvenient.
+        assert(r);
+    }
+
+    resample_group(&p->groups[0]);
+
+    for (int n = 1; n < p->num_groups; n++)
+        mp_waiter_wait(&p->groups[n].waiter);
+
+    // All groups use the same parameters and get the same amount of input,
+    // so they must have the same delay and output the same amount.
+    int res = p->groups[0].result;
+    for (int n = 1; n < p->num_groups; n++) {
+        if (p->groups[n].result != res)
+            return -1;
+    }
+    return res;
+}
+
 static struct mp_frame filter_resample_output(struct priv *p,
                                               struct mp_aframe *in)
 {
@@ -423,7 +612,11 @@ static struct mp_frame filter_resample_output(struct priv *p,
 
     int out_samples = 0;
     if (samples) {
-        out_samples = resample_frame(p->avrctx, out, in, consume_in);
+        if (p->num_groups > 1) {
+            out_samples = resample_groups(p, out, in, consume_in);
+        } else {
+            out_samples = resample_frame(p->avrctx, out, in, consume_in);
+        }
         if (out_samples < 0 || out_samples > samples)
             goto error;
         mp_aframe_set_size(out, out_samples);
@@ -597,7 +790,10 @@ static void process(struct mp_filter *f)
         r = (AVRational){ r.num * mult, r.den * mult };
         if (r.den == r.num)
             r = (AVRational){0}; // fully disable
-        if (swr_set_compensation(p->avrctx, r.den - r.num, r.den) >= 0) {
+        bool ok = swr_set_compensation(p->avrctx, r.den - r.num, r.den) >= 0;
+        for (int n = 1; n < p->num_groups; n++)
+            ok &= swr_set_compensation(p->groups[n].ctx, r.den - r.num, r.den) >= 0;
+        if (ok) {
             exact_rate = true;
             p->is_resampling = true; // libswresample can auto-enable it
         }
@@ -658,6 +854,7 @@ static void destroy(struct mp_filter *f)
 
     close_lavrr(p);
     TA_FREEP(&p->input);
+    TA_FREEP(&p->tp);
 }
 
 static const struct mp_filter_info swresample_filter = {
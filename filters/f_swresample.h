@@ -25,6 +25,7 @@ struct mp_resample_opts {
     int allow_passthrough;
     double max_output_frame_size;
     char **avopts;
+    int threads;
 };
 
 #define MP_RESAMPLE_OPTS_DEF {  \
@@ -33,6 +34,7 @@ struct mp_resample_opts {
     .phase_shift = 10,          \
     .normalize   = 0,           \
     .max_output_frame_size = 40,\
+    .threads     = 1,           \
     }
 
 // Create the filter. If opts==NULL, use the global options as defaults.
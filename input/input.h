@@ -236,4 +236,35 @@ char *mp_json_encode_event(struct mpv_event *event);
 struct mpv_handle;
 char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *buf);
 
+// Like mp_ipc_consume_next_command(), but with per-client state, which also
+// tracks the protocol the client negotiated with the "set_protocol" command.
+// Commands are run asynchronously, so that a single thread can serve multiple
+// clients. Their replies arrive as MPV_EVENT_COMMAND_REPLY or
+// MPV_EVENT_GET_PROPERTY_REPLY events, which must be passed to
+// mp_ipc_encode_event() with the same state.
+// The first complete message is removed from the start of *buf (which is only
+// moved forward, not reallocated), and the reply (if any) is appended to
+// *out, with ta_parent used as for bstr_xappend().
+//  returns:
+//      1: a message was consumed
+//      0: *buf does not contain a complete message
+//      <0: protocol error, the client should be disconnected
+struct mp_ipc_async;
+struct mp_ipc_async *mp_ipc_async_create(void *ta_parent);
+int mp_ipc_execute_next(struct mpv_handle *client, struct mp_ipc_async *state,
+                        bstr *buf, void *ta_parent, bstr *out);
+
+// Whether a command the client expects to complete synchronously is still
+// running. No further commands should be consumed while this is the case, so
+// that replies are sent in the same order as before.
+bool mp_ipc_async_busy(struct mp_ipc_async *state);
+
+// Like mp_json_encode_event(), but uses the client's protocol, formats replies
+// to commands started with mp_ipc_execute_next() as the client expects them,
+// and appends the result to *out. While mp_ipc_async_busy() is true, other
+// events are held back, and appended to *out after the reply. Returns false
+// on encoding errors.
+bool mp_ipc_encode_event(struct mp_ipc_async *state, struct mpv_event *event,
+                         void *ta_parent, bstr *out);
+
 #endif /* MPLAYER_INPUT_H */
@@ -28,6 +28,7 @@
 
 #include "config.h"
 
+#include "osdep/atomic.h"
 #include "osdep/io.h"
 #include "osdep/threads.h"
 
@@ -45,18 +46,44 @@
 #define MSG_NOSIGNAL 0
 #endif
 
+// Size of a single read() from a client socket.
+#define READ_SIZE (64 * 1024)
+
+// If more than this is queued for a client, stop reading its commands and
+// events until it has read some of it. Events then pile up in the client API
+// queue (which is bounded), and commands in the socket buffer.
+#define MAX_OUTPUT (4 * 1024 * 1024)
+
 struct mp_ipc_ctx {
     struct mp_log *log;
     struct mp_client_api *client_api;
     const char *path;
 
     pthread_t thread;
-    int death_pipe[2];
+    int wakeup_pipe[2];
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    int listen_fd;                      // closed by mp_uninit_ipc()
+    bool thread_running;
+    bool in_poll;                       // thread is in poll() with listen_fd
+    uint64_t poll_count;
+    struct client_arg **new_clients;    // not yet picked up by the thread
+    int num_new_clients;
+    int num_clients;                    // all clients not destroyed yet
+    bool terminate;                     // mp_uninit_ipc() was called
+    bool detached;                      // thread frees this struct on exit
+
+    // Accessed by the IPC thread only (after it was started).
+    int client_num;
+    struct client_arg **clients;
+    int num_active;
 };
 
 struct client_arg {
     struct mp_log *log;
     struct mpv_handle *client;
+    struct mp_ipc_ctx *ctx;
 
     const char *client_name;
     int client_fd;
@@ -64,164 +91,380 @@ struct client_arg {
     bool quit_on_close;
 
     bool writable;
+
+    atomic_bool wakeup;         // set by the client API wakeup callback
+    bool has_events;            // mpv_wait_event() may return something
+    bool eof;                   // client closed its end, stop after flushing
+    bool dead;
+    struct mp_ipc_async *async;
+    bstr input;                 // received data, not yet executed
+    bool input_ready;           // input may contain a complete command
+    bstr output;                // data to send, starting at output_pos
+    size_t output_pos;
 };
 
-static int ipc_write_str(struct client_arg *client, const char *buf)
+static void wakeup_ipc_thread(struct mp_ipc_ctx *ctx)
 {
-    size_t count = strlen(buf);
-    while (count > 0) {
-        ssize_t rc = send(client->client_fd, buf, count, MSG_NOSIGNAL);
-        if (rc <= 0) {
-            if (rc == 0)
-                return -1;
+    (void)write(ctx->wakeup_pipe[1], &(char){0}, 1);
+}
+
+static void client_wakeup_cb(void *p)
+{
+    struct client_arg *client = p;
+    if (!atomic_exchange(&client->wakeup, true))
+        wakeup_ipc_thread(client->ctx);
+}
+
+static size_t output_pending(struct client_arg *client)
+{
+    return client->output.len - client->output_pos;
+}
+
+static bool client_busy(struct client_arg *client)
+{
+    return output_pending(client) > MAX_OUTPUT ||
+           mp_ipc_async_busy(client->async);
+}
 
-            if (errno == EBADF || errno == ENOTSOCK) {
+// Called after appending to the output. If nobody reads it, drop it again.
+static void drop_unwritable(struct client_arg *client)
+{
+    if (!client->writable)
+        client->output.len = client->output_pos;
+}
+
+// Send as much of the queued output as possible without blocking. All
+// messages queued during a loop iteration are written with a single call.
+static void flush_output(struct client_arg *client)
+{
+    while (output_pending(client)) {
+        ssize_t rc = send(client->client_fd,
+                          client->output.start + client->output_pos,
+                          output_pending(client), MSG_NOSIGNAL);
+        if (rc <= 0) {
+            if (rc < 0 && errno == EINTR)
+                continue;
+            if (rc < 0 && errno == EAGAIN)
+                break;
+            if (rc < 0 && (errno == EBADF || errno == ENOTSOCK)) {
                 client->writable = false;
-                return 0;
+            } else {
+                MP_ERR(client, "Write error (%s)\n",
+                       rc < 0 ? mp_strerror(errno) : "closed");
+                client->dead = true;
             }
+            client->output_pos = client->output.len;
+            break;
+        }
+        client->output_pos += rc;
+    }
 
-            if (errno == EINTR || errno == EAGAIN)
-                continue;
+    if (!output_pending(client)) {
+        client->output.len = 0;
+        client->output_pos = 0;
+    } else if (client->output_pos > client->output.len / 2) {
+        memmove(client->output.start, client->output.start + client->output_pos,
+                output_pending(client));
+        client->output.len -= client->output_pos;
+        client->output_pos = 0;
+    }
+}
 
-            return rc;
+static void read_input(struct client_arg *client)
+{
+    unsigned char buf[READ_SIZE];
+    ssize_t bytes = read(client->client_fd, buf, sizeof(buf));
+    if (bytes < 0) {
+        if (errno != EAGAIN && errno != EINTR) {
+            MP_ERR(client, "Read error (%s)\n", mp_strerror(errno));
+            client->dead = true;
         }
+        return;
+    }
 
-        count -= rc;
-        buf   += rc;
+    if (bytes == 0) {
+        MP_VERBOSE(client, "Client disconnected\n");
+        client->eof = true;
+        return;
     }
 
-    return 0;
+    bstr_xappend(client, &client->input, (bstr){buf, bytes});
+    client->input_ready = true;
 }
 
-static void *client_thread(void *p)
+static void execute_input(struct client_arg *client)
 {
-    pthread_detach(pthread_self());
+    bstr rest = client->input;
+    while (client->input_ready && !client_busy(client)) {
+        int r = mp_ipc_execute_next(client->client, client->async, &rest,
+                                    client, &client->output);
+        drop_unwritable(client);
+        if (r < 0) {
+            client->dead = true;
+            break;
+        }
+        if (r == 0)
+            client->input_ready = false;
+    }
 
-    // We don't use MSG_NOSIGNAL because the moldy fruit OS doesn't support it.
-    struct sigaction sa = { .sa_handler = SIG_IGN, .sa_flags = SA_RESTART };
-    sigfillset(&sa.sa_mask);
-    sigaction(SIGPIPE, &sa, NULL);
+    if (rest.len < client->input.len) {
+        memmove(client->input.start, rest.start, rest.len);
+        client->input.len = rest.len;
+    }
+}
 
-    int rc;
+static void drain_events(struct client_arg *client)
+{
+    while (client->has_events && !client->dead &&
+           output_pending(client) <= MAX_OUTPUT)
+    {
+        mpv_event *event = mpv_wait_event(client->client, 0);
+
+        if (event->event_id == MPV_EVENT_NONE) {
+            client->has_events = false;
+            break;
+        }
 
-    struct client_arg *arg = p;
-    bstr client_msg = { talloc_strdup(NULL, ""), 0 };
+        if (event->event_id == MPV_EVENT_SHUTDOWN) {
+            client->dead = true;
+            break;
+        }
 
-    mpthread_set_name(arg->client_name);
+        // Replies are needed to track the state of running commands.
+        if (!client->writable && event->event_id != MPV_EVENT_COMMAND_REPLY &&
+            event->event_id != MPV_EVENT_GET_PROPERTY_REPLY)
+            continue;
 
-    int pipe_fd = mpv_get_wakeup_pipe(arg->client);
-    if (pipe_fd < 0) {
-        MP_ERR(arg, "Could not get wakeup pipe\n");
-        goto done;
+        bool ok = mp_ipc_encode_event(client->async, event, client,
+                                      &client->output);
+        drop_unwritable(client);
+        if (!ok) {
+            MP_ERR(client, "Encoding error\n");
+            client->dead = true;
+            break;
+        }
     }
+}
 
-    MP_VERBOSE(arg, "Client connected\n");
+static bool can_make_progress(struct client_arg *client)
+{
+    if (client->dead || output_pending(client) > MAX_OUTPUT)
+        return false;
+    return client->has_events || (!mp_ipc_async_busy(client->async) &&
+                                  client->input_ready);
+}
 
-    struct pollfd fds[2] = {
-        {.events = POLLIN, .fd = pipe_fd},
-        {.events = POLLIN, .fd = arg->client_fd},
-    };
+static void process_client(struct client_arg *client, int revents)
+{
+    if (atomic_exchange(&client->wakeup, false))
+        client->has_events = true;
 
-    fcntl(arg->client_fd, F_SETFL, fcntl(arg->client_fd, F_GETFL, 0) | O_NONBLOCK);
+    if (revents & POLLOUT)
+        flush_output(client);
 
+    if ((revents & (POLLIN | POLLHUP | POLLERR | POLLNVAL)) && !client->dead &&
+        !client->eof && !client_busy(client))
+        read_input(client);
+
+    // Events first, because a command reply can unblock further commands.
+    // Repeat if flushing made room for more output, since the client API
+    // won't wake us up again for events that are already queued.
     while (1) {
-        rc = poll(fds, 2, 0);
-        if (rc == 0)
-            rc = poll(fds, 2, -1);
-        if (rc < 0) {
-            MP_ERR(arg, "Poll error\n");
-            continue;
+        drain_events(client);
+        if (!client->dead)
+            execute_input(client);
+        if (!client->dead)
+            flush_output(client);
+        if (!can_make_progress(client))
+            break;
+    }
+
+    if (client->eof && !mp_ipc_async_busy(client->async) &&
+        !output_pending(client))
+        client->dead = true;
+}
+
+static short client_poll_events(struct client_arg *client)
+{
+    short events = 0;
+    if (!client->eof && !client_busy(client))
+        events |= POLLIN;
+    if (output_pending(client))
+        events |= POLLOUT;
+    return events;
+}
+
+static void destroy_client(struct mp_ipc_ctx *ctx, struct client_arg *client)
+{
+    if (client->input.len > 0)
+        MP_WARN(client, "Ignoring unterminated command on disconnect.\n");
+
+    struct mpv_handle *h = client->client;
+    mpv_set_wakeup_callback(h, NULL, NULL);
+
+    if (client->close_client_fd)
+        close(client->client_fd);
+    bool quit = client->quit_on_close;
+    talloc_free(client);
+
+    if (quit) {
+        mpv_terminate_destroy(h);
+    } else {
+        mpv_destroy(h);
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    ctx->num_clients--;
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+static void ipc_start_client_json(struct mp_ipc_ctx *ctx, int id, int fd);
+
+static void accept_clients(struct mp_ipc_ctx *ctx)
+{
+    int new_fds[16];
+    int num_new = 0;
+
+    // The lock is held, because mp_uninit_ipc() can close the socket anytime.
+    pthread_mutex_lock(&ctx->lock);
+    while (ctx->listen_fd >= 0 && num_new < MP_ARRAY_SIZE(new_fds)) {
+        int client_fd = accept(ctx->listen_fd, NULL, NULL);
+        if (client_fd < 0) {
+            if (errno == EAGAIN || errno == EINTR || errno == ECONNABORTED)
+                break;
+            MP_ERR(ctx, "Could not accept IPC client\n");
+            close(ctx->listen_fd);
+            ctx->listen_fd = -1;
+            break;
         }
+        new_fds[num_new++] = client_fd;
+    }
+    pthread_mutex_unlock(&ctx->lock);
 
-        if (fds[0].revents & POLLIN) {
-            mp_flush_wakeup_pipe(pipe_fd);
+    for (int n = 0; n < num_new; n++)
+        ipc_start_client_json(ctx, ctx->client_num++, new_fds[n]);
+}
 
-            while (1) {
-                mpv_event *event = mpv_wait_event(arg->client, 0);
+static void free_ipc_ctx(struct mp_ipc_ctx *ctx)
+{
+    if (ctx->listen_fd >= 0)
+        close(ctx->listen_fd);
+    close(ctx->wakeup_pipe[0]);
+    close(ctx->wakeup_pipe[1]);
+    pthread_cond_destroy(&ctx->wakeup);
+    pthread_mutex_destroy(&ctx->lock);
+    talloc_free(ctx);
+}
 
-                if (event->event_id == MPV_EVENT_NONE)
-                    break;
+// Serves the listening socket and all clients. It keeps running after
+// mp_uninit_ipc() until all clients are gone.
+static void *ipc_thread(void *p)
+{
+    struct mp_ipc_ctx *ctx = p;
 
-                if (event->event_id == MPV_EVENT_SHUTDOWN)
-                    goto done;
+    mpthread_set_name("ipc");
 
-                if (!arg->writable)
-                    continue;
+    // We don't use MSG_NOSIGNAL because the moldy fruit OS doesn't support it.
+    struct sigaction sa = { .sa_handler = SIG_IGN, .sa_flags = SA_RESTART };
+    sigfillset(&sa.sa_mask);
+    sigaction(SIGPIPE, &sa, NULL);
 
-                char *event_msg = mp_json_encode_event(event);
-                if (!event_msg) {
-                    MP_ERR(arg, "Encoding error\n");
-                    goto done;
-                }
+    struct pollfd *fds = NULL;
 
-                rc = ipc_write_str(arg, event_msg);
-                talloc_free(event_msg);
-                if (rc < 0) {
-                    MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
-                    goto done;
-                }
-            }
+    while (1) {
+        int first_new = ctx->num_active;
+        pthread_mutex_lock(&ctx->lock);
+        for (int n = 0; n < ctx->num_new_clients; n++)
+            MP_TARRAY_APPEND(ctx, ctx->clients, ctx->num_active, ctx->new_clients[n]);
+        ctx->num_new_clients = 0;
+        bool done = ctx->terminate && !ctx->num_clients;
+        pthread_mutex_unlock(&ctx->lock);
+
+        for (int n = first_new; n < ctx->num_active; n++) {
+            struct client_arg *client = ctx->clients[n];
+            MP_VERBOSE(client, "Client connected\n");
+            // Calls the callback once, which makes us check for events.
+            mpv_set_wakeup_callback(client->client, client_wakeup_cb, client);
         }
 
-        if (fds[1].revents & (POLLIN | POLLHUP | POLLNVAL)) {
-            while (1) {
-                char buf[128];
-                bstr append = { buf, 0 };
+        if (done)
+            break;
+
+        int num_fds = 2 + ctx->num_active;
+        fds = talloc_realloc(NULL, fds, struct pollfd, num_fds);
+        fds[0] = (struct pollfd){.events = POLLIN, .fd = ctx->wakeup_pipe[0]};
+        for (int n = 0; n < ctx->num_active; n++) {
+            struct client_arg *client = ctx->clients[n];
+            short events = client_poll_events(client);
+            // Negative FDs are ignored, which avoids busy looping on POLLHUP
+            // while a client is blocked.
+            fds[2 + n] = (struct pollfd){
+                .events = events,
+                .fd = events ? client->client_fd : -1,
+            };
+        }
 
-                ssize_t bytes = read(arg->client_fd, buf, sizeof(buf));
-                if (bytes < 0) {
-                    if (errno == EAGAIN)
-                        break;
+        pthread_mutex_lock(&ctx->lock);
+        fds[1] = (struct pollfd){.events = POLLIN, .fd = ctx->listen_fd};
+        ctx->in_poll = true;
+        pthread_mutex_unlock(&ctx->lock);
 
-                    MP_ERR(arg, "Read error (%s)\n", mp_strerror(errno));
-                    goto done;
-                }
+        int rc = poll(fds, num_fds, -1);
 
-                if (bytes == 0) {
-                    MP_VERBOSE(arg, "Client disconnected\n");
-                    goto done;
-                }
+        pthread_mutex_lock(&ctx->lock);
+        ctx->in_poll = false;
+        ctx->poll_count++;
+        pthread_cond_broadcast(&ctx->wakeup);
+        pthread_mutex_unlock(&ctx->lock);
 
-                append.len = bytes;
+        if (rc < 0 && errno != EINTR) {
+            MP_ERR(ctx, "Poll error\n");
+            continue;
+        }
 
-                bstr_xappend(NULL, &client_msg, append);
+        if (fds[0].revents & POLLIN)
+            mp_flush_wakeup_pipe(ctx->wakeup_pipe[0]);
 
-                while (bstrchr(client_msg, '\n') != -1) {
-                    char *reply_msg = mp_ipc_consume_next_command(arg->client,
-                        NULL, &client_msg);
+        if (fds[1].revents & POLLIN)
+            accept_clients(ctx);
 
-                    if (reply_msg && arg->writable) {
-                        rc = ipc_write_str(arg, reply_msg);
-                        if (rc < 0) {
-                            MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
-                            talloc_free(reply_msg);
-                            goto done;
-                        }
-                    }
+        for (int n = 0; n < ctx->num_active; n++) {
+            struct client_arg *client = ctx->clients[n];
+            process_client(client, fds[2 + n].revents);
+        }
 
-                    talloc_free(reply_msg);
-                }
+        for (int n = ctx->num_active - 1; n >= 0; n--) {
+            struct client_arg *client = ctx->clients[n];
+            if (client->dead) {
+                MP_TARRAY_REMOVE_AT(ctx->clients, ctx->num_active, n);
+                destroy_client(ctx, client);
             }
         }
     }
 
-done:
-    if (client_msg.len > 0)
-        MP_WARN(arg, "Ignoring unterminated command on disconnect.\n");
-    talloc_free(client_msg.start);
-    if (arg->close_client_fd)
-        close(arg->client_fd);
-    struct mpv_handle *h = arg->client;
-    bool quit = arg->quit_on_close;
-    talloc_free(arg);
-    if (quit) {
-        mpv_terminate_destroy(h);
-    } else {
-        mpv_destroy(h);
-    }
+    talloc_free(fds);
+
+    pthread_mutex_lock(&ctx->lock);
+    bool detached = ctx->detached;
+    pthread_mutex_unlock(&ctx->lock);
+
+    if (detached)
+        free_ipc_ctx(ctx);
+
     return NULL;
 }
 
+// Must be called with ctx->lock held.
+static bool start_ipc_thread(struct mp_ipc_ctx *ctx)
+{
+    if (!ctx->thread_running) {
+        if (pthread_create(&ctx->thread, NULL, ipc_thread, ctx))
+            return false;
+        ctx->thread_running = true;
+    }
+    return true;
+}
+
 static bool ipc_start_client(struct mp_ipc_ctx *ctx, struct client_arg *client,
                              bool free_on_init_fail)
 {
@@ -231,9 +474,21 @@ static bool ipc_start_client(struct mp_ipc_ctx *ctx, struct client_arg *client,
         goto err;
 
     client->log = mp_client_get_log(client->client);
-
-    pthread_t client_thr;
-    if (pthread_create(&client_thr, NULL, client_thread, client))
+    client->ctx = ctx;
+    client->async = mp_ipc_async_create(client);
+
+    fcntl(client->client_fd, F_SETFL,
+          fcntl(client->client_fd, F_GETFL, 0) | O_NONBLOCK);
+
+    pthread_mutex_lock(&ctx->lock);
+    bool ok = !ctx->terminate && start_ipc_thread(ctx);
+    if (ok) {
+        MP_TARRAY_APPEND(ctx, ctx->new_clients, ctx->num_new_clients, client);
+        ctx->num_clients++;
+        wakeup_ipc_thread(ctx);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    if (!ok)
         goto err;
 
     return true;
@@ -269,6 +524,9 @@ static void ipc_start_client_json(struct mp_ipc_ctx *ctx, int id, int fd)
 bool mp_ipc_start_anon_client(struct mp_ipc_ctx *ctx, struct mpv_handle *h,
                               int out_fd[2])
 {
+    if (!ctx)
+        return false;
+
     int pair[2];
     if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair))
         return false;
@@ -295,23 +553,19 @@ bool mp_ipc_start_anon_client(struct mp_ipc_ctx *ctx, struct mpv_handle *h,
     return true;
 }
 
-static void *ipc_thread(void *p)
+static int create_listen_socket(struct mp_ipc_ctx *arg)
 {
     int rc;
 
     int ipc_fd;
     struct sockaddr_un ipc_un = {0};
 
-    struct mp_ipc_ctx *arg = p;
-
-    mpthread_set_name("ipc socket listener");
-
     MP_VERBOSE(arg, "Starting IPC master\n");
 
     ipc_fd = socket(AF_UNIX, SOCK_STREAM, 0);
     if (ipc_fd < 0) {
         MP_ERR(arg, "Could not create IPC socket\n");
-        goto done;
+        goto error;
     }
 
     fchmod(ipc_fd, 0600);
@@ -319,7 +573,7 @@ static void *ipc_thread(void *p)
     size_t path_len = strlen(arg->path);
     if (path_len >= sizeof(ipc_un.sun_path) - 1) {
         MP_ERR(arg, "Could not create IPC socket\n");
-        goto done;
+        goto error;
     }
 
     ipc_un.sun_family = AF_UNIX,
@@ -336,50 +590,25 @@ static void *ipc_thread(void *p)
     rc = bind(ipc_fd, (struct sockaddr *) &ipc_un, addr_len);
     if (rc < 0) {
         MP_ERR(arg, "Could not bind IPC socket\n");
-        goto done;
+        goto error;
     }
 
     rc = listen(ipc_fd, 10);
     if (rc < 0) {
         MP_ERR(arg, "Could not listen on IPC socket\n");
-        goto done;
+        goto error;
     }
 
-    MP_VERBOSE(arg, "Listening to IPC socket.\n");
-
-    int client_num = 0;
-
-    struct pollfd fds[2] = {
-        {.events = POLLIN, .fd = arg->death_pipe[0]},
-        {.events = POLLIN, .fd = ipc_fd},
-    };
+    fcntl(ipc_fd, F_SETFL, fcntl(ipc_fd, F_GETFL, 0) | O_NONBLOCK);
 
-    while (1) {
-        rc = poll(fds, 2, -1);
-        if (rc < 0) {
-            MP_ERR(arg, "Poll error\n");
-            continue;
-        }
-
-        if (fds[0].revents & POLLIN)
-            goto done;
-
-        if (fds[1].revents & POLLIN) {
-            int client_fd = accept(ipc_fd, NULL, NULL);
-            if (client_fd < 0) {
-                MP_ERR(arg, "Could not accept IPC client\n");
-                goto done;
-            }
+    MP_VERBOSE(arg, "Listening to IPC socket.\n");
 
-            ipc_start_client_json(arg, client_num++, client_fd);
-        }
-    }
+    return ipc_fd;
 
-done:
+error:
     if (ipc_fd >= 0)
         close(ipc_fd);
-
-    return NULL;
+    return -1;
 }
 
 struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
@@ -392,9 +621,29 @@ struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
         .log        = mp_log_new(arg, global->log, "ipc"),
         .client_api = client_api,
         .path       = mp_get_user_path(arg, global, opts->ipc_path),
-        .death_pipe = {-1, -1},
+        .listen_fd  = -1,
     };
 
+    if (mp_make_wakeup_pipe(arg->wakeup_pipe) < 0) {
+        talloc_free(arg);
+        talloc_free(opts);
+        return NULL;
+    }
+    pthread_mutex_init(&arg->lock, NULL);
+    pthread_cond_init(&arg->wakeup, NULL);
+
+    if (arg->path && arg->path[0]) {
+        arg->listen_fd = create_listen_socket(arg);
+        if (arg->listen_fd >= 0) {
+            pthread_mutex_lock(&arg->lock);
+            if (!start_ipc_thread(arg)) {
+                close(arg->listen_fd);
+                arg->listen_fd = -1;
+            }
+            pthread_mutex_unlock(&arg->lock);
+        }
+    }
+
     if (opts->ipc_client && opts->ipc_client[0]) {
         int fd = -1;
         if (strncmp(opts->ipc_client, "fd://", 5) == 0) {
@@ -412,24 +661,7 @@ struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
 
     talloc_free(opts);
 
-    if (!arg->path || !arg->path[0])
-        goto out;
-
-    if (mp_make_wakeup_pipe(arg->death_pipe) < 0)
-        goto out;
-
-    if (pthread_create(&arg->thread, NULL, ipc_thread, arg))
-        goto out;
-
     return arg;
-
-out:
-    if (arg->death_pipe[0] >= 0) {
-        close(arg->death_pipe[0]);
-        close(arg->death_pipe[1]);
-    }
-    talloc_free(arg);
-    return NULL;
 }
 
 void mp_uninit_ipc(struct mp_ipc_ctx *arg)
@@ -437,10 +669,31 @@ void mp_uninit_ipc(struct mp_ipc_ctx *arg)
     if (!arg)
         return;
 
-    (void)write(arg->death_pipe[1], &(char){0}, 1);
-    pthread_join(arg->thread, NULL);
+    pthread_mutex_lock(&arg->lock);
+    arg->terminate = true;
+    if (arg->listen_fd >= 0)
+        close(arg->listen_fd);
+    arg->listen_fd = -1;
+    bool running = arg->thread_running;
+    pthread_t thread = arg->thread;
+    if (running)
+        wakeup_ipc_thread(arg);
+    // poll() references the socket, so it's really closed only after it
+    // returns. Waiting for this is safe, unlike waiting for client activity.
+    uint64_t poll_count = arg->poll_count;
+    while (arg->in_poll && arg->poll_count == poll_count)
+        pthread_cond_wait(&arg->wakeup, &arg->lock);
+    // If there are still clients, let them continue, and have the thread free
+    // the context once they are done. (arg must not be accessed after unlock.)
+    bool detached = arg->detached = running && arg->num_clients > 0;
+    pthread_mutex_unlock(&arg->lock);
+
+    if (detached) {
+        pthread_detach(thread);
+        return;
+    }
 
-    close(arg->death_pipe[0]);
-    close(arg->death_pipe[1]);
-    talloc_free(arg);
+    if (running)
+        pthread_join(thread, NULL);
+    free_ipc_ctx(arg);
 }
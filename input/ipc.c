@@ -15,11 +15,14 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <inttypes.h>
+
 #include "config.h"
 
 #include "common/msg.h"
 #include "input/input.h"
 #include "misc/json.h"
+#include "misc/msgpack.h"
 #include "misc/node.h"
 #include "options/m_option.h"
 #include "options/options.h"
@@ -74,14 +77,44 @@ static void mpv_node_map_add_string(void *ta_parent, mpv_node *src, const char *
     mpv_node_map_add(ta_parent, src, key, &val_node);
 }
 
+// Maximum size of a single binary protocol message received from a client.
+#define MAX_FRAME_SIZE (16 * 1024 * 1024)
+
+// Maximum size of events held back while a synchronous command is running.
+// If more events happen, they are written before the reply after all.
+#define MAX_HELD_EVENTS (1024 * 1024)
+
+enum ipc_protocol {
+    IPC_PROTOCOL_JSON,      // newline-separated JSON or text commands
+    IPC_PROTOCOL_MSGPACK,   // length-prefixed msgpack (see ipc.rst)
+};
+
+// Per-client state for mp_ipc_execute_next().
+struct mp_ipc_async {
+    enum ipc_protocol protocol;
+    uint64_t next_id;
+    struct ipc_async_cmd **cmds;
+    int num_cmds;
+    int num_sync;
+    bstr held;              // encoded events to write after the sync reply
+};
+
+struct ipc_async_cmd {
+    uint64_t id;            // reply_userdata passed to the client API
+    bool sync;              // the IPC client did not request an async command
+    int64_t reqid;          // for !sync
+    mpv_node *reqid_node;   // for sync; copy of "request_id", or NULL
+    bool string;            // get_property_string (MPV_EVENT_GET_PROPERTY_REPLY)
+};
+
 // This is supposed to write a reply that looks like "normal" command execution.
 static void mpv_format_command_reply(void *ta_parent, mpv_event *event,
-                                     mpv_node *dst)
+                                     int64_t reqid, mpv_node *dst)
 {
     assert(event->event_id == MPV_EVENT_COMMAND_REPLY);
     mpv_event_command *cmd = event->data;
 
-    mpv_node_map_add_int64(ta_parent, dst, "request_id", event->reply_userdata);
+    mpv_node_map_add_int64(ta_parent, dst, "request_id", reqid);
 
     mpv_node_map_add_string(ta_parent, dst, "error",
                             mpv_error_string(event->error));
@@ -89,19 +122,24 @@ static void mpv_format_command_reply(void *ta_parent, mpv_event *event,
     mpv_node_map_add(ta_parent, dst, "data", &cmd->result);
 }
 
-char *mp_json_encode_event(mpv_event *event)
+static void format_event(void *ta_parent, mpv_event *event, mpv_node *dst)
 {
-    void *ta_parent = talloc_new(NULL);
-
-    struct mpv_node event_node;
     if (event->event_id == MPV_EVENT_COMMAND_REPLY) {
-        event_node = (mpv_node){.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
-        mpv_format_command_reply(ta_parent, event, &event_node);
+        *dst = (mpv_node){.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
+        mpv_format_command_reply(ta_parent, event, event->reply_userdata, dst);
     } else {
-        mpv_event_to_node(&event_node, event);
+        mpv_event_to_node(dst, event);
         // Abuse mpv_event_to_node() internals.
-        talloc_steal(ta_parent, node_get_alloc(&event_node));
+        talloc_steal(ta_parent, node_get_alloc(dst));
     }
+}
+
+char *mp_json_encode_event(mpv_event *event)
+{
+    void *ta_parent = talloc_new(NULL);
+
+    struct mpv_node event_node;
+    format_event(ta_parent, event, &event_node);
 
     char *output = talloc_strdup(NULL, "");
     json_write(&output, &event_node);
@@ -112,35 +150,127 @@ char *mp_json_encode_event(mpv_event *event)
     return output;
 }
 
-// Function is allowed to modify src[n].
-static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
-                                  char *src)
+// Add the fields common to all replies to reply_node.
+static void finish_reply(void *ta_parent, mpv_node *reply_node,
+                         mpv_node *reqid_node, int rc)
 {
-    int rc;
+    /* If the request contains a "request_id", copy it back into the response.
+     * This makes it easier on the requester to match up the IPC results with
+     * the original requests.
+     */
+    if (reqid_node) {
+        mpv_node_map_add(ta_parent, reply_node, "request_id", reqid_node);
+    } else {
+        mpv_node_map_add_int64(ta_parent, reply_node, "request_id", 0);
+    }
+
+    mpv_node_map_add_string(ta_parent, reply_node, "error", mpv_error_string(rc));
+}
+
+// Serialize node and append it to *out, using the framing of the protocol.
+static bool encode_message(void *ta_parent, bstr *out,
+                           enum ipc_protocol protocol, mpv_node *node)
+{
+    if (protocol == IPC_PROTOCOL_MSGPACK) {
+        size_t start = out->len;
+        // Placeholder for the big endian 32 bit size.
+        bstr_xappend(ta_parent, out, (bstr){(unsigned char *)"\0\0\0\0", 4});
+        if (msgpack_write(ta_parent, out, node) < 0 ||
+            out->len - start - 4 > UINT32_MAX)
+        {
+            out->len = start;
+            return false;
+        }
+        uint32_t size = out->len - start - 4;
+        for (int n = 0; n < 4; n++)
+            out->start[start + n] = size >> ((3 - n) * 8);
+        return true;
+    }
+
+    if (json_write_bstr(ta_parent, out, node) < 0)
+        return false;
+    bstr_xappend(ta_parent, out, bstr0("\n"));
+    return true;
+}
+
+static struct ipc_async_cmd *new_async_cmd(struct mp_ipc_async *state,
+                                           bool async, int64_t reqid,
+                                           mpv_node *reqid_node)
+{
+    struct ipc_async_cmd *c = talloc_ptrtype(state, c);
+    *c = (struct ipc_async_cmd){
+        .id = state->next_id++,
+        .sync = !async,
+        .reqid = reqid,
+    };
+    if (reqid_node && !async) {
+        static const struct m_option type = { .type = CONF_TYPE_NODE };
+        c->reqid_node = talloc_zero(c, mpv_node);
+        m_option_get_node(&type, c, c->reqid_node, reqid_node);
+    }
+    return c;
+}
+
+// Register c if its request was started (rc >= 0), otherwise free it.
+static int add_async_cmd(struct mp_ipc_async *state, struct ipc_async_cmd *c,
+                         int rc)
+{
+    if (rc < 0) {
+        talloc_free(c);
+        return rc;
+    }
+
+    MP_TARRAY_APPEND(state, state->cmds, state->num_cmds, c);
+    state->num_sync += c->sync;
+    return rc;
+}
+
+static int start_async_command(struct mpv_handle *client,
+                               struct mp_ipc_async *state, mpv_node *cmd_node,
+                               bool async, int64_t reqid, mpv_node *reqid_node)
+{
+    struct ipc_async_cmd *c = new_async_cmd(state, async, reqid, reqid_node);
+    return add_async_cmd(state, c,
+                         mpv_command_node_async(client, c->id, cmd_node));
+}
+
+// The property is read on the playloop, and the reply is sent like the reply
+// to a synchronous command.
+static int start_async_get_property(struct mpv_handle *client,
+                                    struct mp_ipc_async *state,
+                                    const char *name, bool string,
+                                    mpv_node *reqid_node)
+{
+    struct ipc_async_cmd *c = new_async_cmd(state, false, 0, reqid_node);
+    c->string = string;
+    mpv_format format = string ? MPV_FORMAT_STRING : MPV_FORMAT_NODE;
+    return add_async_cmd(state, c,
+                         mpv_get_property_async(client, c->id, name, format));
+}
+
+// Execute the command in msg_node, and write the reply to *reply_node. If
+// state is not NULL, commands are run asynchronously (see
+// mp_ipc_execute_next()). Returns false if there is no reply (yet).
+static bool execute_command(struct mpv_handle *client, void *ta_parent,
+                            struct mp_ipc_async *state, mpv_node *msg_node,
+                            mpv_node *reply_node)
+{
+    int rc = MPV_ERROR_SUCCESS;
     const char *cmd = NULL;
     struct mp_log *log = mp_client_get_log(client);
 
-    mpv_node msg_node;
-    mpv_node reply_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
     mpv_node *reqid_node = NULL;
     int64_t reqid = 0;
     mpv_node *async_node = NULL;
     bool async = false;
     bool send_reply = true;
 
-    rc = json_parse(ta_parent, &msg_node, &src, 50);
-    if (rc < 0) {
-        mp_err(log, "malformed JSON received: '%s'\n", src);
-        rc = MPV_ERROR_INVALID_PARAMETER;
-        goto error;
-    }
-
-    if (msg_node.format != MPV_FORMAT_NODE_MAP) {
+    if (msg_node->format != MPV_FORMAT_NODE_MAP) {
         rc = MPV_ERROR_INVALID_PARAMETER;
         goto error;
     }
 
-    async_node = node_map_get(&msg_node, "async");
+    async_node = node_map_get(msg_node, "async");
     if (async_node) {
         if (async_node->format != MPV_FORMAT_FLAG) {
             rc = MPV_ERROR_INVALID_PARAMETER;
@@ -149,7 +279,7 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
         async = async_node->u.flag;
     }
 
-    reqid_node = node_map_get(&msg_node, "request_id");
+    reqid_node = node_map_get(msg_node, "request_id");
     if (reqid_node) {
         if (reqid_node->format == MPV_FORMAT_INT64) {
             reqid = reqid_node->u.int64;
@@ -163,7 +293,7 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
         }
     }
 
-    mpv_node *cmd_node = node_map_get(&msg_node, "command");
+    mpv_node *cmd_node = node_map_get(msg_node, "command");
     if (!cmd_node) {
         rc = MPV_ERROR_INVALID_PARAMETER;
         goto error;
@@ -181,16 +311,40 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
 
     if (cmd && !strcmp("client_name", cmd)) {
         const char *client_name = mpv_client_name(client);
-        mpv_node_map_add_string(ta_parent, &reply_node, "data", client_name);
+        mpv_node_map_add_string(ta_parent, reply_node, "data", client_name);
         rc = MPV_ERROR_SUCCESS;
     } else if (cmd && !strcmp("get_time_us", cmd)) {
         int64_t time_us = mpv_get_time_us(client);
-        mpv_node_map_add_int64(ta_parent, &reply_node, "data", time_us);
+        mpv_node_map_add_int64(ta_parent, reply_node, "data", time_us);
         rc = MPV_ERROR_SUCCESS;
     } else if (cmd && !strcmp("get_version", cmd)) {
         int64_t ver = mpv_client_api_version();
-        mpv_node_map_add_int64(ta_parent, &reply_node, "data", ver);
+        mpv_node_map_add_int64(ta_parent, reply_node, "data", ver);
         rc = MPV_ERROR_SUCCESS;
+    } else if (cmd && !strcmp("set_protocol", cmd)) {
+        if (cmd_node->u.list->num != 2) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        if (cmd_node->u.list->values[1].format != MPV_FORMAT_STRING) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        char *name = cmd_node->u.list->values[1].u.string;
+        if (!state) {
+            // Only the clients served by mp_ipc_execute_next() can switch.
+            rc = MPV_ERROR_NOT_IMPLEMENTED;
+        } else if (strcmp(name, "json") == 0) {
+            state->protocol = IPC_PROTOCOL_JSON;
+            rc = MPV_ERROR_SUCCESS;
+        } else if (strcmp(name, "msgpack") == 0) {
+            state->protocol = IPC_PROTOCOL_MSGPACK;
+            rc = MPV_ERROR_SUCCESS;
+        } else {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+        }
     } else if (cmd && !strcmp("get_property", cmd)) {
         mpv_node result_node;
 
@@ -204,10 +358,19 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
             goto error;
         }
 
+        if (state) {
+            rc = start_async_get_property(client, state,
+                                          cmd_node->u.list->values[1].u.string,
+                                          false, reqid_node);
+            if (rc >= 0)
+                send_reply = false;
+            goto error;
+        }
+
         rc = mpv_get_property(client, cmd_node->u.list->values[1].u.string,
                               MPV_FORMAT_NODE, &result_node);
         if (rc >= 0) {
-            mpv_node_map_add(ta_parent, &reply_node, "data", &result_node);
+            mpv_node_map_add(ta_parent, reply_node, "data", &result_node);
             mpv_free_node_contents(&result_node);
         }
     } else if (cmd && !strcmp("get_property_string", cmd)) {
@@ -221,13 +384,23 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
             goto error;
         }
 
-        char *result = mpv_get_property_string(client,
-                                        cmd_node->u.list->values[1].u.string);
-        if (result) {
-            mpv_node_map_add_string(ta_parent, &reply_node, "data", result);
+        if (state) {
+            rc = start_async_get_property(client, state,
+                                          cmd_node->u.list->values[1].u.string,
+                                          true, reqid_node);
+            if (rc >= 0)
+                send_reply = false;
+            goto error;
+        }
+
+        char *result = NULL;
+        rc = mpv_get_property(client, cmd_node->u.list->values[1].u.string,
+                              MPV_FORMAT_STRING, &result);
+        if (rc >= 0) {
+            mpv_node_map_add_string(ta_parent, reply_node, "data", result);
             mpv_free(result);
         } else {
-            mpv_node_map_add_null(ta_parent, &reply_node, "data");
+            mpv_node_map_add_null(ta_parent, reply_node, "data");
         }
     } else if (cmd && (!strcmp("set_property", cmd) ||
                        !strcmp("set_property_string", cmd)))
@@ -346,40 +519,30 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
     } else {
         mpv_node result_node = {0};
 
-        if (async) {
+        if (state) {
+            rc = start_async_command(client, state, cmd_node, async, reqid,
+                                     reqid_node);
+            if (rc >= 0)
+                send_reply = false;
+        } else if (async) {
             rc = mpv_command_node_async(client, reqid, cmd_node);
             if (rc >= 0)
                 send_reply = false;
         } else {
             rc = mpv_command_node(client, cmd_node, &result_node);
             if (rc >= 0)
-                mpv_node_map_add(ta_parent, &reply_node, "data", &result_node);
+                mpv_node_map_add(ta_parent, reply_node, "data", &result_node);
         }
 
         mpv_free_node_contents(&result_node);
     }
 
 error:
-    /* If the request contains a "request_id", copy it back into the response.
-     * This makes it easier on the requester to match up the IPC results with
-     * the original requests.
-     */
-    if (reqid_node) {
-        mpv_node_map_add(ta_parent, &reply_node, "request_id", reqid_node);
-    } else {
-        mpv_node_map_add_int64(ta_parent, &reply_node, "request_id", 0);
-    }
-
-    mpv_node_map_add_string(ta_parent, &reply_node, "error", mpv_error_string(rc));
+    if (!send_reply)
+        return false;
 
-    char *output = talloc_strdup(ta_parent, "");
-
-    if (send_reply) {
-        json_write(&output, &reply_node);
-        output = ta_talloc_strdup_append(output, "\n");
-    }
-
-    return output;
+    finish_reply(ta_parent, reply_node, reqid_node, rc);
+    return true;
 }
 
 static char *text_execute_command(struct mpv_handle *client, void *tmp, char *src)
@@ -389,28 +552,197 @@ static char *text_execute_command(struct mpv_handle *client, void *tmp, char *sr
     return NULL;
 }
 
+// Execute a single line of the JSON/text protocol. Returns false if there is
+// no reply (yet), otherwise the reply is written to *reply_node.
+static bool execute_line(struct mpv_handle *client, struct mp_ipc_async *state,
+                         void *tmp, bstr line, mpv_node *reply_node)
+{
+    char *line0 = bstrto0(tmp, line);
+    json_skip_whitespace(&line0);
+
+    if (line0[0] == '\0' || line0[0] == '#')
+        return false;
+
+    if (line0[0] != '{') {
+        text_execute_command(client, tmp, line0);
+        return false;
+    }
+
+    mpv_node msg_node;
+    if (json_parse(tmp, &msg_node, &line0, 50) < 0) {
+        struct mp_log *log = mp_client_get_log(client);
+        mp_err(log, "malformed JSON received: '%s'\n", line0);
+        finish_reply(tmp, reply_node, NULL, MPV_ERROR_INVALID_PARAMETER);
+        return true;
+    }
+
+    return execute_command(client, tmp, state, &msg_node, reply_node);
+}
+
 char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *buf)
 {
     void *tmp = talloc_new(NULL);
 
     bstr rest;
     bstr line = bstr_getline(*buf, &rest);
-    char *line0 = bstrto0(tmp, line);
     talloc_steal(tmp, buf->start);
     *buf = bstrdup(NULL, rest);
 
-    json_skip_whitespace(&line0);
-
     char *reply_msg = NULL;
-    if (line0[0] == '\0' || line0[0] == '#') {
-        // skip
-    } else if (line0[0] == '{') {
-        reply_msg = json_execute_command(client, tmp, line0);
-    } else {
-        reply_msg = text_execute_command(client, tmp, line0);
+    mpv_node reply_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
+    if (execute_line(client, NULL, tmp, line, &reply_node)) {
+        reply_msg = talloc_strdup(ctx, "");
+        json_write(&reply_msg, &reply_node);
+        reply_msg = ta_talloc_strdup_append(reply_msg, "\n");
     }
 
-    talloc_steal(ctx, reply_msg);
     talloc_free(tmp);
     return reply_msg;
 }
+
+struct mp_ipc_async *mp_ipc_async_create(void *ta_parent)
+{
+    return talloc_zero(ta_parent, struct mp_ipc_async);
+}
+
+// Split off the next complete message from buf. Returns 1 on success, 0 if
+// more data is needed, <0 if the client is sending garbage.
+static int next_message(struct mpv_handle *client, struct mp_ipc_async *state,
+                        bstr *buf, bstr *msg)
+{
+    if (state->protocol == IPC_PROTOCOL_MSGPACK) {
+        if (buf->len < 4)
+            return 0;
+        uint32_t size = 0;
+        for (int n = 0; n < 4; n++)
+            size = (size << 8) | buf->start[n];
+        if (size > MAX_FRAME_SIZE) {
+            struct mp_log *log = mp_client_get_log(client);
+            mp_err(log, "Message too large (%"PRIu32" bytes).\n", size);
+            return -1;
+        }
+        if (buf->len - 4 < size)
+            return 0;
+        *msg = bstr_splice(*buf, 4, 4 + size);
+        *buf = bstr_cut(*buf, 4 + size);
+        return 1;
+    }
+
+    int nl = bstrchr(*buf, '\n');
+    if (nl < 0)
+        return 0;
+    *msg = bstr_splice(*buf, 0, nl);
+    *buf = bstr_cut(*buf, nl + 1);
+    return 1;
+}
+
+int mp_ipc_execute_next(struct mpv_handle *client, struct mp_ipc_async *state,
+                        bstr *buf, void *ta_parent, bstr *out)
+{
+    bstr msg;
+    int r = next_message(client, state, buf, &msg);
+    if (r <= 0)
+        return r;
+
+    // The reply to "set_protocol" still uses the old protocol.
+    enum ipc_protocol protocol = state->protocol;
+
+    void *tmp = talloc_new(NULL);
+    mpv_node reply_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
+    bool reply;
+
+    if (protocol == IPC_PROTOCOL_MSGPACK) {
+        mpv_node msg_node;
+        if (msgpack_parse(tmp, &msg_node, &msg, 50) < 0 || msg.len) {
+            struct mp_log *log = mp_client_get_log(client);
+            mp_err(log, "malformed msgpack message received\n");
+            finish_reply(tmp, &reply_node, NULL, MPV_ERROR_INVALID_PARAMETER);
+            reply = true;
+        } else {
+            reply = execute_command(client, tmp, state, &msg_node, &reply_node);
+        }
+    } else {
+        reply = execute_line(client, state, tmp, msg, &reply_node);
+    }
+
+    if (reply && !encode_message(ta_parent, out, protocol, &reply_node))
+        r = -1;
+
+    talloc_free(tmp);
+    return r;
+}
+
+bool mp_ipc_async_busy(struct mp_ipc_async *state)
+{
+    return state->num_sync > 0;
+}
+
+// Write the reply to a synchronous get_property/get_property_string.
+static void format_property_reply(void *ta_parent, mpv_event *event,
+                                  struct ipc_async_cmd *c, mpv_node *dst)
+{
+    mpv_event_property *prop = event->data;
+    if (prop->format == MPV_FORMAT_NODE) {
+        mpv_node_map_add(ta_parent, dst, "data", prop->data);
+    } else if (prop->format == MPV_FORMAT_STRING) {
+        mpv_node_map_add_string(ta_parent, dst, "data", *(char **)prop->data);
+    } else if (c->string) {
+        mpv_node_map_add_null(ta_parent, dst, "data");
+    }
+}
+
+bool mp_ipc_encode_event(struct mp_ipc_async *state, mpv_event *event,
+                         void *ta_parent, bstr *out)
+{
+    struct ipc_async_cmd *c = NULL;
+    if (event->event_id == MPV_EVENT_COMMAND_REPLY ||
+        event->event_id == MPV_EVENT_GET_PROPERTY_REPLY)
+    {
+        for (int n = 0; n < state->num_cmds; n++) {
+            if (state->cmds[n]->id == event->reply_userdata) {
+                c = state->cmds[n];
+                MP_TARRAY_REMOVE_AT(state->cmds, state->num_cmds, n);
+                break;
+            }
+        }
+    }
+
+    void *tmp = talloc_new(NULL);
+    mpv_node node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
+
+    if (!c) {
+        format_event(tmp, event, &node);
+    } else if (c->sync) {
+        if (event->event_id == MPV_EVENT_GET_PROPERTY_REPLY) {
+            format_property_reply(tmp, event, c, &node);
+        } else if (event->error >= 0) {
+            mpv_event_command *cmd = event->data;
+            mpv_node_map_add(tmp, &node, "data", &cmd->result);
+        }
+        finish_reply(tmp, &node, c->reqid_node, event->error);
+        state->num_sync -= 1;
+    } else {
+        mpv_format_command_reply(tmp, event, c->reqid, &node);
+    }
+
+    // Events that happen while a synchronous command is running are written
+    // after its reply, as it was the case when the command blocked the IPC
+    // thread. Replies to async commands are events in this sense too.
+    bool hold = state->num_sync > 0 && !(c && c->sync);
+    if (hold && state->held.len > MAX_HELD_EVENTS) {
+        bstr_xappend(ta_parent, out, state->held);
+        state->held.len = 0;
+    }
+
+    bool ok = hold ? encode_message(state, &state->held, state->protocol, &node)
+                   : encode_message(ta_parent, out, state->protocol, &node);
+
+    if (ok && !state->num_sync && state->held.len) {
+        bstr_xappend(ta_parent, out, state->held);
+        state->held.len = 0;
+    }
+
+    talloc_free(tmp);
+    talloc_free(c);
+    return ok;
+}
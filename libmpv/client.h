@@ -242,7 +242,7 @@ extern "C" {
  * relational operators (<, >, <=, >=).
  */
 #define MPV_MAKE_VERSION(major, minor) (((major) << 16) | (minor) | 0UL)
-#define MPV_CLIENT_API_VERSION MPV_MAKE_VERSION(2, 0)
+#define MPV_CLIENT_API_VERSION MPV_MAKE_VERSION(2, 1)
 
 /**
  * The API user is allowed to "#define MPV_ENABLE_DEPRECATED 0" before
@@ -1148,6 +1148,87 @@ MPV_EXPORT char *mpv_get_property_osd_string(mpv_handle *ctx, const char *name);
 MPV_EXPORT int mpv_get_property_async(mpv_handle *ctx, uint64_t reply_userdata,
                                       const char *name, mpv_format format);
 
+/**
+ * Opaque reference to a property, see mpv_resolve_property().
+ */
+typedef struct mpv_property_handle mpv_property_handle;
+
+/**
+ * Look up the property name once, and return a handle that can be used to
+ * access the property repeatedly without resolving the name again. This is
+ * meant for clients which read the same properties very often, e.g. UIs
+ * refreshing their state on every frame.
+ *
+ * The name can include a sub-property path (like "track-list/0/title"); only
+ * the top-level part is looked up.
+ *
+ * The handle belongs to ctx, and can be used only with ctx. It stays valid
+ * until mpv_free_property_handle() is called, or ctx is destroyed.
+ *
+ * Safe to be called from mpv render API threads.
+ *
+ * @param name The property name.
+ * @return the handle, or NULL if there is no such property
+ */
+MPV_EXPORT mpv_property_handle *mpv_resolve_property(mpv_handle *ctx,
+                                                     const char *name);
+
+/**
+ * Free a handle returned by mpv_resolve_property(). It must not be used
+ * anymore after this call. Passing NULL is allowed.
+ */
+MPV_EXPORT void mpv_free_property_handle(mpv_handle *ctx,
+                                         mpv_property_handle *prop);
+
+/**
+ * Same as mpv_get_property(), but with a handle returned by
+ * mpv_resolve_property().
+ *
+ * @return error code
+ */
+MPV_EXPORT int mpv_get_property_by_handle(mpv_handle *ctx,
+                                          mpv_property_handle *prop,
+                                          mpv_format format, void *data);
+
+/**
+ * A single property read, see mpv_get_properties().
+ */
+typedef struct mpv_property_get {
+    /**
+     * The property to read (set by the caller).
+     */
+    mpv_property_handle *handle;
+    /**
+     * Requested format, same as with mpv_get_property() (set by the caller).
+     */
+    mpv_format format;
+    /**
+     * Pointer to the variable that receives the value, same as with
+     * mpv_get_property() (set by the caller).
+     */
+    void *data;
+    /**
+     * Error code of this read (set by mpv_get_properties()). On success, this
+     * is >= 0 and the variable pointed to by data is set.
+     */
+    int error;
+} mpv_property_get;
+
+/**
+ * Read multiple properties at once. This behaves like calling
+ * mpv_get_property_by_handle() for each entry, but the player core is
+ * locked only once for all of them, so the values are consistent with each
+ * other and the overhead per property is much lower.
+ *
+ * @param[in,out] props array of num_props entries; each entry's error field
+ *                      is set to the result of reading that property
+ * @param num_props number of entries in props
+ * @return error code; if this is < 0, no property was read (invalid
+ *         parameters), otherwise check the error field of each entry
+ */
+MPV_EXPORT int mpv_get_properties(mpv_handle *ctx, mpv_property_get *props,
+                                  int num_props);
+
 /**
  * Get a notification whenever the given property changes. You will receive
  * updates as MPV_EVENT_PROPERTY_CHANGE. Note that this is not very precise:
@@ -1206,6 +1287,15 @@ MPV_EXPORT int mpv_get_property_async(mpv_handle *ctx, uint64_t reply_userdata,
 MPV_EXPORT int mpv_observe_property(mpv_handle *mpv, uint64_t reply_userdata,
                                     const char *name, mpv_format format);
 
+/**
+ * Same as mpv_observe_property(), but with a handle returned by
+ * mpv_resolve_property(). The handle can be freed after this call.
+ */
+MPV_EXPORT int mpv_observe_property_handle(mpv_handle *mpv,
+                                           uint64_t reply_userdata,
+                                           mpv_property_handle *prop,
+                                           mpv_format format);
+
 /**
  * Undo mpv_observe_property(). This will remove all observed properties for
  * which the given number was passed as reply_userdata to mpv_observe_property.
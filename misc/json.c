@@ -78,7 +78,50 @@ void json_skip_whitespace(char **src)
     eat_ws(src);
 }
 
-static int read_id(void *ta_parent, struct mpv_node *dst, char **src)
+// The first arena chunk is small, because most documents parsed by mpv are
+// short IPC commands. Following chunks grow up to the maximum size.
+#define ARENA_MIN 256
+#define ARENA_MAX (64 * 1024)
+
+struct parser {
+    void *ta_parent;
+
+    // Items of all lists which are currently being parsed. Nested lists are
+    // always finished before their parent, so the items of the innermost list
+    // are at the end. keys[n] is only set for items of objects.
+    struct mpv_node *values;
+    char **keys;
+    int num_items;
+    int alloc_items;
+
+    // Bump allocator for the finished lists and some strings. The chunks are
+    // allocated under ta_parent, so the caller can free them as usual.
+    char *arena;
+    size_t arena_left;
+    size_t arena_next;
+};
+
+static void *arena_alloc(struct parser *p, size_t size)
+{
+    size = MP_ALIGN_UP(size, 16);
+    if (size > p->arena_left) {
+        // Don't waste the rest of the current chunk on big allocations.
+        if (size > p->arena_next / 2)
+            return talloc_size(p->ta_parent, size);
+        p->arena = talloc_size(p->ta_parent, p->arena_next);
+        p->arena_left = p->arena_next;
+        p->arena_next = MPMIN(p->arena_next * 2, ARENA_MAX);
+    }
+    void *res = p->arena;
+    p->arena += size;
+    p->arena_left -= size;
+    return res;
+}
+
+static int parse_value(struct parser *p, struct mpv_node *dst, char **src,
+                       int max_depth);
+
+static int read_id(struct parser *p, struct mpv_node *dst, char **src)
 {
     char *start = *src;
     if (!mp_isalpha(**src) && **src != '_')
@@ -89,27 +132,33 @@ static int read_id(void *ta_parent, struct mpv_node *dst, char **src)
         **src = '\0'; // we're allowed to mutate it => can avoid the strndup
         *src += 1;
     } else {
-        start = talloc_strndup(ta_parent, start, *src - start);
+        size_t len = *src - start;
+        char *s = arena_alloc(p, len + 1);
+        memcpy(s, start, len);
+        s[len] = '\0';
+        start = s;
     }
     dst->format = MPV_FORMAT_STRING;
     dst->u.string = start;
     return 0;
 }
 
-static int read_str(void *ta_parent, struct mpv_node *dst, char **src)
+static int read_str(struct parser *p, struct mpv_node *dst, char **src)
 {
     if (!eat_c(src, '"'))
         return -1; // not a string
     char *str = *src;
     char *cur = str;
     bool has_escapes = false;
-    while (cur[0] && cur[0] != '"') {
-        if (cur[0] == '\\') {
-            has_escapes = true;
-            // skip >\"< and >\\< (latter to handle >\\"< correctly)
-            if (cur[1] == '"' || cur[1] == '\\')
-                cur++;
-        }
+    while (1) {
+        // strcspn() is usually vectorized, and most strings have no escapes.
+        cur += strcspn(cur, "\"\\");
+        if (cur[0] != '\\')
+            break;
+        has_escapes = true;
+        // skip >\"< and >\\< (latter to handle >\\"< correctly)
+        if (cur[1] == '"' || cur[1] == '\\')
+            cur++;
         cur++;
     }
     if (cur[0] != '"')
@@ -121,7 +170,7 @@ static int read_str(void *ta_parent, struct mpv_node *dst, char **src)
     if (has_escapes) {
         bstr unescaped = {0};
         bstr r = bstr0(str);
-        if (!mp_append_escaped_string(ta_parent, &unescaped, &r))
+        if (!mp_append_escaped_string(p->ta_parent, &unescaped, &r))
             return -1; // broken escapes
         str = unescaped.start; // the function guarantees null-termination
     }
@@ -130,7 +179,7 @@ static int read_str(void *ta_parent, struct mpv_node *dst, char **src)
     return 0;
 }
 
-static int read_sub(void *ta_parent, struct mpv_node *dst, char **src,
+static int read_sub(struct parser *p, struct mpv_node *dst, char **src,
                     int max_depth)
 {
     bool is_arr = eat_c(src, '[');
@@ -138,53 +187,96 @@ static int read_sub(void *ta_parent, struct mpv_node *dst, char **src,
     if (!is_arr && !is_obj)
         return -1; // not an array or object
     char term = is_obj ? '}' : ']';
-    struct mpv_node_list *list = talloc_zero(ta_parent, struct mpv_node_list);
+    int first = p->num_items;
     while (1) {
         eat_ws(src);
         if (eat_c(src, term))
             break;
-        if (list->num > 0 && !eat_c(src, ','))
+        if (p->num_items > first && !eat_c(src, ','))
             return -1; // missing ','
         eat_ws(src);
         // non-standard extension: allow a trailing ","
         if (eat_c(src, term))
             break;
+        if (p->num_items == p->alloc_items) {
+            p->alloc_items = MPMAX(p->alloc_items * 2, 16);
+            p->values = talloc_realloc(p, p->values, struct mpv_node,
+                                       p->alloc_items);
+            p->keys = talloc_realloc(p, p->keys, char *, p->alloc_items);
+        }
+        int n = p->num_items;
         if (is_obj) {
             struct mpv_node keynode;
             // non-standard extension: allow unquoted strings as keys
-            if (read_id(list, &keynode, src) < 0 &&
-                read_str(list, &keynode, src) < 0)
+            if (read_id(p, &keynode, src) < 0 && read_str(p, &keynode, src) < 0)
                 return -1; // key is not a string
             eat_ws(src);
             // non-standard extension: allow "=" instead of ":"
             if (!eat_c(src, ':') && !eat_c(src, '='))
                 return -1; // ':' missing
             eat_ws(src);
-            MP_TARRAY_GROW(list, list->keys, list->num);
-            list->keys[list->num] = keynode.u.string;
+            p->keys[n] = keynode.u.string;
         }
-        MP_TARRAY_GROW(list, list->values, list->num);
-        if (json_parse(ta_parent, &list->values[list->num], src, max_depth) < 0)
+        // Reserve the slot before parsing, so nested lists push after it.
+        p->num_items++;
+        struct mpv_node val;
+        if (parse_value(p, &val, src, max_depth) < 0)
             return -1;
-        list->num++;
+        p->values[n] = val;
+    }
+
+    // Copy the items into a single allocation.
+    int num = p->num_items - first;
+    size_t size = sizeof(struct mpv_node_list) + num * sizeof(struct mpv_node);
+    if (is_obj)
+        size += num * sizeof(char *);
+    struct mpv_node_list *list = arena_alloc(p, size);
+    *list = (struct mpv_node_list){
+        .num = num,
+        .values = (struct mpv_node *)(list + 1),
+    };
+    if (num) {
+        memcpy(list->values, &p->values[first], num * sizeof(struct mpv_node));
+        if (is_obj) {
+            list->keys = (char **)(list->values + num);
+            memcpy(list->keys, &p->keys[first], num * sizeof(char *));
+        }
     }
+    p->num_items = first;
+
     dst->format = is_obj ? MPV_FORMAT_NODE_MAP : MPV_FORMAT_NODE_ARRAY;
     dst->u.list = list;
     return 0;
 }
 
-/* Parse the string in *src as JSON, and write the result into *dst.
- * max_depth limits the recursion and JSON tree depth.
- * Warning: this overwrites the input string (what *src points to)!
- * Returns:
- *   0: success, *dst is valid, *src points to the end (the caller must check
- *      whether *src really terminates)
- *  -1: failure, *dst is invalid, there may be dead allocs under ta_parent
- *      (ta_free_children(ta_parent) is the only way to free them)
- * The input string can be mutated in both cases. *dst might contain string
- * elements, which point into the (mutated) input string.
- */
-int json_parse(void *ta_parent, struct mpv_node *dst, char **src, int max_depth)
+// Fast path for plain decimal integers, which are by far the most common
+// numbers. Anything else is left to strtoll()/strtod().
+static bool read_simple_int(struct mpv_node *dst, char **src)
+{
+    char *cur = *src;
+    bool neg = cur[0] == '-';
+    cur += neg;
+    // Leading 0s are parsed as octal by strtoll() (or a hex prefix may follow).
+    if (cur[0] == '0' && cur[1] != '\0' && !strchr("]},: \t\r\n", cur[1]))
+        return false;
+    int64_t v = 0;
+    int digits = 0;
+    while (*cur >= '0' && *cur <= '9' && digits < 18) {
+        v = v * 10 + (*cur - '0');
+        cur++;
+        digits++;
+    }
+    if (!digits || (*cur >= '0' && *cur <= '9') || *cur == '.' ||
+        *cur == 'e' || *cur == 'E')
+        return false;
+    dst->format = MPV_FORMAT_INT64;
+    dst->u.int64 = neg ? -v : v;
+    *src = cur;
+    return true;
+}
+
+static int parse_value(struct parser *p, struct mpv_node *dst, char **src,
+                       int max_depth)
 {
     max_depth -= 1;
     if (max_depth < 0)
@@ -210,10 +302,12 @@ int json_parse(void *ta_parent, struct mpv_node *dst, char **src, int max_depth)
         dst->u.flag = 0;
         return 0;
     } else if (c == '"') {
-        return read_str(ta_parent, dst, src);
+        return read_str(p, dst, src);
     } else if (c == '[' || c == '{') {
-        return read_sub(ta_parent, dst, src, max_depth);
+        return read_sub(p, dst, src, max_depth);
     } else if (c == '-' || (c >= '0' && c <= '9')) {
+        if (read_simple_int(dst, src))
+            return 0;
         // The number could be either a float or an int. JSON doesn't make a
         // difference, but the client API does.
         char *nsrci = *src, *nsrcf = *src;
@@ -242,6 +336,29 @@ int json_parse(void *ta_parent, struct mpv_node *dst, char **src, int max_depth)
     return -1; // character doesn't start a valid token
 }
 
+/* Parse the string in *src as JSON, and write the result into *dst.
+ * max_depth limits the recursion and JSON tree depth.
+ * Warning: this overwrites the input string (what *src points to)!
+ * Returns:
+ *   0: success, *dst is valid, *src points to the end (the caller must check
+ *      whether *src really terminates)
+ *  -1: failure, *dst is invalid, there may be dead allocs under ta_parent
+ *      (ta_free_children(ta_parent) is the only way to free them)
+ * The input string can be mutated in both cases. *dst might contain string
+ * elements, which point into the (mutated) input string.
+ * Lists and some strings share a few larger allocations under ta_parent, so
+ * parts of the tree can't be freed or reallocated individually.
+ */
+int json_parse(void *ta_parent, struct mpv_node *dst, char **src, int max_depth)
+{
+    struct parser *p = talloc_zero(NULL, struct parser);
+    p->ta_parent = ta_parent;
+    p->arena_next = ARENA_MIN;
+    int r = parse_value(p, dst, src, max_depth);
+    talloc_free(p);
+    return r;
+}
+
 
 #define APPEND(b, s) bstr_xappend(NULL, (b), bstr0(s))
 
@@ -260,24 +377,43 @@ static void write_json_str(bstr *b, unsigned char *str)
         unsigned char *cur = str;
         while (cur[0] >= 32 && cur[0] != '"' && cur[0] != '\\')
             cur++;
+        if (cur > str)
+            bstr_xappend(NULL, b, (bstr){str, cur - str});
         if (!cur[0])
             break;
-        bstr_xappend(NULL, b, (bstr){str, cur - str});
-        if (cur[0] == '\"') {
-            bstr_xappend(NULL, b, (bstr){"\\\"", 2});
-        } else if (cur[0] == '\\') {
-            bstr_xappend(NULL, b, (bstr){"\\\\", 2});
+        char buf[8];
+        if (cur[0] == '\"' || cur[0] == '\\') {
+            buf[0] = '\\';
+            buf[1] = cur[0];
+            bstr_xappend(NULL, b, (bstr){buf, 2});
         } else if (cur[0] < sizeof(special_escape) && special_escape[cur[0]]) {
-            bstr_xappend_asprintf(NULL, b, "\\%c", special_escape[cur[0]]);
+            buf[0] = '\\';
+            buf[1] = special_escape[cur[0]];
+            bstr_xappend(NULL, b, (bstr){buf, 2});
         } else {
-            bstr_xappend_asprintf(NULL, b, "\\u%04x", (unsigned char)cur[0]);
+            snprintf(buf, sizeof(buf), "\\u%04x", (unsigned char)cur[0]);
+            APPEND(b, buf);
         }
         str = cur + 1;
     }
-    APPEND(b, str);
     APPEND(b, "\"");
 }
 
+static void write_int(bstr *b, int64_t v)
+{
+    char buf[24];
+    char *end = buf + sizeof(buf), *cur = end;
+    // Negate as unsigned, so INT64_MIN works.
+    uint64_t u = v < 0 ? -(uint64_t)v : v;
+    do {
+        *--cur = '0' + u % 10;
+        u /= 10;
+    } while (u);
+    if (v < 0)
+        *--cur = '-';
+    bstr_xappend(NULL, b, (bstr){cur, end - cur});
+}
+
 static void add_indent(bstr *b, int indent)
 {
     if (indent < 0)
@@ -297,11 +433,18 @@ static int json_append(bstr *b, const struct mpv_node *src, int indent)
         APPEND(b, src->u.flag ? "true" : "false");
         return 0;
     case MPV_FORMAT_INT64:
-        bstr_xappend_asprintf(NULL, b, "%"PRId64, src->u.int64);
+        write_int(b, src->u.int64);
         return 0;
     case MPV_FORMAT_DOUBLE: {
         const char *px = isfinite(src->u.double_) ? "" : "\"";
-        bstr_xappend_asprintf(NULL, b, "%s%f%s", px, src->u.double_, px);
+        char buf[64];
+        int len = snprintf(buf, sizeof(buf), "%s%f%s", px, src->u.double_, px);
+        if (len < 0 || len >= sizeof(buf)) {
+            // Huge values; "%f" has no exponent.
+            bstr_xappend_asprintf(NULL, b, "%s%f%s", px, src->u.double_, px);
+        } else {
+            bstr_xappend(NULL, b, (bstr){buf, len});
+        }
         return 0;
     }
     case MPV_FORMAT_STRING:
@@ -354,3 +497,16 @@ int json_write_pretty(char **dst, struct mpv_node *src)
 {
     return json_append_str(dst, src, 0);
 }
+
+/* Like json_write(), but append to the given buffer, without a strlen() on
+ * it. This is meant for writing directly into output buffers (which may
+ * contain binary data). dst->start is expected to be a talloc allocation or
+ * NULL, as with bstr_xappend(); ta_parent is used if it's NULL.
+ */
+int json_write_bstr(void *ta_parent, bstr *dst, struct mpv_node *src)
+{
+    // json_append() appends with a NULL talloc context.
+    if (!dst->start)
+        dst->start = talloc_size(ta_parent, 64);
+    return json_append(dst, src, -1);
+}
@@ -18,6 +18,8 @@
 #ifndef MP_JSON_H
 #define MP_JSON_H
 
+#include "misc/bstr.h"
+
 // We reuse mpv_node.
 #include "libmpv/client.h"
 
@@ -25,5 +27,6 @@ int json_parse(void *ta_parent, struct mpv_node *dst, char **src, int max_depth)
 void json_skip_whitespace(char **src);
 int json_write(char **s, struct mpv_node *src);
 int json_write_pretty(char **s, struct mpv_node *src);
+int json_write_bstr(void *ta_parent, bstr *dst, struct mpv_node *src);
 
 #endif
@@ -0,0 +1,391 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* MessagePack reader/writer for mpv_node, used by the binary IPC protocol.
+ *
+ * Mapping of the mpv_node types:
+ *  MPV_FORMAT_NONE         nil
+ *  MPV_FORMAT_FLAG         true/false
+ *  MPV_FORMAT_INT64        int (smallest encoding that fits)
+ *  MPV_FORMAT_DOUBLE       float 64 (float 32 is accepted when reading)
+ *  MPV_FORMAT_STRING       str
+ *  MPV_FORMAT_BYTE_ARRAY   bin
+ *  MPV_FORMAT_NODE_ARRAY   array
+ *  MPV_FORMAT_NODE_MAP     map (keys must be str)
+ *
+ * The reader rejects the ext types, unsigned integers which don't fit into
+ * int64_t, and strings with embedded 0 bytes (mpv_node strings are
+ * 0-terminated). Unlike with JSON, the writer can represent all node types.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "common/common.h"
+#include "misc/msgpack.h"
+#include "mpv_talloc.h"
+
+struct reader {
+    void *ta_parent;
+    bstr src;
+    // All strings are copied into this buffer, so that decoding needs only
+    // 1 allocation for them. Each string takes at least 1 byte (its type tag)
+    // in the input, so this can't need more than the input size, including
+    // the terminating 0 bytes.
+    char *strings;
+    size_t strings_size, strings_pos;
+    // Number of list elements and map keys which were announced by the list
+    // headers read so far, but not read yet. Each of them takes at least 1
+    // byte, so if this is larger than src.len, the input is truncated.
+    uint64_t pending;
+};
+
+static bool read_be(struct reader *r, int bytes, uint64_t *out)
+{
+    if (r->src.len < bytes)
+        return false;
+    uint64_t v = 0;
+    for (int n = 0; n < bytes; n++)
+        v = (v << 8) | r->src.start[n];
+    r->src = bstr_cut(r->src, bytes);
+    *out = v;
+    return true;
+}
+
+static int read_str(struct reader *r, char **dst, uint64_t len)
+{
+    if (r->src.len < len)
+        return -1; // truncated
+    if (memchr(r->src.start, '\0', len))
+        return -1; // can't be represented
+    if (!r->strings)
+        r->strings = talloc_size(r->ta_parent, r->strings_size);
+    assert(r->strings_size - r->strings_pos > len);
+    char *s = r->strings + r->strings_pos;
+    memcpy(s, r->src.start, len);
+    s[len] = '\0';
+    r->strings_pos += len + 1;
+    r->src = bstr_cut(r->src, len);
+    *dst = s;
+    return 0;
+}
+
+static int read_key(struct reader *r, char **dst)
+{
+    uint64_t len;
+    if (!read_be(r, 1, &len))
+        return -1;
+    int c = len;
+    if ((c & 0xe0) == 0xa0) {
+        len = c & 0x1f;
+    } else if (c >= 0xd9 && c <= 0xdb) {
+        if (!read_be(r, 1 << (c - 0xd9), &len))
+            return -1;
+    } else {
+        return -1; // key is not a string
+    }
+    return read_str(r, dst, len);
+}
+
+static int read_node(struct reader *r, struct mpv_node *dst, int max_depth);
+
+static int read_list(struct reader *r, struct mpv_node *dst, uint64_t num,
+                     bool is_map, int max_depth)
+{
+    // Every element takes at least 1 byte, so this rejects bogus sizes before
+    // they cause huge allocations. This must include the elements of all outer
+    // lists, or nested lists could announce up to the input size each.
+    uint64_t slots = is_map ? num * 2 : num;
+    if (r->pending > r->src.len || slots > r->src.len - r->pending)
+        return -1;
+    r->pending += slots;
+    struct mpv_node_list *list = talloc_zero(r->ta_parent, struct mpv_node_list);
+    list->values = talloc_array(list, struct mpv_node, num);
+    if (is_map)
+        list->keys = talloc_array(list, char *, num);
+    for (list->num = 0; list->num < num; list->num++) {
+        if (is_map) {
+            r->pending -= 1;
+            if (read_key(r, &list->keys[list->num]) < 0)
+                return -1;
+        }
+        r->pending -= 1;
+        if (read_node(r, &list->values[list->num], max_depth) < 0)
+            return -1;
+    }
+    dst->format = is_map ? MPV_FORMAT_NODE_MAP : MPV_FORMAT_NODE_ARRAY;
+    dst->u.list = list;
+    return 0;
+}
+
+static int read_node(struct reader *r, struct mpv_node *dst, int max_depth)
+{
+    max_depth -= 1;
+    if (max_depth < 0)
+        return -1;
+
+    uint64_t v;
+    if (!read_be(r, 1, &v))
+        return -1; // early EOF
+    int c = v;
+
+    if (c <= 0x7f || c >= 0xe0) {
+        dst->format = MPV_FORMAT_INT64;
+        dst->u.int64 = (int8_t)c;
+        return 0;
+    } else if ((c & 0xe0) == 0xa0) {
+        dst->format = MPV_FORMAT_STRING;
+        return read_str(r, &dst->u.string, c & 0x1f);
+    } else if ((c & 0xf0) == 0x90) {
+        return read_list(r, dst, c & 0x0f, false, max_depth);
+    } else if ((c & 0xf0) == 0x80) {
+        return read_list(r, dst, c & 0x0f, true, max_depth);
+    }
+
+    switch (c) {
+    case 0xc0:
+        dst->format = MPV_FORMAT_NONE;
+        return 0;
+    case 0xc2:
+    case 0xc3:
+        dst->format = MPV_FORMAT_FLAG;
+        dst->u.flag = c == 0xc3;
+        return 0;
+    case 0xc4:
+    case 0xc5:
+    case 0xc6: {
+        if (!read_be(r, 1 << (c - 0xc4), &v) || v > r->src.len)
+            return -1;
+        struct mpv_byte_array *ba =
+            talloc_zero(r->ta_parent, struct mpv_byte_array);
+        ba->data = talloc_memdup(ba, r->src.start, v);
+        ba->size = v;
+        r->src = bstr_cut(r->src, v);
+        dst->format = MPV_FORMAT_BYTE_ARRAY;
+        dst->u.ba = ba;
+        return 0;
+    }
+    case 0xca: {
+        uint32_t bits;
+        float f;
+        if (!read_be(r, 4, &v))
+            return -1;
+        bits = v;
+        memcpy(&f, &bits, sizeof(f));
+        dst->format = MPV_FORMAT_DOUBLE;
+        dst->u.double_ = f;
+        return 0;
+    }
+    case 0xcb:
+        if (!read_be(r, 8, &v))
+            return -1;
+        dst->format = MPV_FORMAT_DOUBLE;
+        memcpy(&dst->u.double_, &v, sizeof(v));
+        return 0;
+    case 0xcc:
+    case 0xcd:
+    case 0xce:
+    case 0xcf:
+        if (!read_be(r, 1 << (c - 0xcc), &v) || v > INT64_MAX)
+            return -1;
+        dst->format = MPV_FORMAT_INT64;
+        dst->u.int64 = v;
+        return 0;
+    case 0xd0:
+    case 0xd1:
+    case 0xd2:
+    case 0xd3: {
+        int bytes = 1 << (c - 0xd0);
+        if (!read_be(r, bytes, &v))
+            return -1;
+        // Sign-extend.
+        if (bytes < 8 && (v & (1ULL << (bytes * 8 - 1))))
+            v |= ~0ULL << (bytes * 8);
+        dst->format = MPV_FORMAT_INT64;
+        dst->u.int64 = (int64_t)v;
+        return 0;
+    }
+    case 0xd9:
+    case 0xda:
+    case 0xdb:
+        if (!read_be(r, 1 << (c - 0xd9), &v))
+            return -1;
+        dst->format = MPV_FORMAT_STRING;
+        return read_str(r, &dst->u.string, v);
+    case 0xdc:
+    case 0xdd:
+        if (!read_be(r, c == 0xdc ? 2 : 4, &v))
+            return -1;
+        return read_list(r, dst, v, false, max_depth);
+    case 0xde:
+    case 0xdf:
+        if (!read_be(r, c == 0xde ? 2 : 4, &v))
+            return -1;
+        return read_list(r, dst, v, true, max_depth);
+    }
+
+    return -1; // ext types and the reserved 0xc1
+}
+
+/* Parse a single msgpack object from the start of *src, and write the result
+ * into *dst. max_depth limits the recursion and tree depth.
+ * Returns:
+ *   0: success, *dst is valid, *src is advanced past the parsed object
+ *  -1: failure (including truncated input), *dst is invalid, and there may be
+ *      dead allocs under ta_parent
+ * Unlike json_parse(), the input is not mutated, and *dst does not point into
+ * it. All strings in *dst share a single allocation under ta_parent.
+ */
+int msgpack_parse(void *ta_parent, struct mpv_node *dst, bstr *src,
+                  int max_depth)
+{
+    struct reader r = {
+        .ta_parent = ta_parent,
+        .src = *src,
+        .strings_size = src->len,
+    };
+    if (read_node(&r, dst, max_depth) < 0)
+        return -1;
+    *src = r.src;
+    return 0;
+}
+
+static void append_be(void *ta_parent, bstr *b, int tag, uint64_t v, int bytes)
+{
+    unsigned char buf[9];
+    int len = 0;
+    if (tag >= 0)
+        buf[len++] = tag;
+    for (int n = bytes - 1; n >= 0; n--)
+        buf[len++] = v >> (n * 8);
+    bstr_xappend(ta_parent, b, (bstr){buf, len});
+}
+
+// Write a type tag and a size; fix_tag/fix_max are for the variant which
+// stores the size in the tag byte itself (fix_max=-1 if there is none), and
+// tag8 is -1 if there is no 8 bit size variant.
+static void append_size(void *ta_parent, bstr *b, int fix_tag, int fix_max,
+                        int tag8, int tag16, int tag32, size_t size)
+{
+    if (fix_max >= 0 && size <= fix_max) {
+        append_be(ta_parent, b, fix_tag | size, 0, 0);
+    } else if (tag8 >= 0 && size <= UINT8_MAX) {
+        append_be(ta_parent, b, tag8, size, 1);
+    } else if (size <= UINT16_MAX) {
+        append_be(ta_parent, b, tag16, size, 2);
+    } else {
+        append_be(ta_parent, b, tag32, size, 4);
+    }
+}
+
+static void append_int(void *ta_parent, bstr *b, int64_t v)
+{
+    if (v >= -32 && v <= 127) {
+        append_be(ta_parent, b, -1, v, 1);
+    } else if (v >= 0) {
+        if (v <= UINT8_MAX) {
+            append_be(ta_parent, b, 0xcc, v, 1);
+        } else if (v <= UINT16_MAX) {
+            append_be(ta_parent, b, 0xcd, v, 2);
+        } else if (v <= UINT32_MAX) {
+            append_be(ta_parent, b, 0xce, v, 4);
+        } else {
+            append_be(ta_parent, b, 0xcf, v, 8);
+        }
+    } else {
+        if (v >= INT8_MIN) {
+            append_be(ta_parent, b, 0xd0, v, 1);
+        } else if (v >= INT16_MIN) {
+            append_be(ta_parent, b, 0xd1, v, 2);
+        } else if (v >= INT32_MIN) {
+            append_be(ta_parent, b, 0xd2, v, 4);
+        } else {
+            append_be(ta_parent, b, 0xd3, v, 8);
+        }
+    }
+}
+
+static int append_str(void *ta_parent, bstr *b, const char *s)
+{
+    size_t len = strlen(s);
+    if (len > UINT32_MAX)
+        return -1;
+    append_size(ta_parent, b, 0xa0, 31, 0xd9, 0xda, 0xdb, len);
+    bstr_xappend(ta_parent, b, (bstr){(unsigned char *)s, len});
+    return 0;
+}
+
+static int msgpack_append(void *ta_parent, bstr *b, const struct mpv_node *src)
+{
+    switch (src->format) {
+    case MPV_FORMAT_NONE:
+        append_be(ta_parent, b, 0xc0, 0, 0);
+        return 0;
+    case MPV_FORMAT_FLAG:
+        append_be(ta_parent, b, src->u.flag ? 0xc3 : 0xc2, 0, 0);
+        return 0;
+    case MPV_FORMAT_INT64:
+        append_int(ta_parent, b, src->u.int64);
+        return 0;
+    case MPV_FORMAT_DOUBLE: {
+        uint64_t bits;
+        memcpy(&bits, &src->u.double_, sizeof(bits));
+        append_be(ta_parent, b, 0xcb, bits, 8);
+        return 0;
+    }
+    case MPV_FORMAT_STRING:
+        return append_str(ta_parent, b, src->u.string);
+    case MPV_FORMAT_BYTE_ARRAY: {
+        struct mpv_byte_array *ba = src->u.ba;
+        if (ba->size > UINT32_MAX)
+            return -1;
+        append_size(ta_parent, b, 0, -1, 0xc4, 0xc5, 0xc6, ba->size);
+        bstr_xappend(ta_parent, b, (bstr){ba->data, ba->size});
+        return 0;
+    }
+    case MPV_FORMAT_NODE_ARRAY:
+    case MPV_FORMAT_NODE_MAP: {
+        struct mpv_node_list *list = src->u.list;
+        bool is_map = src->format == MPV_FORMAT_NODE_MAP;
+        int num = list ? list->num : 0;
+        if (is_map) {
+            append_size(ta_parent, b, 0x80, 15, -1, 0xde, 0xdf, num);
+        } else {
+            append_size(ta_parent, b, 0x90, 15, -1, 0xdc, 0xdd, num);
+        }
+        for (int n = 0; n < num; n++) {
+            if (is_map && append_str(ta_parent, b, list->keys[n]) < 0)
+                return -1;
+            if (msgpack_append(ta_parent, b, &list->values[n]) < 0)
+                return -1;
+        }
+        return 0;
+    }
+    }
+    return -1; // unknown format
+}
+
+/* Write the contents of *src as msgpack, and append it to *dst.
+ * dst->start is expected to be a talloc allocation or NULL, as with
+ * bstr_xappend(); ta_parent is used if it's NULL.
+ * Returns: 0 on success, <0 on failure (*dst may contain partial data).
+ */
+int msgpack_write(void *ta_parent, bstr *dst, struct mpv_node *src)
+{
+    return msgpack_append(ta_parent, dst, src);
+}
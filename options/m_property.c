@@ -36,30 +36,71 @@
 #include "common/msg.h"
 #include "common/common.h"
 
-static int m_property_multiply(struct mp_log *log,
-                               const struct m_property *prop_list,
-                               const char *property, double f, void *ctx)
+struct m_property_index {
+    const struct m_property *list;
+    // Open addressing hash table of indexes into list; -1 is an empty slot.
+    int *table;
+    unsigned mask;
+};
+
+static unsigned hash_name(bstr name)
 {
-    union m_option_value val = {0};
-    struct m_option opt = {0};
-    int r;
+    // FNV-1a
+    unsigned h = 2166136261u;
+    for (int n = 0; n < name.len; n++)
+        h = (h ^ name.start[n]) * 16777619u;
+    return h;
+}
 
-    r = m_property_do(log, prop_list, property, M_PROPERTY_GET_CONSTRICTED_TYPE,
-                      &opt, ctx);
-    if (r != M_PROPERTY_OK)
-        return r;
-    assert(opt.type);
+struct m_property_index *m_property_index_create(void *ta_parent,
+                                                 const struct m_property *list)
+{
+    struct m_property_index *index = talloc_zero(ta_parent,
+                                                 struct m_property_index);
+    index->list = list;
 
-    if (!opt.type->multiply)
-        return M_PROPERTY_NOT_IMPLEMENTED;
+    int count = 0;
+    while (list[count].name)
+        count++;
 
-    r = m_property_do(log, prop_list, property, M_PROPERTY_GET, &val, ctx);
-    if (r != M_PROPERTY_OK)
-        return r;
-    opt.type->multiply(&opt, &val, f);
-    r = m_property_do(log, prop_list, property, M_PROPERTY_SET, &val, ctx);
-    m_option_free(&opt, &val);
-    return r;
+    unsigned size = 16;
+    while (size < count * 2)
+        size *= 2;
+    index->mask = size - 1;
+    index->table = talloc_array(index, int, size);
+    for (int n = 0; n < size; n++)
+        index->table[n] = -1;
+
+    for (int n = 0; n < count; n++) {
+        bstr name = bstr0(list[n].name);
+        unsigned slot = hash_name(name) & index->mask;
+        bool dup = false;
+        while (index->table[slot] >= 0) {
+            // Same as m_property_list_find(): the first entry wins.
+            if (bstr_equals0(name, list[index->table[slot]].name)) {
+                dup = true;
+                break;
+            }
+            slot = (slot + 1) & index->mask;
+        }
+        if (!dup)
+            index->table[slot] = n;
+    }
+
+    return index;
+}
+
+struct m_property *m_property_index_find(const struct m_property_index *index,
+                                         bstr name)
+{
+    unsigned slot = hash_name(name) & index->mask;
+    while (index->table[slot] >= 0) {
+        const struct m_property *p = &index->list[index->table[slot]];
+        if (bstr_equals0(name, p->name))
+            return (struct m_property *)p;
+        slot = (slot + 1) & index->mask;
+    }
+    return NULL;
 }
 
 struct m_property *m_property_list_find(const struct m_property *list,
@@ -72,49 +113,112 @@ struct m_property *m_property_list_find(const struct m_property *list,
     return NULL;
 }
 
-static int do_action(const struct m_property *prop_list, const char *name,
-                     int action, void *arg, void *ctx)
+static struct m_property *find_prop(const struct m_property *list,
+                                    const struct m_property_index *index,
+                                    bstr name)
 {
-    struct m_property *prop;
-    struct m_property_action_arg ka;
+    if (index)
+        return m_property_index_find(index, name);
+    for (int n = 0; list && list[n].name; n++) {
+        if (bstr_equals0(name, list[n].name))
+            return (struct m_property *)&list[n];
+    }
+    return NULL;
+}
+
+static bool resolve(const struct m_property *list,
+                    const struct m_property_index *index, const char *name,
+                    struct m_property_handle *h)
+{
+    *h = (struct m_property_handle){.name = name};
     const char *sep = strchr(name, '/');
     if (sep && sep[1]) {
-        char base[128];
-        snprintf(base, sizeof(base), "%.*s", (int)(sep - name), name);
-        prop = m_property_list_find(prop_list, base);
+        h->prop = find_prop(list, index,
+                            bstr_splice(bstr0(name), 0, sep - name));
+        h->key = sep + 1;
+    } else {
+        h->prop = find_prop(list, index, bstr0(name));
+    }
+    return !!h->prop;
+}
+
+bool m_property_resolve(const struct m_property_index *index, const char *name,
+                        struct m_property_handle *h)
+{
+    return resolve(NULL, index, name, h);
+}
+
+static int do_action(const struct m_property_handle *h, int action, void *arg,
+                     void *ctx)
+{
+    if (!h->prop)
+        return M_PROPERTY_UNKNOWN;
+    struct m_property_action_arg ka;
+    if (h->key) {
         ka = (struct m_property_action_arg) {
-            .key = sep + 1,
+            .key = h->key,
             .action = action,
             .arg = arg,
         };
         action = M_PROPERTY_KEY_ACTION;
         arg = &ka;
-    } else
-        prop = m_property_list_find(prop_list, name);
-    if (!prop)
-        return M_PROPERTY_UNKNOWN;
-    return prop->call(ctx, prop, action, arg);
+    }
+    return h->prop->call(ctx, h->prop, action, arg);
+}
+
+static int m_property_multiply(struct mp_log *log,
+                               const struct m_property_handle *h,
+                               double f, void *ctx)
+{
+    union m_option_value val = {0};
+    struct m_option opt = {0};
+    int r;
+
+    r = m_property_do_handle(log, h, M_PROPERTY_GET_CONSTRICTED_TYPE, &opt, ctx);
+    if (r != M_PROPERTY_OK)
+        return r;
+    assert(opt.type);
+
+    if (!opt.type->multiply)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    r = m_property_do_handle(log, h, M_PROPERTY_GET, &val, ctx);
+    if (r != M_PROPERTY_OK)
+        return r;
+    opt.type->multiply(&opt, &val, f);
+    r = m_property_do_handle(log, h, M_PROPERTY_SET, &val, ctx);
+    m_option_free(&opt, &val);
+    return r;
 }
 
 // (as a hack, log can be NULL on read-only paths)
 int m_property_do(struct mp_log *log, const struct m_property *prop_list,
                   const char *name, int action, void *arg, void *ctx)
+{
+    struct m_property_handle h;
+    if (!resolve(prop_list, NULL, name, &h))
+        return M_PROPERTY_UNKNOWN;
+    return m_property_do_handle(log, &h, action, arg, ctx);
+}
+
+int m_property_do_handle(struct mp_log *log, const struct m_property_handle *h,
+                         int action, void *arg, void *ctx)
 {
     union m_option_value val = {0};
     int r;
 
     struct m_option opt = {0};
-    r = do_action(prop_list, name, M_PROPERTY_GET_TYPE, &opt, ctx);
+    r = do_action(h, M_PROPERTY_GET_TYPE, &opt, ctx);
     if (r <= 0)
         return r;
     assert(opt.type);
 
     switch (action) {
     case M_PROPERTY_PRINT: {
-        if ((r = do_action(prop_list, name, M_PROPERTY_PRINT, arg, ctx)) >= 0)
+        if ((r = do_action(h, M_PROPERTY_PRINT, arg, ctx)) >= 0)
             return r;
         // Fallback to m_option
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET, &val, ctx)) <= 0)
+        if ((r = do_action(h, M_PROPERTY_GET, &val, ctx)) <= 0)
             return r;
         char *str = m_option_pretty_print(&opt, &val);
         m_option_free(&opt, &val);
@@ -122,7 +226,7 @@ int m_property_do(struct mp_log *log, const struct m_property *prop_list,
         return str != NULL;
     }
     case M_PROPERTY_GET_STRING: {
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET, &val, ctx)) <= 0)
+        if ((r = do_action(h, M_PROPERTY_GET, &val, ctx)) <= 0)
             return r;
         char *str = m_option_print(&opt, &val);
         m_option_free(&opt, &val);
@@ -131,49 +235,49 @@ int m_property_do(struct mp_log *log, const struct m_property *prop_list,
     }
     case M_PROPERTY_SET_STRING: {
         struct mpv_node node = { .format = MPV_FORMAT_STRING, .u.string = arg };
-        return m_property_do(log, prop_list, name, M_PROPERTY_SET_NODE, &node, ctx);
+        return m_property_do_handle(log, h, M_PROPERTY_SET_NODE, &node, ctx);
     }
     case M_PROPERTY_MULTIPLY: {
-        return m_property_multiply(log, prop_list, name, *(double *)arg, ctx);
+        return m_property_multiply(log, h, *(double *)arg, ctx);
     }
     case M_PROPERTY_SWITCH: {
         if (!log)
             return M_PROPERTY_ERROR;
         struct m_property_switch_arg *sarg = arg;
-        if ((r = do_action(prop_list, name, M_PROPERTY_SWITCH, arg, ctx)) !=
+        if ((r = do_action(h, M_PROPERTY_SWITCH, arg, ctx)) !=
             M_PROPERTY_NOT_IMPLEMENTED)
             return r;
         // Fallback to m_option
-        r = m_property_do(log, prop_list, name, M_PROPERTY_GET_CONSTRICTED_TYPE,
-                          &opt, ctx);
+        r = m_property_do_handle(log, h, M_PROPERTY_GET_CONSTRICTED_TYPE,
+                                 &opt, ctx);
         if (r <= 0)
             return r;
         assert(opt.type);
         if (!opt.type->add)
             return M_PROPERTY_NOT_IMPLEMENTED;
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET, &val, ctx)) <= 0)
+        if ((r = do_action(h, M_PROPERTY_GET, &val, ctx)) <= 0)
             return r;
         opt.type->add(&opt, &val, sarg->inc, sarg->wrap);
-        r = do_action(prop_list, name, M_PROPERTY_SET, &val, ctx);
+        r = do_action(h, M_PROPERTY_SET, &val, ctx);
         m_option_free(&opt, &val);
         return r;
     }
     case M_PROPERTY_GET_CONSTRICTED_TYPE: {
-        r = do_action(prop_list, name, action, arg, ctx);
+        r = do_action(h, action, arg, ctx);
         if (r >= 0 || r == M_PROPERTY_UNAVAILABLE)
             return r;
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET_TYPE, arg, ctx)) >= 0)
-            return r;
-        return M_PROPERTY_NOT_IMPLEMENTED;
+        // The type is the same as the one obtained above.
+        *(struct m_option *)arg = opt;
+        return M_PROPERTY_OK;
     }
     case M_PROPERTY_SET: {
-        return do_action(prop_list, name, M_PROPERTY_SET, arg, ctx);
+        return do_action(h, M_PROPERTY_SET, arg, ctx);
     }
     case M_PROPERTY_GET_NODE: {
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET_NODE, arg, ctx)) !=
+        if ((r = do_action(h, M_PROPERTY_GET_NODE, arg, ctx)) !=
             M_PROPERTY_NOT_IMPLEMENTED)
             return r;
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET, &val, ctx)) <= 0)
+        if ((r = do_action(h, M_PROPERTY_GET, &val, ctx)) <= 0)
             return r;
         struct mpv_node *node = arg;
         int err = m_option_get_node(&opt, NULL, node, &val);
@@ -190,22 +294,22 @@ int m_property_do(struct mp_log *log, const struct m_property *prop_list,
     case M_PROPERTY_SET_NODE: {
         if (!log)
             return M_PROPERTY_ERROR;
-        if ((r = do_action(prop_list, name, M_PROPERTY_SET_NODE, arg, ctx)) !=
+        if ((r = do_action(h, M_PROPERTY_SET_NODE, arg, ctx)) !=
             M_PROPERTY_NOT_IMPLEMENTED)
             return r;
-        int err = m_option_set_node_or_string(log, &opt, name, &val, arg);
+        int err = m_option_set_node_or_string(log, &opt, h->name, &val, arg);
         if (err == M_OPT_UNKNOWN) {
             r = M_PROPERTY_NOT_IMPLEMENTED;
         } else if (err < 0) {
             r = M_PROPERTY_INVALID_FORMAT;
         } else {
-            r = do_action(prop_list, name, M_PROPERTY_SET, &val, ctx);
+            r = do_action(h, M_PROPERTY_SET, &val, ctx);
         }
         m_option_free(&opt, &val);
         return r;
     }
     default:
-        return do_action(prop_list, name, action, arg, ctx);
+        return do_action(h, action, arg, ctx);
     }
 }
 
@@ -236,14 +340,18 @@ static void m_property_unkey(int *action, void **arg)
     }
 }
 
-static int m_property_do_bstr(const struct m_property *prop_list, bstr name,
+static int m_property_do_bstr(const struct m_property *prop_list,
+                              const struct m_property_index *index, bstr name,
                               int action, void *arg, void *ctx)
 {
     char name0[64];
     if (name.len >= sizeof(name0))
         return M_PROPERTY_UNKNOWN;
     snprintf(name0, sizeof(name0), "%.*s", BSTR_P(name));
-    return m_property_do(NULL, prop_list, name0, action, arg, ctx);
+    struct m_property_handle h;
+    if (!resolve(prop_list, index, name0, &h))
+        return M_PROPERTY_UNKNOWN;
+    return m_property_do_handle(NULL, &h, action, arg, ctx);
 }
 
 static void append_str(char **s, int *len, bstr append)
@@ -254,7 +362,8 @@ static void append_str(char **s, int *len, bstr append)
     *len = *len + append.len;
 }
 
-static int expand_property(const struct m_property *prop_list, char **ret,
+static int expand_property(const struct m_property *prop_list,
+                           const struct m_property_index *index, char **ret,
                            int *ret_len, bstr prop, bool silent_error, void *ctx)
 {
     bool cond_yes = bstr_eatstart0(&prop, "?");
@@ -268,7 +377,7 @@ static int expand_property(const struct m_property *prop_list, char **ret,
     int method = raw ? M_PROPERTY_GET_STRING : M_PROPERTY_PRINT;
 
     char *s = NULL;
-    int r = m_property_do_bstr(prop_list, prop, method, &s, ctx);
+    int r = m_property_do_bstr(prop_list, index, prop, method, &s, ctx);
     bool skip;
     if (comp) {
         skip = ((s && bstr_equals0(comp_with, s)) != cond_yes);
@@ -285,8 +394,9 @@ static int expand_property(const struct m_property *prop_list, char **ret,
     return skip;
 }
 
-char *m_properties_expand_string(const struct m_property *prop_list,
-                                 const char *str0, void *ctx)
+static char *expand_string(const struct m_property *prop_list,
+                           const struct m_property_index *index,
+                           const char *str0, void *ctx)
 {
     char *ret = NULL;
     int ret_len = 0;
@@ -311,7 +421,7 @@ char *m_properties_expand_string(const struct m_property *prop_list,
             bool have_fallback = bstr_eatstart0(&str, ":");
 
             if (!skip) {
-                skip = expand_property(prop_list, &ret, &ret_len, name,
+                skip = expand_property(prop_list, index, &ret, &ret_len, name,
                                        have_fallback, ctx);
                 if (skip)
                     skip_level = level;
@@ -341,6 +451,18 @@ char *m_properties_expand_string(const struct m_property *prop_list,
     return ret;
 }
 
+char *m_properties_expand_string(const struct m_property *prop_list,
+                                 const char *str, void *ctx)
+{
+    return expand_string(prop_list, NULL, str, ctx);
+}
+
+char *m_property_index_expand_string(const struct m_property_index *index,
+                                     const char *str, void *ctx)
+{
+    return expand_string(NULL, index, str, ctx);
+}
+
 void m_properties_print_help_list(struct mp_log *log,
                                   const struct m_property *list)
 {
@@ -516,10 +638,71 @@ int m_property_read_sub(const struct m_sub_property *props, int action, void *ar
 }
 
 
+// Return items [first, first + count) as node array.
+static struct mpv_node get_list_node(int first, int count,
+                                     m_get_item_cb get_item, void *ctx)
+{
+    struct mpv_node node;
+    node.format = MPV_FORMAT_NODE_ARRAY;
+    node.u.list = talloc_zero(NULL, mpv_node_list);
+    node.u.list->num = count;
+    node.u.list->values = talloc_array(node.u.list, mpv_node, count);
+    for (int i = 0; i < count; i++) {
+        struct mpv_node *sub = &node.u.list->values[i];
+        int n = first + i;
+        sub->format = MPV_FORMAT_NONE;
+        int r;
+        r = get_item(n, M_PROPERTY_GET_NODE, sub, ctx);
+        if (r == M_PROPERTY_NOT_IMPLEMENTED) {
+            struct m_option opt = {0};
+            r = get_item(n, M_PROPERTY_GET_TYPE, &opt, ctx);
+            if (r != M_PROPERTY_OK)
+                goto err;
+            union m_option_value val = {0};
+            r = get_item(n, M_PROPERTY_GET, &val, ctx);
+            if (r != M_PROPERTY_OK)
+                goto err;
+            m_option_get_node(&opt, node.u.list, sub, &val);
+            m_option_free(&opt, &val);
+        err: ;
+        }
+    }
+    return node;
+}
+
+// Handle "range/<first>/<count>", which returns a node array like a full GET,
+// but only with the given items. This lets clients page through big lists
+// without converting all items on each access.
+static int read_list_range(const char *key, int action, void *arg, int count,
+                           m_get_item_cb get_item, void *ctx)
+{
+    char *end;
+    long int first = strtol(key, &end, 10);
+    if (end == key || end[0] != '/')
+        return M_PROPERTY_UNKNOWN;
+    const char *num_s = end + 1;
+    long int num = strtol(num_s, &end, 10);
+    if (end == num_s || end[0] || first < 0 || num < 0)
+        return M_PROPERTY_UNKNOWN;
+    first = MPMIN(first, count);
+    num = MPMIN(num, count - first);
+
+    switch (action) {
+    case M_PROPERTY_GET_TYPE:
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    case M_PROPERTY_GET:
+        *(struct mpv_node *)arg = get_list_node(first, num, get_item, ctx);
+        return M_PROPERTY_OK;
+    }
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
 // Make a list of items available as indexed sub-properties. E.g. you can access
 // item 0 as "property/0", item 1 as "property/1", etc., where each of these
 // properties is redirected to the get_item(0, ...), get_item(1, ...), callback.
-// Additionally, the number of entries is made available as "property/count".
+// Additionally, the number of entries is made available as "property/count",
+// and a slice of the list as "property/range/<first>/<count>".
 // action, arg: property access.
 // count: number of items.
 // get_item: callback to access a single item.
@@ -532,34 +715,9 @@ int m_property_read_list(int action, void *arg, int count,
     case M_PROPERTY_GET_TYPE:
         *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
         return M_PROPERTY_OK;
-    case M_PROPERTY_GET: {
-        struct mpv_node node;
-        node.format = MPV_FORMAT_NODE_ARRAY;
-        node.u.list = talloc_zero(NULL, mpv_node_list);
-        node.u.list->num = count;
-        node.u.list->values = talloc_array(node.u.list, mpv_node, count);
-        for (int n = 0; n < count; n++) {
-            struct mpv_node *sub = &node.u.list->values[n];
-            sub->format = MPV_FORMAT_NONE;
-            int r;
-            r = get_item(n, M_PROPERTY_GET_NODE, sub, ctx);
-            if (r == M_PROPERTY_NOT_IMPLEMENTED) {
-                struct m_option opt = {0};
-                r = get_item(n, M_PROPERTY_GET_TYPE, &opt, ctx);
-                if (r != M_PROPERTY_OK)
-                    goto err;
-                union m_option_value val = {0};
-                r = get_item(n, M_PROPERTY_GET, &val, ctx);
-                if (r != M_PROPERTY_OK)
-                    goto err;
-                m_option_get_node(&opt, node.u.list, sub, &val);
-                m_option_free(&opt, &val);
-            err: ;
-            }
-        }
-        *(struct mpv_node *)arg = node;
+    case M_PROPERTY_GET:
+        *(struct mpv_node *)arg = get_list_node(0, count, get_item, ctx);
         return M_PROPERTY_OK;
-    }
     case M_PROPERTY_PRINT: {
         // See m_property_read_sub() remarks.
         char *res = NULL;
@@ -591,6 +749,10 @@ int m_property_read_list(int action, void *arg, int count,
             }
             return M_PROPERTY_NOT_IMPLEMENTED;
         }
+        if (strncmp(ka->key, "range/", 6) == 0) {
+            return read_list_range(ka->key + 6, ka->action, ka->arg,
+                                   MPMAX(0, count), get_item, ctx);
+        }
         // This is expected of the form "123" or "123/rest"
         char *next = strchr(ka->key, '/');
         char *end = NULL;
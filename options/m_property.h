@@ -138,6 +138,31 @@ struct m_property {
 struct m_property *m_property_list_find(const struct m_property *list,
                                         const char *name);
 
+// Hash table for fast lookup of properties by name. The list must outlive the
+// index, and must not be changed after creating it. Free with talloc_free().
+struct m_property_index;
+struct m_property_index *m_property_index_create(void *ta_parent,
+                                                 const struct m_property *list);
+
+// Same as m_property_list_find() on the indexed list.
+struct m_property *m_property_index_find(const struct m_property_index *index,
+                                         bstr name);
+
+// A property name resolved to the property table entry, so that repeated
+// accesses don't have to look it up again.
+struct m_property_handle {
+    struct m_property *prop;    // NULL if there is no such property
+    const char *key;            // sub-property path ("a" in "name/a"), or NULL
+    const char *name;           // full name as passed to m_property_resolve()
+};
+
+// Look up the property name (which can include a sub-property path). The
+// handle references the name string, which must remain valid while the
+// handle is used. Returns false (and sets h->prop to NULL) if the property
+// does not exist.
+bool m_property_resolve(const struct m_property_index *index, const char *name,
+                        struct m_property_handle *h);
+
 // Access a property.
 // action: one of m_property_action
 // ctx: opaque value passed through to property implementation
@@ -145,6 +170,10 @@ struct m_property *m_property_list_find(const struct m_property *list,
 int m_property_do(struct mp_log *log, const struct m_property* prop_list,
                   const char* property_name, int action, void* arg, void *ctx);
 
+// Same as m_property_do(), but with an already resolved property.
+int m_property_do_handle(struct mp_log *log, const struct m_property_handle *h,
+                         int action, void *arg, void *ctx);
+
 // Given a path of the form "a/b/c", this function will set *prefix to "a",
 // and rem to "b/c", and return true.
 // If there is no '/' in the path, set prefix to path, and rem to "", and
@@ -170,6 +199,10 @@ void m_properties_print_help_list(struct mp_log *log,
 char* m_properties_expand_string(const struct m_property *prop_list,
                                  const char *str, void *ctx);
 
+// Same as m_properties_expand_string(), but using the index for lookups.
+char *m_property_index_expand_string(const struct m_property_index *index,
+                                     const char *str, void *ctx);
+
 // Trivial helpers for implementing properties.
 int m_property_flag_ro(int action, void* arg, int var);
 int m_property_int_ro(int action, void* arg, int var);
@@ -411,6 +411,7 @@ static const m_option_t mp_opts[] = {
         .flags = CONF_PRE_PARSE | UPDATE_TERM},
     {"dump-stats", OPT_STRING(dump_stats),
         .flags = UPDATE_TERM | CONF_PRE_PARSE | M_OPT_FILE},
+    {"startup-trace", OPT_STRING(startup_trace), .flags = M_OPT_FILE},
     {"msg-color", OPT_FLAG(msg_color), .flags = CONF_PRE_PARSE | UPDATE_TERM},
     {"log-file", OPT_STRING(log_file),
         .flags = CONF_PRE_PARSE | M_OPT_FILE | UPDATE_TERM},
@@ -532,6 +533,8 @@ static const m_option_t mp_opts[] = {
     {"demuxer-termination-timeout", OPT_DOUBLE(demux_termination_timeout)},
     {"demuxer-cache-wait", OPT_FLAG(demuxer_cache_wait)},
     {"prefetch-playlist", OPT_FLAG(prefetch_open)},
+    {"prefetch-playlist-lookahead", OPT_INT(prefetch_lookahead),
+        M_RANGE(0, 32)},
     {"cache-pause", OPT_FLAG(cache_pause)},
     {"cache-pause-initial", OPT_FLAG(cache_pause_initial)},
     {"cache-pause-wait", OPT_FLOAT(cache_pause_wait), M_RANGE(0, DBL_MAX)},
@@ -553,6 +556,7 @@ static const m_option_t mp_opts[] = {
     {"audio-channels", OPT_CHANNELS(audio_output_channels), .flags = UPDATE_AUDIO},
     {"audio-format", OPT_AUDIOFORMAT(audio_output_format), .flags = UPDATE_AUDIO},
     {"speed", OPT_DOUBLE(playback_speed), M_RANGE(0.01, 100.0)},
+    {"trick-play-speed", OPT_DOUBLE(trick_play_speed), M_RANGE(0, 100.0)},
 
     {"audio-pitch-correction", OPT_FLAG(pitch_correction)},
 
@@ -637,6 +641,9 @@ static const m_option_t mp_opts[] = {
     {"replaygain-clip", OPT_FLAG(rgain_clip), .flags = UPDATE_VOL},
     {"replaygain-fallback", OPT_FLOAT(rgain_fallback), .flags = UPDATE_VOL,
         M_RANGE(-200, 60)},
+    {"replaygain-scan", OPT_FLAG(rgain_scan)},
+    {"replaygain-scan-threads", OPT_INT(rgain_scan_threads), M_RANGE(1, 16)},
+    {"replaygain-scan-ahead", OPT_INT(rgain_scan_ahead), M_RANGE(0, 100)},
     {"gapless-audio", OPT_CHOICE(gapless_audio,
         {"no", 0},
         {"yes", 1},
@@ -760,6 +767,7 @@ static const m_option_t mp_opts[] = {
     {"input-ipc-server", OPT_STRING(ipc_path), .flags = M_OPT_FILE},
 #if HAVE_POSIX
     {"input-ipc-client", OPT_STRING(ipc_client)},
+    {"input-ipc-shm", OPT_STRING(ipc_shm_path), .flags = M_OPT_FILE},
 #endif
 
     {"screenshot", OPT_SUBSTRUCT(screenshot_image_opts, screenshot_conf)},
@@ -767,6 +775,16 @@ static const m_option_t mp_opts[] = {
     {"screenshot-directory", OPT_STRING(screenshot_directory),
         .flags = M_OPT_FILE},
     {"screenshot-sw", OPT_BOOL(screenshot_sw)},
+    {"screenshot-threads", OPT_INT(screenshot_threads), M_RANGE(1, 16)},
+    {"screenshot-queue-bytes", OPT_BYTE_SIZE(screenshot_queue_bytes),
+        M_RANGE(0, M_MAX_MEM_BYTES)},
+
+    {"thumbnails", OPT_FLAG(thumbnails)},
+    {"thumbnail-interval", OPT_DOUBLE(thumbnail_interval), M_RANGE(0.1, 3600)},
+    {"thumbnail-width", OPT_INT(thumbnail_width), M_RANGE(16, 1920)},
+    {"thumbnail-threads", OPT_INT(thumbnail_threads), M_RANGE(1, 16)},
+    {"thumbnail-max-bytes", OPT_BYTE_SIZE(thumbnail_max_bytes),
+        M_RANGE(0, M_MAX_MEM_BYTES)},
 
     {"record-file", OPT_STRING(record_file), .flags = M_OPT_FILE,
         .deprecation_message = "use --stream-record or the dump-cache command"},
@@ -962,6 +980,8 @@ static const struct MPOpts mp_default_opts = {
     .use_terminal = 1,
     .msg_color = 1,
     .softvol_max = 130,
+    .rgain_scan_threads = 2,
+    .rgain_scan_ahead = 5,
     .softvol_volume = 100,
     .softvol_mute = 0,
     .gapless_audio = -1,
@@ -1031,6 +1051,12 @@ static const struct MPOpts mp_default_opts = {
     .coverart_auto = 1,
     .osd_bar_visible = 1,
     .screenshot_template = "mpv-shot%n",
+    .screenshot_threads = 4,
+    .screenshot_queue_bytes = 256 * 1024 * 1024,
+    .thumbnail_interval = 10,
+    .thumbnail_width = 160,
+    .thumbnail_threads = 2,
+    .thumbnail_max_bytes = 32 * 1024 * 1024,
     .play_dir = 1,
 
     .audio_output_channels = {
@@ -135,6 +135,7 @@ typedef struct MPOpts {
     int property_print_help;
     int use_terminal;
     char *dump_stats;
+    char *startup_trace;
     int verbose;
     int msg_really_quiet;
     char **msg_levels;
@@ -169,6 +170,9 @@ typedef struct MPOpts {
     float rgain_preamp;         // Set replaygain pre-amplification
     int rgain_clip;             // Enable/disable clipping prevention
     float rgain_fallback;
+    int rgain_scan;
+    int rgain_scan_threads;
+    int rgain_scan_ahead;
     int softvol_mute;
     float softvol_max;
     int gapless_audio;
@@ -273,6 +277,7 @@ typedef struct MPOpts {
     double demux_termination_timeout;
     int demuxer_cache_wait;
     int prefetch_open;
+    int prefetch_lookahead;
     char *audio_demuxer_name;
     char *sub_demuxer_name;
 
@@ -284,6 +289,13 @@ typedef struct MPOpts {
     char *screenshot_template;
     char *screenshot_directory;
     bool screenshot_sw;
+    int screenshot_threads;
+    int64_t screenshot_queue_bytes;
+    int thumbnails;
+    double thumbnail_interval;
+    int thumbnail_width;
+    int thumbnail_threads;
+    int64_t thumbnail_max_bytes;
 
     int index_mode;
 
@@ -291,6 +303,7 @@ typedef struct MPOpts {
     int audio_output_format;
     int force_srate;
     double playback_speed;
+    double trick_play_speed;
     int pitch_correction;
     struct m_obj_settings *vf_settings, *vf_defs;
     struct m_obj_settings *af_settings, *af_defs;
@@ -339,6 +352,7 @@ typedef struct MPOpts {
 
     char *ipc_path;
     char *ipc_client;
+    char *ipc_shm_path;
 
     int wingl_dwm_flush;
 
@@ -49,6 +49,8 @@ typedef struct { uint64_t v;           } mp_atomic_uint64;
 #define memory_order_relaxed 1
 #define memory_order_seq_cst 2
 #define memory_order_acq_rel 3
+#define memory_order_acquire 4
+#define memory_order_release 5
 
 #include <pthread.h>
 
@@ -101,6 +103,9 @@ extern pthread_mutex_t mp_atomic_mutex;
 #define atomic_load_explicit(a, b)                      \
     atomic_load(a)
 
+#define atomic_store_explicit(a, b, c)                  \
+    atomic_store(a, b)
+
 #define atomic_exchange_explicit(a, b, c)               \
     atomic_exchange(a, b)
 
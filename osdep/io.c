@@ -605,6 +605,21 @@ int mp_mkdir(const char *path, int mode)
     return res;
 }
 
+// Unlike MSVCRT rename(), replace an existing newpath, as POSIX does.
+int mp_rename(const char *oldpath, const char *newpath)
+{
+    wchar_t *woldpath = mp_from_utf8(NULL, oldpath);
+    wchar_t *wnewpath = mp_from_utf8(NULL, newpath);
+    int res = 0;
+    if (!MoveFileExW(woldpath, wnewpath, MOVEFILE_REPLACE_EXISTING)) {
+        set_errno_from_lasterror();
+        res = -1;
+    }
+    talloc_free(woldpath);
+    talloc_free(wnewpath);
+    return res;
+}
+
 char *mp_win32_getcwd(char *buf, size_t size)
 {
     if (size >= SIZE_MAX / 3 - 1) {
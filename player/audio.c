@@ -122,10 +122,16 @@ static float compute_replaygain(struct MPContext *mpctx)
 
     float rgain = 1.0;
 
-    struct replaygain_data *rg = NULL;
+    struct replaygain_data *rg = NULL, scanned;
     struct track *track = mpctx->current_track[0][STREAM_AUDIO];
     if (track)
         rg = track->stream->codec->replaygain_data;
+    if (!rg && track && !track->is_external && mpctx->filename &&
+        loudness_scan_get(mpctx, mpctx->filename, &scanned))
+    {
+        MP_VERBOSE(mpctx, "Using scanned loudness.\n");
+        rg = &scanned;
+    }
     if (opts->rgain_mode && rg) {
         MP_VERBOSE(mpctx, "Replaygain: Track=%f/%f Album=%f/%f\n",
                    rg->track_gain, rg->track_peak,
@@ -181,6 +187,7 @@ void update_playback_speed(struct MPContext *mpctx)
     mpctx->video_speed = mpctx->opts->playback_speed * mpctx->speed_factor_v;
 
     update_speed_filters(mpctx);
+    update_video_trick_play(mpctx);
 }
 
 static void ao_chain_reset_state(struct ao_chain *ao_c)
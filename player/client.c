@@ -90,6 +90,7 @@ struct observe_property {
     // -- immutable
     struct mpv_handle *owner;
     char *name;
+    struct m_property_handle handle; // resolved name
     int id;                 // ==mp_get_property_id(name)
     uint64_t event_mask;    // ==mp_get_property_event_mask(name)
     int64_t reply_id;
@@ -1385,9 +1386,16 @@ int mpv_set_property_async(mpv_handle *ctx, uint64_t ud, const char *name,
     return run_async(ctx, setproperty_fn, req);
 }
 
+struct mpv_property_handle {
+    char *name;
+    struct m_property_handle handle;
+};
+
 struct getproperty_request {
     struct MPContext *mpctx;
     const char *name;
+    // If set, used instead of name.
+    const struct m_property_handle *handle;
     mpv_format format;
     void *data;
     int status;
@@ -1402,6 +1410,14 @@ static void free_prop_data(void *ptr)
     m_option_free(type, prop->data);
 }
 
+static int getproperty_do(struct getproperty_request *req, int action,
+                          void *arg)
+{
+    if (req->handle)
+        return mp_property_do_handle(req->handle, action, arg, req->mpctx);
+    return mp_property_do(req->name, action, arg, req->mpctx);
+}
+
 static void getproperty_fn(void *arg)
 {
     struct getproperty_request *req = arg;
@@ -1413,11 +1429,11 @@ static void getproperty_fn(void *arg)
     int err = -1;
     switch (req->format) {
     case MPV_FORMAT_OSD_STRING:
-        err = mp_property_do(req->name, M_PROPERTY_PRINT, data, req->mpctx);
+        err = getproperty_do(req, M_PROPERTY_PRINT, data);
         break;
     case MPV_FORMAT_STRING: {
         char *s = NULL;
-        err = mp_property_do(req->name, M_PROPERTY_GET_STRING, &s, req->mpctx);
+        err = getproperty_do(req, M_PROPERTY_GET_STRING, &s);
         if (err == M_PROPERTY_OK)
             *(char **)data = s;
         break;
@@ -1427,13 +1443,12 @@ static void getproperty_fn(void *arg)
     case MPV_FORMAT_INT64:
     case MPV_FORMAT_DOUBLE: {
         struct mpv_node node = {{0}};
-        err = mp_property_do(req->name, M_PROPERTY_GET_NODE, &node, req->mpctx);
+        err = getproperty_do(req, M_PROPERTY_GET_NODE, &node);
         if (err == M_PROPERTY_NOT_IMPLEMENTED) {
             // Go through explicit string conversion. Same reasoning as on the
             // GET code path.
             char *s = NULL;
-            err = mp_property_do(req->name, M_PROPERTY_GET_STRING, &s,
-                                 req->mpctx);
+            err = getproperty_do(req, M_PROPERTY_GET_STRING, &s);
             if (err != M_PROPERTY_OK)
                 break;
             node.format = MPV_FORMAT_STRING;
@@ -1510,6 +1525,92 @@ char *mpv_get_property_osd_string(mpv_handle *ctx, const char *name)
     return str;
 }
 
+mpv_property_handle *mpv_resolve_property(mpv_handle *ctx, const char *name)
+{
+    // The property table is immutable after command_init(), so no core lock
+    // is needed.
+    struct m_property_handle h;
+    if (!mp_property_resolve(ctx->mpctx, name, &h))
+        return NULL;
+
+    pthread_mutex_lock(&ctx->lock);
+    struct mpv_property_handle *prop = talloc_ptrtype(ctx, prop);
+    prop->name = talloc_strdup(prop, name);
+    pthread_mutex_unlock(&ctx->lock);
+
+    // Make the handle reference the copied name.
+    mp_property_resolve(ctx->mpctx, prop->name, &prop->handle);
+    return prop;
+}
+
+void mpv_free_property_handle(mpv_handle *ctx, mpv_property_handle *prop)
+{
+    if (!prop)
+        return;
+    pthread_mutex_lock(&ctx->lock);
+    talloc_free(prop);
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+int mpv_get_property_by_handle(mpv_handle *ctx, mpv_property_handle *prop,
+                               mpv_format format, void *data)
+{
+    mpv_property_get get = {
+        .handle = prop,
+        .format = format,
+        .data = data,
+    };
+    int err = mpv_get_properties(ctx, &get, 1);
+    return err < 0 ? err : get.error;
+}
+
+struct getproperties_request {
+    struct MPContext *mpctx;
+    mpv_property_get *props;
+    int num_props;
+};
+
+static void getproperties_fn(void *arg)
+{
+    struct getproperties_request *req = arg;
+
+    for (int n = 0; n < req->num_props; n++) {
+        mpv_property_get *get = &req->props[n];
+        struct getproperty_request preq = {
+            .mpctx = req->mpctx,
+            .name = get->handle->name,
+            .handle = &get->handle->handle,
+            .format = get->format,
+            .data = get->data,
+        };
+        getproperty_fn(&preq);
+        get->error = preq.status;
+    }
+}
+
+int mpv_get_properties(mpv_handle *ctx, mpv_property_get *props, int num_props)
+{
+    if (!ctx->mpctx->initialized)
+        return MPV_ERROR_UNINITIALIZED;
+    if (num_props < 0 || (num_props && !props))
+        return MPV_ERROR_INVALID_PARAMETER;
+    for (int n = 0; n < num_props; n++) {
+        if (!props[n].handle || !props[n].data)
+            return MPV_ERROR_INVALID_PARAMETER;
+        if (!get_mp_type_get(props[n].format))
+            return MPV_ERROR_PROPERTY_FORMAT;
+    }
+
+    // All properties are read with a single core lock acquisition.
+    struct getproperties_request req = {
+        .mpctx = ctx->mpctx,
+        .props = props,
+        .num_props = num_props,
+    };
+    run_locked(ctx, getproperties_fn, &req);
+    return 0;
+}
+
 int mpv_get_property_async(mpv_handle *ctx, uint64_t ud, const char *name,
                            mpv_format format)
 {
@@ -1566,6 +1667,7 @@ int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
         .change_ts = 1, // force initial event
         .refcount = 1,
     };
+    mp_property_resolve(ctx->mpctx, prop->name, &prop->handle);
     ctx->properties_change_ts += 1;
     MP_TARRAY_APPEND(ctx, ctx->properties, ctx->num_properties, prop);
     ctx->property_event_masks |= prop->event_mask;
@@ -1577,6 +1679,12 @@ int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
     return 0;
 }
 
+int mpv_observe_property_handle(mpv_handle *ctx, uint64_t userdata,
+                                mpv_property_handle *prop, mpv_format format)
+{
+    return mpv_observe_property(ctx, userdata, prop->name, format);
+}
+
 int mpv_unobserve_property(mpv_handle *ctx, uint64_t userdata)
 {
     pthread_mutex_lock(&ctx->lock);
@@ -1666,6 +1774,7 @@ static void send_client_property_changes(struct mpv_handle *ctx)
             struct getproperty_request req = {
                 .mpctx = ctx->mpctx,
                 .name = prop->name,
+                .handle = &prop->handle,
                 .format = prop->format,
                 .data = &val,
             };
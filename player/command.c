@@ -58,12 +58,14 @@
 #include "video/out/vo.h"
 #include "video/csputils.h"
 #include "video/hwdec.h"
+#include "video/mp_image.h"
 #include "audio/aframe.h"
 #include "audio/format.h"
 #include "audio/out/ao.h"
 #include "video/out/bitmap_packer.h"
 #include "options/path.h"
 #include "screenshot.h"
+#include "shm_state.h"
 #include "misc/dispatch.h"
 #include "misc/node.h"
 #include "misc/thread_pool.h"
@@ -81,6 +83,7 @@
 struct command_ctx {
     // All properties, terminated with a {0} item.
     struct m_property *properties;
+    struct m_property_index *prop_index;
 
     double last_seek_time;
     double last_seek_pts;
@@ -105,6 +108,7 @@ struct command_ctx {
     struct ao_hotplug *hotplug;
 
     struct mp_cmd_ctx *cache_dump_cmd; // in progress cache dumping
+    int cache_dump_percent;            // last reported progress
 
     char **script_props;
 
@@ -1495,6 +1499,32 @@ static int mp_property_demuxer_cache_state(void *ctx, struct m_property *prop,
     return M_PROPERTY_OK;
 }
 
+static int mp_property_thumbnail_info(void *ctx, struct m_property *prop,
+                                      int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct thumbnails_info info;
+    if (!thumbnails_get_info(mpctx, &info))
+        return M_PROPERTY_UNAVAILABLE;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_MAP, NULL);
+    node_map_add_int64(r, "w", info.w);
+    node_map_add_int64(r, "h", info.h);
+    node_map_add_double(r, "interval", info.interval);
+    node_map_add_int64(r, "count", info.count);
+    node_map_add_int64(r, "available", info.available);
+
+    return M_PROPERTY_OK;
+}
+
 static int mp_property_demuxer_start_time(void *ctx, struct m_property *prop,
                                           int action, void *arg)
 {
@@ -3033,8 +3063,9 @@ static int mp_property_playlist(void *ctx, struct m_property *prop,
         struct playlist *pl = mpctx->playlist;
         char *res = talloc_strdup(NULL, "");
 
-        for (int n = 0; n < pl->num_entries; n++) {
-            struct playlist_entry *e = pl->entries[n];
+        for (struct playlist_entry *e = playlist_get_first(pl); e;
+             e = playlist_entry_get_rel(e, 1))
+        {
             char *p = e->title;
             if (!p) {
                 p = e->filename;
@@ -3609,6 +3640,7 @@ static const struct m_property mp_properties_base[] = {
     {"demuxer-cache-idle", mp_property_demuxer_cache_idle},
     {"demuxer-start-time", mp_property_demuxer_start_time},
     {"demuxer-cache-state", mp_property_demuxer_cache_state},
+    {"thumbnail-info", mp_property_thumbnail_info},
     {"cache-buffering-state", mp_property_cache_buffering},
     {"paused-for-cache", mp_property_paused_for_cache},
     {"demuxer-via-network", mp_property_demuxer_is_network},
@@ -3880,11 +3912,26 @@ static bool is_property_set(int action, void *val)
     }
 }
 
+bool mp_property_resolve(struct MPContext *mpctx, const char *name,
+                         struct m_property_handle *h)
+{
+    return m_property_resolve(mpctx->command_ctx->prop_index, name, h);
+}
+
 int mp_property_do(const char *name, int action, void *val,
                    struct MPContext *ctx)
 {
-    struct command_ctx *cmd = ctx->command_ctx;
-    int r = m_property_do(ctx->log, cmd->properties, name, action, val, ctx);
+    struct m_property_handle h;
+    if (!mp_property_resolve(ctx, name, &h))
+        return M_PROPERTY_UNKNOWN;
+    return mp_property_do_handle(&h, action, val, ctx);
+}
+
+int mp_property_do_handle(const struct m_property_handle *h, int action,
+                          void *val, struct MPContext *ctx)
+{
+    const char *name = h->name;
+    int r = m_property_do_handle(ctx->log, h, action, val, ctx);
 
     if (mp_msg_test(ctx->log, MSGL_V) && is_property_set(action, val)) {
         struct m_option ot = {0};
@@ -3909,7 +3956,7 @@ int mp_property_do(const char *name, int action, void *val,
 char *mp_property_expand_string(struct MPContext *mpctx, const char *str)
 {
     struct command_ctx *ctx = mpctx->command_ctx;
-    return m_properties_expand_string(ctx->properties, str, mpctx);
+    return m_property_index_expand_string(ctx->prop_index, str, mpctx);
 }
 
 // Before expanding properties, parse C-style escapes like "\n"
@@ -5943,10 +5990,17 @@ static void cache_dump_poll(struct MPContext *mpctx)
         // Synchronous abort. In particular, the dump command shall not report
         // completion to the user before the dump target file was closed.
         demux_cache_dump_set(mpctx->demuxer, 0, 0, NULL);
-        assert(demux_cache_dump_get_status(mpctx->demuxer) <= 0);
+        assert(demux_cache_dump_get_status(mpctx->demuxer, NULL) <= 0);
     }
 
-    int status = demux_cache_dump_get_status(mpctx->demuxer);
+    double progress;
+    int status = demux_cache_dump_get_status(mpctx->demuxer, &progress);
+    int percent = lrint(progress * 100);
+    if (status > 0 && percent != ctx->cache_dump_percent) {
+        MP_VERBOSE(mpctx, "Cache dumping: %d%% of cached data written.\n",
+                   percent);
+        ctx->cache_dump_percent = percent;
+    }
     if (status <= 0) {
         if (status < 0) {
             mp_cmd_msg(cmd, MSGL_ERR, "Cache dumping stopped due to error.");
@@ -5994,6 +6048,7 @@ static void run_dump_cmd(struct mp_cmd_ctx *cmd, double start, double end,
     }
 
     ctx->cache_dump_cmd = cmd;
+    ctx->cache_dump_percent = -1;
     cache_dump_poll(mpctx);
 }
 
@@ -6013,6 +6068,33 @@ static void cmd_dump_cache_ab(void *p)
                  cmd->args[0].v.s);
 }
 
+static void cmd_thumbnail_raw(void *p)
+{
+    struct mp_cmd_ctx *cmd = p;
+    struct MPContext *mpctx = cmd->mpctx;
+    struct mpv_node *res = &cmd->result;
+
+    struct mp_image *img = thumbnails_get(mpctx, cmd->args[0].v.d);
+    if (!img) {
+        cmd->success = false;
+        return;
+    }
+
+    node_init(res, MPV_FORMAT_NODE_MAP, NULL);
+    node_map_add_int64(res, "w", img->w);
+    node_map_add_int64(res, "h", img->h);
+    node_map_add_int64(res, "stride", img->stride[0]);
+    node_map_add_string(res, "format", "bgr0");
+    node_map_add_double(res, "time", img->pts);
+    struct mpv_byte_array *ba =
+        node_map_add(res, "data", MPV_FORMAT_BYTE_ARRAY)->u.ba;
+    *ba = (struct mpv_byte_array){
+        .data = img->planes[0],
+        .size = img->stride[0] * img->h,
+    };
+    talloc_steal(ba, img);
+}
+
 /* This array defines all known commands.
  * The first field the command name used in libmpv and input.conf.
  * The second field is the handler function (see mp_cmd_def.handler and
@@ -6233,6 +6315,7 @@ const struct mp_cmd_def mp_cmds[] = {
                 .flags = MP_CMD_OPT_ARG},
         },
         .spawn_thread = true,
+        .exec_async = true,
     },
     { "screenshot-to-file", cmd_screenshot_to_file,
         {
@@ -6244,6 +6327,7 @@ const struct mp_cmd_def mp_cmds[] = {
                 OPTDEF_INT(2)},
         },
         .spawn_thread = true,
+        .exec_async = true,
     },
     { "screenshot-raw", cmd_screenshot_raw,
         {
@@ -6444,6 +6528,8 @@ const struct mp_cmd_def mp_cmds[] = {
         .can_abort = true,
     },
 
+    { "thumbnail-raw", cmd_thumbnail_raw, { {"time", OPT_TIME(v.d)} } },
+
     { "ab-loop-dump-cache", cmd_dump_cache_ab, { {"filename", OPT_STRING(v.s)} },
         .exec_async = true,
         .can_abort = true,
@@ -6486,6 +6572,10 @@ void command_init(struct MPContext *mpctx)
         talloc_zero_array(ctx, struct m_property, num_base + num_opts + 1);
     memcpy(ctx->properties, mp_properties_base, sizeof(mp_properties_base));
 
+    // Only the manual properties need to be checked for duplicates below.
+    struct m_property_index *base_index =
+        m_property_index_create(NULL, ctx->properties);
+
     int count = num_base;
     for (int n = 0; n < num_opts; n++) {
         struct m_config_option *co = m_config_get_co_index(mpctx->mconfig, n);
@@ -6519,11 +6609,14 @@ void command_init(struct MPContext *mpctx)
         }
 
         // The option might be covered by a manual property already.
-        if (m_property_list_find(ctx->properties, prop.name))
+        if (m_property_index_find(base_index, bstr0(prop.name)))
             continue;
 
         ctx->properties[count++] = prop;
     }
+
+    talloc_free(base_index);
+    ctx->prop_index = m_property_index_create(ctx, ctx->properties);
 }
 
 static void command_event(struct MPContext *mpctx, int event, void *arg)
@@ -6649,6 +6742,11 @@ void mp_option_change_callback(void *ctx, struct m_config_option *co, int flags,
         mpctx->ipc_ctx = mp_init_ipc(mpctx->clients, mpctx->global);
     }
 
+    if (init || opt_ptr == &opts->ipc_shm_path) {
+        mp_shm_state_uninit(mpctx);
+        mp_shm_state_init(mpctx);
+    }
+
     if (opt_ptr == &opts->vo->video_driver_list) {
         struct track *track = mpctx->current_track[0][STREAM_VIDEO];
         uninit_video_out(mpctx);
@@ -6679,7 +6777,9 @@ void mp_option_change_callback(void *ctx, struct m_config_option *co, int flags,
             vo_control(mpctx->video_out, VOCTRL_EXTERNAL_RESIZE, NULL);
     }
 
-    if (opt_ptr == &opts->playback_speed) {
+    if (opt_ptr == &opts->playback_speed ||
+        opt_ptr == &opts->trick_play_speed)
+    {
         update_playback_speed(mpctx);
         mp_wakeup_core(mpctx);
     }
@@ -249,6 +249,7 @@ typedef struct MPContext {
     struct MPOpts *opts;
     struct mp_log *log;
     struct stats_ctx *stats;
+    struct stats_handle *stats_iterations;
     struct m_config *mconfig;
     struct input_ctx *input;
     struct mp_client_api *clients;
@@ -447,6 +448,10 @@ typedef struct MPContext {
     struct encode_lavc_context *encode_lavc_ctx;
 
     struct mp_ipc_ctx *ipc_ctx;
+    struct shm_state *shm_state;
+
+    struct loudness_scan *loudness_scan;
+    struct thumbnails *thumbnails;
 
     int64_t builtin_script_ids[5];
 
@@ -457,22 +462,37 @@ typedef struct MPContext {
     int num_abort_list;
     bool abort_all; // during final termination
 
+    // Files being opened asynchronously: the file to play, and prefetched
+    // playlist entries (see prefetch_next()).
+    struct mp_open_ctx **opens;
+    int num_opens;
+
+    // Playlist files whose remaining entries are still read in the background.
+    // A nested playlist file is appended while the outer one is still read.
+    struct bg_playlist **bg_playlists;
+    int num_bg_playlists;
+} MPContext;
+
+// A file being opened on a separate thread.
+struct mp_open_ctx {
+    struct MPContext *mpctx;
     // --- Owned by MPContext
-    pthread_t open_thread;
-    bool open_active; // open_thread is a valid thread handle, all setup
-    atomic_bool open_done;
-    // --- All fields below are immutable while open_active is true.
+    pthread_t thread;
+    bool active; // thread is a valid thread handle, all setup
+    atomic_bool done;
+    bool prefetching; // demux_start_prefetch() was called (valid if done)
+    // --- All fields below are immutable while active is true.
     //     Otherwise, they're owned by MPContext.
-    struct mp_cancel *open_cancel;
-    char *open_url;
-    char *open_format;
-    int open_url_flags;
-    bool open_for_prefetch;
-    // --- All fields below are owned by open_thread, unless open_done was set
-    //     to true.
-    struct demuxer *open_res_demuxer;
-    int open_res_error;
-} MPContext;
+    struct mp_cancel *cancel;
+    char *url;
+    char *format;
+    int url_flags;
+    bool for_prefetch;
+    bool incremental_playlist;
+    // --- All fields below are owned by thread, unless done was set to true.
+    struct demuxer *res_demuxer;
+    int res_error;
+};
 
 // Contains information about an asynchronous work item, how it can be aborted,
 // and when. All fields are protected by MPContext.abort_lock.
@@ -517,6 +537,28 @@ void mp_delete_watch_later_conf(struct MPContext *mpctx, const char *file);
 struct playlist_entry *mp_check_playlist_resume(struct MPContext *mpctx,
                                                 struct playlist *playlist);
 
+// encode_segments.c
+int encode_segments(struct MPContext *mpctx, const char *url);
+
+// loudness_scan.c
+struct replaygain_data;
+void loudness_scan_update(struct MPContext *mpctx);
+bool loudness_scan_get(struct MPContext *mpctx, const char *filename,
+                       struct replaygain_data *out);
+void loudness_scan_uninit(struct MPContext *mpctx);
+
+// thumbnails.c
+struct thumbnails_info {
+    int w, h;               // size of each preview image
+    double interval;        // time between previews
+    int count;              // number of previews for the whole file
+    int available;          // number of previews generated so far
+};
+void thumbnails_start(struct MPContext *mpctx);
+void thumbnails_stop(struct MPContext *mpctx);
+struct mp_image *thumbnails_get(struct MPContext *mpctx, double time);
+bool thumbnails_get_info(struct MPContext *mpctx, struct thumbnails_info *info);
+
 // loadfile.c
 void mp_abort_playback_async(struct MPContext *mpctx);
 void mp_abort_add(struct MPContext *mpctx, struct mp_abort_entry *abort);
@@ -553,7 +595,9 @@ void prepare_playlist(struct MPContext *mpctx, struct playlist *pl);
 void autoload_external_files(struct MPContext *mpctx, struct mp_cancel *cancel);
 struct track *select_default_track(struct MPContext *mpctx, int order,
                                    enum stream_type type);
-void prefetch_next(struct MPContext *mpctx);
+void prefetch_next(struct MPContext *mpctx, bool eof);
+void read_background_playlist(struct MPContext *mpctx);
+void stop_background_playlist(struct MPContext *mpctx);
 void close_recorder(struct MPContext *mpctx);
 void close_recorder_and_error(struct MPContext *mpctx);
 void open_recorder(struct MPContext *mpctx, bool on_init);
@@ -563,6 +607,7 @@ void update_lavfi_complex(struct MPContext *mpctx);
 int mp_initialize(struct MPContext *mpctx, char **argv);
 struct MPContext *mp_create(void);
 void mp_destroy(struct MPContext *mpctx);
+void mp_write_startup_trace(struct MPContext *mpctx);
 void mp_print_version(struct mp_log *log, int always);
 void mp_update_logging(struct MPContext *mpctx, bool preinit);
 void issue_refresh_seek(struct MPContext *mpctx, enum seek_precision min_prec);
@@ -658,6 +703,7 @@ bool update_subtitles(struct MPContext *mpctx, double video_pts);
 int video_get_colors(struct vo_chain *vo_c, const char *item, int *value);
 int video_set_colors(struct vo_chain *vo_c, const char *item, int value);
 void reset_video_state(struct MPContext *mpctx);
+void update_video_trick_play(struct MPContext *mpctx);
 int init_video_decoder(struct MPContext *mpctx, struct track *track);
 void reinit_video_chain(struct MPContext *mpctx);
 void reinit_video_chain_src(struct MPContext *mpctx, struct track *track);
@@ -0,0 +1,640 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Segment-parallel encoding (--oparallel-segments). The timeline is split at
+// video keyframes, and each segment is decoded, filtered and encoded by a
+// separate player instance (created with the client API) into a temporary
+// file. Audio is encoded as a whole by one more instance, so that it has no
+// gaps at the segment boundaries. The temporary files are then muxed into
+// the actual output file, with the video segments concatenated in order.
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mpv_talloc.h"
+
+#include "common/common.h"
+#include "common/encode_lavc.h"
+#include "common/global.h"
+#include "common/msg.h"
+#include "common/msg_control.h"
+#include "common/playlist.h"
+#include "demux/demux.h"
+#include "demux/stheader.h"
+#include "libmpv/client.h"
+#include "misc/bstr.h"
+#include "misc/thread_tools.h"
+#include "options/m_config_frontend.h"
+#include "options/options.h"
+#include "osdep/io.h"
+#include "osdep/timer.h"
+#include "stream/stream.h"
+
+#include "core.h"
+
+// Maximum number of packets read after a seek to find the next keyframe.
+#define MAX_PROBE_PACKETS 1000
+
+// Interval in which input is processed while muxing the segments.
+#define MUX_INPUT_INTERVAL_US 50000
+
+// Options which must not be inherited from the main instance.
+static const char *const instance_opts[][2] = {
+    {"config", "no"},
+    {"idle", "once"},
+    {"terminal", "no"},
+    {"input-terminal", "no"},
+    {"input-ipc-server", ""},
+    {"input-ipc-client", ""},
+    {"input-ipc-shm", ""},
+    {"pause", "no"},
+    {"keep-open", "no"},
+    {"loop-file", "no"},
+    {"loop-playlist", "no"},
+    {"resume-playback", "no"},
+    {"save-position-on-quit", "no"},
+    {"load-scripts", "no"},
+    {"scripts", ""},
+    {"osc", "no"},
+    {"ytdl", "no"},
+    {"load-stats-overlay", "no"},
+    {"load-osd-console", "no"},
+    {"load-auto-profiles", "no"},
+    {"log-file", ""},
+    {"dump-stats", ""},
+    {"startup-trace", ""},
+    {"stream-record", ""},
+    {"record-file", ""},
+    {"replaygain-scan", "no"},
+    {"thumbnails", "no"},
+    {"oparallel-segments", "0"},
+};
+
+struct segment {
+    char *name;             // for log messages
+    bool audio;             // encodes the audio instead of a video segment
+    double start, end;      // playback time range (MP_NOPTS_VALUE: unbounded)
+    char *file;             // temporary output file
+    mpv_handle *h;
+    double pos;             // last reported playback position
+    bool ok;                // playback ended normally
+    bool done;              // instance was destroyed
+};
+
+struct encode_segments {
+    struct MPContext *mpctx;
+    struct mp_log *log;
+    struct segment **segments; // video segments in order, then audio
+    int num_segments;
+
+    // Set by probe_file().
+    double *times;          // video keyframes at which segments start
+    int num_times;          // number of video segments
+    double audio_start;     // MP_NOPTS_VALUE if no audio is encoded
+};
+
+// Find the video keyframes at which to split the file, and the start of the
+// audio. Returns false if the file can't be encoded in segments.
+static bool probe_file(struct encode_segments *es, const char *url)
+{
+    struct MPContext *mpctx = es->mpctx;
+    struct MPOpts *opts = mpctx->opts;
+    int num = opts->encode_opts->parallel_segments;
+    bool ok = false;
+
+    struct mp_cancel *cancel = mp_cancel_new(NULL);
+    mp_cancel_set_parent(cancel, mpctx->playback_abort);
+    struct demuxer_params params = {.stream_flags = STREAM_ORIGIN_DIRECT};
+    struct demuxer *demuxer = demux_open_url(url, &params, cancel,
+                                             mpctx->global);
+    if (!demuxer)
+        goto done;
+
+    if (opts->rebase_start_time)
+        demux_set_ts_offset(demuxer, -demuxer->start_time);
+
+    struct sh_stream *video = NULL, *audio = NULL;
+    for (int n = 0; n < demux_get_num_stream(demuxer); n++) {
+        struct sh_stream *sh = demux_get_stream(demuxer, n);
+        if (sh->type == STREAM_VIDEO && !sh->attached_picture && !video)
+            video = sh;
+        if (sh->type == STREAM_AUDIO && !audio)
+            audio = sh;
+    }
+    if (opts->stream_id[0][STREAM_AUDIO] == -2 ||
+        !encode_lavc_stream_type_ok(mpctx->encode_lavc_ctx, STREAM_AUDIO))
+        audio = NULL;
+
+    if (!video || !demuxer->seekable || !(demuxer->duration > 0)) {
+        MP_WARN(es, "File is not seekable or has no video.\n");
+        goto done_demux;
+    }
+
+    demuxer_select_track(demuxer, video, MP_NOPTS_VALUE, true);
+    if (audio)
+        demuxer_select_track(demuxer, audio, MP_NOPTS_VALUE, true);
+
+    es->audio_start = MP_NOPTS_VALUE;
+    for (int n = 0; n < num; n++) {
+        double target = demuxer->duration * n / num;
+        if (n > 0 && !demux_seek(demuxer, target, 0))
+            break;
+        // At the start, also wait for the first audio packet.
+        bool need_audio = n == 0 && audio;
+        double pts = MP_NOPTS_VALUE;
+        for (int i = 0; i < MAX_PROBE_PACKETS; i++) {
+            struct demux_packet *pkt = demux_read_any_packet(demuxer);
+            if (!pkt)
+                break;
+            double ts = pkt->pts != MP_NOPTS_VALUE ? pkt->pts : pkt->dts;
+            if (pkt->stream == video->index && pkt->keyframe &&
+                pts == MP_NOPTS_VALUE)
+                pts = ts;
+            if (need_audio && pkt->stream == audio->index) {
+                es->audio_start = ts;
+                need_audio = false;
+            }
+            talloc_free(pkt);
+            if (pts != MP_NOPTS_VALUE && !need_audio)
+                break;
+        }
+        // Keyframes can be sparse, so several targets may map to the same one.
+        if (pts == MP_NOPTS_VALUE ||
+            (es->num_times && pts <= es->times[es->num_times - 1]))
+            continue;
+        MP_TARRAY_APPEND(es, es->times, es->num_times, pts);
+    }
+
+    if (es->num_times < 2) {
+        MP_WARN(es, "Not enough keyframes to split the file.\n");
+        goto done_demux;
+    }
+
+    if (audio && es->audio_start == MP_NOPTS_VALUE) {
+        MP_WARN(es, "Could not determine the audio start time.\n");
+        goto done_demux;
+    }
+
+    encode_lavc_set_metadata(mpctx->encode_lavc_ctx, demuxer->metadata);
+    ok = true;
+
+done_demux:
+    demux_free(demuxer);
+done:
+    talloc_free(cancel);
+    return ok;
+}
+
+static bool start_instance(struct encode_segments *es, struct segment *seg,
+                           const char *url)
+{
+    struct MPContext *mpctx = es->mpctx;
+    struct encode_lavc_context *ectx = mpctx->encode_lavc_ctx;
+
+    mpv_handle *h = mpv_create();
+    if (!h)
+        return false;
+    seg->h = h;
+
+    // Inherit everything the user set. The values are passed as mpv_node, so
+    // they are not changed by formatting and parsing them again.
+    struct m_config *config = mpctx->mconfig;
+    for (int n = 0; n < config->num_opts; n++) {
+        struct m_config_option *co = &config->opts[n];
+        if (!co->data || !(co->is_set_from_cmdline || co->is_set_from_config))
+            continue;
+        void *tmp = talloc_new(NULL);
+        struct mpv_node node;
+        int r = MPV_ERROR_OPTION_FORMAT;
+        if (m_option_get_node(co->opt, tmp, &node, co->data) >= 0)
+            r = mpv_set_option(h, co->name, MPV_FORMAT_NODE, &node);
+        talloc_free(tmp);
+        if (r < 0) {
+            MP_ERR(es, "Could not pass option %s to %s: %s\n", co->name,
+                   seg->name, mpv_error_string(r));
+            return false;
+        }
+    }
+
+    for (int n = 0; n < MP_ARRAY_SIZE(instance_opts); n++)
+        mpv_set_option_string(h, instance_opts[n][0], instance_opts[n][1]);
+
+    char buf[40];
+    if (seg->start != MP_NOPTS_VALUE) {
+        snprintf(buf, sizeof(buf), "%.17g", seg->start);
+        mpv_set_option_string(h, "start", buf);
+    }
+    if (seg->end != MP_NOPTS_VALUE) {
+        snprintf(buf, sizeof(buf), "%.17g", seg->end);
+        mpv_set_option_string(h, "end", buf);
+    }
+    mpv_set_option_string(h, seg->audio ? "vid" : "aid", "no");
+    // Use the output format, so the encoders are configured like they would
+    // be for the output file (e.g. global headers).
+    mpv_set_option_string(h, "of", ectx->oformat->name);
+    mpv_set_option_string(h, "o", seg->file);
+
+    mpv_request_log_messages(h, "warn");
+    mpv_set_wakeup_callback(h, mp_wakeup_core_cb, mpctx);
+
+    if (mpv_initialize(h) < 0)
+        return false;
+
+    const char *cmd[] = {"loadfile", url, NULL};
+    return mpv_command(h, cmd) >= 0;
+}
+
+// Process the events of all instances. Returns true if all have finished.
+static bool update_instances(struct encode_segments *es)
+{
+    bool all_done = true;
+    for (int n = 0; n < es->num_segments; n++) {
+        struct segment *seg = es->segments[n];
+        while (!seg->done) {
+            mpv_event *ev = mpv_wait_event(seg->h, 0);
+            if (ev->event_id == MPV_EVENT_NONE)
+                break;
+            if (ev->event_id == MPV_EVENT_LOG_MESSAGE) {
+                mpv_event_log_message *msg = ev->data;
+                int level = mp_msg_find_level(msg->level);
+                if (level >= 0) {
+                    MP_MSG(es, level, "%s: [%s] %s", seg->name, msg->prefix,
+                           msg->text);
+                }
+            } else if (ev->event_id == MPV_EVENT_END_FILE) {
+                mpv_event_end_file *end = ev->data;
+                seg->ok = end->reason == MPV_END_FILE_REASON_EOF;
+            } else if (ev->event_id == MPV_EVENT_SHUTDOWN) {
+                // The instance writes the file trailer before it shuts down.
+                mpv_terminate_destroy(seg->h);
+                seg->h = NULL;
+                seg->done = true;
+            }
+        }
+        if (seg->h)
+            mpv_get_property(seg->h, "time-pos", MPV_FORMAT_DOUBLE, &seg->pos);
+        all_done &= seg->done;
+    }
+    return all_done;
+}
+
+static void print_progress(struct encode_segments *es)
+{
+    struct MPContext *mpctx = es->mpctx;
+    if (mpctx->opts->quiet)
+        return;
+
+    char *line = talloc_strdup(NULL, "Encoding segments:");
+    for (int n = 0; n < es->num_segments; n++) {
+        struct segment *seg = es->segments[n];
+        if (seg->done) {
+            line = talloc_asprintf_append(line, " %s",
+                                          seg->ok ? "done" : "failed");
+            continue;
+        }
+        double start = seg->start != MP_NOPTS_VALUE ? seg->start : 0;
+        double end = seg->end;
+        if (end == MP_NOPTS_VALUE &&
+            mpv_get_property(seg->h, "duration", MPV_FORMAT_DOUBLE, &end) < 0)
+            end = 0;
+        double pos = MPCLAMP(seg->pos, start, end);
+        line = talloc_asprintf_append(line, " %d%%", end > start
+                        ? (int)((pos - start) / (end - start) * 100) : 0);
+    }
+    MP_MSG(mpctx, MSGL_STATUS, "%s", line);
+    talloc_free(line);
+}
+
+struct mux_input {
+    AVFormatContext *fmt;
+    AVStream *st;
+    struct mux_stream *dst;
+    AVRational tb;          // timebase of the output stream
+    int64_t offset;         // added to the packet timestamps (in tb)
+    int64_t dts_shift;      // added to the packet DTS only (in tb)
+    int64_t last_dts;
+};
+
+static bool open_input(struct encode_segments *es, struct mux_input *in,
+                       const char *file)
+{
+    if (avformat_open_input(&in->fmt, file, NULL, NULL) < 0 ||
+        avformat_find_stream_info(in->fmt, NULL) < 0 ||
+        in->fmt->nb_streams != 1)
+    {
+        MP_ERR(es, "Could not read temporary file %s.\n", file);
+        avformat_close_input(&in->fmt);
+        return false;
+    }
+    in->st = in->fmt->streams[0];
+    return true;
+}
+
+static bool add_output_stream(struct encode_segments *es, struct mux_input *in)
+{
+    AVCodecParameters *par = avcodec_parameters_alloc();
+    MP_HANDLE_OOM(par);
+    if (avcodec_parameters_copy(par, in->st->codecpar) < 0)
+        MP_HANDLE_OOM(0);
+    // Let the muxer pick the tag, as with a freshly opened encoder.
+    par->codec_tag = 0;
+    in->tb = in->st->time_base;
+    in->dst = encode_lavc_add_packet_stream(es->mpctx->encode_lavc_ctx, par,
+                                            in->tb);
+    avcodec_parameters_free(&par);
+    return !!in->dst;
+}
+
+// Read the next packet into pkt, converted to the output timebase. Returns 1
+// on success, 0 on EOF, -1 on error.
+static int read_packet(struct encode_segments *es, struct mux_input *in,
+                       AVPacket *pkt)
+{
+    if (!in->fmt || av_read_frame(in->fmt, pkt) < 0)
+        return 0;
+    av_packet_rescale_ts(pkt, in->st->time_base, in->tb);
+    if (pkt->pts != AV_NOPTS_VALUE)
+        pkt->pts += in->offset;
+    if (pkt->dts != AV_NOPTS_VALUE) {
+        pkt->dts += in->offset + in->dts_shift;
+        if (in->last_dts != AV_NOPTS_VALUE && pkt->dts <= in->last_dts) {
+            MP_ERR(es, "Non-monotonic DTS when joining the segments.\n");
+            av_packet_unref(pkt);
+            return -1;
+        }
+        in->last_dts = pkt->dts;
+    }
+    return 1;
+}
+
+// Return the encoder delay (PTS - DTS of the first packet, in tb) of a
+// temporary file, or -1 on error.
+static int64_t get_delay(struct encode_segments *es, const char *file,
+                         AVRational tb)
+{
+    struct mux_input in = {0};
+    if (!open_input(es, &in, file))
+        return -1;
+    int64_t delay = 0;
+    AVPacket *pkt = av_packet_alloc();
+    MP_HANDLE_OOM(pkt);
+    if (av_read_frame(in.fmt, pkt) >= 0 && pkt->pts != AV_NOPTS_VALUE &&
+        pkt->dts != AV_NOPTS_VALUE)
+    {
+        delay = av_rescale_q(pkt->pts - pkt->dts, in.st->time_base, tb);
+    }
+    av_packet_free(&pkt);
+    avformat_close_input(&in.fmt);
+    return MPMAX(delay, 0);
+}
+
+// Return the offset (in tb) of an instance's output that started at the
+// given playback time. The instances normalize the timestamps to start at 0,
+// unless --orawts is used.
+static int64_t get_offset(struct encode_segments *es, double start,
+                          AVRational tb)
+{
+    if (es->mpctx->encode_lavc_ctx->options->rawts)
+        return 0;
+    double base = es->times[0];
+    if (es->audio_start != MP_NOPTS_VALUE)
+        base = MPMIN(base, es->audio_start);
+    return llrint((start - base) / av_q2d(tb));
+}
+
+// Mux the temporary files into the output file.
+static bool mux_segments(struct encode_segments *es)
+{
+    struct MPContext *mpctx = es->mpctx;
+    struct encode_lavc_context *ectx = mpctx->encode_lavc_ctx;
+    int num_video = es->num_times;
+    bool ok = false;
+
+    struct mux_input video = {.last_dts = AV_NOPTS_VALUE};
+    struct mux_input audio = {.last_dts = AV_NOPTS_VALUE};
+    bool have_audio = es->num_segments > num_video;
+
+    encode_lavc_expect_stream(ectx, STREAM_VIDEO);
+    if (have_audio)
+        encode_lavc_expect_stream(ectx, STREAM_AUDIO);
+
+    if (!open_input(es, &video, es->segments[0]->file))
+        goto done;
+    if (have_audio && !open_input(es, &audio, es->segments[num_video]->file))
+        goto done;
+    if (!add_output_stream(es, &video))
+        goto done;
+    if (have_audio && !add_output_stream(es, &audio))
+        goto done;
+    video.offset = get_offset(es, es->times[0], video.tb);
+    if (have_audio)
+        audio.offset = get_offset(es, es->audio_start, audio.tb);
+
+    // Each segment starts with DTS = PTS - encoder delay, which overlaps the
+    // DTS at the end of the previous segment if the delays differ. Shift the
+    // DTS of every segment by a fixed amount, so that all use the largest
+    // delay. This keeps DTS <= PTS, and the PTS are not touched.
+    int64_t *delays = talloc_array(NULL, int64_t, num_video);
+    int64_t max_delay = 0;
+    for (int n = 0; n < num_video; n++) {
+        delays[n] = get_delay(es, es->segments[n]->file, video.tb);
+        if (delays[n] < 0) {
+            talloc_free(delays);
+            goto done;
+        }
+        max_delay = MPMAX(max_delay, delays[n]);
+    }
+    video.dts_shift = delays[0] - max_delay;
+
+    AVPacket *vpkt = av_packet_alloc();
+    AVPacket *apkt = av_packet_alloc();
+    MP_HANDLE_OOM(vpkt && apkt);
+    bool have_vpkt = false, have_apkt = false;
+    int segment = 0;
+    int64_t last_input = mp_time_us();
+
+    while (mpctx->stop_play == KEEP_PLAYING) {
+        while (!have_vpkt && segment < num_video) {
+            int r = read_packet(es, &video, vpkt);
+            if (r < 0)
+                goto done_packets;
+            have_vpkt = r > 0;
+            if (have_vpkt)
+                break;
+            // Continue with the next segment.
+            avformat_close_input(&video.fmt);
+            segment += 1;
+            if (segment == num_video)
+                break;
+            if (!open_input(es, &video, es->segments[segment]->file))
+                goto done_packets;
+            video.offset = get_offset(es, es->times[segment], video.tb);
+            video.dts_shift = delays[segment] - max_delay;
+        }
+        if (!have_apkt) {
+            int r = read_packet(es, &audio, apkt);
+            if (r < 0)
+                goto done_packets;
+            have_apkt = r > 0;
+        }
+        if (!have_vpkt && !have_apkt)
+            break;
+
+        bool use_video = have_vpkt;
+        if (have_vpkt && have_apkt && vpkt->dts != AV_NOPTS_VALUE &&
+            apkt->dts != AV_NOPTS_VALUE)
+        {
+            use_video = av_compare_ts(vpkt->dts, video.tb,
+                                      apkt->dts, audio.tb) <= 0;
+        }
+        if (use_video) {
+            encode_lavc_write_packet(video.dst, vpkt);
+            have_vpkt = false;
+        } else {
+            encode_lavc_write_packet(audio.dst, apkt);
+            have_apkt = false;
+        }
+
+        if (encode_lavc_didfail(ectx))
+            goto done_packets;
+        int64_t now = mp_time_us();
+        if (now - last_input >= MUX_INPUT_INTERVAL_US) {
+            mp_wakeup_core(mpctx); // don't actually sleep
+            mp_idle(mpctx); // but process input
+            last_input = now;
+        }
+    }
+
+    ok = mpctx->stop_play == KEEP_PLAYING;
+
+done_packets:
+    av_packet_free(&vpkt);
+    av_packet_free(&apkt);
+    talloc_free(delays);
+done:
+    avformat_close_input(&video.fmt);
+    avformat_close_input(&audio.fmt);
+    return ok;
+}
+
+// Encode the file with --oparallel-segments. Returns -1 if this is disabled or
+// not possible (encode normally instead), 0 on failure, 1 on success.
+int encode_segments(struct MPContext *mpctx, const char *url)
+{
+    struct encode_opts *eopts = mpctx->opts->encode_opts;
+    struct MPOpts *opts = mpctx->opts;
+    int res = -1;
+
+    if (eopts->parallel_segments < 2 || !mpctx->encode_lavc_ctx)
+        return -1;
+
+    struct encode_segments *es = talloc_ptrtype(NULL, es);
+    *es = (struct encode_segments){
+        .mpctx = mpctx,
+        .log = mp_log_new(es, mpctx->log, "segments"),
+    };
+
+    const char *file = eopts->file;
+    if (mpctx->playlist->num_entries != 1 || !strcmp(file, "-") ||
+        bstr_startswith0(bstr0(file), "pipe:") ||
+        opts->play_start.type || opts->play_end.type ||
+        opts->play_length.type || opts->play_frames > 0 ||
+        opts->ab_loop[0] != MP_NOPTS_VALUE ||
+        opts->ab_loop[1] != MP_NOPTS_VALUE ||
+        (mpctx->encode_lavc_ctx->oformat->flags & AVFMT_NOFILE))
+    {
+        MP_WARN(es, "Segment-parallel encoding is only supported for a "
+                "single file, encoded entirely to a file. Encoding normally.\n");
+        goto done;
+    }
+
+    if (!probe_file(es, url)) {
+        MP_WARN(es, "Encoding normally.\n");
+        goto done;
+    }
+
+    res = 0;
+
+    int num_video = es->num_times;
+    bool audio = es->audio_start != MP_NOPTS_VALUE;
+
+    MP_INFO(es, "Encoding %d segments in parallel.\n", num_video);
+
+    for (int n = 0; n < num_video + audio; n++) {
+        struct segment *seg = talloc_ptrtype(es, seg);
+        *seg = (struct segment){
+            .audio = n == num_video,
+            .start = n > 0 && n < num_video ? es->times[n] : MP_NOPTS_VALUE,
+            .end = n + 1 < num_video ? es->times[n + 1] : MP_NOPTS_VALUE,
+            .pos = MP_NOPTS_VALUE,
+        };
+        if (seg->audio) {
+            seg->name = "audio";
+            seg->file = talloc_asprintf(seg, "%s.audio.part", file);
+        } else {
+            seg->name = talloc_asprintf(seg, "segment %d", n + 1);
+            seg->file = talloc_asprintf(seg, "%s.%d.part", file, n + 1);
+        }
+        MP_TARRAY_APPEND(es, es->segments, es->num_segments, seg);
+        MP_VERBOSE(es, "%s: %f - %f\n", seg->name, seg->start, seg->end);
+    }
+
+    bool ok = true;
+    for (int n = 0; n < es->num_segments; n++) {
+        struct segment *seg = es->segments[n];
+        if (!start_instance(es, seg, url)) {
+            MP_ERR(es, "Could not start encoder instance for %s.\n", seg->name);
+            ok = false;
+            break;
+        }
+    }
+
+    while (ok && mpctx->stop_play == KEEP_PLAYING) {
+        if (update_instances(es))
+            break;
+        print_progress(es);
+        mp_set_timeout(mpctx, 0.5);
+        mp_idle(mpctx);
+    }
+
+    // Stop the remaining instances (if aborted).
+    for (int n = 0; n < es->num_segments; n++) {
+        struct segment *seg = es->segments[n];
+        if (seg->h)
+            mpv_terminate_destroy(seg->h);
+        seg->h = NULL;
+        if (!seg->ok && ok && mpctx->stop_play == KEEP_PLAYING) {
+            MP_ERR(es, "Encoding %s failed.\n", seg->name);
+            ok = false;
+        }
+    }
+
+    if (ok && mpctx->stop_play == KEEP_PLAYING) {
+        MP_INFO(es, "Muxing segments.\n");
+        if (mux_segments(es))
+            res = 1;
+    }
+
+    for (int n = 0; n < es->num_segments; n++)
+        unlink(es->segments[n]->file);
+
+done:
+    talloc_free(es);
+    return res;
+}
@@ -1029,154 +1029,318 @@ static void load_per_file_options(m_config_t *conf,
     }
 }
 
+// Select all tracks, and start filling the cache (demuxer must not be in use).
+static void start_demux_prefetch(struct MPContext *mpctx, struct demuxer *demux)
+{
+    int num_streams = demux_get_num_stream(demux);
+    for (int n = 0; n < num_streams; n++) {
+        struct sh_stream *sh = demux_get_stream(demux, n);
+        demuxer_select_track(demux, sh, MP_NOPTS_VALUE, true);
+    }
+
+    demux_set_wakeup_cb(demux, wakeup_demux, mpctx);
+    demux_start_thread(demux);
+    demux_start_prefetch(demux);
+}
+
+static bool can_prefetch(struct mp_open_ctx *o)
+{
+    return o->for_prefetch && o->res_demuxer && !o->res_demuxer->fully_read;
+}
+
 static void *open_demux_thread(void *ctx)
 {
-    struct MPContext *mpctx = ctx;
+    struct mp_open_ctx *o = ctx;
+    struct MPContext *mpctx = o->mpctx;
 
     mpthread_set_name("opener");
 
     struct demuxer_params p = {
-        .force_format = mpctx->open_format,
-        .stream_flags = mpctx->open_url_flags,
+        .force_format = o->format,
+        .stream_flags = o->url_flags,
         .stream_record = true,
         .is_top_level = true,
+        .incremental_playlist = o->incremental_playlist,
     };
+    stats_span_begin(mpctx->stats, "open-url");
     struct demuxer *demux =
-        demux_open_url(mpctx->open_url, &p, mpctx->open_cancel, mpctx->global);
-    mpctx->open_res_demuxer = demux;
+        demux_open_url(o->url, &p, o->cancel, mpctx->global);
+    stats_span_end(mpctx->stats, "open-url");
+    o->res_demuxer = demux;
 
     if (demux) {
-        MP_VERBOSE(mpctx, "Opening done: %s\n", mpctx->open_url);
-
-        if (mpctx->open_for_prefetch && !demux->fully_read) {
-            int num_streams = demux_get_num_stream(demux);
-            for (int n = 0; n < num_streams; n++) {
-                struct sh_stream *sh = demux_get_stream(demux, n);
-                demuxer_select_track(demux, sh, MP_NOPTS_VALUE, true);
-            }
+        MP_VERBOSE(mpctx, "Opening done: %s\n", o->url);
 
-            demux_set_wakeup_cb(demux, wakeup_demux, mpctx);
-            demux_start_thread(demux);
-            demux_start_prefetch(demux);
+        if (can_prefetch(o)) {
+            start_demux_prefetch(mpctx, demux);
+            o->prefetching = true;
         }
     } else {
-        MP_VERBOSE(mpctx, "Opening failed or was aborted: %s\n", mpctx->open_url);
+        MP_VERBOSE(mpctx, "Opening failed or was aborted: %s\n", o->url);
 
         if (p.demuxer_failed) {
-            mpctx->open_res_error = MPV_ERROR_UNKNOWN_FORMAT;
+            o->res_error = MPV_ERROR_UNKNOWN_FORMAT;
         } else {
-            mpctx->open_res_error = MPV_ERROR_LOADING_FAILED;
+            o->res_error = MPV_ERROR_LOADING_FAILED;
         }
     }
 
-    atomic_store(&mpctx->open_done, true);
+    atomic_store(&o->done, true);
     mp_wakeup_core(mpctx);
     return NULL;
 }
 
-static void cancel_open(struct MPContext *mpctx)
+// Abort opening (if still active), and free o with all its resources.
+static void cancel_open(struct MPContext *mpctx, struct mp_open_ctx *o)
 {
-    if (mpctx->open_cancel)
-        mp_cancel_trigger(mpctx->open_cancel);
+    for (int n = 0; n < mpctx->num_opens; n++) {
+        if (mpctx->opens[n] == o) {
+            MP_TARRAY_REMOVE_AT(mpctx->opens, mpctx->num_opens, n);
+            break;
+        }
+    }
 
-    if (mpctx->open_active)
-        pthread_join(mpctx->open_thread, NULL);
-    mpctx->open_active = false;
+    if (o->cancel)
+        mp_cancel_trigger(o->cancel);
 
-    if (mpctx->open_res_demuxer)
-        demux_cancel_and_free(mpctx->open_res_demuxer);
-    mpctx->open_res_demuxer = NULL;
+    if (o->active)
+        pthread_join(o->thread, NULL);
 
-    TA_FREEP(&mpctx->open_cancel);
-    TA_FREEP(&mpctx->open_url);
-    TA_FREEP(&mpctx->open_format);
+    if (o->res_demuxer)
+        demux_cancel_and_free(o->res_demuxer);
 
-    atomic_store(&mpctx->open_done, false);
+    talloc_free(o);
 }
 
-// Setup all the field to open this url, and make sure a thread is running.
-static void start_open(struct MPContext *mpctx, char *url, int url_flags,
-                       bool for_prefetch)
+static void cancel_all_opens(struct MPContext *mpctx)
 {
-    cancel_open(mpctx);
-
-    assert(!mpctx->open_active);
-    assert(!mpctx->open_cancel);
-    assert(!mpctx->open_res_demuxer);
-    assert(!atomic_load(&mpctx->open_done));
+    while (mpctx->num_opens)
+        cancel_open(mpctx, mpctx->opens[mpctx->num_opens - 1]);
+}
 
-    mpctx->open_cancel = mp_cancel_new(NULL);
-    mpctx->open_url = talloc_strdup(NULL, url);
-    mpctx->open_format = talloc_strdup(NULL, mpctx->opts->demuxer_name);
-    mpctx->open_url_flags = url_flags;
-    mpctx->open_for_prefetch = for_prefetch && mpctx->opts->demuxer_thread;
+static struct mp_open_ctx *find_open(struct MPContext *mpctx, const char *url)
+{
+    for (int n = 0; n < mpctx->num_opens; n++) {
+        if (strcmp(mpctx->opens[n]->url, url) == 0)
+            return mpctx->opens[n];
+    }
+    return NULL;
+}
 
-    if (pthread_create(&mpctx->open_thread, NULL, open_demux_thread, mpctx)) {
-        cancel_open(mpctx);
-        return;
+// Setup all the field to open this url, and make sure a thread is running.
+static struct mp_open_ctx *start_open(struct MPContext *mpctx, char *url,
+                                      int url_flags, bool for_prefetch)
+{
+    struct mp_open_ctx *o = talloc_zero(NULL, struct mp_open_ctx);
+    o->mpctx = mpctx;
+    o->cancel = mp_cancel_new(o);
+    o->url = talloc_strdup(o, url);
+    o->format = talloc_strdup(o, mpctx->opts->demuxer_name);
+    o->url_flags = url_flags;
+    o->for_prefetch = for_prefetch && mpctx->opts->demuxer_thread;
+    // Entries added later would not be shuffled or merged.
+    o->incremental_playlist = !mpctx->opts->shuffle && !mpctx->opts->merge_files;
+
+    if (pthread_create(&o->thread, NULL, open_demux_thread, o)) {
+        talloc_free(o);
+        return NULL;
     }
 
-    mpctx->open_active = true;
+    o->active = true;
+    MP_TARRAY_APPEND(mpctx, mpctx->opens, mpctx->num_opens, o);
+    return o;
 }
 
 static void open_demux_reentrant(struct MPContext *mpctx)
 {
     char *url = mpctx->stream_open_filename;
 
-    if (mpctx->open_active) {
-        bool done = atomic_load(&mpctx->open_done);
-        bool failed = done && !mpctx->open_res_demuxer;
-        bool correct_url = strcmp(mpctx->open_url, url) == 0;
-
-        if (correct_url && !failed) {
-            MP_VERBOSE(mpctx, "Using prefetched/prefetching URL.\n");
-        } else if (correct_url && failed) {
+    struct mp_open_ctx *o = find_open(mpctx, url);
+    if (o) {
+        bool done = atomic_load(&o->done);
+        if (done && !o->res_demuxer) {
             MP_VERBOSE(mpctx, "Prefetched URL failed, retrying.\n");
-            cancel_open(mpctx);
+            cancel_open(mpctx, o);
+            o = NULL;
         } else {
-            if (done) {
-                MP_VERBOSE(mpctx, "Dropping finished prefetch of wrong URL.\n");
-            } else {
-                MP_VERBOSE(mpctx, "Aborting ongoing prefetch of wrong URL.\n");
-            }
-            cancel_open(mpctx);
+            MP_VERBOSE(mpctx, "Using prefetched/prefetching URL.\n");
         }
     }
 
-    if (!mpctx->open_active)
-        start_open(mpctx, url, mpctx->playing->stream_flags, false);
+    // Without lookahead, prefetch_next() only runs at EOF, and would not
+    // remove a mispredicted entry.
+    if (!mpctx->opts->prefetch_lookahead) {
+        for (int n = mpctx->num_opens - 1; n >= 0; n--) {
+            if (mpctx->opens[n] != o)
+                cancel_open(mpctx, mpctx->opens[n]);
+        }
+    }
+
+    if (!o)
+        o = start_open(mpctx, url, mpctx->playing->stream_flags, false);
+    if (!o) {
+        mpctx->error_playing = MPV_ERROR_LOADING_FAILED;
+        return;
+    }
 
     // User abort should cancel the opener now.
-    mp_cancel_set_parent(mpctx->open_cancel, mpctx->playback_abort);
+    mp_cancel_set_parent(o->cancel, mpctx->playback_abort);
 
-    while (!atomic_load(&mpctx->open_done)) {
+    while (!atomic_load(&o->done)) {
         mp_idle(mpctx);
 
         if (mpctx->stop_play)
             mp_abort_playback_async(mpctx);
     }
 
-    if (mpctx->open_res_demuxer) {
-        mpctx->demuxer = mpctx->open_res_demuxer;
-        mpctx->open_res_demuxer = NULL;
+    if (o->res_demuxer) {
+        mpctx->demuxer = o->res_demuxer;
+        o->res_demuxer = NULL;
         mp_cancel_set_parent(mpctx->demuxer->cancel, mpctx->playback_abort);
     } else {
-        mpctx->error_playing = mpctx->open_res_error;
+        mpctx->error_playing = o->res_error;
+    }
+
+    cancel_open(mpctx, o); // cleanup
+}
+
+// Maximum number of playlist files read in the background at the same time.
+#define MAX_BG_PLAYLISTS 16
+
+struct bg_playlist {
+    struct demuxer *demuxer;
+    // Last entry added from it. New entries are inserted after it.
+    struct playlist_entry *last;
+};
+
+static void free_bg_playlist(struct bg_playlist *bg)
+{
+    demux_cancel_and_free(bg->demuxer);
+    playlist_entry_unref(bg->last);
+    talloc_free(bg);
+}
+
+// Keep the demuxer of a partially read playlist file around until the rest of
+// the file was read. last is the last entry added from it so far.
+static void start_background_playlist(struct MPContext *mpctx,
+                                      struct demuxer *demuxer,
+                                      struct playlist_entry *last)
+{
+    if (mpctx->num_bg_playlists >= MAX_BG_PLAYLISTS) {
+        struct bg_playlist *old = mpctx->bg_playlists[0];
+        MP_WARN(mpctx, "Too many playlist files, not reading the rest of %s.\n",
+                old->demuxer->filename);
+        free_bg_playlist(old);
+        MP_TARRAY_REMOVE_AT(mpctx->bg_playlists, mpctx->num_bg_playlists, 0);
     }
 
-    cancel_open(mpctx); // cleanup
+    struct bg_playlist *bg = talloc_ptrtype(NULL, bg);
+    *bg = (struct bg_playlist){
+        .demuxer = demuxer,
+        .last = last,
+    };
+    mp_cancel_set_parent(demuxer->cancel, NULL);
+    last->reserved += 1;
+    demux_playlist_set_wakeup_cb(demuxer, wakeup_demux, mpctx);
+    MP_TARRAY_APPEND(mpctx, mpctx->bg_playlists, mpctx->num_bg_playlists, bg);
+}
+
+void stop_background_playlist(struct MPContext *mpctx)
+{
+    for (int n = 0; n < mpctx->num_bg_playlists; n++)
+        free_bg_playlist(mpctx->bg_playlists[n]);
+    mpctx->num_bg_playlists = 0;
+}
+
+// Add the entries that were read since the last call. Returns true if the
+// whole file was read.
+static bool read_bg_playlist(struct MPContext *mpctx, struct bg_playlist *bg)
+{
+    struct playlist *pl = talloc_zero(NULL, struct playlist);
+    bool done = demux_playlist_read_more(bg->demuxer, pl);
+    if (pl->num_entries) {
+        struct playlist_entry *new_last = playlist_get_last(pl);
+        playlist_add_redirect(pl, bg->demuxer->filename);
+        // If the user removed the entry (e.g. with playlist-clear), append the
+        // rest of the file at the end instead.
+        int index = bg->last->pl == mpctx->playlist
+            ? playlist_entry_to_index(mpctx->playlist, bg->last) + 1
+            : playlist_entry_count(mpctx->playlist);
+        playlist_transfer_entries_to(mpctx->playlist, index, pl);
+        new_last->reserved += 1;
+        playlist_entry_unref(bg->last);
+        bg->last = new_last;
+        mp_notify_property(mpctx, "playlist");
+    }
+    talloc_free(pl);
+    return done;
+}
+
+// Add entries of playlist files that were read in the background since the
+// last call.
+void read_background_playlist(struct MPContext *mpctx)
+{
+    for (int n = mpctx->num_bg_playlists - 1; n >= 0; n--) {
+        struct bg_playlist *bg = mpctx->bg_playlists[n];
+        if (read_bg_playlist(mpctx, bg)) {
+            MP_VERBOSE(mpctx, "Done reading playlist file %s.\n",
+                       bg->demuxer->filename);
+            free_bg_playlist(bg);
+            MP_TARRAY_REMOVE_AT(mpctx->bg_playlists, mpctx->num_bg_playlists, n);
+        }
+    }
 }
 
-void prefetch_next(struct MPContext *mpctx)
+// Open the next playlist entries, so that playback can start immediately when
+// they are reached. With eof set (the current file was fully read), the cache
+// of the next entry is filled too.
+void prefetch_next(struct MPContext *mpctx, bool eof)
 {
-    if (!mpctx->opts->prefetch_open)
+    struct MPOpts *opts = mpctx->opts;
+    if (!opts->prefetch_open)
+        return;
+
+    int num = eof ? MPMAX(opts->prefetch_lookahead, 1) : opts->prefetch_lookahead;
+    if (!num)
         return;
 
-    struct playlist_entry *new_entry = mp_next_file(mpctx, +1, false, false);
-    if (new_entry && !mpctx->open_active && new_entry->filename) {
-        MP_VERBOSE(mpctx, "Prefetching: %s\n", new_entry->filename);
-        start_open(mpctx, new_entry->filename, new_entry->stream_flags, true);
+    struct mp_open_ctx **keep = talloc_zero_array(NULL, struct mp_open_ctx *, num);
+    int num_keep = 0;
+
+    struct playlist_entry *e = mp_next_file(mpctx, +1, false, false);
+    for (int n = 0; n < num && e; n++) {
+        if (!e->filename || e == mpctx->playing)
+            break;
+        struct mp_open_ctx *o = find_open(mpctx, e->filename);
+        if (!o) {
+            MP_VERBOSE(mpctx, "Prefetching: %s\n", e->filename);
+            o = start_open(mpctx, e->filename, e->stream_flags, n == 0 && eof);
+        } else if (n == 0 && eof && atomic_load(&o->done) && !o->prefetching) {
+            // Was opened as part of the lookahead window.
+            o->for_prefetch = mpctx->opts->demuxer_thread;
+            if (can_prefetch(o)) {
+                start_demux_prefetch(mpctx, o->res_demuxer);
+                o->prefetching = true;
+            }
+        }
+        if (o)
+            keep[num_keep++] = o;
+        e = playlist_entry_get_rel(e, 1);
+    }
+
+    // Drop entries which are not coming up anymore (e.g. playlist changed).
+    for (int n = mpctx->num_opens - 1; n >= 0; n--) {
+        struct mp_open_ctx *o = mpctx->opens[n];
+        bool found = false;
+        for (int i = 0; i < num_keep; i++)
+            found |= keep[i] == o;
+        if (!found) {
+            MP_VERBOSE(mpctx, "Dropping prefetched URL: %s\n", o->url);
+            cancel_open(mpctx, o);
+        }
     }
+
+    talloc_free(keep);
 }
 
 // Destroy the complex filter, and remove the references to the filter pads.
@@ -1492,6 +1656,8 @@ static void play_current_file(struct MPContext *mpctx)
 
     mp_load_playback_resume(mpctx, mpctx->filename);
 
+    loudness_scan_update(mpctx);
+
     load_per_file_options(mpctx->mconfig, mpctx->playing->params,
                           mpctx->playing->num_params);
 
@@ -1515,7 +1681,16 @@ static void play_current_file(struct MPContext *mpctx)
         goto terminate_playback;
     }
 
+    int segments_res = encode_segments(mpctx, mpctx->stream_open_filename);
+    if (segments_res >= 0) {
+        if (segments_res > 0)
+            mpctx->error_playing = 1;
+        goto terminate_playback;
+    }
+
+    stats_span_begin(mpctx->stats, "open");
     open_demux_reentrant(mpctx);
+    stats_span_end(mpctx->stats, "open");
     if (!mpctx->stop_play && !mpctx->demuxer) {
         process_hooks(mpctx, "on_load_fail");
         if (strcmp(mpctx->stream_open_filename, mpctx->filename) != 0 &&
@@ -1530,8 +1705,14 @@ static void play_current_file(struct MPContext *mpctx)
 
     if (mpctx->demuxer->playlist) {
         struct playlist *pl = mpctx->demuxer->playlist;
+        struct playlist_entry *last = playlist_get_last(pl);
         transfer_playlist(mpctx, pl, &end_event.playlist_insert_id,
                           &end_event.playlist_insert_num_entries);
+        if (mpctx->demuxer->playlist_incomplete && last) {
+            start_background_playlist(mpctx, mpctx->demuxer, last);
+            mpctx->demuxer = NULL;
+            read_background_playlist(mpctx);
+        }
         mp_notify_property(mpctx, "playlist");
         mpctx->error_playing = 2;
         goto terminate_playback;
@@ -1606,8 +1787,12 @@ static void play_current_file(struct MPContext *mpctx)
 
     update_playback_speed(mpctx);
 
+    stats_span_begin(mpctx->stats, "init-video");
     reinit_video_chain(mpctx);
+    stats_span_end(mpctx->stats, "init-video");
+    stats_span_begin(mpctx->stats, "init-audio");
     reinit_audio_chain(mpctx);
+    stats_span_end(mpctx->stats, "init-audio");
     reinit_sub_all(mpctx);
 
     if (mpctx->encode_lavc_ctx) {
@@ -1639,6 +1824,8 @@ static void play_current_file(struct MPContext *mpctx)
     mp_notify(mpctx, MPV_EVENT_FILE_LOADED, NULL);
     update_screensaver_state(mpctx);
 
+    thumbnails_start(mpctx);
+
     if (mpctx->max_frames == 0) {
         if (!mpctx->stop_play)
             mpctx->stop_play = PT_NEXT_ENTRY;
@@ -1701,6 +1888,7 @@ terminate_playback:
 
     process_hooks(mpctx, "on_unload");
 
+    thumbnails_stop(mpctx);
     close_recorder(mpctx);
 
     // time to uninit all, except global stuff:
@@ -1827,8 +2015,10 @@ struct playlist_entry *mp_next_file(struct MPContext *mpctx, int direction,
         if (!force && next && next->init_failed && !ignore_failures) {
             // Don't endless loop if no file in playlist is playable
             bool all_failed = true;
-            for (int n = 0; n < mpctx->playlist->num_entries; n++) {
-                all_failed &= mpctx->playlist->entries[n]->init_failed;
+            for (struct playlist_entry *e = playlist_get_first(mpctx->playlist);
+                 e; e = playlist_entry_get_rel(e, 1))
+            {
+                all_failed &= e->init_failed;
                 if (!all_failed)
                     break;
             }
@@ -1887,7 +2077,8 @@ void mp_play_files(struct MPContext *mpctx)
             break;
     }
 
-    cancel_open(mpctx);
+    cancel_all_opens(mpctx);
+    stop_background_playlist(mpctx);
 
     if (mpctx->encode_lavc_ctx) {
         // Make sure all streams get finished.
@@ -0,0 +1,504 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Background EBU R128 scanning of upcoming playlist entries. Results are
+// stored in a cache file in the config dir, keyed by the absolute path, size
+// and mtime of the file, and used as fallback for missing ReplayGain tags.
+
+#include <fcntl.h>
+#include <math.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mpv_talloc.h"
+
+#include "audio/aframe.h"
+#include "audio/format.h"
+#include "audio/loudness.h"
+#include "common/common.h"
+#include "common/global.h"
+#include "common/msg.h"
+#include "common/playlist.h"
+#include "demux/demux.h"
+#include "demux/stheader.h"
+#include "filters/f_autoconvert.h"
+#include "filters/f_decoder_wrapper.h"
+#include "filters/filter.h"
+#include "misc/bstr.h"
+#include "misc/thread_pool.h"
+#include "misc/thread_tools.h"
+#include "options/options.h"
+#include "options/path.h"
+#include "osdep/io.h"
+#include "osdep/timer.h"
+#include "stream/stream.h"
+
+#include "core.h"
+
+#define CACHE_FILE "replaygain-cache"
+// Only the most recently scanned entries are kept in the cache file.
+#define CACHE_MAX_ENTRIES 2000
+
+struct scan_entry {
+    char *path;                 // absolute path
+    int64_t size;
+    int64_t mtime;
+    bool done;                  // result valid
+    bool failed;                // gave up on it (not written to the cache)
+    bool stale;                 // a newer entry for the same path exists
+    float gain;
+    float peak;
+};
+
+struct loudness_scan {
+    struct mpv_global *global;
+    struct mp_log *log;
+    struct mp_thread_pool *pool;
+    struct mp_cancel *cancel;
+    char *cache_file;
+
+    pthread_mutex_t lock;
+    // --- protected by lock
+    struct scan_entry **entries;
+    int num_entries;
+    uint64_t cache_gen;         // incremented for each cache file snapshot
+
+    // Serializes writing the cache file.
+    pthread_mutex_t write_lock;
+    // --- protected by write_lock
+    uint64_t written_gen;       // cache_gen of the file contents
+};
+
+struct scan_job {
+    struct loudness_scan *s;
+    struct scan_entry *entry;   // owned by s, never freed while the pool runs
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool need_wakeup;
+};
+
+static struct scan_entry *find_entry(struct loudness_scan *s, const char *path,
+                                     int64_t size, int64_t mtime)
+{
+    for (int n = s->num_entries - 1; n >= 0; n--) {
+        struct scan_entry *e = s->entries[n];
+        if (e->size == size && e->mtime == mtime && strcmp(e->path, path) == 0)
+            return e;
+    }
+    return NULL;
+}
+
+// Mark older results for the same path (i.e. for a since modified file) as
+// stale, so they're dropped when the cache file is rewritten.
+static void supersede_entries(struct loudness_scan *s, struct scan_entry *e)
+{
+    for (int n = 0; n < s->num_entries; n++) {
+        struct scan_entry *cur = s->entries[n];
+        if (cur != e && cur->done && strcmp(cur->path, e->path) == 0)
+            cur->stale = true;
+    }
+}
+
+// Cache lines: "<size> <mtime> <gain> <peak> <path>". Later lines override
+// earlier ones.
+static void load_cache(struct loudness_scan *s)
+{
+    FILE *f = fopen(s->cache_file, "rb");
+    if (!f)
+        return;
+
+    char line[4096];
+    while (fgets(line, sizeof(line), f)) {
+        int64_t size, mtime;
+        float gain, peak;
+        int pos = 0;
+        if (sscanf(line, "%"SCNd64" %"SCNd64" %f %f %n",
+                   &size, &mtime, &gain, &peak, &pos) != 4 || !pos)
+            continue;
+        bstr path = bstr_strip_linebreaks(bstr0(line + pos));
+        if (!path.len)
+            continue;
+        struct scan_entry *e = talloc_ptrtype(s, e);
+        *e = (struct scan_entry){
+            .path = bstrto0(e, path),
+            .size = size,
+            .mtime = mtime,
+            .done = true,
+            .gain = gain,
+            .peak = peak,
+        };
+        supersede_entries(s, e);
+        MP_TARRAY_APPEND(s, s->entries, s->num_entries, e);
+    }
+
+    fclose(f);
+    MP_VERBOSE(s, "Loaded %d cached entries.\n", s->num_entries);
+}
+
+// Return the cache file contents with all current results, dropping stale
+// and the oldest entries. Called with s->lock held.
+static bstr format_cache(struct loudness_scan *s, void *ta_parent)
+{
+    int first = s->num_entries;
+    for (int count = 0; first > 0 && count < CACHE_MAX_ENTRIES; first--) {
+        struct scan_entry *e = s->entries[first - 1];
+        count += e->done && !e->stale;
+    }
+
+    bstr data = {0};
+    for (int n = first; n < s->num_entries; n++) {
+        struct scan_entry *e = s->entries[n];
+        if (e->done && !e->stale) {
+            bstr_xappend_asprintf(ta_parent, &data,
+                                  "%"PRId64" %"PRId64" %f %f %s\n", e->size,
+                                  e->mtime, e->gain, e->peak, e->path);
+        }
+    }
+    return data;
+}
+
+// Rewrite the cache file with the given contents. A temporary file is renamed
+// over the old one, so that a concurrently running mpv instance never sees a
+// partially written cache. Snapshots older than the one already written are
+// skipped, as jobs can finish writing out of order.
+// Called without s->lock held, so that a slow disk doesn't block the player.
+static void write_cache(struct loudness_scan *s, bstr data, uint64_t gen)
+{
+    pthread_mutex_lock(&s->write_lock);
+    if (gen <= s->written_gen) {
+        pthread_mutex_unlock(&s->write_lock);
+        return;
+    }
+
+    mp_mk_config_dir(s->global, "");
+    char *tmp = talloc_asprintf(NULL, "%s.XXXXXX", s->cache_file);
+    int fd = mp_mkostemps(tmp, 0, O_CLOEXEC);
+    FILE *f = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if (!f) {
+        if (fd >= 0) {
+            close(fd);
+            unlink(tmp);
+        }
+        goto error;
+    }
+    if (data.len)
+        fwrite(data.start, data.len, 1, f);
+    bool ok = !ferror(f);
+    if (fclose(f) || !ok || rename(tmp, s->cache_file)) {
+        unlink(tmp);
+        goto error;
+    }
+    talloc_free(tmp);
+    s->written_gen = gen;
+    goto done;
+
+error:
+    MP_WARN(s, "Can't write %s\n", s->cache_file);
+    talloc_free(tmp);
+done:
+    pthread_mutex_unlock(&s->write_lock);
+}
+
+static void wakeup_job(void *ctx)
+{
+    struct scan_job *job = ctx;
+
+    pthread_mutex_lock(&job->lock);
+    job->need_wakeup = true;
+    pthread_cond_signal(&job->wakeup);
+    pthread_mutex_unlock(&job->lock);
+}
+
+// Decode the first audio stream of the file and measure it. Runs on a worker
+// thread.
+static bool scan_file(struct scan_job *job, struct mp_cancel *cancel,
+                      float *out_gain, float *out_peak)
+{
+    struct loudness_scan *s = job->s;
+    const char *path = job->entry->path;
+    bool ok = false;
+
+    struct demuxer_params params = {.stream_flags = STREAM_ORIGIN_DIRECT};
+    struct demuxer *demuxer = demux_open_url(path, &params, cancel, s->global);
+    if (!demuxer)
+        return false;
+
+    struct sh_stream *sh = NULL;
+    for (int n = 0; n < demux_get_num_stream(demuxer); n++) {
+        struct sh_stream *cur = demux_get_stream(demuxer, n);
+        if (cur->type == STREAM_AUDIO && !cur->attached_picture) {
+            sh = cur;
+            break;
+        }
+    }
+    if (!sh || sh->codec->replaygain_data)
+        goto done_demux;
+
+    demuxer_select_track(demuxer, sh, MP_NOPTS_VALUE, true);
+
+    struct mp_filter *root = mp_filter_create_root(s->global);
+    mp_filter_graph_set_wakeup_cb(root, wakeup_job, job);
+
+    struct mp_decoder_wrapper *dec = mp_decoder_wrapper_create(root, sh);
+    if (!dec || !mp_decoder_wrapper_reinit(dec))
+        goto done_filters;
+
+    struct mp_autoconvert *conv = mp_autoconvert_create(root);
+    if (!conv)
+        goto done_filters;
+    mp_autoconvert_add_afmt(conv, AF_FORMAT_FLOATP);
+    mp_pin_connect(conv->f->pins[0], dec->f->pins[0]);
+
+    struct mp_pin *out = conv->f->pins[1];
+    struct mp_loudness *meter = NULL;
+
+    while (!mp_cancel_test(cancel)) {
+        struct mp_frame frame = mp_pin_out_read(out);
+        if (frame.type == MP_FRAME_AUDIO) {
+            struct mp_aframe *af = frame.data;
+            if (!meter) {
+                struct mp_chmap chmap;
+                mp_aframe_get_chmap(af, &chmap);
+                meter = mp_loudness_create(root, mp_aframe_get_rate(af), &chmap);
+            }
+            bool added = meter && mp_loudness_add(meter, af);
+            mp_frame_unref(&frame);
+            if (!added) {
+                MP_VERBOSE(s, "Unsupported or changing audio format: %s\n",
+                           path);
+                break;
+            }
+        } else if (frame.type == MP_FRAME_EOF) {
+            ok = !!meter;
+            break;
+        } else if (frame.type) {
+            mp_frame_unref(&frame);
+        } else if (mp_filter_has_failed(root)) {
+            break;
+        } else if (!mp_filter_graph_run(root)) {
+            pthread_mutex_lock(&job->lock);
+            while (!job->need_wakeup)
+                pthread_cond_wait(&job->wakeup, &job->lock);
+            job->need_wakeup = false;
+            pthread_mutex_unlock(&job->lock);
+        }
+    }
+
+    if (ok) {
+        double lufs = mp_loudness_integrated(meter);
+        if (isfinite(lufs)) {
+            *out_gain = MP_LOUDNESS_RG_REFERENCE - lufs;
+            *out_peak = mp_loudness_peak(meter);
+        } else {
+            // Silence: no normalization.
+            *out_gain = 0;
+            *out_peak = 1.0;
+        }
+    }
+
+done_filters:
+    talloc_free(root);
+done_demux:
+    demux_free(demuxer);
+    return ok;
+}
+
+static void scan_job_run(void *ctx)
+{
+    struct scan_job *job = ctx;
+    struct loudness_scan *s = job->s;
+
+    pthread_mutex_init(&job->lock, NULL);
+    pthread_cond_init(&job->wakeup, NULL);
+
+    // Private mp_cancel, so the callback can wake up the decode loop.
+    struct mp_cancel *cancel = mp_cancel_new(NULL);
+    mp_cancel_set_parent(cancel, s->cancel);
+    mp_cancel_set_cb(cancel, wakeup_job, job);
+
+    int64_t start = mp_time_us();
+    float gain = 0, peak = 0;
+    bool ok = !mp_cancel_test(cancel) && scan_file(job, cancel, &gain, &peak);
+
+    mp_cancel_set_cb(cancel, NULL, NULL);
+    talloc_free(cancel);
+
+    void *tmp = talloc_new(NULL);
+    bstr data = {0};
+    uint64_t gen = 0;
+
+    pthread_mutex_lock(&s->lock);
+    struct scan_entry *e = job->entry;
+    if (ok) {
+        e->gain = gain;
+        e->peak = peak;
+        e->done = true;
+        supersede_entries(s, e);
+        MP_VERBOSE(s, "%s: gain %.2f dB, peak %f (%.3f s)\n", e->path, gain,
+                   peak, (mp_time_us() - start) / 1e6);
+        data = format_cache(s, tmp);
+        gen = ++s->cache_gen;
+    } else {
+        e->failed = true;
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    if (gen)
+        write_cache(s, data, gen);
+    talloc_free(tmp);
+
+    pthread_cond_destroy(&job->wakeup);
+    pthread_mutex_destroy(&job->lock);
+    talloc_free(job);
+}
+
+// Return the absolute path of a local file and its identity, or NULL if it
+// can't be scanned.
+static char *get_file_id(void *ta_parent, const char *filename,
+                         int64_t *size, int64_t *mtime)
+{
+    char *path = mp_file_get_path(ta_parent, bstr0(filename));
+    if (!path)
+        return NULL;
+    if (!mp_path_is_absolute(bstr0(path))) {
+        char *cwd = mp_getcwd(ta_parent);
+        if (!cwd)
+            return NULL;
+        path = mp_path_join(ta_parent, cwd, path);
+    }
+    struct stat st;
+    if (strchr(path, '\n') || stat(path, &st) || !S_ISREG(st.st_mode))
+        return NULL;
+    *size = st.st_size;
+    *mtime = st.st_mtime;
+    return path;
+}
+
+static void queue_file(struct loudness_scan *s, const char *filename)
+{
+    void *tmp = talloc_new(NULL);
+    int64_t size, mtime;
+    char *path = get_file_id(tmp, filename, &size, &mtime);
+    if (!path)
+        goto done;
+
+    pthread_mutex_lock(&s->lock);
+    if (!find_entry(s, path, size, mtime)) {
+        struct scan_entry *e = talloc_ptrtype(s, e);
+        *e = (struct scan_entry){
+            .path = talloc_strdup(e, path),
+            .size = size,
+            .mtime = mtime,
+        };
+        MP_TARRAY_APPEND(s, s->entries, s->num_entries, e);
+
+        struct scan_job *job = talloc_ptrtype(NULL, job);
+        *job = (struct scan_job){.s = s, .entry = e};
+        mp_thread_pool_queue(s->pool, scan_job_run, job);
+    }
+    pthread_mutex_unlock(&s->lock);
+
+done:
+    talloc_free(tmp);
+}
+
+static void scan_destroy(void *ptr)
+{
+    struct loudness_scan *s = ptr;
+
+    mp_cancel_trigger(s->cancel);
+    // Blocks until all jobs have finished.
+    TA_FREEP(&s->pool);
+    pthread_mutex_destroy(&s->lock);
+    pthread_mutex_destroy(&s->write_lock);
+}
+
+static struct loudness_scan *scan_create(struct MPContext *mpctx)
+{
+    struct MPOpts *opts = mpctx->opts;
+
+    struct loudness_scan *s = talloc_zero(NULL, struct loudness_scan);
+    talloc_set_destructor(s, scan_destroy);
+    s->global = mpctx->global;
+    s->log = mp_log_new(s, mpctx->log, "rgscan");
+    s->cancel = mp_cancel_new(s);
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_mutex_init(&s->write_lock, NULL);
+    s->pool = mp_thread_pool_create(s, 0, 0, opts->rgain_scan_threads);
+    s->cache_file = mp_find_user_config_file(s, s->global, CACHE_FILE);
+    if (s->cache_file)
+        load_cache(s);
+    return s;
+}
+
+// Queue the current and the next few playlist entries for scanning.
+void loudness_scan_update(struct MPContext *mpctx)
+{
+    struct MPOpts *opts = mpctx->opts;
+
+    if (!opts->rgain_scan || !opts->rgain_mode)
+        return;
+
+    if (!mpctx->loudness_scan)
+        mpctx->loudness_scan = scan_create(mpctx);
+
+    struct playlist_entry *e = mpctx->playlist->current;
+    for (int n = 0; e && n <= opts->rgain_scan_ahead; n++) {
+        queue_file(mpctx->loudness_scan, e->filename);
+        e = playlist_entry_get_rel(e, 1);
+    }
+}
+
+// Return a previously computed result for the given file.
+bool loudness_scan_get(struct MPContext *mpctx, const char *filename,
+                       struct replaygain_data *out)
+{
+    struct loudness_scan *s = mpctx->loudness_scan;
+    if (!s)
+        return false;
+
+    void *tmp = talloc_new(NULL);
+    int64_t size, mtime;
+    char *path = get_file_id(tmp, filename, &size, &mtime);
+    bool found = false;
+    if (path) {
+        pthread_mutex_lock(&s->lock);
+        struct scan_entry *e = find_entry(s, path, size, mtime);
+        if (e && e->done) {
+            // No album information; same fallback as for track-only tags.
+            *out = (struct replaygain_data){
+                .track_gain = e->gain,
+                .track_peak = e->peak,
+                .album_gain = e->gain,
+                .album_peak = e->peak,
+            };
+            found = true;
+        }
+        pthread_mutex_unlock(&s->lock);
+    }
+    talloc_free(tmp);
+    return found;
+}
+
+void loudness_scan_uninit(struct MPContext *mpctx)
+{
+    TA_FREEP(&mpctx->loudness_scan);
+}
@@ -28,6 +28,8 @@
 #include "mpv_talloc.h"
 
 #include "misc/dispatch.h"
+#include "misc/json.h"
+#include "misc/node.h"
 #include "misc/thread_pool.h"
 #include "osdep/io.h"
 #include "osdep/terminal.h"
@@ -63,6 +65,7 @@
 #include "client.h"
 #include "command.h"
 #include "screenshot.h"
+#include "shm_state.h"
 
 static const char def_config[] =
 #if HAVE_VITA
@@ -160,13 +163,46 @@ void mp_print_version(struct mp_log *log, int always)
     }
 }
 
+// Write the trace recorded since mp_create() to the --startup-trace file.
+// Only the first call after tracing was started does anything.
+void mp_write_startup_trace(struct MPContext *mpctx)
+{
+    char *file = mpctx->opts->startup_trace;
+    bool enabled = file && file[0];
+    void *tmp = talloc_new(NULL);
+    struct mpv_node trace;
+    if (stats_trace_stop(mpctx->global, tmp, enabled ? &trace : NULL) &&
+        enabled)
+    {
+        char *path = mp_get_user_path(tmp, mpctx->global, file);
+        char *json = talloc_strdup(tmp, "");
+        FILE *f = NULL;
+        bool ok = json_write(&json, &trace) >= 0 &&
+                  (f = fopen(path, "wb")) && fputs(json, f) >= 0;
+        if (f && fclose(f))
+            ok = false;
+        if (ok) {
+            MP_VERBOSE(mpctx, "Startup trace written to '%s'.\n", path);
+        } else {
+            MP_ERR(mpctx, "Could not write startup trace to '%s'.\n", path);
+        }
+    }
+    talloc_free(tmp);
+}
+
 void mp_destroy(struct MPContext *mpctx)
 {
+    mp_write_startup_trace(mpctx);
+
     mp_shutdown_clients(mpctx);
 
     mp_uninit_ipc(mpctx->ipc_ctx);
     mpctx->ipc_ctx = NULL;
 
+    loudness_scan_uninit(mpctx);
+
+    mp_shm_state_uninit(mpctx);
+
     uninit_audio_out(mpctx);
     uninit_video_out(mpctx);
 
@@ -196,6 +232,7 @@ void mp_destroy(struct MPContext *mpctx)
     mp_msg_uninit(mpctx->global);
     assert(!mpctx->num_abort_list);
     talloc_free(mpctx->abort_list);
+    assert(!mpctx->num_opens);
     pthread_mutex_destroy(&mpctx->abort_lock);
     talloc_free(mpctx->mconfig); // destroy before dispatch
     talloc_free(mpctx);
@@ -273,6 +310,8 @@ struct MPContext *mp_create(void)
     mpctx->global = talloc_zero(mpctx, struct mpv_global);
 
     stats_global_init(mpctx->global);
+    // Dropped in mp_initialize() if --startup-trace is not set.
+    stats_trace_start(mpctx->global);
 
     // Nothing must call mp_msg*() and related before this
     mp_msg_init(mpctx->global);
@@ -280,6 +319,7 @@ struct MPContext *mp_create(void)
     mpctx->statusline = mp_log_new(mpctx, mpctx->log, "!statusline");
 
     mpctx->stats = stats_ctx_create(mpctx, mpctx->global, "main");
+    mpctx->stats_iterations = stats_handle_create(mpctx->stats, "iterations");
 
     // Create the config context and register the options
     mpctx->mconfig = m_config_new(mpctx, mpctx->log, &mp_opt_root);
@@ -342,15 +382,22 @@ int mp_initialize(struct MPContext *mpctx, char **options)
 
     mp_print_version(mpctx->log, false);
 
+    stats_span_begin(mpctx->stats, "config-files");
     mp_parse_cfgfiles(mpctx);
+    stats_span_end(mpctx->stats, "config-files");
 
     if (options) {
+        stats_span_begin(mpctx->stats, "command-line");
         int r = m_config_parse_mp_command_line(mpctx->mconfig, mpctx->playlist,
                                                mpctx->global, options);
+        stats_span_end(mpctx->stats, "command-line");
         if (r < 0)
             return r == M_OPT_EXIT ? 1 : -1;
     }
 
+    if (!opts->startup_trace || !opts->startup_trace[0])
+        stats_trace_stop(mpctx->global, NULL, NULL);
+
     if (opts->operation_mode == 1) {
         m_config_set_profile(mpctx->mconfig, "builtin-pseudo-gui",
                              M_SETOPT_NO_OVERWRITE);
@@ -362,7 +409,9 @@ int mp_initialize(struct MPContext *mpctx, char **options)
     // the command line.
     m_config_backup_watch_later_opts(mpctx->mconfig);
 
+    stats_span_begin(mpctx->stats, "input-config");
     mp_input_load_config(mpctx->input);
+    stats_span_end(mpctx->stats, "input-config");
 
     // From this point on, all mpctx members are initialized.
     mpctx->initialized = true;
@@ -406,7 +455,9 @@ int mp_initialize(struct MPContext *mpctx, char **options)
         mp_input_enable_section(mpctx->input, "encode", MP_INPUT_EXCLUSIVE);
     }
 
+    stats_span_begin(mpctx->stats, "scripts");
     mp_load_scripts(mpctx);
+    stats_span_end(mpctx->stats, "scripts");
 
     if (opts->force_vo == 2 && handle_force_window(mpctx, false) < 0)
         return -1;
@@ -27,6 +27,7 @@
 #include "core.h"
 #include "mpv_talloc.h"
 #include "screenshot.h"
+#include "shm_state.h"
 
 #include "audio/out/ao.h"
 #include "common/common.h"
@@ -56,7 +57,7 @@ void mp_wait_events(struct MPContext *mpctx)
 {
     mp_client_send_property_changes(mpctx);
 
-    stats_event(mpctx->stats, "iterations");
+    stats_handle_event(mpctx->stats_iterations);
 
     bool sleeping = mpctx->sleeptime > 0;
     if (sleeping)
@@ -781,8 +782,7 @@ static void handle_update_cache(struct MPContext *mpctx)
         force_update = true;
     }
 
-    if (s.eof && !busy)
-        prefetch_next(mpctx);
+    prefetch_next(mpctx, s.eof && !busy);
 
     if (force_update) {
         mpctx->cache_update_pts = mpctx->playback_pts;
@@ -1125,6 +1125,8 @@ static void handle_playback_restart(struct MPContext *mpctx)
         mpctx->current_seek = (struct seek_params){0};
         handle_playback_time(mpctx);
         mp_notify(mpctx, MPV_EVENT_PLAYBACK_RESTART, NULL);
+        stats_trace_mark(mpctx->stats, "first-frame");
+        mp_write_startup_trace(mpctx);
         update_core_idle_state(mpctx);
         if (!mpctx->playing_msg_shown) {
             if (opts->playing_msg && opts->playing_msg[0]) {
@@ -1238,6 +1240,10 @@ void run_playloop(struct MPContext *mpctx)
     if (mp_filter_graph_run(mpctx->filter_root))
         mp_wakeup_core(mpctx);
 
+    mp_shm_state_update(mpctx);
+
+    read_background_playlist(mpctx);
+
     mp_wait_events(mpctx);
 
     handle_update_cache(mpctx);
@@ -1252,6 +1258,8 @@ void run_playloop(struct MPContext *mpctx)
 void mp_idle(struct MPContext *mpctx)
 {
     handle_dummy_ticks(mpctx);
+    mp_shm_state_update(mpctx);
+    read_background_playlist(mpctx);
     mp_wait_events(mpctx);
     mp_process_input(mpctx);
     handle_command_updates(mpctx);
@@ -15,6 +15,7 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
@@ -26,12 +27,13 @@
 #include "mpv_talloc.h"
 #include "screenshot.h"
 #include "core.h"
+#include "client.h"
 #include "command.h"
 #include "input/cmd.h"
 #include "misc/bstr.h"
 #include "misc/dispatch.h"
 #include "misc/node.h"
-#include "misc/thread_tools.h"
+#include "misc/thread_pool.h"
 #include "common/msg.h"
 #include "options/path.h"
 #include "video/mp_image.h"
@@ -51,11 +53,44 @@ typedef struct screenshot_ctx {
 
     // Command to repeat in each-frame mode.
     struct mp_cmd *each_frame;
+    // The each-frame command has not taken its screenshot yet.
+    bool each_frame_pending;
 
     int frameno;
     uint64_t last_frame_count;
+
+    // Screenshots are encoded and written on these threads.
+    struct mp_thread_pool *pool;
+    // Filenames of screenshots that were not written yet.
+    char **pending_files;
+    int num_pending_files;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    // --- protected by lock
+    int64_t queued_bytes;       // image memory of queued screenshots
+    int num_queued;
 } screenshot_ctx;
 
+struct screenshot_job {
+    screenshot_ctx *ctx;
+    struct mp_cmd_ctx *cmd;     // completed when the file was written
+    struct mp_image *image;
+    char *filename;
+    struct image_writer_opts opts;
+    int64_t size;
+    bool ok;
+};
+
+static void screenshot_destroy(void *p)
+{
+    screenshot_ctx *ctx = p;
+    // Blocks until all jobs are done (normally there are none left).
+    TA_FREEP(&ctx->pool);
+    pthread_cond_destroy(&ctx->wakeup);
+    pthread_mutex_destroy(&ctx->lock);
+}
+
 void screenshot_init(struct MPContext *mpctx)
 {
     mpctx->screenshot_ctx = talloc(mpctx, screenshot_ctx);
@@ -63,6 +98,9 @@ void screenshot_init(struct MPContext *mpctx)
         .mpctx = mpctx,
         .frameno = 1,
     };
+    pthread_mutex_init(&mpctx->screenshot_ctx->lock, NULL);
+    pthread_cond_init(&mpctx->screenshot_ctx->wakeup, NULL);
+    talloc_set_destructor(mpctx->screenshot_ctx, screenshot_destroy);
 }
 
 static char *stripext(void *talloc_ctx, const char *s)
@@ -73,28 +111,100 @@ static char *stripext(void *talloc_ctx, const char *s)
     return talloc_asprintf(talloc_ctx, "%.*s", (int)(end - s), s);
 }
 
-static bool write_screenshot(struct mp_cmd_ctx *cmd, struct mp_image *img,
+// Called on the main thread after the job was run.
+static void screenshot_done(void *p)
+{
+    struct screenshot_job *job = p;
+    screenshot_ctx *ctx = job->ctx;
+    struct MPContext *mpctx = ctx->mpctx;
+    struct mp_cmd_ctx *cmd = job->cmd;
+
+    for (int n = 0; n < ctx->num_pending_files; n++) {
+        if (ctx->pending_files[n] == job->filename) {
+            MP_TARRAY_REMOVE_AT(ctx->pending_files, ctx->num_pending_files, n);
+            break;
+        }
+    }
+
+    if (job->ok) {
+        mp_cmd_msg(cmd, MSGL_INFO, "Screenshot: '%s'", job->filename);
+    } else {
+        mp_cmd_msg(cmd, MSGL_ERR, "Error writing screenshot!");
+    }
+    cmd->success = job->ok;
+    mp_cmd_ctx_complete(cmd);
+    talloc_free(job);
+
+    mpctx->outstanding_async -= 1;
+    if (!mpctx->outstanding_async && mp_is_shutting_down(mpctx))
+        mp_wakeup_core(mpctx);
+}
+
+// Runs on a worker thread, without core lock.
+static void write_screenshot(void *p)
+{
+    struct screenshot_job *job = p;
+    screenshot_ctx *ctx = job->ctx;
+    struct MPContext *mpctx = ctx->mpctx;
+
+    job->ok = write_image(job->image, &job->opts, job->filename, mpctx->global,
+                          mpctx->log);
+    TA_FREEP(&job->image);
+
+    pthread_mutex_lock(&ctx->lock);
+    ctx->queued_bytes -= job->size;
+    ctx->num_queued -= 1;
+    pthread_cond_broadcast(&ctx->wakeup);
+    pthread_mutex_unlock(&ctx->lock);
+
+    mp_dispatch_enqueue(mpctx->dispatch, screenshot_done, job);
+}
+
+// Queue the image for writing, and complete cmd once it was written. Takes
+// ownership of img. If the queue is full, this waits (with the core unlocked)
+// until enough previous screenshots were written.
+static void queue_screenshot(struct mp_cmd_ctx *cmd, struct mp_image *img,
                              const char *filename, struct image_writer_opts *opts)
 {
     struct MPContext *mpctx = cmd->mpctx;
-    struct image_writer_opts *gopts = mpctx->opts->screenshot_image_opts;
-    struct image_writer_opts opts_copy = opts ? *opts : *gopts;
+    screenshot_ctx *ctx = mpctx->screenshot_ctx;
 
     mp_cmd_msg(cmd, MSGL_V, "Starting screenshot: '%s'", filename);
 
+    if (!ctx->pool) {
+        ctx->pool = mp_thread_pool_create(ctx, 0, 0,
+                                          mpctx->opts->screenshot_threads);
+    }
+
+    struct screenshot_job *job = talloc_ptrtype(NULL, job);
+    *job = (struct screenshot_job){
+        .ctx = ctx,
+        .cmd = cmd,
+        .image = talloc_steal(job, img),
+        .filename = talloc_strdup(job, filename),
+        .opts = opts ? *opts : *mpctx->opts->screenshot_image_opts,
+        .size = mp_image_approx_byte_size(img),
+    };
+    MP_TARRAY_APPEND(ctx, ctx->pending_files, ctx->num_pending_files,
+                     job->filename);
+    mpctx->outstanding_async += 1; // prevent that core disappears
+
+    int64_t max_bytes = mpctx->opts->screenshot_queue_bytes;
+
     mp_core_unlock(mpctx);
 
-    bool ok = img && write_image(img, &opts_copy, filename, mpctx->global,
-                                 mpctx->log);
+    // Always accept 1 screenshot, even if it's larger than the limit.
+    pthread_mutex_lock(&ctx->lock);
+    while (ctx->num_queued && ctx->queued_bytes + job->size > max_bytes)
+        pthread_cond_wait(&ctx->wakeup, &ctx->lock);
+    ctx->queued_bytes += job->size;
+    ctx->num_queued += 1;
+    pthread_mutex_unlock(&ctx->lock);
 
-    mp_core_lock(mpctx);
+    if (!mp_thread_pool_queue(ctx->pool, write_screenshot, job))
+        write_screenshot(job);
 
-    if (ok) {
-        mp_cmd_msg(cmd, MSGL_INFO, "Screenshot: '%s'", filename);
-    } else {
-        mp_cmd_msg(cmd, MSGL_ERR, "Error writing screenshot!");
-    }
-    return ok;
+    mp_core_lock(mpctx);
 }
 
 #ifdef _WIN32
@@ -307,7 +417,11 @@ static char *gen_fname(struct mp_cmd_ctx *cmd, const char *file_ext)
             mp_mkdirp(full_dir);
         }
 
-        if (!mp_path_exists(fname))
+        bool pending = false;
+        for (int n = 0; n < ctx->num_pending_files; n++)
+            pending |= strcmp(ctx->pending_files[n], fname) == 0;
+
+        if (!pending && !mp_path_exists(fname))
             return fname;
 
         if (sequence == prev_sequence) {
@@ -444,10 +558,10 @@ void cmd_screenshot_to_file(void *p)
     if (!image) {
         mp_cmd_msg(cmd, MSGL_ERR, "Taking screenshot failed.");
         cmd->success = false;
+        mp_cmd_ctx_complete(cmd);
         return;
     }
-    cmd->success = write_screenshot(cmd, image, filename, &opts);
-    talloc_free(image);
+    queue_screenshot(cmd, image, filename, &opts);
 }
 
 void cmd_screenshot(void *p)
@@ -467,6 +581,7 @@ void cmd_screenshot(void *p)
         if (each_frame_toggle) {
             if (ctx->each_frame) {
                 TA_FREEP(&ctx->each_frame);
+                mp_cmd_ctx_complete(cmd);
                 return;
             }
             ctx->each_frame = talloc_steal(ctx, mp_cmd_clone(cmd->cmd));
@@ -476,23 +591,36 @@ void cmd_screenshot(void *p)
         }
     }
 
-    cmd->success = false;
+    // The next each-frame screenshot can be taken once this one is queued.
+    // The completion callback would interfere with it.
+    if (each_frame_mode)
+        cmd->on_completion = NULL;
 
     struct image_writer_opts *opts = mpctx->opts->screenshot_image_opts;
     bool high_depth = image_writer_high_depth(opts);
 
     struct mp_image *image = screenshot_get(mpctx, mode, high_depth);
+    char *filename = NULL;
 
     if (image) {
-        char *filename = gen_fname(cmd, image_writer_file_ext(opts));
-        if (filename)
-            cmd->success = write_screenshot(cmd, image, filename, NULL);
-        talloc_free(filename);
+        filename = gen_fname(cmd, image_writer_file_ext(opts));
     } else {
         mp_cmd_msg(cmd, MSGL_ERR, "Taking screenshot failed.");
     }
 
-    talloc_free(image);
+    if (filename) {
+        queue_screenshot(cmd, image, filename, NULL);
+    } else {
+        talloc_free(image);
+        cmd->success = false;
+        mp_cmd_ctx_complete(cmd);
+    }
+    talloc_free(filename);
+
+    if (each_frame_mode) {
+        ctx->each_frame_pending = false;
+        mp_wakeup_core(mpctx);
+    }
 }
 
 void cmd_screenshot_raw(void *p)
@@ -521,13 +649,12 @@ void cmd_screenshot_raw(void *p)
     talloc_steal(ba, img);
 }
 
+// Only called if the each-frame command failed before it could run.
 static void screenshot_fin(struct mp_cmd_ctx *cmd)
 {
-    void **a = cmd->on_completion_priv;
-    struct MPContext *mpctx = a[0];
-    struct mp_waiter *waiter = a[1];
+    struct MPContext *mpctx = cmd->mpctx;
 
-    mp_waiter_wakeup(waiter, 0);
+    mpctx->screenshot_ctx->each_frame_pending = false;
     mp_wakeup_core(mpctx);
 }
 
@@ -542,14 +669,12 @@ void handle_each_frame_screenshot(struct MPContext *mpctx)
         return;
     ctx->last_frame_count = mpctx->shown_vframes;
 
-    struct mp_waiter wait = MP_WAITER_INITIALIZER;
-    void *a[] = {mpctx, &wait};
-    run_command(mpctx, mp_cmd_clone(ctx->each_frame), NULL, screenshot_fin, a);
+    ctx->each_frame_pending = true;
+    run_command(mpctx, mp_cmd_clone(ctx->each_frame), NULL, screenshot_fin, NULL);
 
-    // Block (in a reentrant way) until the screenshot was written. Otherwise,
-    // we could pile up screenshot requests forever.
-    while (!mp_waiter_poll(&wait))
+    // Block (in a reentrant way) until the screenshot was taken and queued.
+    // Writing it happens in the background; if that is too slow, the queue
+    // limit makes the command wait, so screenshot requests can't pile up.
+    while (ctx->each_frame_pending)
         mp_idle(mpctx);
-
-    mp_waiter_wait(&wait);
 }
@@ -0,0 +1,203 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "config.h"
+
+#if HAVE_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "common/playlist.h"
+#include "demux/demux.h"
+#include "mpv_talloc.h"
+#include "options/options.h"
+#include "options/path.h"
+#include "osdep/atomic.h"
+
+#include "core.h"
+#include "shm_state.h"
+
+struct shm_state {
+    char *path;
+    struct mp_shm_state *map;
+};
+
+#if HAVE_POSIX && HAVE_STDATOMIC
+
+static void destroy(void *p)
+{
+    struct shm_state *s = p;
+    if (s->map)
+        munmap(s->map, sizeof(*s->map));
+    if (s->path)
+        unlink(s->path);
+}
+
+void mp_shm_state_init(struct MPContext *mpctx)
+{
+    char *opt = mpctx->opts->ipc_shm_path;
+    if (!opt || !opt[0])
+        return;
+
+    struct shm_state *s = talloc_zero(NULL, struct shm_state);
+    talloc_set_destructor(s, destroy);
+    char *path = mp_get_user_path(s, mpctx->global, opt);
+
+    // Same as with --input-ipc-server: replace stale files.
+    unlink(path);
+    int fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        MP_ERR(mpctx, "Could not create shared state file '%s': %s\n",
+               path, mp_strerror(errno));
+        talloc_free(s);
+        return;
+    }
+    s->path = path;
+
+    void *map = MAP_FAILED;
+    if (ftruncate(fd, sizeof(*s->map)) == 0) {
+        map = mmap(NULL, sizeof(*s->map), PROT_READ | PROT_WRITE, MAP_SHARED,
+                   fd, 0);
+    }
+    int err = errno;
+    close(fd);
+    if (map == MAP_FAILED) {
+        MP_ERR(mpctx, "Could not map shared state file '%s': %s\n",
+               path, mp_strerror(err));
+        talloc_free(s);
+        return;
+    }
+    s->map = map;
+
+    // The file is zero-filled after ftruncate(), so seq starts out at 0.
+    // Write the magic last, so a reader which opens the file early will not
+    // mistake it for a valid one.
+    s->map->version = MP_SHM_STATE_VERSION;
+    s->map->size = sizeof(*s->map);
+    s->map->pid = getpid();
+    atomic_thread_fence(memory_order_release);
+    s->map->magic = MP_SHM_STATE_MAGIC;
+
+    mpctx->shm_state = s;
+    mp_shm_state_update(mpctx);
+}
+
+static uint32_t get_flags(struct MPContext *mpctx)
+{
+    uint32_t flags = 0;
+    if (mpctx->opts->pause)
+        flags |= MP_SHM_STATE_PAUSE;
+    if (!mpctx->playback_active)
+        flags |= MP_SHM_STATE_CORE_IDLE;
+    if (mpctx->stop_play == PT_STOP)
+        flags |= MP_SHM_STATE_IDLE;
+    if (mpctx->playback_initialized) {
+        if (!mpctx->restart_complete)
+            flags |= MP_SHM_STATE_SEEKING;
+        if (mpctx->video_status == STATUS_EOF &&
+            mpctx->audio_status == STATUS_EOF)
+            flags |= MP_SHM_STATE_EOF_REACHED;
+    }
+    if (mpctx->paused_for_cache)
+        flags |= MP_SHM_STATE_PAUSED_FOR_CACHE;
+    if (mpctx->opts->softvol_mute == 1)
+        flags |= MP_SHM_STATE_MUTE;
+    return flags;
+}
+
+static double nopts_to_nan(double v)
+{
+    return v == MP_NOPTS_VALUE ? NAN : v;
+}
+
+// Called once per playloop iteration, so this must stay cheap: all data is
+// gathered first, and the time the sequence number is odd is kept minimal.
+void mp_shm_state_update(struct MPContext *mpctx)
+{
+    struct shm_state *s = mpctx->shm_state;
+    if (!s)
+        return;
+
+    struct mp_shm_state st = {
+        .time_pos = nopts_to_nan(get_playback_time(mpctx)),
+        .duration = nopts_to_nan(get_time_length(mpctx)),
+        .percent_pos = NAN,
+        .speed = mpctx->opts->playback_speed,
+        .volume = mpctx->opts->softvol_volume,
+        .cache_duration = NAN,
+        .cache_bytes = -1,
+        .playlist_pos = -1,
+        .playlist_count = playlist_entry_count(mpctx->playlist),
+        .flags = get_flags(mpctx),
+    };
+
+    double pos = get_current_pos_ratio(mpctx, false);
+    if (pos >= 0)
+        st.percent_pos = pos * 100;
+
+    if (mpctx->demuxer) {
+        struct demux_reader_state rs;
+        demux_get_reader_state(mpctx->demuxer, &rs);
+        if (rs.ts_duration >= 0)
+            st.cache_duration = rs.ts_duration;
+        st.cache_bytes = rs.fw_bytes;
+    }
+
+    if (mpctx->playlist->current)
+        st.playlist_pos = playlist_entry_to_index(mpctx->playlist,
+                                                  mpctx->playlist->current);
+
+    struct mp_shm_state *m = s->map;
+    _Atomic uint64_t *seq = (_Atomic uint64_t *)&m->seq;
+    uint64_t v = atomic_load_explicit(seq, memory_order_relaxed);
+
+    atomic_store_explicit(seq, v + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    const size_t start = offsetof(struct mp_shm_state, time_pos);
+    memcpy((char *)m + start, (char *)&st + start, sizeof(st) - start);
+
+    atomic_store_explicit(seq, v + 2, memory_order_release);
+}
+
+#else
+
+void mp_shm_state_init(struct MPContext *mpctx)
+{
+    if (mpctx->opts->ipc_shm_path && mpctx->opts->ipc_shm_path[0])
+        MP_ERR(mpctx, "--input-ipc-shm is not supported on this platform.\n");
+}
+
+void mp_shm_state_update(struct MPContext *mpctx)
+{
+}
+
+#endif
+
+void mp_shm_state_uninit(struct MPContext *mpctx)
+{
+    TA_FREEP(&mpctx->shm_state);
+}
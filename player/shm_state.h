@@ -0,0 +1,72 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_SHM_STATE_H
+#define MP_SHM_STATE_H
+
+#include <stdint.h>
+
+// Layout of the file written with --input-ipc-shm. This is part of the public
+// interface (see ipc.rst), so fields can only be appended, and the version
+// must be incremented when doing so.
+// All fields use native byte order and alignment.
+
+#define MP_SHM_STATE_MAGIC 0x536d706d // "mpmS" in little endian
+#define MP_SHM_STATE_VERSION 1
+
+enum {
+    MP_SHM_STATE_PAUSE              = 1 << 0,   // "pause" property
+    MP_SHM_STATE_CORE_IDLE          = 1 << 1,   // "core-idle"
+    MP_SHM_STATE_IDLE               = 1 << 2,   // "idle-active"
+    MP_SHM_STATE_SEEKING            = 1 << 3,   // "seeking"
+    MP_SHM_STATE_EOF_REACHED        = 1 << 4,   // "eof-reached"
+    MP_SHM_STATE_PAUSED_FOR_CACHE   = 1 << 5,   // "paused-for-cache"
+    MP_SHM_STATE_MUTE               = 1 << 6,   // "mute"
+};
+
+struct mp_shm_state {
+    // --- immutable
+    uint32_t magic;             // MP_SHM_STATE_MAGIC
+    uint32_t version;           // MP_SHM_STATE_VERSION
+    uint32_t size;              // sizeof(struct mp_shm_state)
+    uint32_t pid;               // process ID of the writer
+    // Sequence lock: odd while an update is in progress, incremented by 2
+    // with each update. Readers read seq (acquire), copy the fields below,
+    // and then re-read seq (after an acquire fence); the copy is consistent
+    // only if both values are equal and even.
+    uint64_t seq;
+    // --- protected by seq; NAN or -1 if unavailable
+    double time_pos;            // "time-pos"
+    double duration;            // "duration"
+    double percent_pos;         // "percent-pos"
+    double speed;               // "speed"
+    double volume;              // "volume"
+    double cache_duration;      // "demuxer-cache-duration"
+    int64_t cache_bytes;        // "demuxer-cache-state/fw-bytes"
+    int64_t playlist_pos;       // "playlist-pos"
+    int64_t playlist_count;     // "playlist-count"
+    uint32_t flags;             // MP_SHM_STATE_* flags
+    uint32_t reserved;
+};
+
+struct MPContext;
+
+void mp_shm_state_init(struct MPContext *mpctx);
+void mp_shm_state_uninit(struct MPContext *mpctx);
+void mp_shm_state_update(struct MPContext *mpctx);
+
+#endif
@@ -0,0 +1,399 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Background generation of seek previews for the current file. The file is
+// opened a second time per worker thread, and each worker seeks to its share
+// of the preview positions, decodes the keyframe found there, and scales it
+// into a slot of a single preallocated image buffer.
+
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+
+#include "mpv_talloc.h"
+
+#include "common/common.h"
+#include "common/global.h"
+#include "common/msg.h"
+#include "common/playlist.h"
+#include "demux/demux.h"
+#include "demux/stheader.h"
+#include "filters/f_decoder_wrapper.h"
+#include "filters/filter.h"
+#include "misc/thread_pool.h"
+#include "misc/thread_tools.h"
+#include "options/options.h"
+#include "osdep/timer.h"
+#include "video/img_format.h"
+#include "video/mp_image.h"
+#include "video/mp_image_pool.h"
+#include "video/sws_utils.h"
+
+#include "core.h"
+
+// Upper bound for the number of previews, independent of the memory limit.
+#define MAX_THUMBNAILS 10000
+
+struct thumbnails {
+    struct mpv_global *global;
+    struct mp_log *log;
+    struct mp_thread_pool *pool;
+    struct mp_cancel *cancel;
+    char *url;
+    int stream_flags;           // of the playlist entry, for opening url
+    int demuxer_id;             // sh_stream.demuxer_id of the video track
+    bool rebase_start_time;     // --rebase-start-time
+
+    // Immutable after creation. Times are playback times.
+    double start;               // time of the first preview
+    double interval;
+    int count;
+    int w, h, stride;
+    uint8_t *data;              // count images of h * stride bytes (bgr0)
+
+    pthread_mutex_t lock;
+    // --- protected by lock
+    double *pts;                // per slot; MP_NOPTS_VALUE if not done yet
+    int available;
+};
+
+struct thumb_job {
+    struct thumbnails *t;
+    int first, last;            // range of slots [first, last)
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool need_wakeup;
+};
+
+static void wakeup_job(void *ctx)
+{
+    struct thumb_job *job = ctx;
+
+    pthread_mutex_lock(&job->lock);
+    job->need_wakeup = true;
+    pthread_cond_signal(&job->wakeup);
+    pthread_mutex_unlock(&job->lock);
+}
+
+// Return the first video frame the decoder outputs, or NULL on EOF or error.
+static struct mp_image *decode_frame(struct thumb_job *job,
+                                     struct mp_cancel *cancel,
+                                     struct mp_filter *root,
+                                     struct mp_pin *out)
+{
+    while (!mp_cancel_test(cancel)) {
+        struct mp_frame frame = mp_pin_out_read(out);
+        if (frame.type == MP_FRAME_VIDEO) {
+            return frame.data;
+        } else if (frame.type == MP_FRAME_EOF) {
+            break;
+        } else if (frame.type) {
+            mp_frame_unref(&frame);
+        } else if (mp_filter_has_failed(root)) {
+            break;
+        } else if (!mp_filter_graph_run(root)) {
+            pthread_mutex_lock(&job->lock);
+            while (!job->need_wakeup)
+                pthread_cond_wait(&job->wakeup, &job->lock);
+            job->need_wakeup = false;
+            pthread_mutex_unlock(&job->lock);
+        }
+    }
+    return NULL;
+}
+
+static bool store_frame(struct thumbnails *t, struct mp_sws_context *sws,
+                        int slot, struct mp_image *img)
+{
+    if (img->fmt.flags & MP_IMGFLAG_HWACCEL) {
+        struct mp_image *sw = mp_image_hw_download(img, NULL);
+        talloc_free(img);
+        img = sw;
+        if (!img)
+            return false;
+    }
+
+    struct mp_image dst = {0};
+    mp_image_setfmt(&dst, IMGFMT_BGR0);
+    mp_image_set_size(&dst, t->w, t->h);
+    dst.planes[0] = t->data + (size_t)slot * t->h * t->stride;
+    dst.stride[0] = t->stride;
+
+    // Each worker writes only its own slots, so this needs no locking.
+    bool ok = mp_sws_scale(sws, &dst, img) >= 0;
+    double pts = img->pts;
+    talloc_free(img);
+    if (!ok)
+        return false;
+
+    pthread_mutex_lock(&t->lock);
+    t->pts[slot] = pts == MP_NOPTS_VALUE ? t->start + slot * t->interval : pts;
+    t->available++;
+    pthread_mutex_unlock(&t->lock);
+    return true;
+}
+
+static void generate(struct thumb_job *job, struct mp_cancel *cancel)
+{
+    struct thumbnails *t = job->t;
+
+    struct demuxer_params params = {.stream_flags = t->stream_flags};
+    struct demuxer *demuxer = demux_open_url(t->url, &params, cancel, t->global);
+    if (!demuxer)
+        return;
+
+    if (t->rebase_start_time)
+        demux_set_ts_offset(demuxer, -demuxer->start_time);
+
+    struct sh_stream *sh = NULL;
+    for (int n = 0; n < demux_get_num_stream(demuxer); n++) {
+        struct sh_stream *cur = demux_get_stream(demuxer, n);
+        if (cur->type == STREAM_VIDEO && cur->demuxer_id == t->demuxer_id) {
+            sh = cur;
+            break;
+        }
+    }
+    if (!sh)
+        goto done_demux;
+
+    demuxer_select_track(demuxer, sh, MP_NOPTS_VALUE, true);
+
+    struct mp_filter *root = mp_filter_create_root(t->global);
+    mp_filter_graph_set_wakeup_cb(root, wakeup_job, job);
+
+    struct mp_decoder_wrapper *dec = mp_decoder_wrapper_create(root, sh);
+    if (!dec || !mp_decoder_wrapper_reinit(dec))
+        goto done_filters;
+
+    // Only the keyframe at each seek target is needed. With frame threading,
+    // the decoder would consume the following frames before returning it.
+    bool single_thread = true;
+    if (mp_decoder_wrapper_control(dec, VDCTRL_SET_SINGLE_THREAD,
+                                   &single_thread) == CONTROL_ERROR)
+        goto done_filters;
+    mp_decoder_wrapper_set_keyframes_only(dec, true);
+
+    struct mp_sws_context *sws = mp_sws_alloc(root);
+    mp_sws_enable_cmdline_opts(sws, t->global);
+
+    double last_pts = MP_NOPTS_VALUE;
+    for (int slot = job->first; slot < job->last; slot++) {
+        if (mp_cancel_test(cancel))
+            break;
+
+        // A seek always lands on a keyframe, and only the first frame decoded
+        // after it is used.
+        double target = t->start + slot * t->interval;
+        if (!demux_seek(demuxer, target, 0))
+            break;
+        mp_filter_reset(root);
+
+        struct mp_image *img = decode_frame(job, cancel, root, dec->f->pins[0]);
+        if (!img)
+            break;
+
+        // With sparse keyframes, several slots map to the same keyframe;
+        // reuse the scaled image instead of scaling it again.
+        if (img->pts != MP_NOPTS_VALUE && img->pts == last_pts) {
+            talloc_free(img);
+            size_t size = (size_t)t->h * t->stride;
+            memcpy(t->data + slot * size, t->data + (slot - 1) * size, size);
+            pthread_mutex_lock(&t->lock);
+            t->pts[slot] = t->pts[slot - 1];
+            t->available++;
+            pthread_mutex_unlock(&t->lock);
+            continue;
+        }
+        last_pts = img->pts;
+
+        if (!store_frame(t, sws, slot, img)) {
+            MP_WARN(t, "Failed to convert preview image.\n");
+            break;
+        }
+    }
+
+done_filters:
+    talloc_free(root);
+done_demux:
+    demux_free(demuxer);
+}
+
+static void thumb_job_run(void *ctx)
+{
+    struct thumb_job *job = ctx;
+    struct thumbnails *t = job->t;
+
+    pthread_mutex_init(&job->lock, NULL);
+    pthread_cond_init(&job->wakeup, NULL);
+
+    // Private mp_cancel, so the callback can wake up the decode loop.
+    struct mp_cancel *cancel = mp_cancel_new(NULL);
+    mp_cancel_set_parent(cancel, t->cancel);
+    mp_cancel_set_cb(cancel, wakeup_job, job);
+
+    int64_t start = mp_time_us();
+    if (!mp_cancel_test(cancel))
+        generate(job, cancel);
+    MP_VERBOSE(t, "Previews %d-%d done (%.3f s).\n", job->first, job->last - 1,
+               (mp_time_us() - start) / 1e6);
+
+    mp_cancel_set_cb(cancel, NULL, NULL);
+    talloc_free(cancel);
+
+    pthread_cond_destroy(&job->wakeup);
+    pthread_mutex_destroy(&job->lock);
+    talloc_free(job);
+}
+
+static void thumbnails_destroy(void *ptr)
+{
+    struct thumbnails *t = ptr;
+
+    mp_cancel_trigger(t->cancel);
+    // Blocks until all jobs have finished.
+    TA_FREEP(&t->pool);
+    pthread_mutex_destroy(&t->lock);
+}
+
+// Start generating previews for the current file, if enabled.
+void thumbnails_start(struct MPContext *mpctx)
+{
+    struct MPOpts *opts = mpctx->opts;
+
+    thumbnails_stop(mpctx);
+
+    struct track *track = mpctx->current_track[0][STREAM_VIDEO];
+    struct demuxer *demuxer = mpctx->demuxer;
+    if (!opts->thumbnails || mpctx->encode_lavc_ctx || !track ||
+        track->is_external || track->image || track->attached_picture ||
+        !demuxer || !demuxer->seekable || !(demuxer->duration > 0))
+        return;
+
+    struct mp_codec_params *c = track->stream->codec;
+    if (c->disp_w < 1 || c->disp_h < 1) {
+        MP_VERBOSE(mpctx, "Unknown video size, not generating previews.\n");
+        return;
+    }
+    double aspect = c->disp_w / (double)c->disp_h;
+    if (c->par_w > 0 && c->par_h > 0)
+        aspect = aspect * c->par_w / c->par_h;
+
+    struct thumbnails *t = talloc_zero(NULL, struct thumbnails);
+    talloc_set_destructor(t, thumbnails_destroy);
+    t->global = mpctx->global;
+    t->log = mp_log_new(t, mpctx->log, "thumbnails");
+    t->cancel = mp_cancel_new(t);
+    pthread_mutex_init(&t->lock, NULL);
+    t->url = talloc_strdup(t, mpctx->stream_open_filename);
+    t->stream_flags = mpctx->playing->stream_flags;
+    t->demuxer_id = track->stream->demuxer_id;
+    t->rebase_start_time = opts->rebase_start_time;
+
+    t->w = opts->thumbnail_width;
+    t->h = MPCLAMP(lrint(t->w / aspect), 1, t->w * 4);
+    t->stride = MP_ALIGN_UP(t->w * 4, 64);
+
+    // Reduce the number of previews (i.e. increase the interval) until they
+    // fit into the memory limit.
+    size_t size = (size_t)t->h * t->stride;
+    double duration = demuxer->duration;
+    int count = MPMIN(ceil(duration / opts->thumbnail_interval), MAX_THUMBNAILS);
+    count = MPMIN(count, opts->thumbnail_max_bytes / size);
+    if (count < 1) {
+        MP_WARN(mpctx, "--thumbnail-max-bytes is too small.\n");
+        talloc_free(t);
+        return;
+    }
+    t->count = count;
+    t->interval = duration / count;
+    t->start = opts->rebase_start_time ? 0 : demuxer->start_time;
+
+    t->data = talloc_size(t, size * count);
+    t->pts = talloc_array(t, double, count);
+    for (int n = 0; n < count; n++)
+        t->pts[n] = MP_NOPTS_VALUE;
+
+    int threads = MPMIN(opts->thumbnail_threads, count);
+    t->pool = mp_thread_pool_create(t, 0, 0, threads);
+    for (int n = 0; n < threads; n++) {
+        struct thumb_job *job = talloc_ptrtype(NULL, job);
+        *job = (struct thumb_job){
+            .t = t,
+            .first = count * (int64_t)n / threads,
+            .last = count * (int64_t)(n + 1) / threads,
+        };
+        mp_thread_pool_queue(t->pool, thumb_job_run, job);
+    }
+
+    MP_VERBOSE(t, "Generating %d previews of %dx%d every %.1f s.\n", count,
+               t->w, t->h, t->interval);
+    mpctx->thumbnails = t;
+}
+
+void thumbnails_stop(struct MPContext *mpctx)
+{
+    TA_FREEP(&mpctx->thumbnails);
+}
+
+// Copy the preview for the given playback time. Returns NULL if previews are
+// disabled, or the preview for this position is not available yet.
+struct mp_image *thumbnails_get(struct MPContext *mpctx, double time)
+{
+    struct thumbnails *t = mpctx->thumbnails;
+    if (!t || !isfinite(time))
+        return NULL;
+
+    int slot = floor((time - t->start) / t->interval);
+    slot = MPCLAMP(slot, 0, t->count - 1);
+
+    pthread_mutex_lock(&t->lock);
+    double pts = t->pts[slot];
+    pthread_mutex_unlock(&t->lock);
+    if (pts == MP_NOPTS_VALUE)
+        return NULL;
+
+    struct mp_image ref = {0};
+    mp_image_setfmt(&ref, IMGFMT_BGR0);
+    mp_image_set_size(&ref, t->w, t->h);
+    ref.planes[0] = t->data + (size_t)slot * t->h * t->stride;
+    ref.stride[0] = t->stride;
+
+    struct mp_image *img = mp_image_new_copy(&ref);
+    if (img)
+        img->pts = pts;
+    return img;
+}
+
+// Return the generation state; false if previews are disabled.
+bool thumbnails_get_info(struct MPContext *mpctx, struct thumbnails_info *info)
+{
+    struct thumbnails *t = mpctx->thumbnails;
+    if (!t)
+        return false;
+
+    pthread_mutex_lock(&t->lock);
+    *info = (struct thumbnails_info){
+        .w = t->w,
+        .h = t->h,
+        .interval = t->interval,
+        .count = t->count,
+        .available = t->available,
+    };
+    pthread_mutex_unlock(&t->lock);
+    return true;
+}
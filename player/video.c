@@ -30,6 +30,7 @@
 #include "options/m_option.h"
 #include "common/common.h"
 #include "common/encode.h"
+#include "common/stats.h"
 #include "options/m_property.h"
 #include "osdep/timer.h"
 
@@ -102,6 +103,7 @@ void reset_video_state(struct MPContext *mpctx)
         struct track *t = mpctx->vo_chain->track;
         if (t && t->dec)
             mp_decoder_wrapper_set_play_dir(t->dec, mpctx->play_dir);
+        update_video_trick_play(mpctx);
     }
 
     for (int n = 0; n < mpctx->num_next_frames; n++)
@@ -123,6 +125,20 @@ void reset_video_state(struct MPContext *mpctx)
     mpctx->video_status = mpctx->vo_chain ? STATUS_SYNCING : STATUS_EOF;
 }
 
+// Decode only keyframes if the playback speed is at least --trick-play-speed.
+void update_video_trick_play(struct MPContext *mpctx)
+{
+    struct MPOpts *opts = mpctx->opts;
+    struct track *t = mpctx->vo_chain ? mpctx->vo_chain->track : NULL;
+    if (!t || !t->dec)
+        return;
+
+    bool enable = opts->trick_play_speed > 0 && mpctx->play_dir > 0 &&
+                  mpctx->video_speed >= opts->trick_play_speed &&
+                  !mpctx->vo_chain->is_sparse;
+    mp_decoder_wrapper_set_keyframes_only(t->dec, enable);
+}
+
 void uninit_video_out(struct MPContext *mpctx)
 {
     uninit_video_chain(mpctx);
@@ -230,7 +246,9 @@ void reinit_video_chain_src(struct MPContext *mpctx, struct track *track)
             .wakeup_cb = mp_wakeup_core_cb,
             .wakeup_ctx = mpctx,
         };
+        stats_span_begin(mpctx->stats, "vo-init");
         mpctx->video_out = init_best_video_out(mpctx->global, &ex);
+        stats_span_end(mpctx->stats, "vo-init");
         if (!mpctx->video_out) {
             MP_FATAL(mpctx, "Error opening/initializing "
                     "the selected video_out (--vo) device.\n");
@@ -0,0 +1,187 @@
+#include <libavutil/opt.h>
+#include <libswresample/swresample.h>
+
+#include "audio/aframe.h"
+#include "audio/fmt-conversion.h"
+#include "audio/format.h"
+#include "filters/f_aconvert.h"
+#include "osdep/timer.h"
+#include "tests.h"
+
+#define NUM_SAMPLES 48000
+#define NUM_ITER 20
+
+static struct mp_aframe *alloc_frame(int format, struct mp_chmap *chmap)
+{
+    struct mp_aframe *fr = mp_aframe_create();
+    mp_aframe_set_format(fr, format);
+    mp_aframe_set_chmap(fr, chmap);
+    mp_aframe_set_rate(fr, 48000);
+    if (!mp_aframe_alloc_data(fr, NUM_SAMPLES))
+        abort();
+    return fr;
+}
+
+// Deterministic test signal, including values outside of [-1, 1] for floats
+// to exercise clipping.
+static void fill_frame(struct mp_aframe *fr)
+{
+    int format = af_fmt_from_planar(mp_aframe_get_format(fr));
+    int planes = mp_aframe_get_planes(fr);
+    int total = mp_aframe_get_total_plane_samples(fr);
+    uint8_t **data = mp_aframe_get_data_rw(fr);
+    uint32_t seed = 1;
+    for (int p = 0; p < planes; p++) {
+        for (int n = 0; n < total; n++) {
+            seed = seed * 1664525 + 1013904223;
+            switch (format) {
+            case AF_FORMAT_S16:
+                ((int16_t *)data[p])[n] = seed >> 16;
+                break;
+            case AF_FORMAT_S32:
+                ((int32_t *)data[p])[n] = seed;
+                break;
+            case AF_FORMAT_FLOAT:
+                ((float *)data[p])[n] = ((int32_t)seed) / (float)(1 << 30) / 1.8;
+                break;
+            default:
+                abort();
+            }
+        }
+    }
+}
+
+static void compare_frames(struct mp_aframe *a, struct mp_aframe *b)
+{
+    int format = af_fmt_from_planar(mp_aframe_get_format(a));
+    int planes = mp_aframe_get_planes(a);
+    int total = mp_aframe_get_total_plane_samples(a);
+    uint8_t **da = mp_aframe_get_data_ro(a);
+    uint8_t **db = mp_aframe_get_data_ro(b);
+    for (int p = 0; p < planes; p++) {
+        for (int n = 0; n < total; n++) {
+            switch (format) {
+            case AF_FORMAT_S16:
+                assert_true(abs(((int16_t *)da[p])[n] -
+                                ((int16_t *)db[p])[n]) <= 1);
+                break;
+            case AF_FORMAT_S32:
+                assert_true(llabs((int64_t)((int32_t *)da[p])[n] -
+                                  ((int32_t *)db[p])[n]) <= 1);
+                break;
+            case AF_FORMAT_FLOAT:
+                assert_float_equal(((float *)da[p])[n],
+                                   ((float *)db[p])[n], 1e-6);
+                break;
+            }
+        }
+    }
+}
+
+static void test_conversion(struct test_ctx *ctx, int in_fmt, int out_fmt,
+                            struct mp_chmap *chmap)
+{
+    struct mp_aframe *src = alloc_frame(in_fmt, chmap);
+    struct mp_aframe *dst = alloc_frame(out_fmt, chmap);
+    struct mp_aframe *ref = alloc_frame(out_fmt, chmap);
+    fill_frame(src);
+
+    struct SwrContext *swr = swr_alloc();
+    if (!swr)
+        abort();
+    uint64_t layout = mp_chmap_to_lavc(chmap);
+    av_opt_set_int(swr, "in_channel_layout",  layout, 0);
+    av_opt_set_int(swr, "out_channel_layout", layout, 0);
+    av_opt_set_int(swr, "in_sample_rate",     48000, 0);
+    av_opt_set_int(swr, "out_sample_rate",    48000, 0);
+    av_opt_set_int(swr, "in_sample_fmt",      af_to_avformat(in_fmt), 0);
+    av_opt_set_int(swr, "out_sample_fmt",     af_to_avformat(out_fmt), 0);
+    if (swr_init(swr) < 0)
+        abort();
+
+    int64_t t0 = mp_time_us();
+    for (int n = 0; n < NUM_ITER; n++)
+        assert_true(mp_aconvert_frame(dst, src));
+    int64_t t1 = mp_time_us();
+    for (int n = 0; n < NUM_ITER; n++) {
+        int r = swr_convert(swr, mp_aframe_get_data_rw(ref), NUM_SAMPLES,
+                            (const uint8_t **)mp_aframe_get_data_ro(src),
+                            NUM_SAMPLES);
+        assert_int_equal(r, NUM_SAMPLES);
+    }
+    int64_t t2 = mp_time_us();
+
+    compare_frames(dst, ref);
+
+    MP_INFO(ctx, "%s %s -> %s: %.3f ms, swr_convert: %.3f ms\n",
+            mp_chmap_to_str(chmap), af_fmt_to_str(in_fmt),
+            af_fmt_to_str(out_fmt), (t1 - t0) / 1000.0 / NUM_ITER,
+            (t2 - t1) / 1000.0 / NUM_ITER);
+
+    swr_free(&swr);
+    talloc_free(src);
+    talloc_free(dst);
+    talloc_free(ref);
+}
+
+static void test_reorder(void)
+{
+    struct mp_chmap in_map, out_map;
+    assert_true(mp_chmap_from_str(&in_map, bstr0("fl-fr-fc")));
+    assert_true(mp_chmap_from_str(&out_map, bstr0("fc-fl-fr")));
+    assert_true(mp_aconvert_supports(AF_FORMAT_S16, &in_map,
+                                     AF_FORMAT_FLOATP, &out_map));
+
+    struct mp_chmap stereo;
+    assert_true(mp_chmap_from_str(&stereo, bstr0("stereo")));
+    assert_false(mp_aconvert_supports(AF_FORMAT_S16, &in_map,
+                                      AF_FORMAT_S16, &stereo));
+    assert_false(mp_aconvert_supports(AF_FORMAT_DOUBLE, &in_map,
+                                      AF_FORMAT_S16, &in_map));
+
+    struct mp_aframe *src = alloc_frame(AF_FORMAT_S16, &in_map);
+    struct mp_aframe *dst = alloc_frame(AF_FORMAT_S16P, &out_map);
+    int16_t *s = (int16_t *)mp_aframe_get_data_rw(src)[0];
+    for (int n = 0; n < NUM_SAMPLES * 3; n++)
+        s[n] = n % 3 + 1; // fl=1, fr=2, fc=3
+    assert_true(mp_aconvert_frame(dst, src));
+    uint8_t **d = mp_aframe_get_data_ro(dst);
+    for (int n = 0; n < NUM_SAMPLES; n++) {
+        assert_int_equal(((int16_t *)d[0])[n], 3);
+        assert_int_equal(((int16_t *)d[1])[n], 1);
+        assert_int_equal(((int16_t *)d[2])[n], 2);
+    }
+    talloc_free(src);
+    talloc_free(dst);
+}
+
+static void run(struct test_ctx *ctx)
+{
+    static const int fmts[][2] = {
+        {AF_FORMAT_S16,     AF_FORMAT_FLOAT},
+        {AF_FORMAT_FLOAT,   AF_FORMAT_S16},
+        {AF_FORMAT_S16P,    AF_FORMAT_FLOAT},
+        {AF_FORMAT_FLOATP,  AF_FORMAT_S16},
+        {AF_FORMAT_FLOATP,  AF_FORMAT_FLOAT},
+        {AF_FORMAT_FLOAT,   AF_FORMAT_FLOATP},
+        {AF_FORMAT_S32,     AF_FORMAT_FLOATP},
+        {AF_FORMAT_FLOAT,   AF_FORMAT_S32},
+        {AF_FORMAT_S16,     AF_FORMAT_S32P},
+    };
+
+    static const char *layouts[] = {"stereo", "5.1", "7.1"};
+
+    for (int l = 0; l < MP_ARRAY_SIZE(layouts); l++) {
+        struct mp_chmap chmap;
+        assert_true(mp_chmap_from_str(&chmap, bstr0(layouts[l])));
+        for (int n = 0; n < MP_ARRAY_SIZE(fmts); n++)
+            test_conversion(ctx, fmts[n][0], fmts[n][1], &chmap);
+    }
+
+    test_reorder();
+}
+
+const struct unittest test_aconvert = {
+    .name = "aconvert",
+    .run = run,
+};
@@ -1,6 +1,8 @@
 #include "common/common.h"
+#include "common/msg.h"
 #include "misc/json.h"
 #include "misc/node.h"
+#include "osdep/timer.h"
 #include "tests.h"
 
 struct entry {
@@ -39,11 +41,21 @@ static const struct entry entries[] = {
     { "abc", .expect_fail = true},
     { "  123  ", "123", NODE_INT64(123)},
     { "123.25", "123.250000", NODE_FLOAT(123.25)},
+    { "-12", "-12", NODE_INT64(-12)},
+    { "0", "0", NODE_INT64(0)},
+    { "-0.5", "-0.500000", NODE_FLOAT(-0.5)},
+    { "1e2", "100.000000", NODE_FLOAT(100)},
+    { "9223372036854775807", "9223372036854775807", NODE_INT64(INT64_MAX)},
+    { "-9223372036854775808", "-9223372036854775808", NODE_INT64(INT64_MIN)},
     { TEXT("a\n\\\/\\\""), TEXT("a\n\\/\\\""), NODE_STR("a\n\\/\\\"")},
     { TEXT("a\u2c29"), TEXT("aⰩ"), NODE_STR("a\342\260\251")},
     { "[1,2,3]", "[1,2,3]",
         NODE_ARRAY(NODE_INT64(1), NODE_INT64(2), NODE_INT64(3))},
     { "[ ]", "[]", NODE_ARRAY()},
+    { TEXT([1,[2,[]],{"a":[3]},4]), TEXT([1,[2,[]],{"a":[3]},4]),
+        NODE_ARRAY(NODE_INT64(1), NODE_ARRAY(NODE_INT64(2), NODE_ARRAY()),
+                   NODE_MAP(L("a"), L(NODE_ARRAY(NODE_INT64(3)))),
+                   NODE_INT64(4))},
     { "[1,,2]", .expect_fail = true},
     { "[,]", .expect_fail = true},
     { TEXT({"a":1, "b":2}), TEXT({"a":1,"b":2}),
@@ -66,6 +78,81 @@ static const struct entry entries[] = {
 
 #define MAX_DEPTH 10
 
+// Roughly what the "playlist" and "track-list" properties return for big
+// playlists and files with many tracks.
+#define NUM_PLAYLIST 5000
+#define NUM_TRACKS 500
+#define NUM_RUNS 20
+
+static struct mpv_node make_documents(void *ta_parent)
+{
+    struct mpv_node root;
+    node_init(&root, MPV_FORMAT_NODE_MAP, NULL);
+    struct mpv_node *pl = node_map_add(&root, "playlist", MPV_FORMAT_NODE_ARRAY);
+    for (int n = 0; n < NUM_PLAYLIST; n++) {
+        struct mpv_node *e = node_array_add(pl, MPV_FORMAT_NODE_MAP);
+        node_map_add_string(e, "filename", talloc_asprintf(ta_parent,
+                            "/home/user/Music/Some \"Artist\"/Album %d/%02d - "
+                            "Track title.flac", n / 12, n % 12));
+        node_map_add_string(e, "title", "Track title");
+        node_map_add_int64(e, "id", n + 1);
+        node_map_add_flag(e, "current", n == 0);
+    }
+    struct mpv_node *tl = node_map_add(&root, "track-list", MPV_FORMAT_NODE_ARRAY);
+    for (int n = 0; n < NUM_TRACKS; n++) {
+        struct mpv_node *e = node_array_add(tl, MPV_FORMAT_NODE_MAP);
+        node_map_add_int64(e, "id", n / 3 + 1);
+        node_map_add_string(e, "type", n % 3 ? "sub" : "audio");
+        node_map_add_string(e, "lang", "eng");
+        node_map_add_string(e, "codec", n % 3 ? "subrip" : "aac");
+        node_map_add_flag(e, "default", false);
+        node_map_add_flag(e, "selected", n < 2);
+        node_map_add_int64(e, "ff-index", n);
+        node_map_add_int64(e, "demux-samplerate", 48000);
+        node_map_add_double(e, "demux-fps", 23.976);
+    }
+    talloc_steal(ta_parent, root.u.list);
+    return root;
+}
+
+static void benchmark(struct test_ctx *ctx)
+{
+    void *tmp = talloc_new(NULL);
+    struct mpv_node root = make_documents(tmp);
+
+    char *text = NULL;
+    int64_t t0 = mp_time_us();
+    for (int n = 0; n < NUM_RUNS; n++) {
+        talloc_free(text);
+        text = talloc_strdup(tmp, "");
+        assert_true(json_write(&text, &root) >= 0);
+    }
+    int64_t t1 = mp_time_us();
+    bstr out = {0};
+    for (int n = 0; n < NUM_RUNS; n++) {
+        out.len = 0;
+        assert_true(json_write_bstr(tmp, &out, &root) >= 0);
+    }
+    int64_t t2 = mp_time_us();
+    assert_int_equal(out.len, strlen(text));
+    for (int n = 0; n < NUM_RUNS; n++) {
+        void *p = talloc_new(NULL);
+        char *s = talloc_strdup(p, text);
+        struct mpv_node res;
+        assert_true(json_parse(p, &res, &s, MAX_DEPTH) >= 0);
+        if (n == 0)
+            assert_true(equal_mpv_node(&root, &res));
+        talloc_free(p);
+    }
+    int64_t t3 = mp_time_us();
+
+    MP_INFO(ctx, "%zu bytes: write %.2f ms, write_bstr %.2f ms, parse %.2f ms\n",
+            strlen(text), (t1 - t0) / 1e3 / NUM_RUNS,
+            (t2 - t1) / 1e3 / NUM_RUNS, (t3 - t2) / 1e3 / NUM_RUNS);
+
+    talloc_free(tmp);
+}
+
 static void run(struct test_ctx *ctx)
 {
     for (int n = 0; n < MP_ARRAY_SIZE(entries); n++) {
@@ -86,6 +173,8 @@ static void run(struct test_ctx *ctx)
         assert_true(equal_mpv_node(&e->out_data, &res));
         talloc_free(tmp);
     }
+
+    benchmark(ctx);
 }
 
 const struct unittest test_json = {
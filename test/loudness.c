@@ -0,0 +1,92 @@
+#include "audio/aframe.h"
+#include "audio/chmap.h"
+#include "audio/format.h"
+#include "audio/loudness.h"
+#include "tests.h"
+
+#define RATE 48000
+
+// Feed seconds of a 1 kHz stereo sine with the given peak level in dBFS.
+// A level of -INFINITY produces silence.
+static void add_sine(struct mp_loudness *l, double level, int seconds)
+{
+    struct mp_chmap chmap;
+    mp_chmap_from_channels(&chmap, 2);
+    double amp = pow(10.0, level / 20.0);
+
+    for (int s = 0; s < seconds; s++) {
+        struct mp_aframe *fr = mp_aframe_create();
+        mp_aframe_set_format(fr, AF_FORMAT_FLOAT);
+        mp_aframe_set_chmap(fr, &chmap);
+        mp_aframe_set_rate(fr, RATE);
+        if (!mp_aframe_alloc_data(fr, RATE))
+            abort();
+        float *data = (float *)mp_aframe_get_data_rw(fr)[0];
+        for (int n = 0; n < RATE; n++) {
+            // (1 kHz has an integer number of periods per second)
+            float v = amp * sin(2 * M_PI * 1000 * n / RATE);
+            data[n * 2 + 0] = v;
+            data[n * 2 + 1] = v;
+        }
+        assert_true(mp_loudness_add(l, fr));
+        talloc_free(fr);
+    }
+}
+
+static struct mp_loudness *create(void)
+{
+    struct mp_chmap chmap;
+    mp_chmap_from_channels(&chmap, 2);
+    struct mp_loudness *l = mp_loudness_create(NULL, RATE, &chmap);
+    assert_true(l);
+    return l;
+}
+
+static void run(struct test_ctx *ctx)
+{
+    // EBU Tech 3341 case 1: stereo sine at -23 dBFS reads -23 LUFS.
+    struct mp_loudness *l = create();
+    add_sine(l, -23, 20);
+    assert_float_equal(mp_loudness_integrated(l), -23, 0.1);
+    assert_float_equal(mp_loudness_peak(l), pow(10.0, -23 / 20.0), 1e-4);
+    talloc_free(l);
+
+    // EBU Tech 3341 case 4: the -72 dBFS parts are below the absolute gate,
+    // and the -36 dBFS parts below the relative gate.
+    l = create();
+    add_sine(l, -72, 10);
+    add_sine(l, -36, 10);
+    add_sine(l, -23, 60);
+    add_sine(l, -36, 10);
+    add_sine(l, -72, 10);
+    assert_float_equal(mp_loudness_integrated(l), -23, 0.1);
+    talloc_free(l);
+
+    // Silence and input shorter than one block have no loudness.
+    l = create();
+    add_sine(l, -INFINITY, 5);
+    assert_true(mp_loudness_integrated(l) == -HUGE_VAL);
+    assert_float_equal(mp_loudness_peak(l), 0, 0);
+    talloc_free(l);
+
+    l = create();
+    assert_true(mp_loudness_integrated(l) == -HUGE_VAL);
+
+    // Frames not matching the meter's parameters are rejected.
+    struct mp_chmap mono;
+    mp_chmap_from_channels(&mono, 1);
+    struct mp_aframe *fr = mp_aframe_create();
+    mp_aframe_set_format(fr, AF_FORMAT_FLOAT);
+    mp_aframe_set_chmap(fr, &mono);
+    mp_aframe_set_rate(fr, RATE);
+    if (!mp_aframe_alloc_data(fr, 100))
+        abort();
+    assert_false(mp_loudness_add(l, fr));
+    talloc_free(fr);
+    talloc_free(l);
+}
+
+const struct unittest test_loudness = {
+    .name = "loudness",
+    .run = run,
+};
@@ -0,0 +1,146 @@
+#include <pthread.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "common/msg_control.h"
+#include "misc/bstr.h"
+#include "osdep/timer.h"
+#include "tests.h"
+
+#define NUM_THREADS 4
+#define NUM_MESSAGES 20000
+
+struct log_thread {
+    struct mp_log *log;
+    int index;
+    int num;
+};
+
+static void *log_thread(void *p)
+{
+    struct log_thread *t = p;
+    for (int n = 0; n < t->num; n++)
+        mp_msg(t->log, MSGL_DEBUG, "thread %d message %d\n", t->index, n);
+    return NULL;
+}
+
+// Return the next message from a log whose name ends with name, or NULL.
+static struct mp_log_buffer_entry *read_entry(struct mp_log_buffer *buffer,
+                                              const char *name)
+{
+    while (1) {
+        struct mp_log_buffer_entry *e = mp_msg_log_buffer_read(buffer);
+        if (!e || bstr_endswith0(bstr0(e->prefix), name))
+            return e;
+        // Not from the test (or a buffer overflow, which is checked later).
+        assert_true(strcmp(e->prefix, "overflow") != 0);
+        assert_true(!bstr_startswith0(bstr0(e->text), "Log message queue"));
+        talloc_free(e);
+    }
+}
+
+static void check_entry(struct mp_log_buffer *buffer, const char *name,
+                        int level, const char *text)
+{
+    struct mp_log_buffer_entry *e = read_entry(buffer, name);
+    assert_true(e);
+    assert_int_equal(e->level, level);
+    assert_string_equal(e->text, text);
+    talloc_free(e);
+}
+
+// Log from num_threads threads at once, and check that the messages arrive in
+// order. If the logger thread can't keep up, messages are dropped, but the
+// number of dropped messages is reported. Returns messages/second.
+static double run_threads(struct test_ctx *ctx, struct mp_log *log,
+                          int num_threads)
+{
+    int num = NUM_THREADS * NUM_MESSAGES / num_threads;
+    struct mp_log_buffer *buffer =
+        mp_msg_log_buffer_new(ctx->global, num * num_threads + 1000,
+                              MSGL_DEBUG, NULL, NULL);
+
+    pthread_t threads[NUM_THREADS];
+    struct log_thread t[NUM_THREADS];
+
+    int64_t start = mp_time_us();
+    for (int n = 0; n < num_threads; n++) {
+        t[n] = (struct log_thread){log, n, num};
+        assert_true(!pthread_create(&threads[n], NULL, log_thread, &t[n]));
+    }
+    for (int n = 0; n < num_threads; n++)
+        pthread_join(threads[n], NULL);
+    mp_msg_flush(ctx->global);
+    int64_t end = mp_time_us();
+
+    int next[NUM_THREADS] = {0};
+    unsigned long received = 0, dropped = 0;
+    struct mp_log_buffer_entry *e;
+    while ((e = mp_msg_log_buffer_read(buffer))) {
+        assert_true(strcmp(e->prefix, "overflow") != 0);
+        unsigned long count;
+        int index, msg;
+        if (sscanf(e->text, "Log message queue overflow: %lu", &count) == 1) {
+            dropped += count;
+        } else if (bstr_endswith0(bstr0(e->prefix), "msgtest")) {
+            assert_int_equal(sscanf(e->text, "thread %d message %d",
+                                    &index, &msg), 2);
+            assert_true(index >= 0 && index < num_threads);
+            assert_true(msg >= next[index] && msg < num);
+            next[index] = msg + 1;
+            received += 1;
+        }
+        talloc_free(e);
+    }
+    // (Messages from elsewhere could have been dropped too.)
+    assert_true(received + dropped >= num * num_threads);
+
+    mp_msg_log_buffer_destroy(buffer);
+
+    return num * num_threads / ((end - start) / 1e6);
+}
+
+static void run(struct test_ctx *ctx)
+{
+    void *tmp = talloc_new(NULL);
+
+    struct mp_log *log = mp_log_new(tmp, ctx->log, "msgtest");
+    struct mp_log_buffer *buffer =
+        mp_msg_log_buffer_new(ctx->global, 100, MSGL_DEBUG, NULL, NULL);
+
+    mp_msg(log, MSGL_DEBUG, "partial ");
+    mp_msg(log, MSGL_V, "line\n");
+    mp_msg(log, MSGL_DEBUG, "two\nlines\n");
+    char long_text[1001];
+    memset(long_text, 'x', 999);
+    long_text[999] = '\n';
+    long_text[1000] = '\0';
+    mp_msg(log, MSGL_DEBUG, "%s", long_text);
+
+    // Queued messages must not reference the mp_log.
+    struct mp_log *tmp_log = mp_log_new(NULL, log, "tmp");
+    mp_msg(tmp_log, MSGL_DEBUG, "from a destroyed log\n");
+    talloc_free(tmp_log);
+
+    mp_msg_flush(ctx->global);
+
+    check_entry(buffer, "msgtest", MSGL_V, "partial line\n");
+    check_entry(buffer, "msgtest", MSGL_DEBUG, "two\n");
+    check_entry(buffer, "msgtest", MSGL_DEBUG, "lines\n");
+    check_entry(buffer, "msgtest", MSGL_DEBUG, long_text);
+    check_entry(buffer, "msgtest/tmp", MSGL_DEBUG, "from a destroyed log\n");
+    assert_true(!read_entry(buffer, "msgtest"));
+    mp_msg_log_buffer_destroy(buffer);
+
+    double single = run_threads(ctx, log, 1);
+    double multi = run_threads(ctx, log, NUM_THREADS);
+    MP_INFO(ctx, "1 thread: %.0f messages/s, %d threads: %.0f messages/s\n",
+            single, NUM_THREADS, multi);
+
+    talloc_free(tmp);
+}
+
+const struct unittest test_msg = {
+    .name = "msg",
+    .run = run,
+};
@@ -0,0 +1,196 @@
+#include "common/common.h"
+#include "common/msg.h"
+#include "misc/json.h"
+#include "misc/msgpack.h"
+#include "misc/node.h"
+#include "osdep/timer.h"
+#include "tests.h"
+
+struct entry {
+    const char *data;
+    int len;
+    struct mpv_node out_data;
+    bool expect_fail;
+};
+
+#define BYTES(s) s, sizeof(s) - 1
+
+#define VAL_LIST(...) (struct mpv_node[]){__VA_ARGS__}
+
+#define L(...) __VA_ARGS__
+
+#define NODE_INT64(v) {.format = MPV_FORMAT_INT64,  .u = { .int64 = (v) }}
+#define NODE_STR(v)   {.format = MPV_FORMAT_STRING, .u = { .string = (v) }}
+#define NODE_BOOL(v)  {.format = MPV_FORMAT_FLAG,   .u = { .flag = (bool)(v) }}
+#define NODE_FLOAT(v) {.format = MPV_FORMAT_DOUBLE, .u = { .double_ = (v) }}
+#define NODE_NONE()   {.format = MPV_FORMAT_NONE }
+#define NODE_ARRAY(...) {.format = MPV_FORMAT_NODE_ARRAY, .u = { .list =    \
+    &(struct mpv_node_list) {                                               \
+        .num = sizeof(VAL_LIST(__VA_ARGS__)) / sizeof(struct mpv_node),     \
+        .values = VAL_LIST(__VA_ARGS__)}}}
+#define NODE_MAP(k, v) {.format = MPV_FORMAT_NODE_MAP, .u = { .list =       \
+    &(struct mpv_node_list) {                                               \
+        .num = sizeof(VAL_LIST(v)) / sizeof(struct mpv_node),               \
+        .values = VAL_LIST(v),                                              \
+        .keys = (char**)(const char *[]){k}}}}
+
+// Entries which don't set expect_fail must be in the encoding the writer
+// produces, so they are also checked byte for byte after a round trip.
+static const struct entry entries[] = {
+    { BYTES("\xc0"), NODE_NONE()},
+    { BYTES("\xc3"), NODE_BOOL(true)},
+    { BYTES("\xc2"), NODE_BOOL(false)},
+    { BYTES("\x7f"), NODE_INT64(127)},
+    { BYTES("\xe0"), NODE_INT64(-32)},
+    { BYTES("\xcc\x80"), NODE_INT64(128)},
+    { BYTES("\xcd\x01\x00"), NODE_INT64(256)},
+    { BYTES("\xce\x00\x01\x00\x00"), NODE_INT64(65536)},
+    { BYTES("\xcf\x7f\xff\xff\xff\xff\xff\xff\xff"), NODE_INT64(INT64_MAX)},
+    { BYTES("\xd0\xdf"), NODE_INT64(-33)},
+    { BYTES("\xd1\xff\x7f"), NODE_INT64(-129)},
+    { BYTES("\xd3\x80\x00\x00\x00\x00\x00\x00\x00"), NODE_INT64(INT64_MIN)},
+    { BYTES("\xcb\x40\x5e\xd0\x00\x00\x00\x00\x00"), NODE_FLOAT(123.25)},
+    { BYTES("\xa3""abc"), NODE_STR("abc")},
+    { BYTES("\xa0"), NODE_STR("")},
+    { BYTES("\x93\x01\x02\x03"),
+        NODE_ARRAY(NODE_INT64(1), NODE_INT64(2), NODE_INT64(3))},
+    { BYTES("\x90"), NODE_ARRAY()},
+    { BYTES("\x82\xa1""a\x01\xa1""b\x92\xc0\xc3"),
+        NODE_MAP(L("a", "b"), L(NODE_INT64(1),
+                                NODE_ARRAY(NODE_NONE(), NODE_BOOL(true))))},
+    { BYTES("\x80"), NODE_MAP(L(), L())},
+    { BYTES("\x92\x91\x01\x02"),
+        NODE_ARRAY(NODE_ARRAY(NODE_INT64(1)), NODE_INT64(2))},
+
+    { BYTES(""), .expect_fail = true},
+    { BYTES("\xc1"), .expect_fail = true},
+    { BYTES("\xd4\x01\x00"), .expect_fail = true},          // ext
+    { BYTES("\xcf\x80\x00\x00\x00\x00\x00\x00\x00"), .expect_fail = true},
+    { BYTES("\xa3""ab"), .expect_fail = true},              // truncated
+    { BYTES("\xa2""a\0"), .expect_fail = true},             // embedded 0
+    { BYTES("\x92\x01"), .expect_fail = true},
+    { BYTES("\xdd\xff\xff\xff\xff\x01"), .expect_fail = true},
+    { BYTES("\x81\x01\x02"), .expect_fail = true},          // non-string key
+    { BYTES("\x92\x92\x01\x02"), .expect_fail = true},      // exceeds input
+    { BYTES("\x91\x91\x91\x91\x91\x91\x91\x91\x91\x91\x90"),
+        .expect_fail = true},                               // too deep
+};
+
+#define MAX_DEPTH 10
+
+// Roughly what the "playlist" property returns for a big playlist.
+#define NUM_PLAYLIST 5000
+#define NUM_RUNS 20
+
+static struct mpv_node make_playlist(void *ta_parent)
+{
+    struct mpv_node root;
+    node_init(&root, MPV_FORMAT_NODE_ARRAY, NULL);
+    for (int n = 0; n < NUM_PLAYLIST; n++) {
+        struct mpv_node *e = node_array_add(&root, MPV_FORMAT_NODE_MAP);
+        node_map_add_string(e, "filename", talloc_asprintf(ta_parent,
+                            "/home/user/Music/Some Artist/Album %d/%02d - "
+                            "Track title.flac", n / 12, n % 12));
+        node_map_add_string(e, "title", "Track title");
+        node_map_add_int64(e, "id", n + 1);
+        node_map_add_flag(e, "current", n == 0);
+        node_map_add_double(e, "duration", 123.456 + n);
+    }
+    talloc_steal(ta_parent, root.u.list);
+    return root;
+}
+
+static void benchmark(struct test_ctx *ctx)
+{
+    void *tmp = talloc_new(NULL);
+    struct mpv_node root = make_playlist(tmp);
+
+    char *json = NULL;
+    bstr mp = {0};
+
+    int64_t t0 = mp_time_us();
+    for (int n = 0; n < NUM_RUNS; n++) {
+        talloc_free(json);
+        json = talloc_strdup(tmp, "");
+        json_write(&json, &root);
+    }
+    int64_t t1 = mp_time_us();
+    for (int n = 0; n < NUM_RUNS; n++) {
+        mp.len = 0;
+        assert_true(msgpack_write(tmp, &mp, &root) >= 0);
+    }
+    int64_t t2 = mp_time_us();
+    for (int n = 0; n < NUM_RUNS; n++) {
+        void *p = talloc_new(NULL);
+        char *s = talloc_strdup(p, json);
+        struct mpv_node res;
+        assert_true(json_parse(p, &res, &s, MAX_DEPTH) >= 0);
+        talloc_free(p);
+    }
+    int64_t t3 = mp_time_us();
+    for (int n = 0; n < NUM_RUNS; n++) {
+        void *p = talloc_new(NULL);
+        bstr s = mp;
+        struct mpv_node res;
+        assert_true(msgpack_parse(p, &res, &s, MAX_DEPTH) >= 0);
+        assert_int_equal(s.len, 0);
+        if (n == 0)
+            assert_true(equal_mpv_node(&root, &res));
+        talloc_free(p);
+    }
+    int64_t t4 = mp_time_us();
+
+    MP_INFO(ctx, "size: json %zu, msgpack %zu bytes\n", strlen(json), mp.len);
+    MP_INFO(ctx, "encode ms: json %.2f, msgpack %.2f\n",
+            (t1 - t0) / 1e3 / NUM_RUNS, (t2 - t1) / 1e3 / NUM_RUNS);
+    MP_INFO(ctx, "decode ms: json %.2f, msgpack %.2f\n",
+            (t3 - t2) / 1e3 / NUM_RUNS, (t4 - t3) / 1e3 / NUM_RUNS);
+
+    talloc_free(tmp);
+}
+
+static void run(struct test_ctx *ctx)
+{
+    for (int n = 0; n < MP_ARRAY_SIZE(entries); n++) {
+        const struct entry *e = &entries[n];
+        void *tmp = talloc_new(NULL);
+        bstr s = {(unsigned char *)e->data, e->len};
+        struct mpv_node res;
+        bool ok = msgpack_parse(tmp, &res, &s, MAX_DEPTH) >= 0;
+        assert_true(ok != e->expect_fail);
+        if (!ok) {
+            talloc_free(tmp);
+            continue;
+        }
+        assert_int_equal(s.len, 0);
+        assert_true(equal_mpv_node(&e->out_data, &res));
+        bstr d = {0};
+        assert_true(msgpack_write(tmp, &d, &res) >= 0);
+        assert_int_equal(d.len, e->len);
+        assert_memcmp(d.start, e->data, e->len);
+        talloc_free(tmp);
+    }
+
+    // Types which JSON can't represent.
+    void *tmp = talloc_new(NULL);
+    unsigned char bin[300] = {0, 1, 2};
+    struct mpv_byte_array ba = {bin, sizeof(bin)};
+    struct mpv_node in = {.format = MPV_FORMAT_BYTE_ARRAY, .u.ba = &ba};
+    bstr d = {0};
+    assert_true(msgpack_write(tmp, &d, &in) >= 0);
+    assert_int_equal(d.len, 3 + sizeof(bin));
+    assert_int_equal(d.start[0], 0xc5);
+    struct mpv_node res;
+    assert_true(msgpack_parse(tmp, &res, &d, MAX_DEPTH) >= 0);
+    assert_int_equal(res.format, MPV_FORMAT_BYTE_ARRAY);
+    assert_int_equal(res.u.ba->size, sizeof(bin));
+    assert_memcmp(res.u.ba->data, bin, sizeof(bin));
+    talloc_free(tmp);
+
+    benchmark(ctx);
+}
+
+const struct unittest test_msgpack = {
+    .name = "msgpack",
+    .run = run,
+};
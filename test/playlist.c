@@ -0,0 +1,125 @@
+#include "common/common.h"
+#include "common/playlist.h"
+#include "tests.h"
+
+#define NUM_ENTRIES 500
+#define NUM_OPS 2000
+
+static uint32_t rnd(uint32_t *state)
+{
+    *state = *state * 1664525 + 1013904223;
+    return *state >> 8;
+}
+
+// Compare the playlist against a plain array of the expected entries.
+static void check(struct playlist *pl, struct playlist_entry **ref, int num)
+{
+    assert_int_equal(playlist_entry_count(pl), num);
+    struct playlist_entry *e = playlist_get_first(pl);
+    for (int n = 0; n < num; n++) {
+        assert_true(e == ref[n]);
+        assert_true(playlist_entry_from_index(pl, n) == ref[n]);
+        assert_int_equal(playlist_entry_to_index(pl, ref[n]), n);
+        e = playlist_entry_get_rel(e, 1);
+    }
+    assert_true(!e);
+    assert_true(playlist_get_last(pl) == (num ? ref[num - 1] : NULL));
+    assert_true(!playlist_entry_from_index(pl, num));
+}
+
+static void run(struct test_ctx *ctx)
+{
+    void *tmp = talloc_new(NULL);
+    struct playlist *pl = talloc_zero(tmp, struct playlist);
+    struct playlist_entry **ref = NULL;
+    int num_ref = 0;
+    uint32_t seed = 1;
+
+    for (int n = 0; n < NUM_ENTRIES; n++) {
+        struct playlist_entry *e = playlist_entry_new("file");
+        playlist_add(pl, e);
+        MP_TARRAY_APPEND(tmp, ref, num_ref, e);
+    }
+    check(pl, ref, num_ref);
+
+    for (int n = 0; n < NUM_OPS; n++) {
+        int i = num_ref ? rnd(&seed) % num_ref : 0;
+        switch (rnd(&seed) % 4) {
+        case 0:
+            if (!num_ref)
+                break;
+            playlist_remove(pl, ref[i]);
+            MP_TARRAY_REMOVE_AT(ref, num_ref, i);
+            break;
+        case 1: {
+            if (!num_ref)
+                break;
+            int j = rnd(&seed) % (num_ref + 1);
+            struct playlist_entry *e = ref[i];
+            playlist_move(pl, e, j < num_ref ? ref[j] : NULL);
+            if (j > i)
+                j -= 1;
+            MP_TARRAY_REMOVE_AT(ref, num_ref, i);
+            MP_TARRAY_INSERT_AT(tmp, ref, num_ref, j, e);
+            break;
+        }
+        case 2: {
+            struct playlist *src = talloc_zero(tmp, struct playlist);
+            int count = rnd(&seed) % 8;
+            for (int c = 0; c < count; c++)
+                playlist_add_file(src, "new");
+            pl->current = num_ref ? ref[i] : NULL;
+            int at = num_ref ? i + 1 : 0;
+            struct playlist_entry *first = playlist_get_first(src);
+            for (int c = 0; c < count; c++) {
+                MP_TARRAY_INSERT_AT(tmp, ref, num_ref, at + c,
+                                    playlist_entry_from_index(src, c));
+            }
+            int64_t id = playlist_transfer_entries(pl, src);
+            assert_int_equal(id, first ? first->id : 0);
+            assert_int_equal(playlist_entry_count(src), 0);
+            pl->current = NULL;
+            break;
+        }
+        case 3:
+            if (n % 50)
+                break;
+            playlist_shuffle(pl);
+            playlist_unshuffle(pl);
+            break;
+        }
+        check(pl, ref, num_ref);
+    }
+
+    playlist_shuffle(pl);
+    for (int n = 0; n < num_ref; n++)
+        ref[n] = playlist_entry_from_index(pl, n);
+    check(pl, ref, num_ref);
+
+    playlist_clear(pl);
+    check(pl, ref, 0);
+
+    // Removing from the front and appending at the end is what a client
+    // cycling through a playlist does.
+    num_ref = 0;
+    for (int n = 0; n < NUM_ENTRIES; n++) {
+        struct playlist_entry *e = playlist_entry_new("file");
+        playlist_add(pl, e);
+        MP_TARRAY_APPEND(tmp, ref, num_ref, e);
+    }
+    for (int n = 0; n < NUM_ENTRIES * 2; n++) {
+        playlist_remove(pl, ref[0]);
+        MP_TARRAY_REMOVE_AT(ref, num_ref, 0);
+        struct playlist_entry *e = playlist_entry_new("file");
+        playlist_add(pl, e);
+        MP_TARRAY_APPEND(tmp, ref, num_ref, e);
+    }
+    check(pl, ref, num_ref);
+
+    talloc_free(tmp);
+}
+
+const struct unittest test_playlist = {
+    .name = "playlist",
+    .run = run,
+};
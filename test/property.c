@@ -0,0 +1,124 @@
+#include "common/common.h"
+#include "common/msg.h"
+#include "misc/node.h"
+#include "options/m_option.h"
+#include "options/m_property.h"
+#include "osdep/timer.h"
+#include "tests.h"
+
+// Roughly the size of the player's property table (manual properties plus
+// the option bridge).
+#define NUM_PROPS 1200
+#define NUM_GETS 200000
+
+static int prop_call(void *ctx, struct m_property *prop, int action, void *arg)
+{
+    int v = (intptr_t)prop->priv;
+    if (action == M_PROPERTY_KEY_ACTION) {
+        struct m_property_action_arg *ka = arg;
+        if (strcmp(ka->key, "double") != 0)
+            return M_PROPERTY_UNKNOWN;
+        return m_property_int_ro(ka->action, ka->arg, v * 2);
+    }
+    return m_property_int_ro(action, arg, v);
+}
+
+static int get_list_item(int item, int action, void *arg, void *ctx)
+{
+    return m_property_int_ro(action, arg, item * 10);
+}
+
+static void check_range(const char *key, int first, int num)
+{
+    struct mpv_node node;
+    struct m_property_action_arg ka = {key, M_PROPERTY_GET, &node};
+    assert_int_equal(m_property_read_list(M_PROPERTY_KEY_ACTION, &ka, 5,
+                                          get_list_item, NULL), M_PROPERTY_OK);
+    assert_int_equal(node.format, MPV_FORMAT_NODE_ARRAY);
+    assert_int_equal(node.u.list->num, num);
+    for (int n = 0; n < num; n++)
+        assert_int_equal(node.u.list->values[n].u.int64, (first + n) * 10);
+    talloc_free(node.u.list);
+}
+
+static void run(struct test_ctx *ctx)
+{
+    void *ta_ctx = talloc_new(NULL);
+
+    struct m_property *list = talloc_zero_array(ta_ctx, struct m_property,
+                                                NUM_PROPS + 1);
+    char **names = talloc_array(ta_ctx, char *, NUM_PROPS);
+    for (int n = 0; n < NUM_PROPS; n++) {
+        names[n] = talloc_asprintf(ta_ctx, "property-%d", n);
+        list[n] = (struct m_property){
+            .name = names[n],
+            .call = prop_call,
+            .priv = (void *)(intptr_t)n,
+        };
+    }
+
+    struct m_property_index *index = m_property_index_create(ta_ctx, list);
+
+    for (int n = 0; n < NUM_PROPS; n++) {
+        assert_true(m_property_index_find(index, bstr0(names[n])) == &list[n]);
+        assert_true(m_property_list_find(list, names[n]) == &list[n]);
+    }
+    assert_true(!m_property_index_find(index, bstr0("property-")));
+    assert_true(!m_property_index_find(index, bstr0("")));
+
+    struct m_property_handle h;
+    assert_true(m_property_resolve(index, "property-7/double", &h));
+    assert_true(h.prop == &list[7]);
+    assert_string_equal(h.key, "double");
+    int v = 0;
+    assert_int_equal(m_property_do_handle(NULL, &h, M_PROPERTY_GET, &v, NULL),
+                     M_PROPERTY_OK);
+    assert_int_equal(v, 14);
+    assert_false(m_property_resolve(index, "nonexistent/double", &h));
+    assert_int_equal(m_property_do_handle(NULL, &h, M_PROPERTY_GET, &v, NULL),
+                     M_PROPERTY_UNKNOWN);
+
+    char *s = m_property_index_expand_string(index,
+                        "${property-3} ${=property-4/double} ${nonexistent:x}", NULL);
+    assert_string_equal(s, "3 8 x");
+    talloc_free(s);
+
+    check_range("range/1/2", 1, 2);
+    check_range("range/3/100", 3, 2);
+    check_range("range/9/1", 5, 0);
+    struct m_property_action_arg ka = {"range/1", M_PROPERTY_GET, &v};
+    assert_int_equal(m_property_read_list(M_PROPERTY_KEY_ACTION, &ka, 5,
+                                          get_list_item, NULL),
+                     M_PROPERTY_UNKNOWN);
+
+    // Access the properties at the end of the table, which is the worst case
+    // for the linear lookup.
+    const char *name = names[NUM_PROPS - 1];
+
+    int64_t t0 = mp_time_us();
+    for (int n = 0; n < NUM_GETS; n++)
+        m_property_do(NULL, list, name, M_PROPERTY_GET, &v, NULL);
+    int64_t t1 = mp_time_us();
+    for (int n = 0; n < NUM_GETS; n++) {
+        m_property_resolve(index, name, &h);
+        m_property_do_handle(NULL, &h, M_PROPERTY_GET, &v, NULL);
+    }
+    int64_t t2 = mp_time_us();
+    m_property_resolve(index, name, &h);
+    for (int n = 0; n < NUM_GETS; n++)
+        m_property_do_handle(NULL, &h, M_PROPERTY_GET, &v, NULL);
+    int64_t t3 = mp_time_us();
+    assert_int_equal(v, NUM_PROPS - 1);
+
+    MP_INFO(ctx, "gets/sec: list %.0f, index %.0f, handle %.0f\n",
+            NUM_GETS / MPMAX((t1 - t0) / 1e6, 1e-6),
+            NUM_GETS / MPMAX((t2 - t1) / 1e6, 1e-6),
+            NUM_GETS / MPMAX((t3 - t2) / 1e6, 1e-6));
+
+    talloc_free(ta_ctx);
+}
+
+const struct unittest test_property = {
+    .name = "property",
+    .run = run,
+};
@@ -0,0 +1,263 @@
+#include <pthread.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "common/stats.h"
+#include "common/stats_file.h"
+#include "misc/node.h"
+#include "options/path.h"
+#include "osdep/timer.h"
+#include "tests.h"
+
+static struct mpv_node *get_field(struct mpv_node *map, const char *key)
+{
+    assert_int_equal(map->format, MPV_FORMAT_NODE_MAP);
+    struct mpv_node_list *list = map->u.list;
+    for (int n = 0; n < list->num; n++) {
+        if (strcmp(list->keys[n], key) == 0)
+            return &list->values[n];
+    }
+    assert_true(false);
+    return NULL;
+}
+
+static void check_event(struct mpv_node *ev, const char *name, const char *ph,
+                        int64_t *tid, int64_t *ts)
+{
+    assert_string_equal(get_field(ev, "name")->u.string, name);
+    assert_string_equal(get_field(ev, "cat")->u.string, "test");
+    assert_string_equal(get_field(ev, "ph")->u.string, ph);
+    *tid = get_field(ev, "tid")->u.int64;
+    int64_t t = get_field(ev, "ts")->u.int64;
+    assert_true(t >= *ts);
+    *ts = t;
+}
+
+static void *thread_fn(void *arg)
+{
+    struct stats_ctx *stats = arg;
+    stats_span_begin(stats, "other");
+    stats_span_end(stats, "other");
+    return NULL;
+}
+
+#define NUM_EVENTS 1000000
+
+static void *handle_thread_fn(void *arg)
+{
+    struct stats_handle *h = arg;
+    for (int n = 0; n < NUM_EVENTS; n++)
+        stats_handle_event(h);
+    return NULL;
+}
+
+// Return the value of the entry with the given name.
+static double query_value(struct mpv_node *res, const char *name)
+{
+    for (int n = 0; n < res->u.list->num; n++) {
+        struct mpv_node *e = &res->u.list->values[n];
+        if (strcmp(get_field(e, "name")->u.string, name) == 0)
+            return get_field(e, "value")->u.double_;
+    }
+    assert_true(false);
+    return 0;
+}
+
+static void test_handles(struct test_ctx *ctx, struct stats_ctx *stats)
+{
+    struct mpv_node res;
+    stats_global_query(ctx->global, &res); // enable stats
+    talloc_free(res.u.list);
+
+    struct stats_handle *h1 = stats_handle_create(stats, "events");
+    struct stats_handle *h2 = stats_handle_create(stats, "events");
+    pthread_t thread;
+    assert_int_equal(pthread_create(&thread, NULL, handle_thread_fn, h2), 0);
+    handle_thread_fn(h1);
+    pthread_join(thread, NULL);
+
+    struct stats_handle *lat = stats_handle_create(stats, "latency");
+    for (int n = 1; n <= 1000; n++)
+        stats_handle_latency(lat, n);
+
+    stats_global_query(ctx->global, &res);
+    assert_int_equal(query_value(&res, "test/events"), 2 * NUM_EVENTS);
+    assert_int_equal(query_value(&res, "test/latency/count"), 1000);
+    assert_float_equal(query_value(&res, "test/latency/max"), 1.0, 1e-9);
+    double p50 = query_value(&res, "test/latency/p50") * 1e3;
+    double p99 = query_value(&res, "test/latency/p99") * 1e3;
+    assert_true(p50 >= 500 && p50 <= 500 * 1.25);
+    assert_true(p99 >= 990 && p99 <= 1000);
+    talloc_free(res.u.list);
+
+    // Only changes since the previous query are reported.
+    stats_handle_event(h1);
+    stats_global_query(ctx->global, &res);
+    assert_int_equal(query_value(&res, "test/events"), 1);
+    talloc_free(res.u.list);
+
+    int64_t t0 = mp_time_us();
+    for (int n = 0; n < NUM_EVENTS; n++)
+        stats_event(stats, "by-name");
+    int64_t t1 = mp_time_us();
+    for (int n = 0; n < NUM_EVENTS; n++)
+        stats_handle_event(h1);
+    int64_t t2 = mp_time_us();
+
+    MP_INFO(ctx, "event ns: by name %.1f, with handle %.1f\n",
+            (t1 - t0) * 1e3 / NUM_EVENTS, (t2 - t1) * 1e3 / NUM_EVENTS);
+}
+
+static void record(struct mp_stats_file *sf, const char *format, ...)
+{
+    va_list va;
+    va_start(va, format);
+    mp_stats_file_record(sf, format, va);
+    va_end(va);
+}
+
+#define NUM_RECORDS 100000
+
+static void *record_thread_fn(void *arg)
+{
+    struct mp_stats_file *sf = arg;
+    for (int n = 0; n < NUM_RECORDS; n++) {
+        record(sf, "start %s", "work");
+        record(sf, "value %f thread-value", (double)n);
+        record(sf, "end work");
+    }
+    return NULL;
+}
+
+static void test_stats_file(struct test_ctx *ctx)
+{
+    void *tmp = talloc_new(NULL);
+    char *path = mp_path_join(tmp, ctx->out_path, "stats.bin");
+
+    struct mp_stats_file *sf = mp_stats_file_create();
+    assert_true(sf);
+    record(sf, "not-recorded");
+    assert_true(mp_stats_file_set_path(sf, path));
+
+    int64_t t0 = mp_time_us();
+    pthread_t thread;
+    assert_int_equal(pthread_create(&thread, NULL, record_thread_fn, sf), 0);
+    record_thread_fn(sf);
+    pthread_join(thread, NULL);
+    int64_t t1 = mp_time_us();
+    record(sf, "mistimed");
+    record(sf, "value-timed %d %f x", 123, 1.5);
+
+    assert_true(mp_stats_file_set_path(sf, NULL));
+    mp_stats_file_destroy(sf);
+
+    MP_INFO(ctx, "record ns: %.1f\n", (t1 - t0) * 1e3 / (NUM_RECORDS * 3.0));
+
+    FILE *f = fopen(path, "rb");
+    assert_true(f);
+    struct mp_stats_file_header header;
+    assert_int_equal(fread(&header, sizeof(header), 1, f), 1);
+    assert_memcmp(header.magic, MP_STATS_FILE_MAGIC, 8);
+    assert_int_equal(header.version, MP_STATS_FILE_VERSION);
+    assert_int_equal(header.record_size, sizeof(struct mp_stats_record));
+
+    char *names[8] = {0};
+    int counts[MP_STATS_DROPPED + 1] = {0};
+    double dropped = 0;
+    uint32_t tids = 0;
+    struct mp_stats_record rec;
+    while (fread(&rec, sizeof(rec), 1, f) == 1) {
+        int type = MP_STATS_RECORD_TYPE(rec.id);
+        int index = MP_STATS_RECORD_INDEX(rec.id);
+        assert_true(type >= MP_STATS_SIGNAL && type <= MP_STATS_DROPPED);
+        counts[type] += 1;
+        if (type == MP_STATS_NAME || type == MP_STATS_TEXT) {
+            char buf[64] = {0};
+            int len = rec.value;
+            assert_true(len < sizeof(buf));
+            assert_int_equal(fread(buf, (len + 7) & ~7, 1, f), 1);
+            if (type == MP_STATS_NAME) {
+                assert_true(index < MP_ARRAY_SIZE(names));
+                names[index] = talloc_strdup(tmp, buf);
+            } else {
+                assert_string_equal(buf, "value-timed 123 1.500000 x");
+            }
+        }
+        if (type == MP_STATS_DROPPED)
+            dropped += rec.value;
+        if (type == MP_STATS_START)
+            tids |= 1 << rec.tid;
+    }
+    fclose(f);
+
+    // The loops above produce records faster than they can be written, so
+    // some are dropped, but they must be accounted for.
+    MP_INFO(ctx, "dropped: %.0f\n", dropped);
+    assert_int_equal(counts[MP_STATS_START] + counts[MP_STATS_END] +
+                     counts[MP_STATS_VALUE] + dropped, 6 * NUM_RECORDS);
+    assert_int_equal(counts[MP_STATS_SIGNAL], 1);
+    assert_int_equal(counts[MP_STATS_TEXT], 1);
+    assert_int_equal(counts[MP_STATS_NAME], 3);
+    assert_int_equal(tids, 3);
+    assert_string_equal(names[0], "work");
+    assert_string_equal(names[1], "thread-value");
+
+    talloc_free(tmp);
+}
+
+static void run(struct test_ctx *ctx)
+{
+    void *tmp = talloc_new(NULL);
+    struct stats_ctx *stats = stats_ctx_create(tmp, ctx->global, "test");
+
+    // Nothing is recorded unless tracing is enabled.
+    stats_span_begin(stats, "outer");
+    stats_span_end(stats, "outer");
+    stats_trace_stop(ctx->global, NULL, NULL);
+    struct mpv_node trace;
+    assert_false(stats_trace_stop(ctx->global, tmp, &trace));
+
+    stats_trace_start(ctx->global);
+    stats_span_begin(stats, "outer");
+    stats_span_begin(stats, "inner");
+    stats_span_begin(stats, "outer"); // recursion
+    stats_span_end(stats, "outer");
+    stats_trace_mark(stats, "mark");
+    stats_span_end(stats, "inner");
+    stats_span_end(stats, "outer");
+
+    pthread_t thread;
+    assert_int_equal(pthread_create(&thread, NULL, thread_fn, stats), 0);
+    pthread_join(thread, NULL);
+
+    assert_true(stats_trace_stop(ctx->global, tmp, &trace));
+    assert_false(stats_trace_stop(ctx->global, NULL, NULL));
+
+    struct mpv_node *events = get_field(&trace, "traceEvents");
+    assert_int_equal(events->format, MPV_FORMAT_NODE_ARRAY);
+    struct mpv_node_list *list = events->u.list;
+    assert_int_equal(list->num, 9);
+
+    static const char *const expect[][2] = {
+        {"outer", "B"}, {"inner", "B"}, {"outer", "B"}, {"outer", "E"},
+        {"mark", "i"}, {"inner", "E"}, {"outer", "E"},
+        {"other", "B"}, {"other", "E"},
+    };
+    int64_t tid[9], ts = 0;
+    for (int n = 0; n < list->num; n++)
+        check_event(&list->values[n], expect[n][0], expect[n][1], &tid[n], &ts);
+    for (int n = 1; n < 7; n++)
+        assert_int_equal(tid[n], tid[0]);
+    assert_true(tid[7] != tid[0]);
+    assert_int_equal(tid[8], tid[7]);
+
+    test_handles(ctx, stats);
+    test_stats_file(ctx);
+
+    talloc_free(tmp);
+}
+
+const struct unittest test_stats = {
+    .name = "stats",
+    .run = run,
+};
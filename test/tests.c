@@ -4,12 +4,19 @@
 #include "tests.h"
 
 static const struct unittest *unittests[] = {
+    &test_aconvert,
     &test_chmap,
     &test_gl_video,
     &test_img_format,
     &test_json,
     &test_linked_list,
+    &test_loudness,
+    &test_msg,
+    &test_msgpack,
     &test_paths,
+    &test_playlist,
+    &test_property,
+    &test_stats,
     &test_repack_sws,
 #if HAVE_ZIMG
     &test_repack, // zimg only due to cross-checking with zimg.c
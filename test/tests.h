@@ -36,15 +36,22 @@ struct unittest {
     void (*run)(struct test_ctx *ctx);
 };
 
+extern const struct unittest test_aconvert;
 extern const struct unittest test_chmap;
 extern const struct unittest test_gl_video;
 extern const struct unittest test_img_format;
 extern const struct unittest test_json;
 extern const struct unittest test_linked_list;
+extern const struct unittest test_loudness;
+extern const struct unittest test_msg;
+extern const struct unittest test_msgpack;
 extern const struct unittest test_repack_sws;
 extern const struct unittest test_repack_zimg;
 extern const struct unittest test_repack;
 extern const struct unittest test_paths;
+extern const struct unittest test_playlist;
+extern const struct unittest test_property;
+extern const struct unittest test_stats;
 
 #define assert_true(x) assert(x)
 #define assert_false(x) assert(!(x))
@@ -172,6 +172,7 @@ typedef struct lavc_ctx {
     struct hwdec_info hwdec; // valid only if use_hwdec==true
     AVRational codec_timebase;
     enum AVDiscard skip_frame;
+    bool single_thread;
     bool flushing;
     struct lavc_state state;
     const char *decoder;
@@ -653,7 +654,8 @@ static void init_avctx(struct mp_filter *vd)
             ctx->max_delay_queue = HWDEC_DELAY_QUEUE_COUNT;
         ctx->hw_probing = true;
     } else {
-        mp_set_avcodec_threads(vd->log, avctx, lavc_param->threads);
+        mp_set_avcodec_threads(vd->log, avctx,
+                               ctx->single_thread ? 1 : lavc_param->threads);
     }
 
     if (!ctx->use_hwdec && ctx->vo && lavc_param->dr) {
@@ -979,6 +981,8 @@ static void prepare_decoding(struct mp_filter *vd)
         // Can be much more aggressive for true intra codecs.
         if (ctx->intra_only)
             avctx->skip_frame = AVDISCARD_ALL;
+    } else if (drop == 3) {
+        avctx->skip_frame = AVDISCARD_NONKEY;   // keyframe-only trick play
     } else {
         avctx->skip_frame = ctx->skip_frame;    // normal playback
     }
@@ -1200,6 +1204,18 @@ static int control(struct mp_filter *vd, enum dec_ctrl cmd, void *arg)
     case VDCTRL_SET_FRAMEDROP:
         ctx->framedrop_flags = *(int *)arg;
         return CONTROL_TRUE;
+    case VDCTRL_SET_SINGLE_THREAD: {
+        bool enable = *(bool *)arg;
+        if (ctx->single_thread != enable) {
+            ctx->single_thread = enable;
+            // The thread count can be set only when opening the decoder.
+            if (ctx->avctx && !ctx->use_hwdec) {
+                uninit_avctx(vd);
+                init_avctx(vd);
+            }
+        }
+        return ctx->avctx ? CONTROL_TRUE : CONTROL_ERROR;
+    }
     case VDCTRL_GET_BFRAMES: {
         AVCodecContext *avctx = ctx->avctx;
         if (!avctx)
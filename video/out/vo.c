@@ -185,6 +185,9 @@ struct vo_internal {
     double reported_display_fps;
 
     struct stats_ctx *stats;
+    // Used by the VO thread only.
+    struct stats_handle *stats_draw, *stats_flip, *stats_render;
+    struct stats_handle *stats_iterations;
 };
 
 extern const struct m_sub_options gl_video_conf;
@@ -969,7 +972,8 @@ static bool render_frame(struct vo *vo)
         if (can_queue)
             wakeup_core(vo);
 
-        stats_time_start(in->stats, "video-draw");
+        int64_t render_start = mp_time_us();
+        stats_handle_time_start(in->stats_draw);
 
         if (vo->driver->draw_frame) {
             vo->driver->draw_frame(vo, frame);
@@ -977,11 +981,13 @@ static bool render_frame(struct vo *vo)
             vo->driver->draw_image(vo, mp_image_new_ref(frame->current));
         }
 
-        stats_time_end(in->stats, "video-draw");
+        stats_handle_time_end(in->stats_draw);
 
+        int64_t wait_start = mp_time_us();
         wait_until(vo, target);
 
-        stats_time_start(in->stats, "video-flip");
+        int64_t flip_start = mp_time_us();
+        stats_handle_time_start(in->stats_flip);
 
         vo->driver->flip_page(vo);
 
@@ -996,7 +1002,10 @@ static bool render_frame(struct vo *vo)
         if (vsync.last_queue_display_time < 0)
             vsync.last_queue_display_time = mp_time_us();
 
-        stats_time_end(in->stats, "video-flip");
+        stats_handle_time_end(in->stats_flip);
+        // Time spent drawing and flipping, excluding waiting for the target.
+        stats_handle_latency(in->stats_render, mp_time_us() - flip_start +
+                                               wait_start - render_start);
 
         pthread_mutex_lock(&in->lock);
         in->dropped_frame = prev_drop_count < vo->in->drop_count;
@@ -1090,12 +1099,19 @@ static void *vo_thread(void *ptr)
 
     mpthread_set_name("vo");
 
+    in->stats_draw = stats_handle_create(in->stats, "video-draw");
+    in->stats_flip = stats_handle_create(in->stats, "video-flip");
+    in->stats_render = stats_handle_create(in->stats, "render-time");
+    in->stats_iterations = stats_handle_create(in->stats, "iterations");
+
     if (vo->driver->get_image) {
         in->dr_helper = dr_helper_create(in->dispatch, get_image_vo, vo);
         dr_helper_acquire_thread(in->dr_helper);
     }
 
+    stats_span_begin(in->stats, "preinit");
     int r = vo->driver->preinit(vo) ? -1 : 0;
+    stats_span_end(in->stats, "preinit");
     mp_rendezvous(vo, r); // init barrier
     if (r < 0)
         goto done;
@@ -1108,7 +1124,7 @@ static void *vo_thread(void *ptr)
         mp_dispatch_queue_process(vo->in->dispatch, 0);
         if (in->terminate)
             break;
-        stats_event(in->stats, "iterations");
+        stats_handle_event(in->stats_iterations);
         vo->driver->control(vo, VOCTRL_CHECK_EVENTS, NULL);
         bool working = render_frame(vo);
         int64_t now = mp_time_us();
@@ -26,6 +26,7 @@
 #include "config.h"
 #include "common/common.h"
 #include "options/options.h"
+#include "osdep/timer.h"
 #include "video/fmt-conversion.h"
 #include "video/mp_image.h"
 #include "mpv_talloc.h"
@@ -57,7 +58,7 @@ static void uninit(struct vo *vo)
     struct encoder_context *enc = vc->enc;
 
     if (!vc->shutdown)
-        encoder_encode(enc, NULL); // finish encoding
+        encoder_encode_async(enc, NULL); // finish encoding
 }
 
 static void on_ready(void *ptr)
@@ -173,6 +174,8 @@ static void draw_frame(struct vo *vo, struct vo_frame *voframe)
     if (voframe->redraw || voframe->repeat || voframe->num_frames < 1)
         return;
 
+    double t0 = mp_time_sec();
+
     struct mp_image *mpi = voframe->frames[0];
 
     struct mp_osd_res dim = osd_res_from_image_params(vo->params);
@@ -223,8 +226,11 @@ static void draw_frame(struct vo *vo, struct vo_frame *voframe)
     frame->pts = rint(outpts * av_q2d(av_inv_q(avc->time_base)));
     frame->pict_type = 0; // keep this at unknown/undefined
     frame->quality = avc->global_quality;
-    encoder_encode(enc, frame);
-    av_frame_free(&frame);
+    encoder_account_stage(enc, ENCODE_STAGE_CONVERT, t0);
+
+    // Encoding and muxing run on separate threads (unless --oqueue-size=0),
+    // so the VO can prepare the next frame meanwhile.
+    encoder_encode_async(enc, frame);
 }
 
 static void flip_page(struct vo *vo)
@@ -230,6 +230,7 @@ def build(ctx):
         ( "audio/filter/af_scaletempo2_internals.c" ),
         ( "audio/fmt-conversion.c" ),
         ( "audio/format.c" ),
+        ( "audio/loudness.c" ),
         ( "audio/out/ao.c" ),
         ( "audio/out/ao_alsa.c",                 "alsa" ),
         ( "audio/out/ao_audiotrack.c",           "android" ),
@@ -263,6 +264,7 @@ def build(ctx):
         ( "common/playlist.c" ),
         ( "common/recorder.c" ),
         ( "common/stats.c" ),
+        ( "common/stats_file.c" ),
         ( "common/tags.c" ),
         ( "common/version.c" ),
 
@@ -287,6 +289,7 @@ def build(ctx):
         ( "demux/packet.c" ),
         ( "demux/timeline.c" ),
 
+        ( "filters/f_aconvert.c" ),
         ( "filters/f_async_queue.c" ),
         ( "filters/f_autoconvert.c" ),
         ( "filters/f_auto_filters.c" ),
@@ -317,6 +320,7 @@ def build(ctx):
         ( "misc/dispatch.c" ),
         ( "misc/jni.c",                          "android" ),
         ( "misc/json.c" ),
+        ( "misc/msgpack.c" ),
         ( "misc/natural_sort.c" ),
         ( "misc/node.c" ),
         ( "misc/rendezvous.c" ),
@@ -338,9 +342,11 @@ def build(ctx):
         ( "player/client.c" ),
         ( "player/command.c" ),
         ( "player/configfiles.c" ),
+        ( "player/encode_segments.c" ),
         ( "player/external_files.c" ),
         ( "player/javascript.c",                 "javascript" ),
         ( "player/loadfile.c" ),
+        ( "player/loudness_scan.c" ),
         ( "player/lua.c",                        "lua" ),
         ( "player/main.c" ),
         ( "player/misc.c" ),
@@ -348,7 +354,9 @@ def build(ctx):
         ( "player/playloop.c" ),
         ( "player/screenshot.c" ),
         ( "player/scripting.c" ),
+        ( "player/shm_state.c" ),
         ( "player/sub.c" ),
+        ( "player/thumbnails.c" ),
         ( "player/video.c" ),
 
         ## Streams
@@ -386,12 +394,19 @@ def build(ctx):
         ( "sub/sd_lavc.c" ),
 
         ## Tests
+        ( "test/aconvert.c",                     "tests" ),
         ( "test/chmap.c",                        "tests" ),
         ( "test/gl_video.c",                     "tests" ),
         ( "test/img_format.c",                   "tests" ),
         ( "test/json.c",                         "tests" ),
         ( "test/linked_list.c",                  "tests" ),
+        ( "test/loudness.c",                     "tests" ),
+        ( "test/msg.c",                          "tests" ),
+        ( "test/msgpack.c",                      "tests" ),
         ( "test/paths.c",                        "tests" ),
+        ( "test/playlist.c",                     "tests" ),
+        ( "test/property.c",                     "tests" ),
+        ( "test/stats.c",                        "tests" ),
         ( "test/repack.c",                       "tests && zimg" ),
         ( "test/scale_sws.c",                    "tests" ),
         ( "test/scale_test.c",                   "tests" ),